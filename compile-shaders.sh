@@ -1,3 +1,3 @@
-mkdir -p build/shaders
-glslc shaders/shader.vert -o build/shaders/vert.spv
-glslc shaders/shader.frag -o build/shaders/frag.spv
+# shaders and textures are cooked by the build's assets target, which only
+# recompiles sources whose contents or flags changed
+cmake --build build --target assets
@@ -1,7 +1,18 @@
 #include "engine/exception.hpp"
 #include "engine/vulkan.hpp"
+#include "engine/simulation.hpp"
+#include "engine/audio.hpp"
 
 class Engine {
   public:
+    // runs on the simulation thread at a fixed tick rate
+    Simulation::UpdateFunc update;
+    double tickRate = 60.0;
+    // mounted before init when it exists, relative to the working directory
+    std::string assetPack = "assets.pack";
+    std::string assetManifest = "assets.manifest";
+    // opened after the window; update may queue sounds on it from the simulation thread
+    AudioSettings audioSettings;
+    AudioMixer audio;
     void run();
 };
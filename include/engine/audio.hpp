@@ -0,0 +1,265 @@
+#ifndef MIX_AUDIO_HPP
+#define MIX_AUDIO_HPP
+#include "engine/audiostream.hpp"
+
+#include <SDL2/SDL.h>
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// zeroed frames after every clip channel, so the mixer can interpolate and
+// load whole vectors past the last frame
+const uint32_t AUDIO_CLIP_PADDING = 8;
+// streamed voices resample at most this many source frames per output frame
+const uint32_t AUDIO_MAX_STREAM_STEP = 8;
+
+// Fully decoded sound, planar float. Clips are immutable once given to a mixer.
+struct AudioClip {
+  std::vector<float> samples;
+  uint32_t frames = 0;
+  uint32_t channels = 1;
+  uint32_t sampleRate = 48000;
+
+  // mono clips return the same channel for both sides
+  const float* channel(uint32_t c) const {
+    return samples.data() + (c < channels ? c : 0) * size_t(frames + AUDIO_CLIP_PADDING);
+  }
+};
+
+// WAV through SDL, converted to float but kept at its own rate; the mixer
+// resamples as part of pitch. Goes through readFile, so packs apply.
+AudioClip loadAudioClip(const std::string& path);
+AudioClip makeAudioClip(const float* interleaved, uint32_t frames, uint32_t channels, uint32_t sampleRate);
+
+struct AudioSettings {
+  int sampleRate = 48000;
+  // frames per callback; 256 at 48 kHz is 5.3 ms of latency per buffer
+  uint16_t bufferFrames = 256;
+  uint32_t maxVoices = 512;
+  uint32_t maxClips = 1024;
+  uint32_t buses = 4;
+  // commands queued between two callbacks; extra ones are dropped and counted
+  uint32_t commandCapacity = 4096;
+  // streamed sources playing at once, each with its own ring of frames; the
+  // default holds about a third of a second, raise it if underruns show up
+  uint32_t maxStreams = 16;
+  uint32_t streamFrames = 16384;
+};
+
+struct AudioStats {
+  uint64_t callbacks = 0;
+  uint64_t framesMixed = 0;
+  uint32_t activeVoices = 0;
+  // plays ignored because every voice was busy, and commands the full queue refused
+  uint64_t voicesDropped = 0;
+  uint64_t commandsDropped = 0;
+  // time spent in the last callback
+  double lastMixUs = 0.0;
+  // buffers where a stream's ring ran dry, and the frames left silent
+  uint64_t streamUnderruns = 0;
+  uint64_t streamUnderrunFrames = 0;
+  // playStream calls refused because every stream slot was busy
+  uint64_t streamsDropped = 0;
+  size_t streamMemory = 0;
+};
+
+// Bounded multi-producer, single-consumer queue after Vyukov's bounded
+// MPMC queue: each cell carries a sequence number, so producers claim cells
+// with one CAS and the consumer never blocks them.
+template <typename T>
+class AudioCommandQueue {
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+  std::unique_ptr<Cell[]> cells;
+  size_t mask = 0;
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+  public:
+    // capacity is rounded up to a power of two
+    void reset(size_t capacity) {
+      size_t size = 1;
+      while (size < capacity) size *= 2;
+      cells.reset(new Cell[size]);
+      for (size_t i = 0; i < size; i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+      mask = size - 1;
+      head.store(0, std::memory_order_relaxed);
+      tail.store(0, std::memory_order_relaxed);
+    }
+
+    bool push(const T& value) {
+      size_t position = tail.load(std::memory_order_relaxed);
+      for (;;) {
+        Cell& cell = cells[position & mask];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if (difference == 0) {
+          if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+            cell.value = value;
+            cell.sequence.store(position + 1, std::memory_order_release);
+            return true;
+          }
+        }
+        else if (difference < 0) {
+          return false;
+        }
+        else {
+          position = tail.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    // consumer only
+    bool pop(T& value) {
+      size_t position = head.load(std::memory_order_relaxed);
+      Cell& cell = cells[position & mask];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1) < 0) {
+        return false;
+      }
+      value = cell.value;
+      cell.sequence.store(position + mask + 1, std::memory_order_release);
+      head.store(position + 1, std::memory_order_relaxed);
+      return true;
+    }
+};
+
+// Mixes voices into float buses on the SDL audio thread. Game threads only
+// enqueue commands, and the callback never allocates or locks: every buffer,
+// voice and queue cell is sized by open() or prepare().
+class AudioMixer {
+  public:
+    typedef uint32_t VoiceId;
+    static const VoiceId NO_VOICE = 0;
+
+  private:
+    struct Command {
+      enum Type { PLAY, PLAY_STREAM, STOP, GAIN, PAN, PITCH, BUS_GAIN, STOP_ALL };
+      Type type;
+      VoiceId voice;
+      uint32_t clip;
+      int32_t stream;
+      uint32_t bus;
+      float gain;
+      float pan;
+      float pitch;
+      bool loop;
+    };
+
+    struct Voice {
+      VoiceId id;
+      const AudioClip* clip;
+      // stream slot, -1 for clips
+      int32_t stream;
+      uint32_t bus;
+      // fractional for streams, whose whole frames are consumed from the ring
+      double position;
+      float gain;
+      float pan;
+      float pitch;
+      bool loop;
+      bool stopping;
+      // a stream waits for its first refill before it counts underruns
+      bool primed;
+      // ramped towards the targets over one buffer so changes don't click
+      float leftGain;
+      float rightGain;
+    };
+
+    AudioSettings settings;
+    SDL_AudioDeviceID device = 0;
+    int sampleRate = 48000;
+    uint32_t bufferFrames = 0;
+    // commands are ignored unless a device is open or prepare() was called
+    std::atomic<bool> running{false};
+
+    AudioCommandQueue<Command> commands;
+    std::atomic<VoiceId> nextVoice{1};
+
+    // appended by game threads under clipMutex, read by the callback
+    std::mutex clipMutex;
+    std::vector<std::unique_ptr<AudioClip>> ownedClips;
+    std::unique_ptr<std::atomic<const AudioClip*>[]> clips;
+    std::atomic<uint32_t> clipCount{0};
+
+    // callback only
+    std::vector<Voice> voices;
+    std::vector<float> busGains;
+    // planar: bus b channel c starts at (b * 2 + c) * bufferFrames
+    std::vector<float> busSamples;
+    std::vector<float> masterSamples;
+    // ring frames a stream voice reads for one buffer, planar
+    std::vector<float> streamScratch;
+    uint32_t streamScratchFrames = 0;
+
+    AudioStreams streams;
+
+    std::atomic<uint64_t> callbacks{0};
+    std::atomic<uint64_t> framesMixed{0};
+    std::atomic<uint32_t> activeVoices{0};
+    std::atomic<uint64_t> voicesDropped{0};
+    std::atomic<uint64_t> commandsDropped{0};
+    std::atomic<uint64_t> lastMixNanoseconds{0};
+    std::atomic<uint64_t> streamUnderruns{0};
+    std::atomic<uint64_t> streamUnderrunFrames{0};
+    std::atomic<uint64_t> streamsDropped{0};
+
+    static void SDLCALL callback(void* userdata, Uint8* stream, int length);
+    void allocate(int rate, uint32_t frames);
+    bool send(const Command& command);
+    void applyCommands();
+    void mixVoice(Voice& voice, uint32_t frames, bool& finished);
+    void mixStream(
+      Voice& voice, uint32_t frames, float* dstLeft, float* dstRight,
+      float left, float stepLeft, float right, float stepRight, bool& finished);
+    void mixChunk(float* out, uint32_t frames);
+  public:
+    AudioMixer() {}
+    ~AudioMixer();
+    AudioMixer(const AudioMixer&) = delete;
+    AudioMixer& operator=(const AudioMixer&) = delete;
+
+    // opens the default output and starts the callback; false when there is
+    // no audio device, in which case clips can still be added but commands
+    // are ignored
+    bool open(const AudioSettings& settings = AudioSettings());
+    void close();
+    bool isOpen() const { return device != 0; }
+    // sizes the mixer without a device, for offline mixing and benchmarks
+    void prepare(const AudioSettings& settings);
+
+    // safe from any thread; clips live until the mixer is closed
+    uint32_t addClip(AudioClip clip);
+
+    // any thread; returns NO_VOICE if the command queue is full
+    VoiceId play(uint32_t clip, float gain = 1.0f, float pan = 0.0f, float pitch = 1.0f, bool loop = false, uint32_t bus = 0);
+    // decodes on the stream thread instead of loading the whole file; any
+    // thread. NO_VOICE when every stream slot is busy or the queue is full,
+    // throws when the file can't be opened
+    VoiceId playStream(const std::string& path, float gain = 1.0f, float pan = 0.0f, float pitch = 1.0f, bool loop = false, uint32_t bus = 0);
+    void stop(VoiceId voice);
+    void stopAll();
+    void setGain(VoiceId voice, float gain);
+    // -1 is hard left, 1 hard right, with constant power in between
+    void setPan(VoiceId voice, float pan);
+    // playback rate, 2 is an octave up
+    void setPitch(VoiceId voice, float pitch);
+    void setBusGain(uint32_t bus, float gain);
+
+    // interleaved stereo; runs commands first. The callback calls this, and
+    // it may be called directly when there is no device
+    void mix(float* out, uint32_t frames);
+
+    int outputRate() const { return sampleRate; }
+    uint32_t outputBufferFrames() const { return bufferFrames; }
+    AudioStats stats() const;
+};
+#endif
@@ -0,0 +1,91 @@
+#ifndef MIX_AUDIO_STREAM_HPP
+#define MIX_AUDIO_STREAM_HPP
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+// Pulls interleaved stereo float frames from a file a block at a time. Mono
+// sources are duplicated to both sides.
+class AudioDecoder {
+  public:
+    uint32_t sampleRate = 0;
+    uint32_t channels = 0;
+
+    virtual ~AudioDecoder() {}
+    // fewer than frames only at the end of the data
+    virtual uint32_t read(float* out, uint32_t frames) = 0;
+    virtual bool rewind() = 0;
+};
+
+// WAV (PCM 8/16/24/32 bit or float) or Ogg Vorbis, picked by the file's magic.
+// Reads from the mounted pack when it has the file, otherwise from disk.
+std::unique_ptr<AudioDecoder> openAudioDecoder(const std::string& path);
+
+// One streamed source: the decode thread writes frames into the ring ahead
+// of the audio callback, which reads them. Positions only grow, so the
+// frames buffered are writePosition - readPosition.
+struct AudioStream {
+  enum State : uint32_t { FREE, OPENING, ACTIVE, RELEASED };
+
+  std::atomic<uint32_t> state{FREE};
+  // set while OPENING, then only touched by the decode thread
+  std::unique_ptr<AudioDecoder> decoder;
+  bool loop = false;
+  uint32_t sampleRate = 0;
+
+  // interleaved stereo, capacity frames, allocated once
+  std::vector<float> ring;
+  uint32_t capacity = 0;
+  std::atomic<uint64_t> readPosition{0};
+  std::atomic<uint64_t> writePosition{0};
+  // the decoder ran out and everything it produced is in the ring
+  std::atomic<bool> ended{false};
+
+  uint64_t buffered() const {
+    return writePosition.load(std::memory_order_acquire) - readPosition.load(std::memory_order_relaxed);
+  }
+};
+
+// Fixed set of stream slots and the thread that keeps their rings topped up.
+// Memory is slots * ring frames no matter how long the tracks are.
+class AudioStreams {
+  std::unique_ptr<AudioStream[]> streams;
+  uint32_t count = 0;
+
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+  // how long the thread sleeps between passes when nothing wakes it
+  uint32_t refillIntervalMs = 5;
+
+  void run();
+  void refill(AudioStream& stream);
+  public:
+    AudioStreams() {}
+    ~AudioStreams();
+    AudioStreams(const AudioStreams&) = delete;
+    AudioStreams& operator=(const AudioStreams&) = delete;
+
+    // ringFrames is rounded up to a power of two
+    void start(uint32_t slots, uint32_t ringFrames, int outputRate);
+    void stop();
+
+    // claims a free slot and opens the file on the calling thread; returns
+    // -1 when every slot is busy, throws when the file can't be decoded
+    int32_t open(const std::string& path, bool loop);
+    // from the audio callback once its voice is done with the slot
+    void release(int32_t index) { streams[index].state.store(AudioStream::RELEASED, std::memory_order_release); }
+    // back to free without waiting for a voice, when its play command was dropped
+    void cancel(int32_t index);
+
+    AudioStream& operator[](int32_t index) { return streams[index]; }
+    uint32_t size() const { return count; }
+    size_t memory() const;
+};
+#endif
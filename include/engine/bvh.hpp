@@ -0,0 +1,119 @@
+#ifndef MIX_BVH_HPP
+#define MIX_BVH_HPP
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <shared_mutex>
+#include <cstdint>
+
+struct AABB {
+  glm::vec3 min = glm::vec3(0.0f);
+  glm::vec3 max = glm::vec3(0.0f);
+
+  glm::vec3 center() const { return (min + max) * 0.5f; }
+  float surfaceArea() const {
+    glm::vec3 d = max - min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+  }
+  bool contains(const AABB& other) const {
+    return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z
+      && max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+  }
+  bool overlaps(const AABB& other) const {
+    return min.x <= other.max.x && max.x >= other.min.x
+      && min.y <= other.max.y && max.y >= other.min.y
+      && min.z <= other.max.z && max.z >= other.min.z;
+  }
+
+  static AABB merge(const AABB& a, const AABB& b) {
+    AABB box;
+    box.min = glm::min(a.min, b.min);
+    box.max = glm::max(a.max, b.max);
+    return box;
+  }
+  // bounds of this box after an affine transform
+  AABB transformed(const glm::mat4& m) const;
+};
+
+struct Ray {
+  glm::vec3 origin;
+  glm::vec3 direction;
+};
+
+// planes point inwards, extracted from a Vulkan (0..1 depth) clip matrix
+struct Frustum {
+  glm::vec4 planes[6];
+
+  static Frustum fromMatrix(const glm::mat4& viewProj);
+  enum Result { OUTSIDE, INTERSECTS, INSIDE };
+  Result classify(const AABB& box) const;
+};
+
+// Dynamic AABB tree. Leaves hold fattened boxes so small movements don't
+// touch the tree; move() only reinserts a leaf once it leaves its fat box.
+// Proxy ids are leaf node indices and stay valid across rebuild().
+//
+// Queries take a shared lock and may run from any number of threads;
+// insert/remove/move/rebuild take an exclusive lock.
+class BVH {
+  struct Node {
+    AABB box;
+    uint32_t parent;
+    uint32_t left;
+    uint32_t right;
+    uint32_t data;
+    // -1 marks a node on the free list
+    int32_t height;
+    bool leaf() const { return left == NONE; }
+  };
+
+  std::vector<Node> nodes;
+  uint32_t root = NONE;
+  uint32_t freeList = NONE;
+  size_t leafCount = 0;
+  float margin;
+  float rebuildCost = 0.0f;
+  size_t reinsertions = 0;
+  mutable std::shared_mutex mutex;
+
+  uint32_t allocateNode();
+  void freeNode(uint32_t node);
+  void insertLeaf(uint32_t leaf);
+  void removeLeaf(uint32_t leaf);
+  void refitUpwards(uint32_t node);
+  bool moveLeaf(uint32_t proxy, const AABB& box);
+  uint32_t build(uint32_t* leaves, size_t count);
+  void rebuildLocked();
+  float costLocked() const;
+  public:
+    static const uint32_t NONE = UINT32_MAX;
+
+    BVH(float _margin = 0.1f) : margin(_margin) {}
+    BVH(const BVH&) = delete;
+    BVH& operator=(const BVH&) = delete;
+
+    uint32_t insert(const AABB& box, uint32_t data);
+    void remove(uint32_t proxy);
+    // returns true when the leaf had to be reinserted
+    bool move(uint32_t proxy, const AABB& box);
+    void move(const std::vector<uint32_t>& proxies, const std::vector<AABB>& boxes);
+    void clear();
+
+    // top-down binned SAH build over the current leaves
+    void rebuild();
+    // after enough reinsertions, rebuilds if the SAH cost has grown by threshold
+    bool rebuildIfDegraded(float threshold = 2.0f);
+
+    // matches are appended to out as the data passed to insert
+    void queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out) const;
+    void queryRay(const Ray& ray, float maxDistance, std::vector<uint32_t>& out) const;
+    void queryBox(const AABB& box, std::vector<uint32_t>& out) const;
+
+    AABB fatBox(uint32_t proxy) const;
+    size_t size() const;
+    int32_t height() const;
+    // sum of internal node areas relative to the root, lower is better
+    float cost() const;
+};
+#endif
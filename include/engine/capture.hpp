@@ -0,0 +1,67 @@
+#ifndef MIX_CAPTURE_HPP
+#define MIX_CAPTURE_HPP
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// one presented frame read back from the GPU
+struct CapturedFrame {
+  // drawFrame calls that submitted work before this frame, from 0
+  uint64_t frame = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  // RGBA8, top row first and tightly packed, encoded like the swapchain
+  // (sRGB for the usual formats)
+  std::vector<unsigned char> pixels;
+};
+
+// Encodes captured frames on its own thread, in the order they were given,
+// so the render thread only hands over the pixels. PNG writes one file per
+// frame, named path + the zero padded frame number + ".png". RAW appends the
+// bare pixels of every frame to the file at path, which ffmpeg reads with
+// -f rawvideo -pix_fmt rgba as long as the size doesn't change.
+class FrameWriter {
+  public:
+    enum Format { PNG, RAW };
+
+  private:
+    Format format;
+    std::string path;
+    std::FILE* raw = nullptr;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable workDone;
+    std::deque<CapturedFrame> queue;
+    bool encoding = false;
+    bool stopping = false;
+    uint64_t written = 0;
+    uint64_t failed = 0;
+
+    bool encode(const CapturedFrame& frame);
+    void run();
+  public:
+    // throws if the RAW file can't be created
+    FrameWriter(const std::string& _path, Format _format = PNG);
+    // writes whatever is still queued first
+    ~FrameWriter();
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    // takes the pixels and returns without waiting for the encoder
+    void write(CapturedFrame frame);
+    // blocks until every queued frame has been written
+    void flush();
+
+    size_t pending();
+    uint64_t framesWritten();
+    // frames that couldn't be encoded or written
+    uint64_t framesFailed();
+};
+#endif
@@ -0,0 +1,35 @@
+#ifndef MIX_DELETION_HPP
+#define MIX_DELETION_HPP
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <cstdint>
+
+// Holds Vulkan handles until the GPU timeline reaches the value of the last
+// submission that could still reference them.
+class DeletionQueue {
+  struct Entry {
+    uint64_t value;
+    VkObjectType type;
+    uint64_t handle;
+    uint64_t owner;
+  };
+
+  std::deque<Entry> entries;
+
+  void push(uint64_t value, VkObjectType type, uint64_t handle, uint64_t owner = 0);
+  public:
+    void destroyBuffer(uint64_t value, VkBuffer buffer, VkDeviceMemory memory);
+    void destroyImage(uint64_t value, VkImage image, VkImageView view, VkDeviceMemory memory);
+    void destroyPipeline(uint64_t value, VkPipeline pipeline, VkPipelineLayout layout);
+    void freeDescriptorSet(uint64_t value, VkDescriptorPool pool, VkDescriptorSet set);
+    // frees every set allocated from it too
+    void destroyDescriptorPool(uint64_t value, VkDescriptorPool pool);
+    void freeMemory(uint64_t value, VkDeviceMemory memory);
+    void destroyFramebuffer(uint64_t value, VkFramebuffer framebuffer);
+
+    // frees everything queued at or before completedValue
+    void flush(VkDevice device, uint64_t completedValue);
+    size_t size() const { return entries.size(); }
+};
+#endif
@@ -0,0 +1,192 @@
+#ifndef MIX_ECS_HPP
+#define MIX_ECS_HPP
+#include <vulkan/vulkan.h>
+
+#include "engine/transform.hpp"
+#include "engine/bvh.hpp"
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+// low bits index the sparse arrays, high bits detect stale handles
+typedef uint32_t Entity;
+const Entity NULL_ENTITY = UINT32_MAX;
+const uint32_t ENTITY_INDEX_BITS = 22;
+const uint32_t ENTITY_INDEX_MASK = (1u << ENTITY_INDEX_BITS) - 1;
+
+inline uint32_t entityIndex(Entity e) { return e & ENTITY_INDEX_MASK; }
+inline uint32_t entityGeneration(Entity e) { return e >> ENTITY_INDEX_BITS; }
+
+// Maps entities to a packed range [0, size). Removal swaps the last element
+// into the hole so the packed range never has gaps.
+class SparseIndex {
+  std::vector<uint32_t> sparse;
+  std::vector<Entity> packed;
+  public:
+    static const uint32_t NONE = UINT32_MAX;
+
+    bool contains(Entity e) const {
+      uint32_t i = entityIndex(e);
+      return i < sparse.size() && sparse[i] != NONE && packed[sparse[i]] == e;
+    }
+    uint32_t find(Entity e) const {
+      return contains(e) ? sparse[entityIndex(e)] : NONE;
+    }
+    uint32_t insert(Entity e) {
+      uint32_t i = entityIndex(e);
+      if (i >= sparse.size()) {
+        sparse.resize(i + 1, NONE);
+      }
+      sparse[i] = static_cast<uint32_t>(packed.size());
+      packed.push_back(e);
+      return sparse[i];
+    }
+    // returns the packed slot that was vacated and refilled from the back
+    uint32_t remove(Entity e) {
+      uint32_t slot = sparse[entityIndex(e)];
+      Entity last = packed.back();
+      packed[slot] = last;
+      sparse[entityIndex(last)] = slot;
+      packed.pop_back();
+      sparse[entityIndex(e)] = NONE;
+      return slot;
+    }
+    // packed slot k takes the entity previously at order[k]
+    void reorder(const std::vector<uint32_t>& order) {
+      std::vector<Entity> reordered(order.size());
+      for (size_t k = 0; k < order.size(); k++) {
+        reordered[k] = packed[order[k]];
+        sparse[entityIndex(reordered[k])] = static_cast<uint32_t>(k);
+      }
+      packed.swap(reordered);
+    }
+    const std::vector<Entity>& entities() const { return packed; }
+    size_t size() const { return packed.size(); }
+};
+
+template <typename T>
+class SparseSet {
+  SparseIndex index;
+  std::vector<T> components;
+  public:
+    bool has(Entity e) const { return index.contains(e); }
+    T& get(Entity e) { return components[index.find(e)]; }
+    T* tryGet(Entity e) {
+      uint32_t slot = index.find(e);
+      return slot == SparseIndex::NONE ? nullptr : &components[slot];
+    }
+    T& insert(Entity e, const T& component) {
+      uint32_t slot = index.find(e);
+      if (slot != SparseIndex::NONE) {
+        return components[slot] = component;
+      }
+      index.insert(e);
+      components.push_back(component);
+      return components.back();
+    }
+    void remove(Entity e) {
+      if (!index.contains(e)) return;
+      uint32_t slot = index.remove(e);
+      components[slot] = std::move(components.back());
+      components.pop_back();
+    }
+
+    size_t size() const { return components.size(); }
+    T& operator[](size_t i) { return components[i]; }
+    const T& operator[](size_t i) const { return components[i]; }
+    std::vector<T>& data() { return components; }
+    const std::vector<T>& data() const { return components; }
+    const std::vector<Entity>& entities() const { return index.entities(); }
+};
+
+// Structure-of-arrays transform storage: each field is its own dense array so
+// per-frame updates only touch the memory they need.
+//
+// position/rotation/scale are local to the parent entity. The arrays are kept
+// sorted by depth (parents before children, grouped into levels) so world
+// matrices resolve in one forward pass, and each level can be split across
+// threads. Code that writes the arrays directly must also set dirty[slot].
+class TransformStorage {
+  SparseIndex index;
+  std::vector<uint32_t> parentSlot;
+  std::vector<size_t> levelStarts;
+  bool orderDirty = false;
+
+  void sortByDepth();
+  void updateRange(size_t begin, size_t end);
+  public:
+    std::vector<glm::vec3> position;
+    std::vector<glm::quat> rotation;
+    std::vector<glm::vec3> scale;
+    std::vector<glm::mat4> world;
+    std::vector<Entity> parent;
+    std::vector<uint8_t> dirty;
+    // nodes whose world matrix was recomputed by the last updateWorld
+    std::vector<uint8_t> changed;
+
+    bool has(Entity e) const { return index.contains(e); }
+    uint32_t find(Entity e) const { return index.find(e); }
+    void insert(Entity e, const Transform& transform);
+    void remove(Entity e);
+    Transform get(Entity e) const;
+    void set(Entity e, const Transform& transform);
+
+    // orphans of a removed parent become roots on the next update
+    void setParent(Entity child, Entity parentEntity);
+    Entity getParent(Entity e) const;
+
+    // recomputes world matrices of dirty nodes and their descendants
+    void updateWorld(unsigned threads = 1);
+
+    size_t size() const { return index.size(); }
+    const std::vector<Entity>& entities() const { return index.entities(); }
+};
+
+// only GPU handles; the resources themselves are owned by the renderer
+struct Renderable {
+  uint32_t pipeline;
+  VkBuffer vertexBuffer;
+  VkBuffer indexBuffer;
+  // index range of the selected level of detail
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t texture;
+  uint32_t mesh;
+  uint32_t lod;
+};
+
+// local-space box and the entity's leaf in the scene BVH
+struct Bounds {
+  AABB local;
+  uint32_t proxy;
+};
+
+class World {
+  std::vector<uint32_t> generations;
+  std::vector<uint32_t> freeIndices;
+  std::vector<uint32_t> movedProxies;
+  std::vector<AABB> movedBoxes;
+  public:
+    TransformStorage transforms;
+    SparseSet<Renderable> renderables;
+    // bumped whenever renderables are added or removed, so recorded draws can be invalidated
+    uint64_t renderablesVersion = 0;
+    SparseSet<Bounds> bounds;
+    // world-space boxes of every entity with Bounds; leaf data is the Entity
+    BVH bvh;
+
+    Entity create();
+    void destroy(Entity e);
+    bool alive(Entity e) const;
+    void clear();
+
+    void addRenderable(Entity e, const Renderable& renderable);
+    void removeRenderable(Entity e);
+
+    void setBounds(Entity e, const AABB& local);
+    void removeBounds(Entity e);
+    // refits the BVH for entities whose transforms changed in the last updateWorld
+    void updateBounds();
+};
+#endif
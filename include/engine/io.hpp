@@ -0,0 +1,88 @@
+#ifndef MIX_IO_HPP
+#define MIX_IO_HPP
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Asynchronous file reads. On Linux requests go through an io_uring owned by
+// one submission thread; where io_uring is unavailable (old kernels, seccomp
+// sandboxes) the worker threads read with pread instead.
+//
+// Callbacks always run on a worker thread, never on the caller's, so they may
+// decode but must not touch thread-affine state like Vulkan queues.
+class IoService {
+  public:
+    enum Priority { HIGH, NORMAL, LOW, PRIORITY_COUNT };
+    typedef uint64_t RequestId;
+
+    struct Result {
+      RequestId id;
+      std::string path;
+      // 0 or an errno value; ECANCELED for cancelled requests
+      int error = 0;
+      size_t bytes = 0;
+      // the caller's buffer, or data.data() for whole-file reads
+      char* buffer = nullptr;
+      std::vector<char> data;
+    };
+    typedef std::function<void(Result& result)> Callback;
+
+  private:
+    struct Request;
+    struct Ring;
+
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable requestDone;
+    std::deque<std::unique_ptr<Request>> queues[PRIORITY_COUNT];
+    std::deque<std::unique_ptr<Request>> completed;
+    // queued or in flight, by id; erased once the callback has returned
+    std::unordered_map<RequestId, Request*> active;
+    RequestId nextId = 1;
+    bool stopping = false;
+    bool workersStopping = false;
+
+    std::unique_ptr<Ring> ring;
+    std::thread ringThread;
+    std::vector<std::thread> workers;
+
+    RequestId submit(std::unique_ptr<Request> request);
+    std::unique_ptr<Request> popQueued();
+    void complete(std::unique_ptr<Request> request);
+    void deliver(std::unique_ptr<Request> request);
+    void perform(Request& request);
+    void runRing();
+    void runWorker();
+  public:
+    explicit IoService(unsigned workerCount = 2, unsigned queueDepth = 64);
+    ~IoService();
+    IoService(const IoService&) = delete;
+    IoService& operator=(const IoService&) = delete;
+
+    // reads size bytes at offset straight into buffer, which must stay valid
+    // until the callback has run; short files complete with fewer bytes
+    RequestId read(const std::string& path, void* buffer, size_t size, uint64_t offset, Callback callback, Priority priority = NORMAL);
+    // reads the whole file into result.data
+    RequestId readFile(const std::string& path, Callback callback, Priority priority = NORMAL);
+
+    // queued requests complete immediately with ECANCELED, in-flight ones as
+    // soon as their current read returns; false if it already finished
+    bool cancel(RequestId id);
+    // blocks until the request's callback has returned; don't call it from a callback
+    void wait(RequestId id);
+
+    bool usingIoUring() const { return ring != nullptr; }
+
+    // process-wide service used by readFile and the asset loaders
+    static IoService& shared();
+};
+#endif
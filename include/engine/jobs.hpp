@@ -0,0 +1,88 @@
+#ifndef MIX_JOBS_HPP
+#define MIX_JOBS_HPP
+#include <vector>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+class JobSystem;
+
+// Counts unfinished jobs. It may be reused once it reaches zero, and must
+// outlive the jobs counted on it.
+class JobCounter {
+  friend class JobSystem;
+
+  // guards both, so whoever sees zero knows the last job is done with the counter
+  std::mutex mutex;
+  uint32_t pending = 0;
+  // schedule the jobs waiting on this counter
+  std::vector<std::function<void()>> continuations;
+  public:
+    JobCounter() {}
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool done();
+};
+
+// Work-stealing scheduler. Each worker owns a Chase-Lev deque: it pushes and
+// pops at the bottom while idle workers steal from the top, so spawning and
+// running local work never takes a lock. Threads outside the system submit
+// through a shared queue.
+//
+// There are no fibers. wait() runs other jobs until the counter reaches
+// zero, so jobs may wait on jobs they spawned without tying up a worker.
+class JobSystem {
+  public:
+    typedef std::function<void()> Function;
+
+  private:
+    struct Job;
+    struct Deque;
+    struct Worker;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex injectedMutex;
+    std::deque<Job*> injected;
+    std::atomic<size_t> injectedCount{0};
+
+    // idle workers sleep here after spinning for a while
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<unsigned> sleeping{0};
+    uint64_t wakeups = 0;
+    std::atomic<bool> stopping{false};
+
+    void schedule(Job* job);
+    Job* findWork(int self);
+    void execute(Job* job);
+    void complete(JobCounter* counter);
+    void runWorker(unsigned index);
+  public:
+    // workerCount threads besides the ones calling wait(), which help out
+    explicit JobSystem(unsigned workerCount);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // counter, if given, is incremented now and decremented once fn returns
+    void run(Function fn, JobCounter* counter = nullptr);
+    // queues fn once dependency reaches zero, right away if it already has
+    void runAfter(JobCounter& dependency, Function fn, JobCounter* counter = nullptr);
+    // runs queued jobs on the calling thread until counter reaches zero
+    void wait(JobCounter& counter);
+    // calls fn(begin, end) over [0, count) in ranges of at least grain and waits
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& fn);
+
+    unsigned workerCount() const { return static_cast<unsigned>(workers.size()); }
+
+    // one worker per core besides the caller; used for transform updates
+    static JobSystem& shared();
+};
+#endif
@@ -0,0 +1,58 @@
+#ifndef MIX_MANIFEST_HPP
+#define MIX_MANIFEST_HPP
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+// Written by mix-cook next to its outputs, one line per cooked asset:
+//
+//   mix-manifest 1
+//   <kind> <hash> <name> <cooked path>
+//
+// name is the path the engine asks for and the cooked path is where the
+// processed result lives; the hash covers the source bytes and cook options,
+// so mix-cook also uses the manifest to skip assets that haven't changed.
+const uint32_t MANIFEST_VERSION = 1;
+
+// cooked textures are this header followed by width * height RGBA8 texels
+const uint32_t COOKED_TEXTURE_MAGIC = 0x5854584d; // "MXTX"
+const uint32_t COOKED_TEXTURE_VERSION = 1;
+
+struct CookedTextureHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+};
+
+// points texels into data; false if it isn't a complete cooked texture
+bool parseCookedTexture(const char* data, size_t size, int& width, int& height, const unsigned char*& texels);
+
+class AssetManifest {
+  public:
+    enum Kind { SHADER, TEXTURE };
+
+    struct Entry {
+      Kind kind;
+      uint64_t hash;
+      std::string cooked;
+    };
+
+  private:
+    std::unordered_map<std::string, Entry> entries;
+
+  public:
+    // false when the file doesn't exist; throws on a malformed manifest
+    bool load(const std::string& path);
+    void save(const std::string& path) const;
+
+    const Entry* find(const std::string& name) const;
+    void set(const std::string& name, const Entry& entry) { entries[name] = entry; }
+    void clear() { entries.clear(); }
+    size_t size() const { return entries.size(); }
+
+    // the manifest the asset loaders resolve names through
+    static AssetManifest& loaded();
+};
+#endif
@@ -0,0 +1,112 @@
+#ifndef MIX_PACK_HPP
+#define MIX_PACK_HPP
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Asset pack layout, all little endian:
+//
+//   PackHeader
+//   PackEntry[entryCount]   sorted by name hash
+//   PackChunk[chunkCount]   LZ4 chunks of compressed entries
+//   names                   entry names, not terminated
+//   data                    every entry starts on a PACK_ALIGNMENT boundary
+//
+// Names are the paths the engine asks for (e.g. "shaders/vert.spv"), so a
+// mounted pack can stand in for loose files without changing call sites.
+const uint32_t PACK_MAGIC = 0x4b50584d; // "MXPK"
+const uint32_t PACK_VERSION = 1;
+const uint64_t PACK_ALIGNMENT = 64;
+// uncompressed size of one LZ4 chunk
+const uint32_t PACK_CHUNK_SIZE = 64 * 1024;
+
+struct PackHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entryCount;
+  uint32_t chunkCount;
+  uint64_t entriesOffset;
+  uint64_t chunksOffset;
+  uint64_t namesOffset;
+  uint64_t namesSize;
+  uint64_t reserved[2];
+};
+
+struct PackEntry {
+  uint64_t nameHash;
+  uint64_t offset;
+  // bytes stored in the pack, and after decompression
+  uint64_t storedSize;
+  uint64_t size;
+  uint32_t nameOffset;
+  uint32_t nameLength;
+  uint32_t firstChunk;
+  // 0 for entries stored uncompressed
+  uint32_t chunkCount;
+};
+
+// a chunk that didn't shrink is stored raw, with storedSize == size
+struct PackChunk {
+  uint64_t offset;
+  uint32_t storedSize;
+  uint32_t size;
+};
+
+struct PackSpan {
+  const char* data = nullptr;
+  size_t size = 0;
+};
+
+// 64-bit FNV-1a
+uint64_t hashAssetName(const std::string& name);
+
+// Read-only view of a pack mapped into memory. Lookups don't allocate and
+// may run from any thread once open() has returned.
+class AssetPack {
+  int fd = -1;
+  const char* base = nullptr;
+  size_t mappedSize = 0;
+  const PackHeader* header = nullptr;
+  const PackEntry* entries = nullptr;
+  const PackChunk* chunks = nullptr;
+  const char* names = nullptr;
+
+  void validate() const;
+  public:
+    AssetPack() {}
+    ~AssetPack();
+    AssetPack(const AssetPack&) = delete;
+    AssetPack& operator=(const AssetPack&) = delete;
+
+    // false when the file doesn't exist; throws on a malformed pack
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return base != nullptr; }
+
+    const PackEntry* find(const std::string& name) const;
+    bool contains(const std::string& name) const { return find(name) != nullptr; }
+    // zero-copy view of an uncompressed entry, empty for missing or compressed ones
+    PackSpan view(const std::string& name) const;
+    // copies or decompresses into out; false when the entry is missing
+    bool read(const std::string& name, std::vector<char>& out) const;
+
+    size_t size() const { return header ? header->entryCount : 0; }
+
+    // the pack readFile and the texture loaders consult before the filesystem
+    static AssetPack& mounted();
+};
+
+class AssetPackWriter {
+  struct Pending {
+    std::string name;
+    std::vector<char> data;
+    bool compress;
+  };
+  std::vector<Pending> pending;
+  public:
+    // compression needs LZ4 at build time and is skipped for entries it doesn't shrink
+    void add(const std::string& name, std::vector<char> data, bool compress);
+    void write(const std::string& path) const;
+};
+#endif
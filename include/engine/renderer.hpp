@@ -5,13 +5,15 @@
 #include <stdexcept>
 #include <functional>
 #include <array>
+#include <atomic>
 
 class Renderer {
   protected:
   const int MAX_FRAMES_IN_FLIGHT = 2;
   public:
-    bool framebufferResized = false;
-    bool minimized = false;
+    // written by the event thread, read by the render thread
+    std::atomic<bool> framebufferResized{false};
+    std::atomic<bool> minimized{false};
     virtual void init(std::function<void(Renderer* renderer)> func) = 0;
     virtual void drawFrame() = 0;
     virtual void cleanup() = 0;
@@ -0,0 +1,166 @@
+#ifndef MIX_RENDERGRAPH_HPP
+#define MIX_RENDERGRAPH_HPP
+#include <vulkan/vulkan.h>
+
+#include "engine/deletion.hpp"
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+// Passes declare the resources they read and write, and compile() works out
+// the rest once: passes nothing needed writes to are culled, the barriers
+// before each pass are merged into a single vkCmdPipelineBarrier, and
+// transient images whose lifetimes don't overlap share one allocation.
+// Compiled once per swapchain, like the command buffers that execute it.
+class RenderGraph {
+  public:
+    typedef uint32_t Resource;
+    typedef uint32_t Pass;
+    typedef std::function<void(VkCommandBuffer commandBuffer, size_t image)> RecordFunc;
+
+    // how a pass uses a resource; layout only matters for images
+    struct Access {
+      VkPipelineStageFlags stages = 0;
+      VkAccessFlags access = 0;
+      VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+
+    struct ImageDesc {
+      VkFormat format = VK_FORMAT_UNDEFINED;
+      VkExtent2D extent = {0, 0};
+      VkImageUsageFlags usage = 0;
+      VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+      uint32_t mipLevels = 1;
+    };
+
+    struct Stats {
+      uint32_t passes = 0;
+      uint32_t culled = 0;
+      // pipeline barriers and image barriers in them, per execute
+      uint32_t barriers = 0;
+      uint32_t imageBarriers = 0;
+      // memory allocated for transient images, and what aliasing saved
+      VkDeviceSize transientMemory = 0;
+      VkDeviceSize aliasedMemory = 0;
+    };
+
+    // the stages and accesses that usually go with a layout; throws for
+    // layouts it doesn't know
+    static Access layoutAccess(VkImageLayout layout);
+
+  private:
+    struct ResourceInfo {
+      std::string name;
+      bool image = false;
+      bool transient = false;
+      // one per swapchain image, or a single one used by all
+      std::vector<VkImage> images;
+      VkImageView view = VK_NULL_HANDLE;
+      VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+      uint32_t mipLevels = 1;
+      ImageDesc desc;
+      Access initial;
+      bool output = false;
+      Access final;
+    };
+
+    struct Use {
+      Resource resource;
+      Access access;
+      bool write;
+      // inside a render pass, which synchronizes it and leaves it in finalLayout
+      bool attachment;
+      VkImageLayout finalLayout;
+    };
+
+    struct PassInfo {
+      std::string name;
+      RecordFunc record;
+      std::vector<Use> uses;
+      bool live = false;
+    };
+
+    struct ImageBarrier {
+      Resource resource;
+      VkImageLayout oldLayout;
+      VkImageLayout newLayout;
+      VkAccessFlags srcAccess;
+      VkAccessFlags dstAccess;
+    };
+
+    // everything that has to happen before one pass
+    struct Batch {
+      VkPipelineStageFlags srcStages = 0;
+      VkPipelineStageFlags dstStages = 0;
+      VkAccessFlags srcAccess = 0;
+      VkAccessFlags dstAccess = 0;
+      std::vector<ImageBarrier> images;
+    };
+
+    // where a resource is as the compiled passes run
+    struct State {
+      VkPipelineStageFlags writeStages = 0;
+      VkAccessFlags writeAccess = 0;
+      VkPipelineStageFlags readStages = 0;
+      VkPipelineStageFlags visibleStages = 0;
+      VkAccessFlags visibleAccess = 0;
+      VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+
+    std::vector<ResourceInfo> resources;
+    std::vector<PassInfo> passes;
+    // one per pass, plus the hand-off of outputs at the end
+    std::vector<Batch> batches;
+    std::vector<VkDeviceMemory> transientMemory;
+    bool compiled = false;
+    Stats graphStats;
+
+    Use& use(Pass pass, Resource resource, const Access& access);
+    void transition(Batch& batch, State& state, Resource resource, const Access& access, bool write);
+    void allocateTransients(const std::vector<uint32_t>& firstUse, const std::vector<uint32_t>& lastUse, std::vector<std::vector<Resource>>& buckets);
+    void emit(VkCommandBuffer commandBuffer, const Batch& batch, size_t image) const;
+  public:
+    void init(VkDevice _device, VkPhysicalDevice _physicalDevice);
+
+    // images and state are what every frame starts from; the final state of
+    // markOutput should hand the next frame the same
+    Resource importImage(const std::string& name, const std::vector<VkImage>& images, VkImageAspectFlags aspect, uint32_t mipLevels, const Access& initial);
+    // only global memory barriers are used for buffers, so they need no handle
+    Resource importBuffer(const std::string& name, const Access& initial);
+    Resource importBuffer(const std::string& name);
+    // created by compile and undefined at the start of every frame
+    Resource createImage(const std::string& name, const ImageDesc& desc);
+    // throws when there is no such resource
+    Resource find(const std::string& name) const;
+    bool has(const std::string& name) const;
+    VkImage image(Resource resource, size_t image = 0) const;
+    // transient images only
+    VkImageView view(Resource resource) const;
+
+    // passes run in the order they are added
+    Pass addPass(const std::string& name, RecordFunc record);
+    void read(Pass pass, Resource resource, const Access& access);
+    // access may include reads, for read-modify-write
+    void write(Pass pass, Resource resource, const Access& access);
+    void attachment(Pass pass, Resource resource, const Access& access, VkImageLayout finalLayout);
+    // keeps the passes writing it; a final layout or access is transitioned
+    // to after the last pass
+    void markOutput(Resource resource, const Access& final);
+    void markOutput(Resource resource);
+
+    void compile();
+    void execute(VkCommandBuffer commandBuffer, size_t image) const;
+    bool culled(Pass pass) const;
+    const Stats& stats() const { return graphStats; }
+
+    // frees transient images now, or once the timeline reaches value, and
+    // forgets every pass and resource
+    void destroy();
+    void release(DeletionQueue& queue, uint64_t value);
+};
+#endif
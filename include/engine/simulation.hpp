@@ -0,0 +1,84 @@
+#ifndef MIX_SIMULATION_HPP
+#define MIX_SIMULATION_HPP
+#include <SDL2/SDL.h>
+
+#include "engine/transform.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+struct RenderSnapshot {
+  uint64_t tick = 0;
+  std::chrono::steady_clock::time_point time;
+  std::vector<Transform> previous;
+  std::vector<Transform> current;
+};
+
+// Single producer, single consumer. The writer always has a buffer to fill and
+// the reader always has a complete one, so neither side ever blocks.
+template <typename T>
+class TripleBuffer {
+  static const uint8_t FRESH = 4;
+  static const uint8_t INDEX = 3;
+
+  T buffers[3];
+  std::atomic<uint8_t> middle;
+  uint8_t back = 0;
+  uint8_t front = 2;
+  public:
+    TripleBuffer() : middle(1) {}
+
+    T& writeBuffer() { return buffers[back]; }
+    void publish() {
+      back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // returns true when a newer buffer was published since the last call
+    bool update() {
+      if (!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+      front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+      return true;
+    }
+    const T& readBuffer() const { return buffers[front]; }
+};
+
+class Simulation {
+  public:
+    typedef std::function<void(std::vector<Transform>& transforms, const std::vector<SDL_Event>& events, double dt)> UpdateFunc;
+  private:
+    std::thread thread;
+    std::atomic<bool> running;
+    double tickSeconds;
+    uint64_t tick = 0;
+
+    std::vector<Transform> previous;
+    std::vector<Transform> current;
+    TripleBuffer<RenderSnapshot> snapshots;
+    bool received = false;
+    UpdateFunc update;
+
+    std::mutex inputMutex;
+    std::vector<SDL_Event> pendingEvents;
+    std::vector<SDL_Event> events;
+
+    void loop();
+    void publish();
+  public:
+    Simulation(double tickRate = 60.0) : running(false), tickSeconds(1.0 / tickRate) {}
+    ~Simulation() { stop(); }
+
+    void start(std::vector<Transform> initial, UpdateFunc func);
+    void stop();
+    void pushEvent(const SDL_Event& e);
+
+    double tickInterval() const { return tickSeconds; }
+    // render thread only: latest published snapshot, or nullptr before the first tick
+    const RenderSnapshot* latest();
+    std::vector<Transform>& interpolate(const RenderSnapshot& snapshot, std::vector<Transform>& out) const;
+};
+#endif
@@ -0,0 +1,57 @@
+#ifndef MIX_TIMELINE_HPP
+#define MIX_TIMELINE_HPP
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+// A monotonically increasing counter of GPU submissions. Every submit signals
+// the next value, and the CPU waits on values instead of resetting fences.
+// Uses a timeline semaphore when the device has one and a pool of fences
+// otherwise.
+class GpuTimeline {
+  struct PendingFence {
+    uint64_t value;
+    VkFence fence;
+  };
+
+  struct Retirement {
+    uint64_t value;
+    std::function<void()> callback;
+  };
+
+  VkDevice device = VK_NULL_HANDLE;
+  bool timelineSemaphore = false;
+
+  VkSemaphore semaphore = VK_NULL_HANDLE;
+  PFN_vkWaitSemaphores waitSemaphores = nullptr;
+  PFN_vkGetSemaphoreCounterValue getSemaphoreCounterValue = nullptr;
+
+  std::deque<PendingFence> pendingFences;
+  std::vector<VkFence> freeFences;
+
+  std::deque<Retirement> retirements;
+
+  uint64_t submittedValue = 0;
+  uint64_t completedValue = 0;
+
+  VkFence acquireFence();
+  public:
+    void init(VkDevice _device, bool useTimelineSemaphore, bool coreTimelineSemaphore);
+    void destroy();
+
+    bool usesTimelineSemaphore() const { return timelineSemaphore; }
+    uint64_t lastSubmitted() const { return submittedValue; }
+    uint64_t lastCompleted() const { return completedValue; }
+
+    uint64_t submit(VkQueue queue, VkSubmitInfo submitInfo);
+    uint64_t poll();
+    bool reached(uint64_t value);
+    void wait(uint64_t value);
+
+    void retire(uint64_t value, std::function<void()> callback);
+    void collect();
+};
+#endif
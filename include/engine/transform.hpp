@@ -0,0 +1,26 @@
+#ifndef MIX_TRANSFORM_HPP
+#define MIX_TRANSFORM_HPP
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+struct Transform {
+  glm::vec3 position = glm::vec3(0.0f);
+  glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+  glm::vec3 scale = glm::vec3(1.0f);
+
+  glm::mat4 matrix() const {
+    glm::mat4 m = glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation);
+    return glm::scale(m, scale);
+  }
+
+  static Transform interpolate(const Transform& a, const Transform& b, float alpha) {
+    Transform t;
+    t.position = glm::mix(a.position, b.position, alpha);
+    t.rotation = glm::slerp(a.rotation, b.rotation, alpha);
+    t.scale = glm::mix(a.scale, b.scale, alpha);
+    return t;
+  }
+};
+#endif
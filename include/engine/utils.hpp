@@ -5,5 +5,6 @@
 #include <string>
 #include "engine/exception.hpp"
 
+// blocks the caller; goes through IoService::shared, so don't call it from an IoService callback
 std::vector<char> readFile (const std::string& filename);
 #endif
@@ -14,6 +14,14 @@
 #include "engine/renderer.hpp"
 #include "engine/exception.hpp"
 #include "engine/utils.hpp"
+#include "engine/timeline.hpp"
+#include "engine/deletion.hpp"
+#include "engine/rendergraph.hpp"
+#include "engine/capture.hpp"
+#include "engine/ecs.hpp"
+#include "engine/io.hpp"
+#include "engine/pack.hpp"
+#include "engine/manifest.hpp"
 
 // C++ stdlib
 #include <iostream>
@@ -23,15 +31,20 @@
 #include <set>
 #include <algorithm>
 #include <chrono>
+#include <mutex>
+#include <deque>
+#include <functional>
 
 // C stdlib
 #include <cstring>
 #include <cstdint>
 
-struct UniformBufferObject {
-  alignas(16) glm::mat4 model;
+// set 0, written once per frame and shared by every draw
+struct CameraUniform {
   alignas(16) glm::mat4 view;
   alignas(16) glm::mat4 proj;
+  // world pixels to clip space for tilemaps, from Camera2D
+  alignas(16) glm::mat4 view2D;
 };
 
 struct Vertex {
@@ -64,32 +77,268 @@ struct Vertex {
   }
 };
 
-struct VulkanObject {
-  std::vector<VkBuffer> uniformBuffers;
-  std::vector<VkDeviceMemory> uniformBuffersMemory;
-  VkBuffer vertexBuffer;
-  VkBuffer indexBuffer;
-  VkDeviceMemory vertexBufferMemory;
-  VkDeviceMemory indexBufferMemory;
-  std::vector<Vertex> vertices;
-  std::vector<uint16_t> indices;
-  VkImage textureImage;
-  VkImageView textureImageView;
-  VkDeviceMemory textureImageMemory;
-  std::vector<VkDescriptorSet> descriptorSets;
-  UniformBufferObject ubo;
+// per-object data streamed through an instance-rate vertex binding, so
+// prerecorded command buffers pick up new transforms without re-recording
+struct InstanceData {
+  glm::mat4 model;
 
-  void destroy (VkDevice device) {
-    for (size_t i = 0; i < uniformBuffers.size(); i++) {
-      vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-      vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+  static VkVertexInputBindingDescription getBindingDescription() {
+    VkVertexInputBindingDescription bindingDescription = {};
+    bindingDescription.binding = 1;
+    bindingDescription.stride = sizeof(InstanceData);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+    return bindingDescription;
+  }
+
+  // a mat4 input takes one location per column
+  static std::array<VkVertexInputAttributeDescription, 4> getAttributeDescriptions() {
+    std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions = {};
+
+    for (uint32_t i = 0; i < attributeDescriptions.size(); i++) {
+      attributeDescriptions[i].binding = 1;
+      attributeDescriptions[i].location = 2 + i;
+      attributeDescriptions[i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+      attributeDescriptions[i].offset = static_cast<uint32_t>(offsetof(InstanceData, model) + sizeof(glm::vec4) * i);
     }
 
-    vkDestroyImageView(device, textureImageView, nullptr);
+    return attributeDescriptions;
+  }
+};
+
+// axis-aligned rectangle; positions are in pixels from the top left, texture
+// coordinates in 0..1
+struct SpriteRect {
+  glm::vec2 min = glm::vec2(0.0f);
+  glm::vec2 max = glm::vec2(1.0f);
+};
+
+// clamped to 0..1, red in the lowest byte like unpackUnorm4x8 expects
+uint32_t packColor(const glm::vec4& color);
 
-    vkDestroyImage(device, textureImage, nullptr);
-    vkFreeMemory(device, textureImageMemory, nullptr);
+// written already transformed, so a batch of sprites is one plain draw
+struct SpriteVertex {
+  glm::vec2 pos;
+  glm::vec2 texCoord;
+  // RGBA8, multiplied with the texture
+  uint32_t color;
+
+  static VkVertexInputBindingDescription getBindingDescription() {
+    VkVertexInputBindingDescription bindingDescription = {};
+    bindingDescription.binding = 0;
+    bindingDescription.stride = sizeof(SpriteVertex);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+    return bindingDescription;
+  }
+
+  static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+    std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
+
+    attributeDescriptions[0].binding = 0;
+    attributeDescriptions[0].location = 0;
+    attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+    attributeDescriptions[0].offset = offsetof(SpriteVertex, pos);
+
+    attributeDescriptions[1].binding = 0;
+    attributeDescriptions[1].location = 1;
+    attributeDescriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
+    attributeDescriptions[1].offset = offsetof(SpriteVertex, texCoord);
+
+    attributeDescriptions[2].binding = 0;
+    attributeDescriptions[2].location = 2;
+    attributeDescriptions[2].format = VK_FORMAT_R8G8B8A8_UNORM;
+    attributeDescriptions[2].offset = offsetof(SpriteVertex, color);
+
+    return attributeDescriptions;
+  }
+};
+
+// a run of sprites sharing a pipeline and texture, drawn with one call
+struct SpriteBatch {
+  uint32_t pipeline;
+  uint32_t texture;
+  uint32_t firstSprite;
+  uint32_t spriteCount;
+
+  bool operator==(const SpriteBatch& other) const {
+    return pipeline == other.pipeline && texture == other.texture
+      && firstSprite == other.firstSprite && spriteCount == other.spriteCount;
+  }
+};
+
+// tiles along each side of a tilemap chunk
+const uint32_t TILEMAP_CHUNK_SIZE = 32;
+
+// one layer of one visible chunk, compared between frames like SpriteBatch
+struct TilemapDraw {
+  VkBuffer vertexBuffer;
+  uint32_t texture;
+  uint32_t firstQuad;
+  uint32_t quadCount;
+
+  bool operator==(const TilemapDraw& other) const {
+    return vertexBuffer == other.vertexBuffer && texture == other.texture
+      && firstQuad == other.firstQuad && quadCount == other.quadCount;
+  }
+};
+
+// Every layer of a chunk baked into one device local buffer of sprite quads.
+// Rebuilt only when one of its tiles changes, and only once it is visible.
+struct TilemapChunk {
+  VkBuffer vertexBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+  // layer l is quads layerStart[l] up to layerStart[l + 1]
+  std::vector<uint32_t> layerStart;
+  bool dirty = true;
+};
+
+// A grid of tiles cut from one atlas texture, placed in world pixels and
+// drawn through Camera2D. Tile 0 is empty, tile n is atlas cell n - 1
+// counted row by row from the top left.
+struct Tilemap {
+  uint32_t texture = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t layers = 0;
+  glm::vec2 origin = glm::vec2(0.0f);
+  glm::vec2 tileSize = glm::vec2(1.0f);
+  uint32_t atlasColumns = 1;
+  uint32_t atlasRows = 1;
+  // layer by layer, each row by row
+  std::vector<uint16_t> tiles;
+  uint32_t chunksX = 0;
+  uint32_t chunksY = 0;
+  std::vector<TilemapChunk> chunks;
+};
+
+// emitters a particle system reads each frame; more are ignored
+const uint32_t PARTICLE_MAX_EMITTERS = 16;
+
+struct ParticleEmitter {
+  glm::vec3 position = glm::vec3(0.0f);
+  // particles per second, spread evenly over frames
+  float rate = 100.0f;
+  glm::vec3 velocity = glm::vec3(0.0f, 0.0f, 1.0f);
+  // up to this much random velocity is added on each axis
+  float spread = 0.25f;
+  glm::vec4 color = glm::vec4(1.0f);
+  // seconds
+  float lifetime = 2.0f;
+  // world units across the billboard
+  float size = 0.05f;
+};
+
+// Particles that live entirely on the GPU: compute stages emit into free
+// slots, simulate and compact the alive list every frame, and the draw is
+// indirect, so the CPU only writes emitter parameters.
+struct ParticleSystem {
+  uint32_t capacity = 0;
+  uint32_t texture = 0;
+  glm::vec3 gravity = glm::vec3(0.0f, 0.0f, -9.8f);
+  std::vector<ParticleEmitter> emitters;
+
+  // device local: two particle pools and two alive lists of slot indices
+  // that swap every frame, the free list and the counters. A frame's update
+  // only writes the pool and list the previous frame's draw doesn't read.
+  VkBuffer particleBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory particleBufferMemory = VK_NULL_HANDLE;
+  VkBuffer aliveBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory aliveBufferMemory = VK_NULL_HANDLE;
+  VkBuffer deadBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory deadBufferMemory = VK_NULL_HANDLE;
+  VkBuffer stateBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory stateBufferMemory = VK_NULL_HANDLE;
+
+  // per swapchain image, persistently mapped frame parameters, the draw the
+  // finish stage writes, and the sets binding them with the buffers above
+  VkDescriptorPool pool = VK_NULL_HANDLE;
+  std::vector<VkBuffer> paramBuffers;
+  std::vector<VkDeviceMemory> paramBuffersMemory;
+  std::vector<void*> paramBuffersMapped;
+  std::vector<VkBuffer> drawBuffers;
+  std::vector<VkDeviceMemory> drawBuffersMemory;
+  std::vector<VkDescriptorSet> sets;
+
+  // fractions of a particle each emitter still owes
+  std::vector<float> emitCarry;
+};
+
+// one entry per renderable in the cull shader's object buffer
+struct CullObject {
+  glm::vec4 boundsMin;
+  glm::vec4 boundsMax;
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t padding[2];
+};
 
+// written by the cull shader with atomics, reset at the start of every frame
+struct CullCounters {
+  uint32_t drawn;
+  uint32_t frustumCulled;
+  uint32_t occlusionCulled;
+};
+
+struct RenderStats {
+  uint32_t drawCalls = 0;
+  uint64_t deviceAllocations = 0;
+  uint64_t bytesUploaded = 0;
+  double uploadSeconds = 0.0;
+  double gpuFrameMs = 0.0;
+  uint64_t trianglesDrawn = 0;
+  // triangles skipped this frame by drawing coarser levels of detail
+  uint64_t trianglesSaved = 0;
+  // results of the GPU cull pass, one frame behind like gpuFrameMs
+  uint32_t objectsDrawn = 0;
+  uint32_t objectsFrustumCulled = 0;
+  uint32_t objectsOcclusionCulled = 0;
+  // from the start of init to the first present, and to the last requested
+  // texture or reserved mesh being swapped in (0 until then)
+  double timeToFirstFrameMs = 0.0;
+  double timeToLoadedMs = 0.0;
+  // sprites drawn last frame and the draws they were batched into
+  uint32_t spritesDrawn = 0;
+  uint32_t spriteBatches = 0;
+  // tilemap chunks overlapping the view last frame, and how many of them
+  // had to be rebuilt because their tiles changed
+  uint32_t tilemapChunksDrawn = 0;
+  uint32_t tilemapChunksRebuilt = 0;
+  // live particles in all systems, read back one frame behind like gpuFrameMs,
+  // and particles emitted last frame
+  uint32_t particlesAlive = 0;
+  uint32_t particlesEmitted = 0;
+  // whether last frame's compute work ran on its own queue
+  bool asyncCompute = false;
+  // from the frame graph: pipeline barriers recorded per frame, passes
+  // culled, and the device memory behind its transient images
+  uint32_t graphBarriers = 0;
+  uint32_t graphPassesCulled = 0;
+  uint64_t transientMemory = 0;
+  // fraction of the swapchain's width and height the scene was drawn at
+  float renderScale = 1.0f;
+  // whether textures are pushed rather than bound as descriptor sets
+  bool pushDescriptors = false;
+};
+
+// one index range of a mesh; error is the object-space deviation from the
+// full detail mesh, so projected to pixels it drives LOD selection
+struct MeshLod {
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error;
+};
+
+struct VulkanMesh {
+  VkBuffer vertexBuffer = VK_NULL_HANDLE;
+  VkBuffer indexBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+  VkDeviceMemory indexBufferMemory = VK_NULL_HANDLE;
+  // finest first, all sharing one vertex and index buffer
+  std::vector<MeshLod> lods;
+  AABB bounds;
+  // reserved, then destroyed before it streamed in; its replaceMesh is dropped
+  bool cancelled = false;
+
+  void destroy (VkDevice device) {
     vkDestroyBuffer(device, indexBuffer, nullptr);
     vkFreeMemory(device, indexBufferMemory, nullptr);
 
@@ -97,26 +346,99 @@ struct VulkanObject {
     vkFreeMemory(device, vertexBufferMemory, nullptr);
   }
 
-  void updateUBO(VkExtent2D extent) {
-    ubo.model = ubo.view = ubo.proj = glm::mat4(1.0f);
-    ubo.model = glm::rotate(ubo.model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-    ubo.view = glm::lookAt(glm::vec3(0.0f, 3.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.proj = glm::perspective(glm::radians(45.0f), extent.width / (float) extent.height, 0.1f, 10.0f);
-    ubo.proj[1][1] *= -1;
+  // defers destruction until the GPU timeline reaches value
+  void destroy (DeletionQueue& queue, uint64_t value) {
+    queue.destroyBuffer(value, indexBuffer, indexBufferMemory);
+    queue.destroyBuffer(value, vertexBuffer, vertexBufferMemory);
+  }
+};
+
+struct VulkanTexture {
+  VkImage image = VK_NULL_HANDLE;
+  VkImageView view = VK_NULL_HANDLE;
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  // null when textures are pushed
+  VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+  // requested and still streaming in; drawn as the placeholder meanwhile
+  bool borrowsPlaceholder = false;
+
+  void destroy (VkDevice device) {
+    vkDestroyImageView(device, view, nullptr);
+
+    vkDestroyImage(device, image, nullptr);
+    vkFreeMemory(device, memory, nullptr);
+  }
+
+  void destroy (DeletionQueue& queue, uint64_t value, VkDescriptorPool pool) {
+    if (descriptorSet != VK_NULL_HANDLE) {
+      queue.freeDescriptorSet(value, pool, descriptorSet);
+    }
+    queue.destroyImage(value, image, view, memory);
+  }
+};
+
+struct Camera {
+  glm::vec3 eye = glm::vec3(0.0f, 3.0f, 0.0f);
+  glm::vec3 target = glm::vec3(0.0f, 0.0f, 0.0f);
+  glm::vec3 up = glm::vec3(0.0f, 0.0f, 1.0f);
+  float fovy = glm::radians(45.0f);
+  float near = 0.1f;
+  float far = 10.0f;
+
+  glm::mat4 view() const {
+    return glm::lookAt(eye, target, up);
+  }
+
+  glm::mat4 proj(VkExtent2D extent) const {
+    glm::mat4 p = glm::perspective(fovy, extent.width / (float) extent.height, near, far);
+    p[1][1] *= -1;
+    return p;
+  }
+
+  Frustum frustum(VkExtent2D extent) const {
+    return Frustum::fromMatrix(proj(extent) * view());
+  }
+};
+
+// pans and zooms tilemaps; position is the world pixel at the window's center
+struct Camera2D {
+  glm::vec2 position = glm::vec2(0.0f);
+  float zoom = 1.0f;
+
+  glm::mat4 viewProj(VkExtent2D extent) const {
+    glm::mat4 m(1.0f);
+    m[0][0] = 2.0f * zoom / extent.width;
+    m[1][1] = 2.0f * zoom / extent.height;
+    m[3][0] = -position.x * m[0][0];
+    m[3][1] = -position.y * m[1][1];
+    return m;
   }
 };
 
+// decoded on an I/O worker, uploaded by the render thread
+struct PendingTexture {
+  std::string path;
+  // decoded by stb, or null for cooked textures, which fill cooked instead
+  unsigned char* pixels;
+  std::vector<unsigned char> cooked;
+  int width;
+  int height;
+  std::function<void(uint32_t texture)> onLoaded;
+  std::function<void()> onFailed;
+};
+
 struct VulkanPipeline {
   VkPipeline pipeline;
   VkPipelineLayout layout;
   std::string vertShaderPath;
   std::string fragShaderPath;
-  std::vector<VulkanObject> objects;
 };
 
 struct QueueFamilyIndices {
   std::optional<uint32_t> graphicsFamily;
   std::optional<uint32_t> presentFamily;
+  // a family with compute but no graphics, for async compute; optional
+  std::optional<uint32_t> computeFamily;
   bool isComplete() {
     return graphicsFamily.has_value() && presentFamily.has_value();
   }
@@ -137,6 +459,11 @@ class VulkanRenderer : public Renderer {
     VkDevice device;
     VkQueue graphicsQueue;
     VkQueue presentQueue;
+    // the graphics queue when there is no separate compute family
+    VkQueue computeQueue;
+    bool asyncComputeSupported = false;
+    uint32_t graphicsQueueFamily = 0;
+    uint32_t computeQueueFamily = 0;
     VkSurfaceKHR surface;
 
     VkSwapchainKHR swapchain;
@@ -144,20 +471,170 @@ class VulkanRenderer : public Renderer {
     VkFormat swapchainImageFormat;
     std::vector<VkImageView> swapchainImageViews;
 
-    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorSetLayout cameraSetLayout;
+    VkDescriptorSetLayout textureSetLayout;
+    // textures are pushed while recording instead of owning a set; decided
+    // when the device is created
+    bool pushDescriptorsEnabled = false;
+    PFN_vkCmdPushDescriptorSetWithTemplateKHR cmdPushDescriptorSetWithTemplate = nullptr;
+    // indexed by the set textures are bound at
+    std::array<VkPipelineLayout, 2> textureTemplateLayouts = {};
+    std::array<VkDescriptorUpdateTemplate, 2> textureTemplates = {};
     VkRenderPass renderPass;
     std::vector<VkFramebuffer> swapchainFramebuffers;
 
+    // Dynamic resolution: the scene pass draws into the top left of a
+    // swapchain-sized transient target, which is blitted up to the swapchain
+    // image. The render pass matches renderPass but leaves color attachable.
+    bool dynamicResolutionSupported = false;
+    VkRenderPass offscreenRenderPass = VK_NULL_HANDLE;
+    VkFramebuffer offscreenFramebuffer = VK_NULL_HANDLE;
+    RenderGraph::Resource sceneColor = 0;
+    // whether the current frame graph was built with the offscreen target
+    bool renderingOffscreen = false;
+    float renderScale = 1.0f;
+    double smoothedGpuFrameMs = 0.0;
+    uint32_t framesSinceScaleChange = 0;
+
+    // one depth target shared by every swapchain image; frames are serialized
+    // on the graphics queue, and the render pass leaves it sampleable
+    VkFormat depthFormat;
+    VkImage depthImage;
+    VkDeviceMemory depthImageMemory;
+    VkImageView depthImageView;
+
+    // Hi-Z occlusion culling: the pyramid is built from each frame's depth and
+    // tested against by the next frame's cull pass
+    bool occlusionCullingSupported = false;
+    VkDescriptorSetLayout cullSetLayout;
+    VkDescriptorSetLayout hizSetLayout;
+    VkPipelineLayout cullLayout;
+    VkPipelineLayout hizLayout;
+    VkPipeline cullPipeline;
+    VkPipeline hizPipeline;
+    VkSampler hizSampler;
+    VkDescriptorPool occlusionPool;
+    VkImage hizImage;
+    VkDeviceMemory hizImageMemory;
+    VkImageView hizView;
+    std::vector<VkImageView> hizLevelViews;
+    std::vector<VkDescriptorSet> hizSets;
+    uint32_t hizLevels = 0;
+
     VkCommandPool commandPool;
     std::vector<VkCommandBuffer> commandBuffers;
+    std::vector<bool> commandBuffersDirty;
+    std::vector<uint64_t> recordedVersions;
+    // cull, scene and Hi-Z passes plus graphPasses, compiled with the swapchain
+    RenderGraph frameGraph;
+    // per swapchain image, and whether its compute work was recorded there
+    // rather than into its graphics command buffer
+    VkCommandPool computeCommandPool;
+    std::vector<VkCommandBuffer> computeCommandBuffers;
+    std::vector<bool> computeRecorded;
+
+    // Frame capture: a ring of host-visible buffers, each with a command buffer
+    // that copies the presented image into it after the frame's own commands.
+    // Buffers are handed back once the timeline passes their frame.
+    struct ReadbackBuffer {
+      VkBuffer buffer = VK_NULL_HANDLE;
+      VkDeviceMemory memory = VK_NULL_HANDLE;
+      void* mapped = nullptr;
+      VkDeviceSize size = 0;
+      bool coherent = true;
+      // swapchain formats with blue in the lowest byte are swizzled on read
+      bool bgra = false;
+      VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+      bool inFlight = false;
+      CapturedFrame frame;
+      std::function<void(CapturedFrame& frame)> callback;
+    };
+    bool captureFormatSupported = false;
+    std::vector<ReadbackBuffer> readbackBuffers;
+    std::deque<std::function<void(CapturedFrame& frame)>> pendingCaptures;
+    uint64_t framesDrawn = 0;
+
+    VkQueryPool timestampPool;
+    float timestampPeriod = 0.0f;
+    bool timestampsSupported = false;
 
     std::vector<VkSemaphore> imageAvailableSemaphores;
     std::vector<VkSemaphore> renderFinishedSemaphores;
-    std::vector<VkFence> inFlightFences;
-    std::vector<VkFence> imagesInFlight;
+    std::vector<VkSemaphore> computeFinishedSemaphores;
+    GpuTimeline timeline;
+    DeletionQueue deletionQueue;
+    std::vector<uint64_t> framesInFlight;
+    std::vector<uint64_t> imagesInFlight;
     int currentFrame = 0;
 
+    bool timelineSemaphoreSupported = false;
+    bool timelineSemaphoreCore = false;
+
     VkDescriptorPool descriptorPool;
+    // owns only the placeholder texture's set, which exists before descriptorPool
+    VkDescriptorPool placeholderPool = VK_NULL_HANDLE;
+    // requested textures and reserved meshes still showing a placeholder
+    uint32_t streamingResources = 0;
+    std::chrono::high_resolution_clock::time_point initStart;
+
+    // per swapchain image, persistently mapped
+    std::vector<VkBuffer> cameraBuffers;
+    std::vector<VkDeviceMemory> cameraBuffersMemory;
+    std::vector<void*> cameraBuffersMapped;
+    std::vector<VkDescriptorSet> cameraSets;
+    std::vector<VkBuffer> instanceBuffers;
+    std::vector<VkDeviceMemory> instanceBuffersMemory;
+    std::vector<void*> instanceBuffersMapped;
+    size_t instanceCapacity = 0;
+    // sized with the instance buffers
+    std::vector<VkBuffer> cullObjectBuffers;
+    std::vector<VkDeviceMemory> cullObjectBuffersMemory;
+    std::vector<void*> cullObjectBuffersMapped;
+    std::vector<VkBuffer> drawCommandBuffers;
+    std::vector<VkDeviceMemory> drawCommandBuffersMemory;
+    std::vector<VkBuffer> cullCounterBuffers;
+    std::vector<VkDeviceMemory> cullCounterBuffersMemory;
+    std::vector<void*> cullCounterBuffersMapped;
+    std::vector<VkDescriptorSet> cullSets;
+
+    // sprites queued since the last frame: four vertices each, and a sort key
+    // of layer, pipeline and texture
+    struct SpriteKey {
+      uint64_t key;
+      uint32_t sprite;
+    };
+    std::vector<SpriteVertex> spriteVertices;
+    std::vector<SpriteKey> spriteKeys;
+    std::vector<SpriteKey> spriteKeysScratch;
+    std::vector<SpriteBatch> spriteBatches;
+    // what each image's command buffer was recorded with; it only needs
+    // re-recording when the batches change, not the vertices
+    std::vector<std::vector<SpriteBatch>> recordedSpriteBatches;
+    // per swapchain image, persistently mapped, with one shared quad index buffer
+    std::vector<VkBuffer> spriteBuffers;
+    std::vector<VkDeviceMemory> spriteBuffersMemory;
+    std::vector<void*> spriteBuffersMapped;
+    VkBuffer spriteIndexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory spriteIndexBufferMemory = VK_NULL_HANDLE;
+    size_t spriteCapacity = 0;
+
+    // destroyed maps keep their slot with no chunks, so indices stay valid
+    std::vector<Tilemap> tilemaps;
+    VulkanPipeline tilemapPipeline;
+    // this frame's visible chunk layers, in map then layer order
+    std::vector<TilemapDraw> tilemapDraws;
+    std::vector<std::vector<TilemapDraw>> recordedTilemapDraws;
+    // scratch for prepareTilemaps, kept to avoid allocating every frame
+    std::vector<uint32_t> visibleTilemapChunks;
+    std::vector<std::pair<uint32_t, uint32_t>> tilemapRebuilds;
+    std::vector<SpriteVertex> tilemapVertices;
+
+    VkDescriptorSetLayout particleSetLayout;
+    VkPipelineLayout particleComputeLayout;
+    VkPipeline particleComputePipeline;
+    VulkanPipeline particlePipeline;
+    uint32_t particleSeed = 0;
+    std::chrono::high_resolution_clock::time_point lastParticleUpdate;
 
     const uint32_t HEIGHT = 720;
     const uint32_t WIDTH = 1280;
@@ -179,20 +656,10 @@ class VulkanRenderer : public Renderer {
       VK_KHR_SWAPCHAIN_EXTENSION_NAME
     };
 
-    void createCube (VulkanObject &c) {
-      c.vertices = {
-        {{-0.5f, -0.3f}, {1.0f, 0.0f}},
-        {{0.5f, -0.3f}, {0.0f, 0.0f}},
-        {{0.5f, 0.3f}, {0.0f, 1.0f}},
-        {{-0.5f, 0.3f}, {1.0f, 1.0f}}
-      };
-      c.indices = {
-        0, 1, 2, 2, 3, 0
-      };
-    }
-
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    bool checkTimelineSemaphoreSupport(VkPhysicalDevice device, bool& core);
+    bool checkPushDescriptorSupport(VkPhysicalDevice device);
     bool deviceIsSuitable(VkPhysicalDevice device);
 
     void createInstance();
@@ -205,29 +672,121 @@ class VulkanRenderer : public Renderer {
     void createFramebuffers();
     void createCommandPool();
     void createCommandBuffers();
+    void recordCommandBuffer(size_t i);
+    void createFrameGraph();
+    void recordScene(VkCommandBuffer commandBuffer, size_t i);
+
+    bool checkBlitSupport(const VkSurfaceCapabilitiesKHR& capabilities, VkFormat format);
+    void createOffscreenFramebuffer();
+    VkExtent2D renderExtent() const;
+    void updateRenderScale();
+    void recordUpscale(VkCommandBuffer commandBuffer, size_t i);
+    bool checkCaptureSupport(const VkSurfaceCapabilitiesKHR& capabilities, VkFormat format);
+    void allocateReadbackBuffer(ReadbackBuffer& readback, VkDeviceSize size);
+    void freeReadbackBuffer(ReadbackBuffer& readback);
+    bool recordCapture(uint32_t imageIndex, size_t& slot);
+    void retireCapture(size_t slot, uint64_t frameValue);
+    void readCapture(ReadbackBuffer& readback);
+    void releaseReadbackBuffers();
     void createSyncObjects();
-
-    void createVertexBuffer(VulkanObject& obj);
-    void createIndexBuffer(VulkanObject& obj);
-    void createUniformBuffers(VulkanObject& obj);
-    void createDescriptorSets(VulkanObject& obj);
-    void createTextureImage(VulkanObject& obj, std::string fileName);
-    void createTextureImageView(VulkanObject& obj);
+    void createTimestampQueryPool();
+    void readTimestamps(uint32_t imageIndex);
+
+    VkFormat findDepthFormat();
+    void createDepthResources();
+    void createOcclusionPipelines();
+    void createHiZResources();
+    void cleanupHiZResources();
+    void createCullBuffers(size_t capacity);
+    void releaseCullBuffers();
+    bool occlusionCullingActive() const;
+    void recordCullPass(VkCommandBuffer commandBuffer, size_t i);
+    void recordDepthPyramid(VkCommandBuffer commandBuffer);
+    void readCullCounters(uint32_t imageIndex);
+
+    void createDeviceLocalBuffer(
+      const void* data,
+      VkDeviceSize size,
+      VkBufferUsageFlags usage,
+      VkBuffer& buffer,
+      VkDeviceMemory& bufferMemory,
+      bool shared = false
+    );
+    std::mutex pendingTexturesMutex;
+    std::vector<PendingTexture> pendingTextures;
+    std::vector<IoService::RequestId> textureRequests;
+
+    void createTextureImage(VulkanTexture& texture, const unsigned char* pixels, int width, int height);
+    uint32_t addTexture(const unsigned char* pixels, int width, int height);
+    void uploadPendingTextures();
+    void discardPendingTextures();
+    void createTextureDescriptorSet(VulkanTexture& texture, VkDescriptorPool pool);
+    void createTextureTemplates();
+    void destroyTextureTemplates();
+    // pushes the texture, or binds its set, for the draws that follow
+    void bindTexture(VkCommandBuffer commandBuffer, VkPipelineLayout layout, uint32_t set, uint32_t texture);
+    void createCameraBuffers();
+    void ensureInstanceCapacity(size_t count);
+    void releaseInstanceBuffers();
+    void releaseFrameBuffers();
+
+    // world pipelines read Camera2D from set 0 and take their texture at set 1
+    void createSpritePipeline(VulkanPipeline& pipeline, bool world = false);
+    void ensureSpriteCapacity(size_t count);
+    void releaseSpriteBuffers();
+    void sortSprites();
+    void prepareSprites(uint32_t imageIndex);
+    void recordSprites(VkCommandBuffer commandBuffer, size_t i, uint32_t& drawCalls);
+
+    Tilemap& liveTilemap(uint32_t map);
+    void buildTilemapChunk(const Tilemap& map, uint32_t chunk, std::vector<SpriteVertex>& vertices, std::vector<uint32_t>& layerStart);
+    void rebuildTilemapChunks();
+    void releaseTilemap(Tilemap& map);
+    void prepareTilemaps(uint32_t imageIndex);
+    void recordTilemaps(VkCommandBuffer commandBuffer, size_t i, uint32_t& drawCalls);
+
+    void createParticlePipelines();
+    void createParticlePipeline();
+    void destroyParticlePipelines();
+    void createParticleFrameResources(ParticleSystem& system);
+    void releaseParticleFrameResources(ParticleSystem& system);
+    void releaseParticleSystem(ParticleSystem& system);
+    void prepareParticles(uint32_t imageIndex);
+    void recordParticleSimulation(VkCommandBuffer commandBuffer, size_t i, bool async);
+    void recordParticles(VkCommandBuffer commandBuffer, size_t i, uint32_t& drawCalls);
+
+    void createComputeCommandPool();
+    bool hasComputeWork() const;
+    void recordComputeHandoff(VkCommandBuffer commandBuffer, size_t i, bool acquire);
+    void submitCompute(uint32_t imageIndex);
 
     void updateUniformBuffer(uint32_t currentImage);
-    void createDescriptorSetLayout();
+    void selectLods();
+    void createDescriptorSetLayouts();
 
+    // shared buffers are used by the graphics and compute queues at the same
+    // time, so they are concurrent when those are different families
     void createBuffer(
       VkDeviceSize size,
       VkBufferUsageFlags usage,
       VkMemoryPropertyFlags properties,
       VkBuffer& buffer,
-      VkDeviceMemory& bufferMemory
+      VkDeviceMemory& bufferMemory,
+      bool shared = false
     );
     void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
-    VkCommandBuffer beginSingleTimeCommands();
-    void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+    // nested calls share one command buffer, submitted by the outermost
+    // submitUploads without waiting for it
+    VkCommandBuffer beginUploads();
+    void submitUploads();
+    void releaseStagingBuffer(VkBuffer buffer, VkDeviceMemory memory);
+    VkCommandBuffer uploadCommandBuffer = VK_NULL_HANDLE;
+    uint32_t uploadDepth = 0;
+    std::vector<std::pair<VkBuffer, VkDeviceMemory>> uploadStaging;
+    // the last upload into a buffer shared with the compute queue
+    bool uploadsShared = false;
+    uint64_t computeUploadValue = 0;
 
     VkShaderModule createShaderModule(const std::vector<char>& code);
 
@@ -241,14 +800,36 @@ class VulkanRenderer : public Renderer {
       VkImageUsageFlags usage,
       VkMemoryPropertyFlags properties,
       VkImage& image,
-      VkDeviceMemory& imageMemory
+      VkDeviceMemory& imageMemory,
+      uint32_t mipLevels = 1
+    );
+    VkImageView createImageView(
+      VkImage image,
+      VkFormat format,
+      VkImageAspectFlags aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT,
+      uint32_t baseMipLevel = 0,
+      uint32_t levelCount = 1
+    );
+    void transitionImageLayout(
+      VkImage image,
+      VkImageLayout oldLayout,
+      VkImageLayout newLayout,
+      VkImageAspectFlags aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT,
+      uint32_t mipLevels = 1
     );
-    VkImageView createImageView(VkImage image, VkFormat format);
-    void transitionImageLayout(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout);
     void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
     void createTextureSampler();
     VkSampler textureSampler;
 
+    void createPlaceholders();
+    bool borrowsPlaceholderTexture(uint32_t texture) const;
+    bool borrowsPlaceholderMesh(uint32_t mesh) const;
+    bool meshInUse(uint32_t mesh) const;
+    bool textureInUse(uint32_t texture) const;
+    void swapInTexture(uint32_t slot, uint32_t loaded);
+    void finishStreaming();
+    void recordFirstFrame();
+
     SwapchainSupportDetails querySwapchainSupport(VkPhysicalDevice device);
     VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
     VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
@@ -258,20 +839,155 @@ class VulkanRenderer : public Renderer {
     std::function<void(Renderer* renderer)> createFunc;
   public:
     void createGraphicsPipeline(VulkanPipeline &pipeline);
+    // compute pipelines don't depend on the swapchain; destroy them before cleanup
+    void createComputePipeline(const std::string& shaderPath, VkDescriptorSetLayout setLayout, uint32_t pushConstantSize, VkPipelineLayout& layout, VkPipeline& pipeline);
+    void createComputePipeline(const std::string& shaderPath, const std::vector<VkDescriptorSetLayout>& setLayouts, uint32_t pushConstantSize, VkPipelineLayout& layout, VkPipeline& pipeline);
+    // orders compute shader writes before the given stages read them
+    void recordComputeBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess);
+    // recorded after the built-in compute work, before the render pass; call
+    // markCommandBuffersDirty after changing. With async compute they are on
+    // the compute queue and may overlap the previous frame's draws
+    std::vector<std::function<void(VkCommandBuffer commandBuffer, size_t image)>> computePasses;
+    // Add passes to the frame graph after the built-in ones, which leave
+    // "swapchain", "depth", "hiz", "drawCommands" and "cullCounters" to find by
+    // name. Mark outputs, or the passes are culled. Run whenever the swapchain
+    // is recreated; call rebuildFrameGraph after changing.
+    std::vector<std::function<void(RenderGraph& graph)>> graphPasses;
+    void rebuildFrameGraph();
     std::vector<VulkanPipeline> pipelines;
-    void createDescriptorPool(int size);
+    // alpha blended over the scene with sprite vertices; 0 is built in
+    std::vector<VulkanPipeline> spritePipelines;
+    // maxTextures is ignored when textures are pushed
+    void createDescriptorPool(int maxTextures);
     VkExtent2D swapchainExtent;
-    VulkanObject createObject(std::string texturePath) {
-      VulkanObject obj;
-      createCube(obj);
-      createVertexBuffer(obj);
-      createIndexBuffer(obj);
-      createUniformBuffers(obj);
-      createTextureImage(obj, texturePath);
-      createTextureImageView(obj);
-      createDescriptorSets(obj);
-      return obj;
-    }
+    RenderStats stats;
+    World scene;
+    Camera camera;
+    Camera2D camera2D;
+    // ranges per hierarchy level that world matrix updates are split into, run
+    // on JobSystem::shared(); 1 keeps them on the render thread
+    unsigned transformThreads = 1;
+    // largest acceptable LOD error in pixels, and the band around it in
+    // which the current level is kept to avoid popping
+    float lodErrorPixels = 1.0f;
+    float lodHysteresis = 0.25f;
+    // GPU frustum and Hi-Z culling; ignored on devices without
+    // drawIndirectFirstInstance. Call markCommandBuffersDirty after changing it
+    bool occlusionCulling = true;
+    // particle simulation and computePasses on a separate compute queue, when
+    // the device has one. Call markCommandBuffersDirty after changing it
+    bool asyncCompute = true;
+    bool asyncComputeActive() const;
+    // textures pushed into command buffers with VK_KHR_push_descriptor
+    // instead of each owning a descriptor set, when the device has it. Read
+    // by init
+    bool pushDescriptors = true;
+    bool pushDescriptorsActive() const;
+    // Draws the scene below swapchain resolution when the GPU takes longer
+    // than targetFrameMs, and upscales it with a linear blit. Scales apply
+    // to width and height, and scales above 1 are clamped. Ignored without
+    // timestamps or blittable swapchain images. Call rebuildFrameGraph after
+    // turning it on or off
+    bool dynamicResolution = false;
+    float targetFrameMs = 16.6f;
+    float minRenderScale = 0.5f;
+    float maxRenderScale = 1.0f;
+    bool dynamicResolutionActive() const;
+    // Copies the next frame drawn into a host-visible buffer as part of its
+    // submission. callback runs inside a later drawFrame, once the timeline
+    // shows the copy finished, so the render loop never waits on it; hand
+    // the pixels to a FrameWriter to encode them. With every readback buffer
+    // in flight the capture moves to the next frame that has one free.
+    void captureFrame(std::function<void(CapturedFrame& frame)> callback);
+    // needs transfer-src swapchain images in an 8 bit RGBA or BGRA format
+    bool captureSupported() const;
+    // blocks until every capture in flight has reached its callback
+    void finishCaptures();
+    std::vector<VulkanMesh> meshes;
+    std::vector<VulkanTexture> textures;
+    // destroyed systems keep their slot with capacity 0
+    std::vector<ParticleSystem> particleSystems;
+    // built in, created by init before createFunc runs
+    uint32_t placeholderTexture = 0;
+    uint32_t placeholderMesh = 0;
+
+    uint32_t createMesh(const std::vector<Vertex>& vertices, const std::vector<uint16_t>& indices);
+    // lodIndices[0] is full detail; errors are in object space, increasing
+    uint32_t createMesh(
+      const std::vector<Vertex>& vertices,
+      const std::vector<std::vector<uint16_t>>& lodIndices,
+      const std::vector<float>& lodErrors
+    );
+    uint32_t createQuadMesh();
+    uint32_t createGridMesh(uint32_t cells, uint32_t lodCount);
+    uint32_t createTexture(std::string texturePath);
+    // reads and decodes off the render thread; onLoaded runs inside a later
+    // drawFrame with the new texture index, once it has been uploaded; a file
+    // that can't be read or decoded is logged and gets onFailed instead
+    void loadTextureAsync(
+      std::string texturePath,
+      std::function<void(uint32_t texture)> onLoaded,
+      IoService::Priority priority = IoService::NORMAL,
+      std::function<void()> onFailed = nullptr
+    );
+    // a texture index usable right away: it draws as the placeholder until the
+    // file has streamed in, then every renderable using it switches in one
+    // frame; if the file fails to load it keeps the placeholder
+    uint32_t requestTexture(std::string texturePath, IoService::Priority priority = IoService::NORMAL);
+    // a mesh index drawn as the placeholder until replaceMesh gives it geometry
+    uint32_t reserveMesh();
+    void replaceMesh(
+      uint32_t mesh,
+      const std::vector<Vertex>& vertices,
+      const std::vector<std::vector<uint16_t>>& lodIndices,
+      const std::vector<float>& lodErrors
+    );
+    // Queues a sprite for the next drawFrame only. rect corners are moved by
+    // transform (2D affine, in pixels) on the CPU; sprites are sorted by layer,
+    // then pipeline and texture, keeping call order within each.
+    void drawSprite(
+      uint32_t texture,
+      const SpriteRect& rect,
+      const SpriteRect& uv = SpriteRect(),
+      const glm::vec4& color = glm::vec4(1.0f),
+      const glm::mat3& transform = glm::mat3(1.0f),
+      int16_t layer = 0,
+      uint32_t pipeline = 0
+    );
+    // compiles a sprite pipeline from its shader paths, returns its index
+    uint32_t addSpritePipeline(VulkanPipeline pipeline);
+    // Tiles are tileSize world pixels with tile (0, 0) at origin, drawn after
+    // the scene and before sprites, lowest layer first. Every tile starts empty.
+    uint32_t createTilemap(
+      uint32_t texture,
+      uint32_t width,
+      uint32_t height,
+      uint32_t layers,
+      glm::vec2 tileSize,
+      uint32_t atlasColumns,
+      uint32_t atlasRows,
+      glm::vec2 origin = glm::vec2(0.0f)
+    );
+    // only the chunk holding the tile is rebuilt, once it is next visible
+    void setTile(uint32_t map, uint32_t layer, uint32_t x, uint32_t y, uint16_t tile);
+    uint16_t getTile(uint32_t map, uint32_t layer, uint32_t x, uint32_t y);
+    // a whole layer at once, width * height tiles row by row
+    void setTiles(uint32_t map, uint32_t layer, const std::vector<uint16_t>& tiles);
+    void destroyTilemap(uint32_t map);
+    // drawn with additive blending after the scene's renderables, depth
+    // tested but not written; emitters are added to the returned system
+    uint32_t createParticleSystem(uint32_t capacity, uint32_t texture);
+    void destroyParticleSystem(uint32_t system);
+    Entity spawn(uint32_t pipeline, uint32_t mesh, uint32_t texture, const Transform& transform);
+    void despawn(Entity e);
+    void resize(int width, int height);
+    // both throw while a renderable, sprite, tilemap or particle system uses them
+    void destroyMesh(uint32_t mesh);
+    void destroyTexture(uint32_t texture);
+    void destroyBuffer(VkBuffer buffer, VkDeviceMemory memory);
+    // throws while a renderable uses it; the index stays reserved
+    void removePipeline(size_t pipelineIndex);
+    void markCommandBuffersDirty();
     void cleanup();
     void init(std::function<void(Renderer* renderer)> func);
     void drawFrame();
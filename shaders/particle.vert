@@ -0,0 +1,58 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// One camera facing quad per instance, read from the live particle list
+layout(set = 0, binding = 0) uniform CameraUniform {
+    mat4 view;
+    mat4 proj;
+} camera;
+
+struct Particle {
+    vec4 position;  // w: seconds left
+    vec4 velocity;  // w: lifetime
+    uint color;
+    float size;
+    float padding0;
+    float padding1;
+};
+
+layout(std430, set = 2, binding = 1) readonly buffer Particles {
+    Particle particles[];
+};
+
+layout(std430, set = 2, binding = 2) readonly buffer Alive {
+    uint alive[];
+};
+
+layout(std430, set = 2, binding = 5) readonly buffer Draw {
+    uint vertexCount;
+    uint instanceCount;
+    uint firstVertex;
+    uint firstInstance;
+    // the pool and alive list the finish stage left current
+    uint first;
+} draw;
+
+layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) out vec4 fragColor;
+
+const vec2 corners[6] = vec2[](
+  vec2(-0.5, -0.5), vec2(0.5, -0.5), vec2(0.5, 0.5),
+  vec2(0.5, 0.5), vec2(-0.5, 0.5), vec2(-0.5, -0.5)
+);
+
+void main() {
+  Particle p = particles[draw.first + alive[draw.first + uint(gl_InstanceIndex)]];
+  vec2 corner = corners[gl_VertexIndex];
+
+  // the view matrix's rows are the camera's right and up in world space
+  vec3 right = vec3(camera.view[0][0], camera.view[1][0], camera.view[2][0]);
+  vec3 up = vec3(camera.view[0][1], camera.view[1][1], camera.view[2][1]);
+  vec3 world = p.position.xyz + (right * corner.x + up * corner.y) * p.size;
+
+  gl_Position = camera.proj * camera.view * vec4(world, 1.0);
+  fragTexCoord = corner + 0.5;
+  fragColor = unpackUnorm4x8(p.color);
+  // fades out over its life
+  fragColor.a *= clamp(p.position.w / p.velocity.w, 0.0, 1.0);
+}
@@ -1,18 +1,18 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
+layout(set = 0, binding = 0) uniform CameraUniform {
     mat4 view;
     mat4 proj;
-} ubo;
+} camera;
 
 layout(location = 0) in vec2 inPosition;
 layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in mat4 inModel;
 
 layout(location = 0) out vec2 fragTexCoord;
 
 void main() {
-  gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 0.0, 1.0);
+  gl_Position = camera.proj * camera.view * inModel * vec4(inPosition, 0.0, 1.0);
   fragTexCoord = inTexCoord;
 }
@@ -0,0 +1,22 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// tile quads are baked in world pixels, view2D pans and zooms them
+layout(set = 0, binding = 0) uniform CameraUniform {
+    mat4 view;
+    mat4 proj;
+    mat4 view2D;
+} camera;
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inTexCoord;
+layout(location = 2) in vec4 inColor;
+
+layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) out vec4 fragColor;
+
+void main() {
+  gl_Position = camera.view2D * vec4(inPosition, 0.0, 1.0);
+  fragTexCoord = inTexCoord;
+  fragColor = inColor;
+}
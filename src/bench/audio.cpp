@@ -0,0 +1,82 @@
+#include "bench.hpp"
+#include "engine/audio.hpp"
+
+#include <cmath>
+
+static const uint32_t SAMPLE_RATE = 48000;
+static const uint32_t CLIP_SECONDS = 2;
+
+// looping stereo noise-ish tones, so every voice runs for the whole measurement
+static AudioClip makeClip(uint32_t seed) {
+  uint32_t frames = SAMPLE_RATE * CLIP_SECONDS;
+  std::vector<float> samples(frames * 2);
+  float frequency = 110.0f + seed * 7.0f;
+  for (uint32_t i = 0; i < frames; i++) {
+    float phase = 6.2831853f * frequency * i / SAMPLE_RATE;
+    samples[i * 2] = 0.25f * std::sin(phase);
+    samples[i * 2 + 1] = 0.25f * std::sin(phase * 1.01f);
+  }
+  return makeAudioClip(samples.data(), frames, 2, SAMPLE_RATE);
+}
+
+// mixes offline through the same path the device callback uses
+AudioResult runAudio(const AudioConfig& config) {
+  AudioResult result;
+  result.config = config;
+
+  AudioSettings settings;
+  settings.sampleRate = SAMPLE_RATE;
+  settings.bufferFrames = static_cast<uint16_t>(config.bufferFrames);
+  settings.maxVoices = config.voices;
+  settings.commandCapacity = config.voices * 2;
+
+  AudioMixer mixer;
+  mixer.prepare(settings);
+  std::vector<uint32_t> clips;
+  for (uint32_t i = 0; i < 16; i++) {
+    clips.push_back(mixer.addClip(makeClip(i)));
+  }
+  for (uint32_t i = 0; i < config.voices; i++) {
+    float pan = (i % 17) / 8.0f - 1.0f;
+    float pitch = config.pitched ? 0.75f + (i % 13) * 0.05f : 1.0f;
+    mixer.play(clips[i % clips.size()], 0.5f, pan, pitch, true, i % settings.buses);
+  }
+
+  std::vector<float> out(config.bufferFrames * 2);
+  // the first buffer takes the play commands
+  mixer.mix(out.data(), config.bufferFrames);
+
+  result.mixUs.reserve(config.buffers);
+  uint64_t allocations = hostAllocationCount();
+  double totalMs = 0.0;
+  for (uint32_t i = 0; i < config.buffers; i++) {
+    // a handful of parameter changes per buffer, like a game would send
+    mixer.setGain(i % config.voices + 1, 0.4f + (i % 5) * 0.05f);
+    mixer.setPan(i % config.voices + 1, (i % 9) / 4.0f - 1.0f);
+
+    auto start = Clock::now();
+    mixer.mix(out.data(), config.bufferFrames);
+    double ms = elapsedMs(start);
+    totalMs += ms;
+    result.mixUs.push_back(ms * 1000.0);
+  }
+  result.hostAllocations = hostAllocationCount() - allocations;
+
+  double meanMs = totalMs / config.buffers;
+  double bufferMs = 1000.0 * config.bufferFrames / SAMPLE_RATE;
+  result.voicesPerMs = config.voices / meanMs;
+  result.realtimeVoices = config.voices * bufferMs / meanMs;
+  return result;
+}
+
+void writeAudioResult(JsonWriter& json, const AudioResult& result) {
+  json.beginObject();
+  json.field("voices", result.config.voices);
+  json.field("bufferFrames", result.config.bufferFrames);
+  json.field("pitched", result.config.pitched);
+  writeTimes(json, "mixUs", result.mixUs);
+  json.field("voicesPerMs", result.voicesPerMs);
+  json.field("realtimeVoices", result.realtimeVoices);
+  json.field("hostAllocations", result.hostAllocations);
+  json.endObject();
+}
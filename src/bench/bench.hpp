@@ -0,0 +1,203 @@
+#ifndef MIX_BENCH_HPP
+#define MIX_BENCH_HPP
+#include "engine.hpp"
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+inline double elapsedMs(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct SceneConfig {
+  uint32_t objects = 1;
+  bool sharedTexture = true;
+  bool animated = false;
+  // a subdivided grid with levels of detail instead of the single quad
+  bool lodMesh = false;
+  // textures requested during init and streamed in while frames run
+  bool streaming = false;
+  // 2D sprites queued every frame on top of the objects, cycling over the textures
+  uint32_t sprites = 0;
+  // side of a two layer tilemap the 2D camera pans across, 0 for none
+  uint32_t tilemapSize = 0;
+  // GPU particle pool, kept about full by one emitter
+  uint32_t particles = 0;
+  // particle simulation on the compute queue when the device has one
+  bool asyncCompute = true;
+  // textures pushed while recording when the device supports it, instead of
+  // each owning a descriptor set
+  bool pushDescriptors = true;
+  // GPU frame time dynamic resolution holds, 0 to always render at full size
+  double targetFrameMs = 0.0;
+  uint32_t frames = 300;
+  // PNG of a frame drawn after the measured ones is written to this prefix, empty for none
+  std::string capturePrefix;
+};
+
+struct SceneResult {
+  SceneConfig config;
+  bool ok = true;
+  std::string error;
+
+  double startupMs = 0.0;
+  double timeToFirstFrameMs = 0.0;
+  // 0 when the textures didn't finish streaming within the measured frames
+  double timeToLoadedMs = 0.0;
+  double resizeMs = 0.0;
+  uint64_t bytesUploaded = 0;
+  double uploadSeconds = 0.0;
+
+  std::vector<double> cpuFrameMs;
+  std::vector<double> gpuFrameMs;
+
+  uint32_t drawCalls = 0;
+  // pipeline barriers the frame graph records per frame
+  uint32_t graphBarriers = 0;
+  double trianglesDrawn = 0.0;
+  double trianglesSaved = 0.0;
+  double objectsDrawn = 0.0;
+  double objectsFrustumCulled = 0.0;
+  double objectsOcclusionCulled = 0.0;
+  double spriteBatches = 0.0;
+  double tilemapChunksDrawn = 0.0;
+  double tilemapChunksRebuilt = 0.0;
+  double particlesAlive = 0.0;
+  // false when the device had no separate compute queue
+  bool asyncComputeUsed = false;
+  // false when the device had no VK_KHR_push_descriptor
+  bool pushDescriptorsUsed = false;
+  // mean render scale over the measured frames
+  double renderScale = 0.0;
+  // frames drawn after the captured one before its pixels arrived, 0 without a capture
+  uint32_t captureLatencyFrames = 0;
+  uint64_t deviceAllocations = 0;
+  uint64_t hostAllocations = 0;
+  uint64_t hostAllocationsPerFrame = 0;
+};
+
+struct HierarchyConfig {
+  uint32_t nodes = 1000000;
+  uint32_t fanout = 4;
+  unsigned threads = 1;
+  // fraction of nodes whose local transform changes each frame
+  double dirtyFraction = 1.0;
+  uint32_t frames = 100;
+};
+
+struct HierarchyResult {
+  HierarchyConfig config;
+  uint32_t depth = 0;
+  double sortMs = 0.0;
+  std::vector<double> updateMs;
+};
+
+struct BvhConfig {
+  uint32_t objects = 100000;
+  uint32_t queries = 10000;
+  // reader threads for the concurrent query pass
+  unsigned threads = 1;
+};
+
+struct BvhResult {
+  BvhConfig config;
+  uint32_t height = 0;
+  float incrementalCost = 0.0f;
+  float rebuildCost = 0.0f;
+  double rebuildMs = 0.0;
+  double insertPerSecond = 0.0;
+  double refitPerSecond = 0.0;
+  double reinsertPerSecond = 0.0;
+  double frustumPerSecond = 0.0;
+  double frustumHits = 0.0;
+  double rayPerSecond = 0.0;
+  double rayHits = 0.0;
+  double boxPerSecond = 0.0;
+  double boxHits = 0.0;
+  double concurrentBoxPerSecond = 0.0;
+};
+
+struct JobsConfig {
+  // workers plus the calling thread, which helps while it waits
+  unsigned threads = 1;
+  uint32_t repeats = 10;
+};
+
+struct JobsResult {
+  JobsConfig config;
+  // recursive fork/join: every job spawns two children and waits on them
+  double forkJoinJobsPerSecond = 0.0;
+  // parallelFor over a compute bound loop
+  std::vector<double> parallelForMs;
+  // jobs chained with runAfter, each released by the one before it
+  double chainLatencyUs = 0.0;
+};
+
+struct AudioConfig {
+  uint32_t voices = 256;
+  uint32_t bufferFrames = 256;
+  // every voice resampled at a non-unity pitch instead of copied straight
+  bool pitched = false;
+  uint32_t buffers = 2000;
+};
+
+struct AudioResult {
+  AudioConfig config;
+  std::vector<double> mixUs;
+  // voices mixed for one buffer per millisecond of mixing time
+  double voicesPerMs = 0.0;
+  // voices one core could keep mixing in real time
+  double realtimeVoices = 0.0;
+  // must stay 0, the callback isn't allowed to allocate
+  uint64_t hostAllocations = 0;
+};
+
+class JsonWriter {
+  std::ostream& out;
+  std::vector<bool> first;
+  bool afterKey = false;
+  void separator();
+  public:
+    JsonWriter(std::ostream& _out) : out(_out) {}
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+    void key(const std::string& name);
+    void value(const std::string& v);
+    void value(const char* v);
+    void value(bool v);
+    void value(double v);
+    void value(uint32_t v);
+    void value(uint64_t v);
+    template <typename T>
+    void field(const std::string& name, T v) {
+      key(name);
+      value(v);
+    }
+};
+
+uint64_t hostAllocationCount();
+
+void writeTimes(JsonWriter& json, const std::string& name, std::vector<double> times);
+
+SceneResult runScene(const SceneConfig& config);
+void writeSceneResult(JsonWriter& json, const SceneResult& result);
+
+HierarchyResult runHierarchy(const HierarchyConfig& config);
+void writeHierarchyResult(JsonWriter& json, const HierarchyResult& result);
+
+BvhResult runBvh(const BvhConfig& config);
+void writeBvhResult(JsonWriter& json, const BvhResult& result);
+
+JobsResult runJobs(const JobsConfig& config);
+void writeJobsResult(JsonWriter& json, const JobsResult& result);
+
+AudioResult runAudio(const AudioConfig& config);
+void writeAudioResult(JsonWriter& json, const AudioResult& result);
+#endif
@@ -0,0 +1,147 @@
+#include "bench.hpp"
+
+#include <cmath>
+#include <random>
+#include <thread>
+
+// random boxes in a cube sized so the density stays roughly constant
+static std::vector<AABB> randomBoxes(std::mt19937& rng, uint32_t count, float worldSize) {
+  std::uniform_real_distribution<float> position(0.0f, worldSize);
+  std::uniform_real_distribution<float> size(0.5f, 2.0f);
+
+  std::vector<AABB> boxes(count);
+  for (auto &box : boxes) {
+    box.min = glm::vec3(position(rng), position(rng), position(rng));
+    box.max = box.min + glm::vec3(size(rng), size(rng), size(rng));
+  }
+  return boxes;
+}
+
+static double perSecond(uint32_t operations, double ms) {
+  return ms > 0.0 ? operations / (ms / 1000.0) : 0.0;
+}
+
+BvhResult runBvh(const BvhConfig& config) {
+  BvhResult result;
+  result.config = config;
+
+  std::mt19937 rng(1234);
+  float worldSize = 10.0f * std::cbrt(static_cast<float>(config.objects));
+  std::vector<AABB> boxes = randomBoxes(rng, config.objects, worldSize);
+
+  BVH bvh;
+  std::vector<uint32_t> proxies(config.objects);
+  auto start = Clock::now();
+  for (uint32_t i = 0; i < config.objects; i++) {
+    proxies[i] = bvh.insert(boxes[i], i);
+  }
+  result.insertPerSecond = perSecond(config.objects, elapsedMs(start));
+  result.incrementalCost = bvh.cost();
+
+  start = Clock::now();
+  bvh.rebuild();
+  result.rebuildMs = elapsedMs(start);
+  result.rebuildCost = bvh.cost();
+  result.height = static_cast<uint32_t>(bvh.height());
+
+  // small moves stay inside the fat boxes, large ones force reinsertion
+  std::uniform_real_distribution<float> jitter(-1.0f, 1.0f);
+  for (float distance : {0.05f, 5.0f}) {
+    for (uint32_t i = 0; i < config.objects; i++) {
+      glm::vec3 offset(jitter(rng) * distance, jitter(rng) * distance, jitter(rng) * distance);
+      boxes[i].min = boxes[i].min + offset;
+      boxes[i].max = boxes[i].max + offset;
+    }
+    start = Clock::now();
+    bvh.move(proxies, boxes);
+    double ms = elapsedMs(start);
+    if (distance < 1.0f) result.refitPerSecond = perSecond(config.objects, ms);
+    else result.reinsertPerSecond = perSecond(config.objects, ms);
+  }
+
+  std::uniform_real_distribution<float> position(0.0f, worldSize);
+  std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+  std::vector<uint32_t> hits;
+  uint64_t totalHits = 0;
+
+  start = Clock::now();
+  for (uint32_t q = 0; q < config.queries; q++) {
+    glm::vec3 eye(position(rng), position(rng), position(rng));
+    glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(direction(rng), direction(rng), 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, worldSize * 0.1f);
+    hits.clear();
+    bvh.queryFrustum(Frustum::fromMatrix(proj * view), hits);
+    totalHits += hits.size();
+  }
+  result.frustumPerSecond = perSecond(config.queries, elapsedMs(start));
+  result.frustumHits = config.queries > 0 ? totalHits / static_cast<double>(config.queries) : 0.0;
+
+  totalHits = 0;
+  start = Clock::now();
+  for (uint32_t q = 0; q < config.queries; q++) {
+    Ray ray;
+    ray.origin = glm::vec3(position(rng), position(rng), position(rng));
+    ray.direction = glm::vec3(direction(rng), direction(rng), direction(rng));
+    hits.clear();
+    bvh.queryRay(ray, worldSize, hits);
+    totalHits += hits.size();
+  }
+  result.rayPerSecond = perSecond(config.queries, elapsedMs(start));
+  result.rayHits = config.queries > 0 ? totalHits / static_cast<double>(config.queries) : 0.0;
+
+  std::vector<AABB> queryBoxes = randomBoxes(rng, config.queries, worldSize);
+  for (auto &box : queryBoxes) {
+    box.max = box.min + glm::vec3(worldSize * 0.05f);
+  }
+
+  totalHits = 0;
+  start = Clock::now();
+  for (auto &box : queryBoxes) {
+    hits.clear();
+    bvh.queryBox(box, hits);
+    totalHits += hits.size();
+  }
+  result.boxPerSecond = perSecond(config.queries, elapsedMs(start));
+  result.boxHits = config.queries > 0 ? totalHits / static_cast<double>(config.queries) : 0.0;
+
+  // the same box queries split across reader threads sharing the tree
+  start = Clock::now();
+  std::vector<std::thread> readers;
+  for (unsigned t = 0; t < config.threads; t++) {
+    readers.emplace_back([&, t]() {
+      std::vector<uint32_t> local;
+      for (size_t q = t; q < queryBoxes.size(); q += config.threads) {
+        local.clear();
+        bvh.queryBox(queryBoxes[q], local);
+      }
+    });
+  }
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  result.concurrentBoxPerSecond = perSecond(config.queries, elapsedMs(start));
+
+  return result;
+}
+
+void writeBvhResult(JsonWriter& json, const BvhResult& result) {
+  json.beginObject();
+  json.field("objects", result.config.objects);
+  json.field("queries", result.config.queries);
+  json.field("threads", static_cast<uint32_t>(result.config.threads));
+  json.field("height", result.height);
+  json.field("incrementalCost", static_cast<double>(result.incrementalCost));
+  json.field("rebuildCost", static_cast<double>(result.rebuildCost));
+  json.field("rebuildMs", result.rebuildMs);
+  json.field("insertPerSecond", result.insertPerSecond);
+  json.field("refitPerSecond", result.refitPerSecond);
+  json.field("reinsertPerSecond", result.reinsertPerSecond);
+  json.field("frustumPerSecond", result.frustumPerSecond);
+  json.field("frustumHits", result.frustumHits);
+  json.field("rayPerSecond", result.rayPerSecond);
+  json.field("rayHits", result.rayHits);
+  json.field("boxPerSecond", result.boxPerSecond);
+  json.field("boxHits", result.boxHits);
+  json.field("concurrentBoxPerSecond", result.concurrentBoxPerSecond);
+  json.endObject();
+}
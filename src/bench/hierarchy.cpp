@@ -0,0 +1,65 @@
+#include "bench.hpp"
+
+#include <algorithm>
+
+// builds a complete tree where node i hangs off node (i - 1) / fanout, then
+// times world matrix updates with a given share of nodes touched per frame
+HierarchyResult runHierarchy(const HierarchyConfig& config) {
+  HierarchyResult result;
+  result.config = config;
+
+  World world;
+  std::vector<Entity> entities(config.nodes);
+  for (uint32_t i = 0; i < config.nodes; i++) {
+    entities[i] = world.create();
+
+    Transform transform;
+    transform.position = glm::vec3(1.0f, 0.0f, 0.0f);
+    transform.rotation = glm::angleAxis(0.1f, glm::vec3(0.0f, 0.0f, 1.0f));
+    transform.scale = glm::vec3(0.99f);
+    world.transforms.insert(entities[i], transform);
+    if (i > 0) {
+      world.transforms.setParent(entities[i], entities[(i - 1) / config.fanout]);
+    }
+  }
+
+  // the first update pays for sorting into levels and computing every node
+  auto start = Clock::now();
+  world.transforms.updateWorld(config.threads);
+  result.sortMs = elapsedMs(start);
+
+  for (uint32_t i = config.nodes > 0 ? config.nodes - 1 : 0; i > 0; i = (i - 1) / config.fanout) {
+    result.depth++;
+  }
+
+  TransformStorage& transforms = world.transforms;
+  size_t step = config.dirtyFraction > 0.0 ? std::max<size_t>(1, static_cast<size_t>(1.0 / config.dirtyFraction)) : 0;
+  result.updateMs.reserve(config.frames);
+  for (uint32_t frame = 0; frame < config.frames; frame++) {
+    if (step > 0) {
+      glm::quat spin = glm::angleAxis(frame * 0.01f, glm::vec3(0.0f, 0.0f, 1.0f));
+      for (size_t i = frame % step; i < transforms.size(); i += step) {
+        transforms.rotation[i] = spin;
+        transforms.dirty[i] = 1;
+      }
+    }
+
+    start = Clock::now();
+    transforms.updateWorld(config.threads);
+    result.updateMs.push_back(elapsedMs(start));
+  }
+  return result;
+}
+
+void writeHierarchyResult(JsonWriter& json, const HierarchyResult& result) {
+  json.beginObject();
+  json.field("nodes", result.config.nodes);
+  json.field("fanout", result.config.fanout);
+  json.field("depth", result.depth);
+  json.field("threads", static_cast<uint32_t>(result.config.threads));
+  json.field("dirtyFraction", result.config.dirtyFraction);
+  json.field("frames", result.config.frames);
+  json.field("sortMs", result.sortMs);
+  writeTimes(json, "updateMs", result.updateMs);
+  json.endObject();
+}
@@ -0,0 +1,61 @@
+#include "bench.hpp"
+#include "engine/jobs.hpp"
+
+#include <cmath>
+
+static const uint32_t FORK_DEPTH = 18;
+static const size_t LOOP_SIZE = 1 << 22;
+static const uint32_t CHAIN_LENGTH = 10000;
+
+static void forkJoin(JobSystem& jobs, uint32_t depth) {
+  if (depth == 0) return;
+  JobCounter children;
+  jobs.run([&jobs, depth]() { forkJoin(jobs, depth - 1); }, &children);
+  forkJoin(jobs, depth - 1);
+  jobs.wait(children);
+}
+
+// the same three workloads at every thread count, so results scale against threads = 1
+JobsResult runJobs(const JobsConfig& config) {
+  JobsResult result;
+  result.config = config;
+  JobSystem jobs(config.threads > 0 ? config.threads - 1 : 0);
+
+  // 2^depth - 1 jobs, spawned and stolen from inside workers
+  auto start = Clock::now();
+  forkJoin(jobs, FORK_DEPTH);
+  result.forkJoinJobsPerSecond = ((1u << FORK_DEPTH) - 1) / (elapsedMs(start) / 1000.0);
+
+  std::vector<float> values(LOOP_SIZE);
+  for (uint32_t repeat = 0; repeat < config.repeats; repeat++) {
+    start = Clock::now();
+    jobs.parallelFor(values.size(), 4096, [&values](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        float x = static_cast<float>(i);
+        values[i] = std::sqrt(x) * std::sin(x) + std::cos(x * 0.5f);
+      }
+    });
+    result.parallelForMs.push_back(elapsedMs(start));
+  }
+
+  // every job waits for the previous one, so this is pure scheduling latency
+  std::vector<JobCounter> links(CHAIN_LENGTH);
+  start = Clock::now();
+  jobs.run([]() {}, &links[0]);
+  for (uint32_t i = 1; i < CHAIN_LENGTH; i++) {
+    jobs.runAfter(links[i - 1], []() {}, &links[i]);
+  }
+  jobs.wait(links.back());
+  result.chainLatencyUs = elapsedMs(start) * 1000.0 / CHAIN_LENGTH;
+
+  return result;
+}
+
+void writeJobsResult(JsonWriter& json, const JobsResult& result) {
+  json.beginObject();
+  json.field("threads", static_cast<uint32_t>(result.config.threads));
+  json.field("forkJoinJobsPerSecond", result.forkJoinJobsPerSecond);
+  writeTimes(json, "parallelForMs", result.parallelForMs);
+  json.field("chainLatencyUs", result.chainLatencyUs);
+  json.endObject();
+}
@@ -0,0 +1,116 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+void JsonWriter::separator() {
+  if (afterKey) {
+    afterKey = false;
+    return;
+  }
+  if (first.empty()) return;
+  if (!first.back()) out << ',';
+  first.back() = false;
+}
+
+void JsonWriter::beginObject() {
+  separator();
+  out << '{';
+  first.push_back(true);
+}
+
+void JsonWriter::endObject() {
+  first.pop_back();
+  out << '}';
+}
+
+void JsonWriter::beginArray() {
+  separator();
+  out << '[';
+  first.push_back(true);
+}
+
+void JsonWriter::endArray() {
+  first.pop_back();
+  out << ']';
+}
+
+void JsonWriter::key(const std::string& name) {
+  value(name);
+  out << ':';
+  afterKey = true;
+}
+
+void JsonWriter::value(const std::string& v) {
+  separator();
+  out << '"';
+  for (char c : v) {
+    switch (c) {
+      case '"': out << "\\\""; break;
+      case '\\': out << "\\\\"; break;
+      case '\n': out << "\\n"; break;
+      case '\t': out << "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char escaped[8];
+          std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          out << escaped;
+        }
+        else {
+          out << c;
+        }
+    }
+  }
+  out << '"';
+}
+
+void JsonWriter::value(const char* v) {
+  value(std::string(v));
+}
+
+void JsonWriter::value(bool v) {
+  separator();
+  out << (v ? "true" : "false");
+}
+
+void JsonWriter::value(double v) {
+  separator();
+  if (std::isfinite(v)) {
+    out << v;
+  }
+  else {
+    out << "null";
+  }
+}
+
+void JsonWriter::value(uint32_t v) {
+  separator();
+  out << v;
+}
+
+void JsonWriter::value(uint64_t v) {
+  separator();
+  out << v;
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0.0;
+  size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+void writeTimes(JsonWriter& json, const std::string& name, std::vector<double> times) {
+  std::sort(times.begin(), times.end());
+  double sum = 0.0;
+  for (double t : times) sum += t;
+
+  json.key(name);
+  json.beginObject();
+  json.field("mean", times.empty() ? 0.0 : sum / times.size());
+  json.field("p50", percentile(times, 0.50));
+  json.field("p90", percentile(times, 0.90));
+  json.field("p99", percentile(times, 0.99));
+  json.field("max", times.empty() ? 0.0 : times.back());
+  json.endObject();
+}
@@ -0,0 +1,327 @@
+#include "bench.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <thread>
+
+static std::atomic<uint64_t> hostAllocations(0);
+
+void* operator new(std::size_t size) {
+  hostAllocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+uint64_t hostAllocationCount() {
+  return hostAllocations.load(std::memory_order_relaxed);
+}
+
+static std::vector<uint32_t> parseCounts(const std::string& list) {
+  std::vector<uint32_t> counts;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    counts.push_back(static_cast<uint32_t>(std::stoul(item)));
+  }
+  return counts;
+}
+
+static void usage() {
+  std::cerr <<
+    "usage: mix-bench [options]\n"
+    "  --objects N[,N...]            object counts (default 1,100,1000,10000,100000)\n"
+    "  --textures shared|unique|both (default both)\n"
+    "  --transforms static|animated|both (default both)\n"
+    "  --mesh quad|grid|both         grid uses 4 levels of detail (default quad)\n"
+    "  --loading blocking|streaming|both\n"
+    "                                load textures in init or stream them in (default blocking)\n"
+    "  --sprites N                   sprites drawn each frame on top of the scene (default 0)\n"
+    "  --tilemap N                   pan across an N x N tilemap each frame (default 0, none)\n"
+    "  --particles N                 GPU particle pool kept full by one emitter (default 0)\n"
+    "  --compute async|graphics      queue the particle simulation runs on (default async)\n"
+    "  --descriptors push|sets       push textures while recording, or bind a set per texture (default push)\n"
+    "  --target-ms X                 scale the render resolution to hold X ms of GPU time (default off)\n"
+    "  --frames N                    frames measured per scene (default 300)\n"
+    "  --capture DIR                 write a PNG of each scene to DIR after its measured frames\n"
+    "  --suite scenes|hierarchy|bvh|jobs|audio|all\n"
+    "                                which benchmarks to run (default all)\n"
+    "  --nodes N                     transform hierarchy size (default 1000000)\n"
+    "  --threads N[,N...]            hierarchy update and BVH reader threads (default 1 and all cores);\n"
+    "                                job system threads (default powers of two up to all cores)\n"
+    "  --bvh-objects N[,N...]        BVH sizes (default 10000,100000,1000000)\n"
+    "  --voices N[,N...]             audio mixer voice counts (default 64,256,1024)\n"
+    "  --buffer-frames N             audio mixer buffer size (default 256)\n"
+    "  --out FILE                    write JSON results to FILE instead of stdout\n";
+}
+
+int main(int argc, char** argv) {
+  std::vector<uint32_t> objectCounts = {1, 100, 1000, 10000, 100000};
+  std::vector<bool> textureModes = {true, false};
+  std::vector<bool> transformModes = {false, true};
+  std::vector<bool> meshModes = {false};
+  std::vector<bool> loadingModes = {false};
+  uint32_t sprites = 0;
+  uint32_t tilemapSize = 0;
+  uint32_t particles = 0;
+  bool asyncCompute = true;
+  bool pushDescriptors = true;
+  double targetFrameMs = 0.0;
+  uint32_t frames = 300;
+  std::string captureDir;
+  std::string suite = "all";
+  uint32_t nodes = 1000000;
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<uint32_t> threadCounts = {1, cores};
+  std::vector<uint32_t> jobThreadCounts;
+  for (uint32_t threads = 1; threads < cores; threads *= 2) {
+    jobThreadCounts.push_back(threads);
+  }
+  jobThreadCounts.push_back(cores);
+  std::vector<uint32_t> bvhCounts = {10000, 100000, 1000000};
+  std::vector<uint32_t> voiceCounts = {64, 256, 1024};
+  uint32_t bufferFrames = 256;
+  std::string outPath;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      usage();
+      return 1;
+    }
+    std::string next = argv[++i];
+    if (arg == "--objects") {
+      objectCounts = parseCounts(next);
+    }
+    else if (arg == "--textures") {
+      if (next == "both") textureModes = {true, false};
+      else textureModes = {next == "shared"};
+    }
+    else if (arg == "--transforms") {
+      if (next == "both") transformModes = {false, true};
+      else transformModes = {next == "animated"};
+    }
+    else if (arg == "--mesh") {
+      if (next == "both") meshModes = {false, true};
+      else meshModes = {next == "grid"};
+    }
+    else if (arg == "--loading") {
+      if (next == "both") loadingModes = {false, true};
+      else loadingModes = {next == "streaming"};
+    }
+    else if (arg == "--sprites") {
+      sprites = static_cast<uint32_t>(std::stoul(next));
+    }
+    else if (arg == "--tilemap") {
+      tilemapSize = static_cast<uint32_t>(std::stoul(next));
+    }
+    else if (arg == "--particles") {
+      particles = static_cast<uint32_t>(std::stoul(next));
+    }
+    else if (arg == "--compute") {
+      asyncCompute = next == "async";
+    }
+    else if (arg == "--descriptors") {
+      pushDescriptors = next == "push";
+    }
+    else if (arg == "--target-ms") {
+      targetFrameMs = std::stod(next);
+    }
+    else if (arg == "--frames") {
+      frames = static_cast<uint32_t>(std::stoul(next));
+    }
+    else if (arg == "--capture") {
+      captureDir = next;
+    }
+    else if (arg == "--suite") {
+      suite = next;
+    }
+    else if (arg == "--nodes") {
+      nodes = static_cast<uint32_t>(std::stoul(next));
+    }
+    else if (arg == "--threads") {
+      threadCounts = parseCounts(next);
+      jobThreadCounts = threadCounts;
+    }
+    else if (arg == "--bvh-objects") {
+      bvhCounts = parseCounts(next);
+    }
+    else if (arg == "--voices") {
+      voiceCounts = parseCounts(next);
+    }
+    else if (arg == "--buffer-frames") {
+      bufferFrames = static_cast<uint32_t>(std::stoul(next));
+    }
+    else if (arg == "--out") {
+      outPath = next;
+    }
+    else {
+      usage();
+      return 1;
+    }
+  }
+
+  bool runScenes = suite == "all" || suite == "scenes";
+  bool runHierarchies = suite == "all" || suite == "hierarchy";
+  bool runBvhs = suite == "all" || suite == "bvh";
+  bool runJobSystem = suite == "all" || suite == "jobs";
+  bool runMixer = suite == "all" || suite == "audio";
+  if (!runScenes && !runHierarchies && !runBvhs && !runJobSystem && !runMixer) {
+    usage();
+    return 1;
+  }
+
+  // startup is measured with the same cooked assets the engine loads
+  AssetManifest::loaded().load("assets.manifest");
+  AssetPack::mounted().open("assets.pack");
+
+  std::vector<SceneResult> results;
+  for (uint32_t objects : runScenes ? objectCounts : std::vector<uint32_t>()) {
+    for (bool sharedTexture : textureModes) {
+      for (bool animated : transformModes) {
+        for (bool lodMesh : meshModes) {
+          for (bool streaming : loadingModes) {
+            SceneConfig config;
+            config.objects = objects;
+            config.sharedTexture = sharedTexture;
+            config.animated = animated;
+            config.lodMesh = lodMesh;
+            config.streaming = streaming;
+            config.sprites = sprites;
+            config.tilemapSize = tilemapSize;
+            config.particles = particles;
+            config.asyncCompute = asyncCompute;
+            config.pushDescriptors = pushDescriptors;
+            config.targetFrameMs = targetFrameMs;
+            config.frames = frames;
+            if (!captureDir.empty()) {
+              std::ostringstream prefix;
+              prefix << captureDir << "/scene-" << objects << "-"
+                << (sharedTexture ? "shared" : "unique") << "-"
+                << (animated ? "animated" : "static") << "-"
+                << (lodMesh ? "grid" : "quad") << "-"
+                << (streaming ? "streaming" : "blocking") << "-";
+              config.capturePrefix = prefix.str();
+            }
+            std::cerr << "scene: " << objects << " objects, "
+              << (sharedTexture ? "shared" : "unique") << " textures, "
+              << (animated ? "animated" : "static") << ", "
+              << (lodMesh ? "grid" : "quad") << " mesh, "
+              << (streaming ? "streaming" : "blocking") << std::endl;
+            results.push_back(runScene(config));
+          }
+        }
+      }
+    }
+  }
+
+  std::vector<HierarchyResult> hierarchyResults;
+  if (runHierarchies) {
+    for (uint32_t threads : threadCounts) {
+      for (double dirtyFraction : {1.0, 0.01}) {
+        HierarchyConfig config;
+        config.nodes = nodes;
+        config.threads = threads;
+        config.dirtyFraction = dirtyFraction;
+        std::cerr << "hierarchy: " << nodes << " nodes, " << threads << " threads, "
+          << dirtyFraction * 100.0 << "% dirty" << std::endl;
+        hierarchyResults.push_back(runHierarchy(config));
+      }
+    }
+  }
+
+  std::vector<BvhResult> bvhResults;
+  if (runBvhs) {
+    for (uint32_t objects : bvhCounts) {
+      BvhConfig config;
+      config.objects = objects;
+      config.threads = threadCounts.back();
+      std::cerr << "bvh: " << objects << " objects" << std::endl;
+      bvhResults.push_back(runBvh(config));
+    }
+  }
+
+  std::vector<JobsResult> jobsResults;
+  if (runJobSystem) {
+    for (uint32_t threads : jobThreadCounts) {
+      JobsConfig config;
+      config.threads = threads;
+      std::cerr << "jobs: " << threads << " threads" << std::endl;
+      jobsResults.push_back(runJobs(config));
+    }
+  }
+
+  std::vector<AudioResult> audioResults;
+  if (runMixer) {
+    for (uint32_t voices : voiceCounts) {
+      for (bool pitched : {false, true}) {
+        AudioConfig config;
+        config.voices = voices;
+        config.bufferFrames = bufferFrames;
+        config.pitched = pitched;
+        std::cerr << "audio: " << voices << " voices, " << bufferFrames << " frames, "
+          << (pitched ? "pitched" : "unity pitch") << std::endl;
+        audioResults.push_back(runAudio(config));
+      }
+    }
+  }
+
+  std::ofstream file;
+  if (!outPath.empty()) {
+    file.open(outPath);
+    if (!file.is_open()) {
+      std::cerr << "failed to open " << outPath << std::endl;
+      return 1;
+    }
+  }
+  std::ostream& out = outPath.empty() ? std::cout : file;
+
+  JsonWriter json(out);
+  json.beginObject();
+  json.field("benchmark", "mix-bench");
+  json.key("scenes");
+  json.beginArray();
+  for (auto &result : results) {
+    writeSceneResult(json, result);
+  }
+  json.endArray();
+  json.key("hierarchy");
+  json.beginArray();
+  for (auto &result : hierarchyResults) {
+    writeHierarchyResult(json, result);
+  }
+  json.endArray();
+  json.key("bvh");
+  json.beginArray();
+  for (auto &result : bvhResults) {
+    writeBvhResult(json, result);
+  }
+  json.endArray();
+  json.key("jobs");
+  json.beginArray();
+  for (auto &result : jobsResults) {
+    writeJobsResult(json, result);
+  }
+  json.endArray();
+  json.key("audio");
+  json.beginArray();
+  for (auto &result : audioResults) {
+    writeAudioResult(json, result);
+  }
+  json.endArray();
+  json.endObject();
+  out << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,256 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static const char* texturePath = "../assets/patch.png";
+
+// lays the objects out in a square grid that always fits in front of the camera
+static Transform placement(const SceneConfig& config, uint32_t index, float time) {
+  uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(config.objects))));
+  float spacing = 3.0f / side;
+  float x = (index % side + 0.5f) * spacing - 1.5f;
+  float y = (index / side + 0.5f) * spacing - 1.5f;
+
+  // the grid lies in the quad's local xy plane, tipped -90 degrees about x
+  Transform transform;
+  transform.position = glm::vec3(x, 0.0f, -y);
+  transform.rotation = glm::angleAxis(glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+  if (config.animated) {
+    transform.rotation = transform.rotation * glm::angleAxis(time + index * 0.1f, glm::vec3(0.0f, 0.0f, 1.0f));
+  }
+  transform.scale = glm::vec3(spacing * 0.9f);
+  return transform;
+}
+
+static void createScene(VulkanRenderer* vulkan, const SceneConfig& config, std::vector<uint32_t>& textures) {
+  vulkan->createDescriptorPool(config.sharedTexture ? 1 : config.objects);
+  VulkanPipeline pipeline;
+  pipeline.vertShaderPath = "shaders/vert.spv";
+  pipeline.fragShaderPath = "shaders/frag.spv";
+  vulkan->createGraphicsPipeline(pipeline);
+  vulkan->pipelines.push_back(pipeline);
+
+  uint32_t mesh = config.lodMesh ? vulkan->createGridMesh(32, 4) : vulkan->createQuadMesh();
+  uint32_t texture = 0;
+  for (uint32_t i = 0; i < config.objects; i++) {
+    if (i == 0 || !config.sharedTexture) {
+      texture = config.streaming ? vulkan->requestTexture(texturePath) : vulkan->createTexture(texturePath);
+      textures.push_back(texture);
+    }
+    vulkan->spawn(0, mesh, texture, placement(config, i, 0.0f));
+  }
+
+  if (config.tilemapSize > 0) {
+    // ground on layer 0 everywhere, a sparse pattern of cells from a 4x4 atlas over it
+    uint32_t size = config.tilemapSize;
+    uint32_t atlas = textures.empty() ? vulkan->placeholderTexture : textures[0];
+    uint32_t map = vulkan->createTilemap(atlas, size, size, 2, glm::vec2(16.0f), 4, 4);
+    std::vector<uint16_t> ground(size_t(size) * size, 1);
+    std::vector<uint16_t> detail(size_t(size) * size, 0);
+    for (size_t i = 0; i < detail.size(); i += 7) {
+      detail[i] = static_cast<uint16_t>(2 + i % 15);
+    }
+    vulkan->setTiles(map, 0, ground);
+    vulkan->setTiles(map, 1, detail);
+  }
+
+  if (config.particles > 0) {
+    uint32_t system = vulkan->createParticleSystem(config.particles, textures.empty() ? vulkan->placeholderTexture : textures[0]);
+    ParticleEmitter emitter;
+    emitter.lifetime = 2.0f;
+    emitter.rate = config.particles / emitter.lifetime;
+    emitter.velocity = glm::vec3(0.0f, 0.0f, 3.0f);
+    emitter.spread = 1.0f;
+    vulkan->particleSystems[system].emitters.push_back(emitter);
+  }
+}
+
+// small quads drifting across the window, spread over layers so the batcher
+// has to sort them back together by texture
+static void drawSprites(VulkanRenderer& renderer, const SceneConfig& config, const std::vector<uint32_t>& textures, float time) {
+  if (textures.empty()) return;
+  VkExtent2D extent = renderer.swapchainExtent;
+  SpriteRect rect;
+  rect.min = glm::vec2(-8.0f);
+  rect.max = glm::vec2(8.0f);
+  for (uint32_t i = 0; i < config.sprites; i++) {
+    float x = std::fmod(i * 37.0f + time * 60.0f, static_cast<float>(extent.width));
+    float y = std::fmod(i * 53.0f, static_cast<float>(extent.height));
+    glm::mat3 transform(1.0f);
+    transform[2] = glm::vec3(x, y, 1.0f);
+    renderer.drawSprite(
+      textures[i % textures.size()], rect, SpriteRect(), glm::vec4(1.0f), transform,
+      static_cast<int16_t>(i % 4));
+  }
+}
+
+SceneResult runScene(const SceneConfig& config) {
+  SceneResult result;
+  result.config = config;
+
+  VulkanRenderer renderer;
+  std::vector<uint32_t> textures;
+  try {
+    uint64_t hostStart = hostAllocationCount();
+    auto start = Clock::now();
+    renderer.asyncCompute = config.asyncCompute;
+    renderer.pushDescriptors = config.pushDescriptors;
+    renderer.dynamicResolution = config.targetFrameMs > 0.0;
+    renderer.targetFrameMs = static_cast<float>(config.targetFrameMs);
+    renderer.init([&config, &textures](Renderer* r) {
+      createScene((VulkanRenderer*)r, config, textures);
+    });
+    result.startupMs = elapsedMs(start);
+
+    result.cpuFrameMs.reserve(config.frames);
+    result.gpuFrameMs.reserve(config.frames);
+
+    uint64_t framesStart = hostAllocationCount();
+    for (uint32_t frame = 0; frame < config.frames; frame++) {
+      SDL_Event e;
+      while (SDL_PollEvent(&e)) {}
+
+      auto frameStart = Clock::now();
+      if (config.animated) {
+        float time = frame / 60.0f;
+        // entity indices follow spawn order since nothing is destroyed
+        TransformStorage& transforms = renderer.scene.transforms;
+        for (uint32_t i = 0; i < transforms.size(); i++) {
+          transforms.rotation[i] = placement(config, entityIndex(transforms.entities()[i]), time).rotation;
+          transforms.dirty[i] = 1;
+        }
+      }
+      drawSprites(renderer, config, textures, frame / 60.0f);
+      if (config.tilemapSize > 0) {
+        // diagonally across the map, editing a tile under the camera every tenth frame
+        float extent = config.tilemapSize * 16.0f;
+        renderer.camera2D.position = glm::vec2(std::fmod(frame * 8.0f, extent));
+        if (frame % 10 == 0) {
+          uint32_t tile = static_cast<uint32_t>(renderer.camera2D.position.x / 16.0f);
+          renderer.setTile(0, 1, tile, tile, static_cast<uint16_t>(1 + frame % 16));
+        }
+      }
+      renderer.drawFrame();
+      result.cpuFrameMs.push_back(elapsedMs(frameStart));
+      result.gpuFrameMs.push_back(renderer.stats.gpuFrameMs);
+      result.trianglesDrawn += renderer.stats.trianglesDrawn;
+      result.trianglesSaved += renderer.stats.trianglesSaved;
+      result.objectsDrawn += renderer.stats.objectsDrawn;
+      result.objectsFrustumCulled += renderer.stats.objectsFrustumCulled;
+      result.objectsOcclusionCulled += renderer.stats.objectsOcclusionCulled;
+      result.spriteBatches += renderer.stats.spriteBatches;
+      result.tilemapChunksDrawn += renderer.stats.tilemapChunksDrawn;
+      result.tilemapChunksRebuilt += renderer.stats.tilemapChunksRebuilt;
+      result.particlesAlive += renderer.stats.particlesAlive;
+      result.asyncComputeUsed = renderer.stats.asyncCompute;
+      result.renderScale += renderer.stats.renderScale;
+    }
+    if (config.frames > 0) {
+      result.trianglesDrawn /= config.frames;
+      result.trianglesSaved /= config.frames;
+      result.objectsDrawn /= config.frames;
+      result.objectsFrustumCulled /= config.frames;
+      result.objectsOcclusionCulled /= config.frames;
+      result.spriteBatches /= config.frames;
+      result.tilemapChunksDrawn /= config.frames;
+      result.tilemapChunksRebuilt /= config.frames;
+      result.particlesAlive /= config.frames;
+      result.renderScale /= config.frames;
+      result.hostAllocationsPerFrame = (hostAllocationCount() - framesStart) / config.frames;
+    }
+    result.drawCalls = renderer.stats.drawCalls;
+    result.pushDescriptorsUsed = renderer.stats.pushDescriptors;
+    result.graphBarriers = renderer.stats.graphBarriers;
+    // streamed textures upload during the frames, so these are read after them
+    result.bytesUploaded = renderer.stats.bytesUploaded;
+    result.uploadSeconds = renderer.stats.uploadSeconds;
+    result.timeToFirstFrameMs = renderer.stats.timeToFirstFrameMs;
+    result.timeToLoadedMs = renderer.stats.timeToLoadedMs;
+
+    // drawn after the measured frames so encoding doesn't count against them
+    if (!config.capturePrefix.empty() && renderer.captureSupported()) {
+      FrameWriter writer(config.capturePrefix);
+      bool delivered = false;
+      renderer.captureFrame([&writer, &delivered](CapturedFrame& captured) {
+        writer.write(std::move(captured));
+        delivered = true;
+      });
+      for (uint32_t frame = 0; frame < 8 && !delivered; frame++) {
+        drawSprites(renderer, config, textures, config.frames / 60.0f);
+        renderer.drawFrame();
+        if (frame > 0) {
+          result.captureLatencyFrames++;
+        }
+      }
+      renderer.finishCaptures();
+      writer.flush();
+    }
+
+    VkExtent2D extent = renderer.swapchainExtent;
+    start = Clock::now();
+    renderer.resize(extent.width / 2, extent.height / 2);
+    result.resizeMs = elapsedMs(start);
+
+    result.deviceAllocations = renderer.stats.deviceAllocations;
+    result.hostAllocations = hostAllocationCount() - hostStart;
+
+    renderer.cleanup();
+  }
+  catch (EngineException &e) {
+    result.ok = false;
+    result.error = e.what();
+  }
+  return result;
+}
+
+void writeSceneResult(JsonWriter& json, const SceneResult& result) {
+  json.beginObject();
+  json.field("objects", result.config.objects);
+  json.field("textures", result.config.sharedTexture ? "shared" : "unique");
+  json.field("transforms", result.config.animated ? "animated" : "static");
+  json.field("mesh", result.config.lodMesh ? "grid" : "quad");
+  json.field("loading", result.config.streaming ? "streaming" : "blocking");
+  json.field("sprites", result.config.sprites);
+  json.field("tilemapSize", result.config.tilemapSize);
+  json.field("particles", result.config.particles);
+  json.field("asyncCompute", result.config.asyncCompute);
+  json.field("descriptors", result.config.pushDescriptors ? "push" : "sets");
+  json.field("targetFrameMs", result.config.targetFrameMs);
+  json.field("frames", result.config.frames);
+  json.field("ok", result.ok);
+  if (!result.ok) {
+    json.field("error", result.error);
+    json.endObject();
+    return;
+  }
+  json.field("startupMs", result.startupMs);
+  json.field("timeToFirstFrameMs", result.timeToFirstFrameMs);
+  json.field("timeToLoadedMs", result.timeToLoadedMs);
+  json.field("resizeMs", result.resizeMs);
+  json.field("bytesUploaded", result.bytesUploaded);
+  json.field("uploadMBps", result.uploadSeconds > 0.0 ? result.bytesUploaded / result.uploadSeconds / 1e6 : 0.0);
+  writeTimes(json, "cpuFrameMs", result.cpuFrameMs);
+  writeTimes(json, "gpuFrameMs", result.gpuFrameMs);
+  json.field("drawCalls", result.drawCalls);
+  json.field("graphBarriers", result.graphBarriers);
+  json.field("trianglesDrawnPerFrame", result.trianglesDrawn);
+  json.field("trianglesSavedPerFrame", result.trianglesSaved);
+  json.field("objectsDrawnPerFrame", result.objectsDrawn);
+  json.field("objectsFrustumCulledPerFrame", result.objectsFrustumCulled);
+  json.field("objectsOcclusionCulledPerFrame", result.objectsOcclusionCulled);
+  json.field("spriteBatchesPerFrame", result.spriteBatches);
+  json.field("tilemapChunksDrawnPerFrame", result.tilemapChunksDrawn);
+  json.field("tilemapChunksRebuiltPerFrame", result.tilemapChunksRebuilt);
+  json.field("particlesAlivePerFrame", result.particlesAlive);
+  json.field("asyncComputeUsed", result.asyncComputeUsed);
+  json.field("pushDescriptorsUsed", result.pushDescriptorsUsed);
+  json.field("renderScale", result.renderScale);
+  if (!result.config.capturePrefix.empty()) {
+    json.field("captureLatencyFrames", result.captureLatencyFrames);
+  }
+  json.field("deviceAllocations", result.deviceAllocations);
+  json.field("hostAllocations", result.hostAllocations);
+  json.field("hostAllocationsPerFrame", result.hostAllocationsPerFrame);
+  json.endObject();
+}
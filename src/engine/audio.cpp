@@ -0,0 +1,601 @@
+#include "engine/audio.hpp"
+#include "engine/exception.hpp"
+#include "engine/utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#define file "src/engine/audio.cpp"
+
+AudioClip makeAudioClip(const float* interleaved, uint32_t frames, uint32_t channels, uint32_t sampleRate) {
+  AudioClip clip;
+  clip.frames = frames;
+  // the mixer is stereo, anything past the first two channels is dropped
+  clip.channels = std::min<uint32_t>(std::max<uint32_t>(channels, 1), 2);
+  clip.sampleRate = sampleRate;
+
+  size_t stride = frames + AUDIO_CLIP_PADDING;
+  clip.samples.assign(stride * clip.channels, 0.0f);
+  for (uint32_t c = 0; c < clip.channels; c++) {
+    float* dst = clip.samples.data() + c * stride;
+    for (uint32_t i = 0; i < frames; i++) {
+      dst[i] = interleaved[size_t(i) * channels + c];
+    }
+  }
+  return clip;
+}
+
+AudioClip loadAudioClip(const std::string& path) {
+  std::vector<char> data = readFile(path);
+
+  SDL_AudioSpec spec;
+  Uint8* buffer = nullptr;
+  Uint32 length = 0;
+  SDL_RWops* rw = SDL_RWFromConstMem(data.data(), static_cast<int>(data.size()));
+  if (rw == nullptr || SDL_LoadWAV_RW(rw, 1, &spec, &buffer, &length) == nullptr) {
+    throw EngineException("failed to load sound", file);
+  }
+
+  SDL_AudioCVT cvt;
+  if (SDL_BuildAudioCVT(&cvt, spec.format, spec.channels, spec.freq, AUDIO_F32SYS, spec.channels, spec.freq) < 0) {
+    SDL_FreeWAV(buffer);
+    throw EngineException("unsupported sound format", file);
+  }
+  std::vector<Uint8> converted(size_t(length) * std::max(cvt.len_mult, 1));
+  memcpy(converted.data(), buffer, length);
+  SDL_FreeWAV(buffer);
+
+  cvt.len = static_cast<int>(length);
+  cvt.buf = converted.data();
+  if (cvt.needed && SDL_ConvertAudio(&cvt) != 0) {
+    throw EngineException("failed to convert sound", file);
+  }
+  size_t bytes = cvt.needed ? static_cast<size_t>(cvt.len_cvt) : length;
+
+  uint32_t frames = static_cast<uint32_t>(bytes / (sizeof(float) * spec.channels));
+  return makeAudioClip(reinterpret_cast<const float*>(converted.data()), frames, spec.channels, static_cast<uint32_t>(spec.freq));
+}
+
+AudioMixer::~AudioMixer() {
+  close();
+}
+
+void AudioMixer::allocate(int rate, uint32_t frames) {
+  sampleRate = rate;
+  bufferFrames = std::max<uint32_t>(frames, 1);
+
+  commands.reset(settings.commandCapacity);
+  clips.reset(new std::atomic<const AudioClip*>[settings.maxClips]);
+  for (uint32_t i = 0; i < settings.maxClips; i++) {
+    clips[i].store(nullptr, std::memory_order_relaxed);
+  }
+  clipCount.store(0, std::memory_order_relaxed);
+
+  voices.clear();
+  voices.reserve(settings.maxVoices);
+  busGains.assign(std::max<uint32_t>(settings.buses, 1), 1.0f);
+  busSamples.assign(busGains.size() * 2 * bufferFrames, 0.0f);
+  masterSamples.assign(2 * bufferFrames, 0.0f);
+
+  streamScratchFrames = bufferFrames * AUDIO_MAX_STREAM_STEP + 3;
+  streamScratch.assign(size_t(streamScratchFrames) * 2, 0.0f);
+  // a ring smaller than two buffers' worth could never prime
+  streams.start(settings.maxStreams, std::max(settings.streamFrames, streamScratchFrames * 2), rate);
+  running = true;
+}
+
+bool AudioMixer::open(const AudioSettings& settings) {
+  close();
+  this->settings = settings;
+
+  SDL_AudioSpec want = {};
+  want.freq = settings.sampleRate;
+  want.format = AUDIO_F32SYS;
+  want.channels = 2;
+  want.samples = settings.bufferFrames;
+  want.callback = &AudioMixer::callback;
+  want.userdata = this;
+
+  // the device starts paused, so the callback can't run before allocate
+  SDL_AudioSpec have;
+  device = SDL_OpenAudioDevice(nullptr, 0, &want, &have,
+    SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+  if (device == 0) {
+    allocate(settings.sampleRate, settings.bufferFrames);
+    running = false;
+    return false;
+  }
+
+  allocate(have.freq, have.samples);
+  SDL_PauseAudioDevice(device, 0);
+  return true;
+}
+
+void AudioMixer::prepare(const AudioSettings& settings) {
+  close();
+  this->settings = settings;
+  allocate(settings.sampleRate, settings.bufferFrames);
+}
+
+void AudioMixer::close() {
+  // waits for a running callback to return
+  if (device != 0) {
+    SDL_CloseAudioDevice(device);
+    device = 0;
+  }
+  running = false;
+  streams.stop();
+
+  std::lock_guard<std::mutex> lock(clipMutex);
+  voices.clear();
+  clips.reset();
+  ownedClips.clear();
+  clipCount.store(0, std::memory_order_relaxed);
+  activeVoices.store(0, std::memory_order_relaxed);
+}
+
+uint32_t AudioMixer::addClip(AudioClip clip) {
+  std::lock_guard<std::mutex> lock(clipMutex);
+  uint32_t index = clipCount.load(std::memory_order_relaxed);
+  if (!clips) {
+    throw EngineException("audio mixer isn't open", file);
+  }
+  if (index >= settings.maxClips) {
+    throw EngineException("too many audio clips", file);
+  }
+
+  ownedClips.push_back(std::unique_ptr<AudioClip>(new AudioClip(std::move(clip))));
+  clips[index].store(ownedClips.back().get(), std::memory_order_release);
+  clipCount.store(index + 1, std::memory_order_release);
+  return index;
+}
+
+bool AudioMixer::send(const Command& command) {
+  if (!running) return false;
+  if (!commands.push(command)) {
+    commandsDropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+AudioMixer::VoiceId AudioMixer::play(uint32_t clip, float gain, float pan, float pitch, bool loop, uint32_t bus) {
+  VoiceId id = nextVoice.fetch_add(1, std::memory_order_relaxed);
+  if (id == NO_VOICE) {
+    id = nextVoice.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  Command command = {};
+  command.type = Command::PLAY;
+  command.voice = id;
+  command.clip = clip;
+  command.bus = bus;
+  command.gain = gain;
+  command.pan = pan;
+  command.pitch = pitch;
+  command.loop = loop;
+  return send(command) ? id : NO_VOICE;
+}
+
+AudioMixer::VoiceId AudioMixer::playStream(const std::string& path, float gain, float pan, float pitch, bool loop, uint32_t bus) {
+  if (!running) return NO_VOICE;
+  int32_t stream = streams.open(path, loop);
+  if (stream < 0) {
+    streamsDropped.fetch_add(1, std::memory_order_relaxed);
+    return NO_VOICE;
+  }
+
+  VoiceId id = nextVoice.fetch_add(1, std::memory_order_relaxed);
+  if (id == NO_VOICE) {
+    id = nextVoice.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  Command command = {};
+  command.type = Command::PLAY_STREAM;
+  command.voice = id;
+  command.stream = stream;
+  command.bus = bus;
+  command.gain = gain;
+  command.pan = pan;
+  command.pitch = pitch;
+  command.loop = loop;
+  if (!send(command)) {
+    streams.cancel(stream);
+    return NO_VOICE;
+  }
+  return id;
+}
+
+void AudioMixer::stop(VoiceId voice) {
+  Command command = {};
+  command.type = Command::STOP;
+  command.voice = voice;
+  send(command);
+}
+
+void AudioMixer::stopAll() {
+  Command command = {};
+  command.type = Command::STOP_ALL;
+  send(command);
+}
+
+void AudioMixer::setGain(VoiceId voice, float gain) {
+  Command command = {};
+  command.type = Command::GAIN;
+  command.voice = voice;
+  command.gain = gain;
+  send(command);
+}
+
+void AudioMixer::setPan(VoiceId voice, float pan) {
+  Command command = {};
+  command.type = Command::PAN;
+  command.voice = voice;
+  command.pan = pan;
+  send(command);
+}
+
+void AudioMixer::setPitch(VoiceId voice, float pitch) {
+  Command command = {};
+  command.type = Command::PITCH;
+  command.voice = voice;
+  command.pitch = pitch;
+  send(command);
+}
+
+void AudioMixer::setBusGain(uint32_t bus, float gain) {
+  Command command = {};
+  command.type = Command::BUS_GAIN;
+  command.bus = bus;
+  command.gain = gain;
+  send(command);
+}
+
+AudioStats AudioMixer::stats() const {
+  AudioStats stats;
+  stats.callbacks = callbacks.load(std::memory_order_relaxed);
+  stats.framesMixed = framesMixed.load(std::memory_order_relaxed);
+  stats.activeVoices = activeVoices.load(std::memory_order_relaxed);
+  stats.voicesDropped = voicesDropped.load(std::memory_order_relaxed);
+  stats.commandsDropped = commandsDropped.load(std::memory_order_relaxed);
+  stats.lastMixUs = lastMixNanoseconds.load(std::memory_order_relaxed) / 1000.0;
+  stats.streamUnderruns = streamUnderruns.load(std::memory_order_relaxed);
+  stats.streamUnderrunFrames = streamUnderrunFrames.load(std::memory_order_relaxed);
+  stats.streamsDropped = streamsDropped.load(std::memory_order_relaxed);
+  stats.streamMemory = streams.memory();
+  return stats;
+}
+
+static float clampPitch(float pitch) {
+  return std::min(std::max(pitch, 1.0f / 64.0f), 64.0f);
+}
+
+// constant power: equal gains of sqrt(1/2) in the middle
+static void panGains(float gain, float pan, float& left, float& right) {
+  float angle = (std::min(std::max(pan, -1.0f), 1.0f) + 1.0f) * 0.7853981634f;
+  left = gain * std::cos(angle);
+  right = gain * std::sin(angle);
+}
+
+void AudioMixer::applyCommands() {
+  Command command;
+  while (commands.pop(command)) {
+    if (command.type == Command::PLAY || command.type == Command::PLAY_STREAM) {
+      bool streamed = command.type == Command::PLAY_STREAM;
+      uint32_t count = clipCount.load(std::memory_order_acquire);
+      bool valid = command.bus < busGains.size() && (streamed || command.clip < count);
+      // never grows past the reserved capacity, so this can't allocate
+      if (!valid || voices.size() >= settings.maxVoices) {
+        if (valid) voicesDropped.fetch_add(1, std::memory_order_relaxed);
+        if (streamed) streams.release(command.stream);
+        continue;
+      }
+
+      Voice voice = {};
+      voice.id = command.voice;
+      voice.clip = streamed ? nullptr : clips[command.clip].load(std::memory_order_acquire);
+      voice.stream = streamed ? command.stream : -1;
+      voice.bus = command.bus;
+      voice.gain = command.gain;
+      voice.pan = command.pan;
+      voice.pitch = clampPitch(command.pitch);
+      voice.loop = command.loop;
+      // starts at full gain, ramping in would soften the attack
+      panGains(voice.gain, voice.pan, voice.leftGain, voice.rightGain);
+      voices.push_back(voice);
+    }
+    else if (command.type == Command::BUS_GAIN) {
+      if (command.bus < busGains.size()) busGains[command.bus] = command.gain;
+    }
+    else if (command.type == Command::STOP_ALL) {
+      for (auto &voice : voices) {
+        voice.gain = 0.0f;
+        voice.stopping = true;
+      }
+    }
+    else {
+      // few voices change per buffer, a scan beats keeping an index in sync
+      for (auto &voice : voices) {
+        if (voice.id != command.voice) continue;
+        if (command.type == Command::STOP) {
+          // ramps to silence over the next buffer, then frees the voice
+          voice.gain = 0.0f;
+          voice.stopping = true;
+        }
+        else if (command.type == Command::GAIN) voice.gain = command.gain;
+        else if (command.type == Command::PAN) voice.pan = command.pan;
+        else if (command.type == Command::PITCH) voice.pitch = clampPitch(command.pitch);
+        break;
+      }
+    }
+  }
+}
+
+// Adds count frames into dst starting at offset, linearly interpolating
+// src from position; src must hold a frame past the last one read.
+static void mixFrames(
+  const float* srcLeft, const float* srcRight, double position, double step, uint32_t count,
+  float* dstLeft, float* dstRight, uint32_t offset,
+  float left, float stepLeft, float right, float stepRight) {
+  uint32_t i = 0;
+
+#ifdef __AVX__
+  const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+  if (step == 1.0 && position == std::floor(position)) {
+    // unity pitch, straight copy with gain
+    const float* inLeft = srcLeft + static_cast<size_t>(position);
+    const float* inRight = srcRight + static_cast<size_t>(position);
+    for (; i + 8 <= count; i += 8) {
+      __m256 index = _mm256_add_ps(_mm256_set1_ps(float(offset + i)), lanes);
+      __m256 gainLeft = _mm256_add_ps(_mm256_set1_ps(left), _mm256_mul_ps(index, _mm256_set1_ps(stepLeft)));
+      __m256 gainRight = _mm256_add_ps(_mm256_set1_ps(right), _mm256_mul_ps(index, _mm256_set1_ps(stepRight)));
+
+      __m256 outLeft = _mm256_add_ps(_mm256_loadu_ps(dstLeft + offset + i), _mm256_mul_ps(_mm256_loadu_ps(inLeft + i), gainLeft));
+      __m256 outRight = _mm256_add_ps(_mm256_loadu_ps(dstRight + offset + i), _mm256_mul_ps(_mm256_loadu_ps(inRight + i), gainRight));
+      _mm256_storeu_ps(dstLeft + offset + i, outLeft);
+      _mm256_storeu_ps(dstRight + offset + i, outRight);
+    }
+  }
+  else {
+    // positions come from double so long clips don't drift; only the
+    // interpolation and gain are vectorized
+    alignas(32) float a[2][8], b[2][8], fraction[8];
+    for (; i + 8 <= count; i += 8) {
+      for (int lane = 0; lane < 8; lane++) {
+        double p = position + (i + lane) * step;
+        size_t index = static_cast<size_t>(p);
+        fraction[lane] = static_cast<float>(p - index);
+        a[0][lane] = srcLeft[index];
+        b[0][lane] = srcLeft[index + 1];
+        a[1][lane] = srcRight[index];
+        b[1][lane] = srcRight[index + 1];
+      }
+      __m256 t = _mm256_load_ps(fraction);
+      __m256 inLeft = _mm256_add_ps(_mm256_load_ps(a[0]), _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(b[0]), _mm256_load_ps(a[0])), t));
+      __m256 inRight = _mm256_add_ps(_mm256_load_ps(a[1]), _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(b[1]), _mm256_load_ps(a[1])), t));
+
+      __m256 index = _mm256_add_ps(_mm256_set1_ps(float(offset + i)), lanes);
+      __m256 gainLeft = _mm256_add_ps(_mm256_set1_ps(left), _mm256_mul_ps(index, _mm256_set1_ps(stepLeft)));
+      __m256 gainRight = _mm256_add_ps(_mm256_set1_ps(right), _mm256_mul_ps(index, _mm256_set1_ps(stepRight)));
+
+      __m256 outLeft = _mm256_add_ps(_mm256_loadu_ps(dstLeft + offset + i), _mm256_mul_ps(inLeft, gainLeft));
+      __m256 outRight = _mm256_add_ps(_mm256_loadu_ps(dstRight + offset + i), _mm256_mul_ps(inRight, gainRight));
+      _mm256_storeu_ps(dstLeft + offset + i, outLeft);
+      _mm256_storeu_ps(dstRight + offset + i, outRight);
+    }
+  }
+#endif
+
+  for (; i < count; i++) {
+    double p = position + i * step;
+    size_t index = static_cast<size_t>(p);
+    float t = static_cast<float>(p - index);
+    float inLeft = srcLeft[index] + (srcLeft[index + 1] - srcLeft[index]) * t;
+    float inRight = srcRight[index] + (srcRight[index + 1] - srcRight[index]) * t;
+    float n = float(offset + i);
+    dstLeft[offset + i] += inLeft * (left + n * stepLeft);
+    dstRight[offset + i] += inRight * (right + n * stepRight);
+  }
+}
+
+// Adds frames of the voice into its bus. Gains ramp from last buffer's values
+// to the current targets so changes don't click.
+void AudioMixer::mixVoice(Voice& voice, uint32_t frames, bool& finished) {
+  float* dstLeft = busSamples.data() + (voice.bus * 2 + 0) * bufferFrames;
+  float* dstRight = busSamples.data() + (voice.bus * 2 + 1) * bufferFrames;
+
+  float targetLeft, targetRight;
+  panGains(voice.gain, voice.pan, targetLeft, targetRight);
+  float left = voice.leftGain;
+  float right = voice.rightGain;
+  float stepLeft = (targetLeft - left) / frames;
+  float stepRight = (targetRight - right) / frames;
+  finished = false;
+
+  if (voice.stream >= 0) {
+    mixStream(voice, frames, dstLeft, dstRight, left, stepLeft, right, stepRight, finished);
+  }
+  else {
+    const AudioClip& clip = *voice.clip;
+    double step = double(voice.pitch) * clip.sampleRate / sampleRate;
+    double position = voice.position;
+    uint32_t done = 0;
+
+    while (done < frames) {
+      if (position >= clip.frames) {
+        if (!voice.loop || clip.frames == 0) {
+          finished = true;
+          break;
+        }
+        position = std::fmod(position, double(clip.frames));
+      }
+
+      // output frames until the clip runs out
+      uint32_t count = static_cast<uint32_t>(std::min<double>(frames - done, std::ceil((clip.frames - position) / step)));
+      mixFrames(clip.channel(0), clip.channel(1), position, step, count,
+        dstLeft, dstRight, done, left, stepLeft, right, stepRight);
+      position += count * step;
+      done += count;
+    }
+    voice.position = position;
+  }
+
+  voice.leftGain = targetLeft;
+  voice.rightGain = targetRight;
+  if (voice.stopping) finished = true;
+}
+
+// Streams keep only the fractional position; whole frames are consumed from
+// the ring as they're mixed. The frames needed are copied out of the ring
+// into scratch first, so the same kernel handles wrapping and resampling.
+void AudioMixer::mixStream(
+  Voice& voice, uint32_t frames, float* dstLeft, float* dstRight,
+  float left, float stepLeft, float right, float stepRight, bool& finished) {
+  AudioStream& stream = streams[voice.stream];
+  double step = std::min(double(voice.pitch) * stream.sampleRate / sampleRate, double(AUDIO_MAX_STREAM_STEP));
+  double position = voice.position;
+
+  bool ended = stream.ended.load(std::memory_order_acquire);
+  uint64_t available = stream.buffered();
+  // frames read to interpolate count outputs, including the one after the last
+  auto needed = [&](uint32_t count) {
+    return count == 0 ? 0 : static_cast<uint64_t>(position + (count - 1) * step) + 2;
+  };
+
+  // nothing plays until the first refill, so a stream can't start on an underrun
+  if (!voice.primed) {
+    if (available < needed(frames) && !ended) return;
+    voice.primed = true;
+  }
+
+  uint32_t count = frames;
+  if (available < needed(frames)) {
+    if (ended) {
+      // runs out this buffer, the missing frames read as silence
+      count = available == 0 ? 0 : std::min<uint32_t>(frames, static_cast<uint32_t>(std::ceil((available - position) / step)));
+    }
+    else {
+      double reach = available - 2 - position;
+      count = reach < 0.0 ? 0 : std::min<uint32_t>(frames, static_cast<uint32_t>(reach / step) + 1);
+      streamUnderruns.fetch_add(1, std::memory_order_relaxed);
+      streamUnderrunFrames.fetch_add(frames - count, std::memory_order_relaxed);
+    }
+  }
+
+  uint64_t read = stream.readPosition.load(std::memory_order_relaxed);
+  uint32_t copy = static_cast<uint32_t>(std::min(needed(count), available));
+  uint32_t mask = stream.capacity - 1;
+  float* scratchLeft = streamScratch.data();
+  float* scratchRight = streamScratch.data() + streamScratchFrames;
+  const float* ring = stream.ring.data();
+  for (uint32_t i = 0; i < copy; i++) {
+    size_t index = ((read + i) & mask) * 2;
+    scratchLeft[i] = ring[index];
+    scratchRight[i] = ring[index + 1];
+  }
+  for (uint32_t i = copy; i < needed(count); i++) {
+    scratchLeft[i] = scratchRight[i] = 0.0f;
+  }
+
+  mixFrames(scratchLeft, scratchRight, position, step, count,
+    dstLeft, dstRight, 0, left, stepLeft, right, stepRight);
+
+  position += count * step;
+  uint64_t consumed = std::min(static_cast<uint64_t>(position), available);
+  voice.position = position - std::floor(position);
+  stream.readPosition.store(read + consumed, std::memory_order_release);
+
+  if (ended && consumed == available) {
+    finished = true;
+  }
+}
+
+// frames is at most bufferFrames
+void AudioMixer::mixChunk(float* out, uint32_t frames) {
+  std::fill(busSamples.begin(), busSamples.end(), 0.0f);
+
+  for (size_t v = 0; v < voices.size();) {
+    bool finished;
+    mixVoice(voices[v], frames, finished);
+    if (finished) {
+      if (voices[v].stream >= 0) streams.release(voices[v].stream);
+      voices[v] = voices.back();
+      voices.pop_back();
+    }
+    else {
+      v++;
+    }
+  }
+
+  float* masterLeft = masterSamples.data();
+  float* masterRight = masterSamples.data() + bufferFrames;
+  std::fill(masterSamples.begin(), masterSamples.end(), 0.0f);
+  for (size_t bus = 0; bus < busGains.size(); bus++) {
+    const float* left = busSamples.data() + (bus * 2 + 0) * bufferFrames;
+    const float* right = busSamples.data() + (bus * 2 + 1) * bufferFrames;
+    float gain = busGains[bus];
+    uint32_t i = 0;
+#ifdef __AVX__
+    __m256 g = _mm256_set1_ps(gain);
+    for (; i + 8 <= frames; i += 8) {
+      _mm256_storeu_ps(masterLeft + i, _mm256_add_ps(_mm256_loadu_ps(masterLeft + i), _mm256_mul_ps(_mm256_loadu_ps(left + i), g)));
+      _mm256_storeu_ps(masterRight + i, _mm256_add_ps(_mm256_loadu_ps(masterRight + i), _mm256_mul_ps(_mm256_loadu_ps(right + i), g)));
+    }
+#endif
+    for (; i < frames; i++) {
+      masterLeft[i] += left[i] * gain;
+      masterRight[i] += right[i] * gain;
+    }
+  }
+
+  // interleave and clip
+  uint32_t i = 0;
+#ifdef __AVX__
+  const __m256 low = _mm256_set1_ps(-1.0f);
+  const __m256 high = _mm256_set1_ps(1.0f);
+  for (; i + 8 <= frames; i += 8) {
+    __m256 l = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(masterLeft + i), low), high);
+    __m256 r = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(masterRight + i), low), high);
+    // l0 r0 l1 r1 | l4 r4 l5 r5 and l2 r2 l3 r3 | l6 r6 l7 r7
+    __m256 first = _mm256_unpacklo_ps(l, r);
+    __m256 second = _mm256_unpackhi_ps(l, r);
+    _mm256_storeu_ps(out + i * 2, _mm256_permute2f128_ps(first, second, 0x20));
+    _mm256_storeu_ps(out + i * 2 + 8, _mm256_permute2f128_ps(first, second, 0x31));
+  }
+#endif
+  for (; i < frames; i++) {
+    out[i * 2] = std::min(std::max(masterLeft[i], -1.0f), 1.0f);
+    out[i * 2 + 1] = std::min(std::max(masterRight[i], -1.0f), 1.0f);
+  }
+}
+
+void AudioMixer::mix(float* out, uint32_t frames) {
+  if (!running) {
+    std::fill(out, out + size_t(frames) * 2, 0.0f);
+    return;
+  }
+  auto start = std::chrono::steady_clock::now();
+
+  applyCommands();
+  for (uint32_t done = 0; done < frames; done += bufferFrames) {
+    mixChunk(out + size_t(done) * 2, std::min(bufferFrames, frames - done));
+  }
+
+  activeVoices.store(static_cast<uint32_t>(voices.size()), std::memory_order_relaxed);
+  callbacks.fetch_add(1, std::memory_order_relaxed);
+  framesMixed.fetch_add(frames, std::memory_order_relaxed);
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+  lastMixNanoseconds.store(static_cast<uint64_t>(elapsed.count()), std::memory_order_relaxed);
+}
+
+void SDLCALL AudioMixer::callback(void* userdata, Uint8* stream, int length) {
+  AudioMixer* mixer = static_cast<AudioMixer*>(userdata);
+  uint32_t frames = static_cast<uint32_t>(length / (sizeof(float) * 2));
+  mixer->mix(reinterpret_cast<float*>(stream), frames);
+}
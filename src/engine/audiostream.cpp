@@ -0,0 +1,399 @@
+// stb_vorbis has the same "-Wtype-limits" trouble as stb_image, and leaves a
+// few helpers unused
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wtype-limits"
+#pragma GCC diagnostic ignored "-Wunused-value"
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#pragma GCC diagnostic ignored "-Wsign-compare"
+#include "stb_vorbis.c"
+#pragma GCC diagnostic pop
+#include "engine/audiostream.hpp"
+#include "engine/exception.hpp"
+#include "engine/pack.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <cstring>
+
+#define file "src/engine/audiostream.cpp"
+
+// frames decoded per read; bounds the decoders' scratch memory
+static const uint32_t DECODE_BLOCK = 4096;
+
+// Bytes of an asset, from a pack mapping, an owned copy of a compressed pack
+// entry, or the file on disk.
+class AudioSource {
+  const char* data = nullptr;
+  size_t size = 0;
+  size_t offset = 0;
+  std::vector<char> owned;
+  std::ifstream stream;
+  public:
+    explicit AudioSource(const std::string& path) {
+      AssetPack& pack = AssetPack::mounted();
+      PackSpan span = pack.view(path);
+      if (span.data != nullptr) {
+        data = span.data;
+        size = span.size;
+      }
+      else if (pack.read(path, owned)) {
+        data = owned.data();
+        size = owned.size();
+      }
+      else {
+        stream.open(path, std::ios::binary);
+        if (!stream.is_open()) {
+          throw EngineException("failed to open sound", file);
+        }
+      }
+    }
+
+    bool inMemory() const { return data != nullptr; }
+    const char* memory() const { return data; }
+    size_t memorySize() const { return size; }
+
+    size_t read(void* out, size_t bytes) {
+      if (data != nullptr) {
+        bytes = std::min(bytes, size - offset);
+        memcpy(out, data + offset, bytes);
+        offset += bytes;
+        return bytes;
+      }
+      stream.read(static_cast<char*>(out), bytes);
+      return static_cast<size_t>(stream.gcount());
+    }
+
+    void seek(size_t position) {
+      if (data != nullptr) {
+        offset = std::min(position, size);
+        return;
+      }
+      stream.clear();
+      stream.seekg(static_cast<std::streamoff>(position));
+    }
+};
+
+static uint32_t readLE(const unsigned char* bytes, int count) {
+  uint32_t value = 0;
+  for (int i = count - 1; i >= 0; i--) {
+    value = (value << 8) | bytes[i];
+  }
+  return value;
+}
+
+class WavDecoder : public AudioDecoder {
+  AudioSource source;
+  size_t dataOffset = 0;
+  size_t dataSize = 0;
+  size_t consumed = 0;
+  uint32_t bytesPerSample = 0;
+  bool floating = false;
+  std::vector<unsigned char> block;
+
+  float sample(const unsigned char* bytes) const {
+    switch (bytesPerSample) {
+      case 1:
+        return (bytes[0] - 128) / 128.0f;
+      case 2:
+        return static_cast<int16_t>(readLE(bytes, 2)) / 32768.0f;
+      case 3:
+        // shift into the top of an int32 to sign extend
+        return static_cast<int32_t>(readLE(bytes, 3) << 8) / 2147483648.0f;
+      default:
+        if (floating) {
+          float value;
+          memcpy(&value, bytes, sizeof(value));
+          return value;
+        }
+        return static_cast<int32_t>(readLE(bytes, 4)) / 2147483648.0f;
+    }
+  }
+  public:
+    explicit WavDecoder(const std::string& path) : source(path) {
+      unsigned char header[12];
+      if (source.read(header, 12) != 12 || memcmp(header + 8, "WAVE", 4) != 0) {
+        throw EngineException("not a WAV file", file);
+      }
+
+      size_t position = 12;
+      bool haveFormat = false;
+      for (;;) {
+        unsigned char chunk[8];
+        if (source.read(chunk, 8) != 8) {
+          throw EngineException("WAV file has no data", file);
+        }
+        uint32_t size = readLE(chunk + 4, 4);
+        position += 8;
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+          unsigned char format[40] = {};
+          size_t length = std::min<size_t>(size, sizeof(format));
+          if (size < 16 || source.read(format, length) != length) {
+            throw EngineException("bad WAV format chunk", file);
+          }
+          uint32_t tag = readLE(format, 2);
+          // WAVE_FORMAT_EXTENSIBLE keeps the real tag in its subformat
+          if (tag == 0xfffe && length >= 26) tag = readLE(format + 24, 2);
+          channels = readLE(format + 2, 2);
+          sampleRate = readLE(format + 4, 4);
+          bytesPerSample = readLE(format + 14, 2) / 8;
+          floating = tag == 3;
+
+          bool supported = (tag == 1 && bytesPerSample >= 1 && bytesPerSample <= 4)
+            || (floating && bytesPerSample == 4);
+          if (!supported || channels == 0 || sampleRate == 0) {
+            throw EngineException("unsupported WAV encoding", file);
+          }
+          haveFormat = true;
+        }
+        else if (memcmp(chunk, "data", 4) == 0) {
+          if (!haveFormat) {
+            throw EngineException("WAV data before format", file);
+          }
+          dataOffset = position;
+          dataSize = size;
+          break;
+        }
+        // chunks are padded to even sizes
+        position += size + (size & 1);
+        source.seek(position);
+      }
+
+      block.resize(size_t(DECODE_BLOCK) * channels * bytesPerSample);
+    }
+
+    uint32_t read(float* out, uint32_t frames) override {
+      size_t frameBytes = size_t(channels) * bytesPerSample;
+      uint32_t done = 0;
+      while (done < frames) {
+        size_t wanted = std::min<size_t>(std::min(frames - done, DECODE_BLOCK), (dataSize - consumed) / frameBytes);
+        if (wanted == 0) break;
+        size_t bytes = source.read(block.data(), wanted * frameBytes);
+        uint32_t got = static_cast<uint32_t>(bytes / frameBytes);
+        if (got == 0) break;
+        consumed += got * frameBytes;
+
+        for (uint32_t i = 0; i < got; i++) {
+          const unsigned char* frame = block.data() + i * frameBytes;
+          float left = sample(frame);
+          float right = channels > 1 ? sample(frame + bytesPerSample) : left;
+          out[(done + i) * 2] = left;
+          out[(done + i) * 2 + 1] = right;
+        }
+        done += got;
+      }
+      return done;
+    }
+
+    bool rewind() override {
+      source.seek(dataOffset);
+      consumed = 0;
+      return true;
+    }
+};
+
+class OggDecoder : public AudioDecoder {
+  AudioSource source;
+  stb_vorbis* vorbis = nullptr;
+  std::vector<float> block;
+  public:
+    explicit OggDecoder(const std::string& path) : source(path) {
+      int error = 0;
+      if (source.inMemory()) {
+        vorbis = stb_vorbis_open_memory(reinterpret_cast<const unsigned char*>(source.memory()),
+          static_cast<int>(source.memorySize()), &error, nullptr);
+      }
+      else {
+        // stb_vorbis reads through its own FILE, a page at a time
+        vorbis = stb_vorbis_open_filename(path.c_str(), &error, nullptr);
+      }
+      if (vorbis == nullptr) {
+        throw EngineException("failed to open Ogg Vorbis", file);
+      }
+
+      stb_vorbis_info info = stb_vorbis_get_info(vorbis);
+      sampleRate = info.sample_rate;
+      channels = static_cast<uint32_t>(info.channels);
+      if (channels == 1) block.resize(DECODE_BLOCK);
+    }
+
+    ~OggDecoder() {
+      stb_vorbis_close(vorbis);
+    }
+
+    uint32_t read(float* out, uint32_t frames) override {
+      uint32_t done = 0;
+      while (done < frames) {
+        uint32_t wanted = std::min(frames - done, DECODE_BLOCK);
+        int got;
+        if (channels == 1) {
+          got = stb_vorbis_get_samples_float_interleaved(vorbis, 1, block.data(), static_cast<int>(wanted));
+          for (int i = 0; i < got; i++) {
+            out[(done + i) * 2] = out[(done + i) * 2 + 1] = block[i];
+          }
+        }
+        else {
+          // drops channels past the first two
+          got = stb_vorbis_get_samples_float_interleaved(vorbis, 2, out + done * 2, static_cast<int>(wanted * 2));
+        }
+        if (got <= 0) break;
+        done += static_cast<uint32_t>(got);
+      }
+      return done;
+    }
+
+    bool rewind() override {
+      return stb_vorbis_seek_start(vorbis) != 0;
+    }
+};
+
+std::unique_ptr<AudioDecoder> openAudioDecoder(const std::string& path) {
+  char magic[4] = {};
+  {
+    AudioSource source(path);
+    source.read(magic, sizeof(magic));
+  }
+
+  if (memcmp(magic, "RIFF", 4) == 0) {
+    return std::unique_ptr<AudioDecoder>(new WavDecoder(path));
+  }
+  if (memcmp(magic, "OggS", 4) == 0) {
+    return std::unique_ptr<AudioDecoder>(new OggDecoder(path));
+  }
+  throw EngineException("unknown sound format", file);
+}
+
+AudioStreams::~AudioStreams() {
+  stop();
+}
+
+void AudioStreams::start(uint32_t slots, uint32_t ringFrames, int outputRate) {
+  stop();
+
+  uint32_t capacity = 1;
+  while (capacity < ringFrames) capacity *= 2;
+
+  count = slots;
+  streams.reset(new AudioStream[slots]);
+  for (uint32_t i = 0; i < slots; i++) {
+    streams[i].ring.assign(size_t(capacity) * 2, 0.0f);
+    streams[i].capacity = capacity;
+  }
+
+  // a quarter of a ring's playing time, so a pass always comes before it drains
+  refillIntervalMs = std::max(1u, static_cast<uint32_t>(250.0 * capacity / std::max(outputRate, 1)));
+  stopping = false;
+  if (slots > 0) {
+    thread = std::thread(&AudioStreams::run, this);
+  }
+}
+
+void AudioStreams::stop() {
+  if (thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+  }
+  streams.reset();
+  count = 0;
+}
+
+int32_t AudioStreams::open(const std::string& path, bool loop) {
+  for (uint32_t i = 0; i < count; i++) {
+    AudioStream& stream = streams[i];
+    uint32_t expected = AudioStream::FREE;
+    if (!stream.state.compare_exchange_strong(expected, AudioStream::OPENING, std::memory_order_acquire)) {
+      continue;
+    }
+
+    try {
+      stream.decoder = openAudioDecoder(path);
+    }
+    catch (...) {
+      stream.state.store(AudioStream::FREE, std::memory_order_release);
+      throw;
+    }
+    stream.loop = loop;
+    stream.sampleRate = stream.decoder->sampleRate;
+    stream.readPosition.store(0, std::memory_order_relaxed);
+    stream.writePosition.store(0, std::memory_order_relaxed);
+    stream.ended.store(false, std::memory_order_relaxed);
+    stream.state.store(AudioStream::ACTIVE, std::memory_order_release);
+
+    // the first fill shouldn't wait for the next pass
+    wake.notify_one();
+    return static_cast<int32_t>(i);
+  }
+  return -1;
+}
+
+void AudioStreams::cancel(int32_t index) {
+  release(index);
+  wake.notify_one();
+}
+
+size_t AudioStreams::memory() const {
+  size_t bytes = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    bytes += streams[i].ring.size() * sizeof(float);
+  }
+  return bytes;
+}
+
+void AudioStreams::refill(AudioStream& stream) {
+  uint32_t mask = stream.capacity - 1;
+  uint64_t write = stream.writePosition.load(std::memory_order_relaxed);
+  uint64_t read = stream.readPosition.load(std::memory_order_acquire);
+  uint32_t space = stream.capacity - static_cast<uint32_t>(write - read);
+
+  // topping up a few frames at a time would cost a decode call each
+  if (stream.ended.load(std::memory_order_relaxed) || space < stream.capacity / 4) return;
+
+  bool rewound = false;
+  while (space > 0) {
+    uint32_t start = static_cast<uint32_t>(write & mask);
+    uint32_t frames = std::min(space, stream.capacity - start);
+    uint32_t got = stream.decoder->read(stream.ring.data() + size_t(start) * 2, frames);
+
+    if (got == 0) {
+      // a second empty read right after rewinding means there is nothing to loop
+      if (!stream.loop || rewound || !stream.decoder->rewind()) {
+        stream.writePosition.store(write, std::memory_order_release);
+        stream.ended.store(true, std::memory_order_release);
+        return;
+      }
+      rewound = true;
+      continue;
+    }
+    rewound = false;
+    write += got;
+    space -= got;
+    // publish each piece, the callback may already be waiting on it
+    stream.writePosition.store(write, std::memory_order_release);
+  }
+}
+
+void AudioStreams::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!stopping) {
+    lock.unlock();
+    for (uint32_t i = 0; i < count; i++) {
+      AudioStream& stream = streams[i];
+      uint32_t state = stream.state.load(std::memory_order_acquire);
+      if (state == AudioStream::ACTIVE) {
+        refill(stream);
+      }
+      else if (state == AudioStream::RELEASED) {
+        // closes the file here rather than on the audio thread
+        stream.decoder.reset();
+        stream.state.store(AudioStream::FREE, std::memory_order_release);
+      }
+    }
+    lock.lock();
+    wake.wait_for(lock, std::chrono::milliseconds(refillIntervalMs));
+  }
+}
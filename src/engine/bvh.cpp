@@ -0,0 +1,483 @@
+#include "engine/bvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+static const int SAH_BINS = 16;
+
+AABB AABB::transformed(const glm::mat4& m) const {
+  glm::vec3 c = center();
+  glm::vec3 e = max - c;
+
+  AABB box;
+  for (int i = 0; i < 3; i++) {
+    float center = m[3][i] + m[0][i] * c.x + m[1][i] * c.y + m[2][i] * c.z;
+    float extent = std::abs(m[0][i]) * e.x + std::abs(m[1][i]) * e.y + std::abs(m[2][i]) * e.z;
+    box.min[i] = center - extent;
+    box.max[i] = center + extent;
+  }
+  return box;
+}
+
+Frustum Frustum::fromMatrix(const glm::mat4& m) {
+  glm::vec4 rows[4];
+  for (int i = 0; i < 4; i++) {
+    rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+  }
+
+  Frustum frustum;
+  frustum.planes[0] = rows[3] + rows[0];
+  frustum.planes[1] = rows[3] - rows[0];
+  frustum.planes[2] = rows[3] + rows[1];
+  frustum.planes[3] = rows[3] - rows[1];
+  frustum.planes[4] = rows[2];
+  frustum.planes[5] = rows[3] - rows[2];
+  for (auto &plane : frustum.planes) {
+    float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+    if (length > 0.0f) {
+      plane /= length;
+    }
+  }
+  return frustum;
+}
+
+Frustum::Result Frustum::classify(const AABB& box) const {
+  Result result = INSIDE;
+  for (auto &plane : planes) {
+    // corners furthest along and against the plane normal
+    glm::vec3 positive(
+      plane.x >= 0.0f ? box.max.x : box.min.x,
+      plane.y >= 0.0f ? box.max.y : box.min.y,
+      plane.z >= 0.0f ? box.max.z : box.min.z);
+    glm::vec3 negative(
+      plane.x >= 0.0f ? box.min.x : box.max.x,
+      plane.y >= 0.0f ? box.min.y : box.max.y,
+      plane.z >= 0.0f ? box.min.z : box.max.z);
+
+    if (plane.x * positive.x + plane.y * positive.y + plane.z * positive.z + plane.w < 0.0f) {
+      return OUTSIDE;
+    }
+    if (plane.x * negative.x + plane.y * negative.y + plane.z * negative.z + plane.w < 0.0f) {
+      result = INTERSECTS;
+    }
+  }
+  return result;
+}
+
+uint32_t BVH::allocateNode() {
+  uint32_t node;
+  if (freeList != NONE) {
+    node = freeList;
+    freeList = nodes[node].parent;
+  }
+  else {
+    node = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+  }
+  nodes[node].parent = NONE;
+  nodes[node].left = NONE;
+  nodes[node].right = NONE;
+  nodes[node].data = NONE;
+  nodes[node].height = 0;
+  return node;
+}
+
+void BVH::freeNode(uint32_t node) {
+  nodes[node].height = -1;
+  nodes[node].parent = freeList;
+  freeList = node;
+}
+
+void BVH::refitUpwards(uint32_t node) {
+  while (node != NONE) {
+    Node& n = nodes[node];
+    n.box = AABB::merge(nodes[n.left].box, nodes[n.right].box);
+    n.height = 1 + std::max(nodes[n.left].height, nodes[n.right].height);
+    node = n.parent;
+  }
+}
+
+void BVH::insertLeaf(uint32_t leaf) {
+  if (root == NONE) {
+    root = leaf;
+    nodes[leaf].parent = NONE;
+    return;
+  }
+
+  // descend towards the child that grows the least, stopping when pairing
+  // with the current node is cheaper than going further down
+  AABB box = nodes[leaf].box;
+  uint32_t index = root;
+  while (!nodes[index].leaf()) {
+    const Node& n = nodes[index];
+    float area = n.box.surfaceArea();
+    float combined = AABB::merge(n.box, box).surfaceArea();
+    float cost = 2.0f * combined;
+    float inheritance = 2.0f * (combined - area);
+
+    float childCost[2];
+    uint32_t children[2] = {n.left, n.right};
+    for (int c = 0; c < 2; c++) {
+      const Node& child = nodes[children[c]];
+      float merged = AABB::merge(child.box, box).surfaceArea();
+      childCost[c] = (child.leaf() ? merged : merged - child.box.surfaceArea()) + inheritance;
+    }
+
+    if (cost < childCost[0] && cost < childCost[1]) break;
+    index = childCost[0] < childCost[1] ? children[0] : children[1];
+  }
+
+  uint32_t sibling = index;
+  uint32_t oldParent = nodes[sibling].parent;
+  uint32_t newParent = allocateNode();
+  nodes[newParent].parent = oldParent;
+  nodes[newParent].left = sibling;
+  nodes[newParent].right = leaf;
+  nodes[sibling].parent = newParent;
+  nodes[leaf].parent = newParent;
+
+  if (oldParent == NONE) {
+    root = newParent;
+  }
+  else if (nodes[oldParent].left == sibling) {
+    nodes[oldParent].left = newParent;
+  }
+  else {
+    nodes[oldParent].right = newParent;
+  }
+  refitUpwards(newParent);
+}
+
+void BVH::removeLeaf(uint32_t leaf) {
+  if (leaf == root) {
+    root = NONE;
+    return;
+  }
+
+  uint32_t parent = nodes[leaf].parent;
+  uint32_t grandParent = nodes[parent].parent;
+  uint32_t sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+  if (grandParent == NONE) {
+    root = sibling;
+    nodes[sibling].parent = NONE;
+    freeNode(parent);
+    return;
+  }
+
+  if (nodes[grandParent].left == parent) {
+    nodes[grandParent].left = sibling;
+  }
+  else {
+    nodes[grandParent].right = sibling;
+  }
+  nodes[sibling].parent = grandParent;
+  freeNode(parent);
+  refitUpwards(grandParent);
+}
+
+uint32_t BVH::insert(const AABB& box, uint32_t data) {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  uint32_t leaf = allocateNode();
+  nodes[leaf].box.min = box.min - glm::vec3(margin);
+  nodes[leaf].box.max = box.max + glm::vec3(margin);
+  nodes[leaf].data = data;
+  insertLeaf(leaf);
+  leafCount++;
+  reinsertions++;
+  return leaf;
+}
+
+void BVH::remove(uint32_t proxy) {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  removeLeaf(proxy);
+  freeNode(proxy);
+  leafCount--;
+  reinsertions++;
+}
+
+bool BVH::moveLeaf(uint32_t proxy, const AABB& box) {
+  if (nodes[proxy].box.contains(box)) {
+    return false;
+  }
+  removeLeaf(proxy);
+  nodes[proxy].box.min = box.min - glm::vec3(margin);
+  nodes[proxy].box.max = box.max + glm::vec3(margin);
+  insertLeaf(proxy);
+  reinsertions++;
+  return true;
+}
+
+bool BVH::move(uint32_t proxy, const AABB& box) {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  return moveLeaf(proxy, box);
+}
+
+void BVH::move(const std::vector<uint32_t>& proxies, const std::vector<AABB>& boxes) {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  for (size_t i = 0; i < proxies.size(); i++) {
+    moveLeaf(proxies[i], boxes[i]);
+  }
+}
+
+void BVH::clear() {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  nodes.clear();
+  root = NONE;
+  freeList = NONE;
+  leafCount = 0;
+  rebuildCost = 0.0f;
+  reinsertions = 0;
+}
+
+uint32_t BVH::build(uint32_t* leaves, size_t count) {
+  if (count == 1) {
+    return leaves[0];
+  }
+
+  AABB centroids;
+  centroids.min = centroids.max = nodes[leaves[0]].box.center();
+  for (size_t i = 1; i < count; i++) {
+    glm::vec3 c = nodes[leaves[i]].box.center();
+    centroids.min = glm::min(centroids.min, c);
+    centroids.max = glm::max(centroids.max, c);
+  }
+
+  glm::vec3 extent = centroids.max - centroids.min;
+  int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+  float low = centroids.min[axis];
+  float width = extent[axis];
+
+  size_t mid = count / 2;
+  if (width > 0.0f) {
+    struct Bin {
+      AABB box;
+      size_t count = 0;
+    };
+    Bin bins[SAH_BINS];
+    auto binOf = [&](uint32_t leaf) {
+      int bin = static_cast<int>((nodes[leaf].box.center()[axis] - low) / width * SAH_BINS);
+      return std::min(bin, SAH_BINS - 1);
+    };
+    for (size_t i = 0; i < count; i++) {
+      Bin& bin = bins[binOf(leaves[i])];
+      bin.box = bin.count == 0 ? nodes[leaves[i]].box : AABB::merge(bin.box, nodes[leaves[i]].box);
+      bin.count++;
+    }
+
+    // sweep from the right so each split sees both sides in one pass
+    float rightArea[SAH_BINS];
+    size_t rightCount[SAH_BINS];
+    AABB accumulated;
+    size_t accumulatedCount = 0;
+    for (int i = SAH_BINS - 1; i > 0; i--) {
+      if (bins[i].count > 0) {
+        accumulated = accumulatedCount == 0 ? bins[i].box : AABB::merge(accumulated, bins[i].box);
+        accumulatedCount += bins[i].count;
+      }
+      rightArea[i] = accumulatedCount == 0 ? 0.0f : accumulated.surfaceArea();
+      rightCount[i] = accumulatedCount;
+    }
+
+    float bestCost = INFINITY;
+    int bestSplit = -1;
+    accumulatedCount = 0;
+    for (int split = 1; split < SAH_BINS; split++) {
+      const Bin& bin = bins[split - 1];
+      if (bin.count > 0) {
+        accumulated = accumulatedCount == 0 ? bin.box : AABB::merge(accumulated, bin.box);
+        accumulatedCount += bin.count;
+      }
+      if (accumulatedCount == 0 || rightCount[split] == 0) continue;
+      float cost = accumulatedCount * accumulated.surfaceArea() + rightCount[split] * rightArea[split];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestSplit = split;
+      }
+    }
+
+    if (bestSplit > 0) {
+      uint32_t* middle = std::partition(leaves, leaves + count, [&](uint32_t leaf) {
+        return binOf(leaf) < bestSplit;
+      });
+      mid = middle - leaves;
+    }
+  }
+
+  // every centroid in one bin (or all coincident): fall back to a median split
+  if (mid == 0 || mid == count) {
+    mid = count / 2;
+    std::nth_element(leaves, leaves + mid, leaves + count, [&](uint32_t a, uint32_t b) {
+      return nodes[a].box.center()[axis] < nodes[b].box.center()[axis];
+    });
+  }
+
+  uint32_t left = build(leaves, mid);
+  uint32_t right = build(leaves + mid, count - mid);
+  uint32_t node = allocateNode();
+  nodes[node].left = left;
+  nodes[node].right = right;
+  nodes[node].box = AABB::merge(nodes[left].box, nodes[right].box);
+  nodes[node].height = 1 + std::max(nodes[left].height, nodes[right].height);
+  nodes[left].parent = node;
+  nodes[right].parent = node;
+  return node;
+}
+
+void BVH::rebuildLocked() {
+  std::vector<uint32_t> leaves;
+  leaves.reserve(leafCount);
+  for (size_t i = 0; i < nodes.size(); i++) {
+    if (nodes[i].height < 0) continue;
+    if (nodes[i].leaf()) {
+      leaves.push_back(static_cast<uint32_t>(i));
+    }
+    else {
+      freeNode(static_cast<uint32_t>(i));
+    }
+  }
+
+  root = leaves.empty() ? NONE : build(leaves.data(), leaves.size());
+  if (root != NONE) {
+    nodes[root].parent = NONE;
+  }
+  rebuildCost = costLocked();
+  reinsertions = 0;
+}
+
+void BVH::rebuild() {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  rebuildLocked();
+}
+
+bool BVH::rebuildIfDegraded(float threshold) {
+  std::unique_lock<std::shared_mutex> lock(mutex);
+  if (reinsertions * 4 < leafCount) {
+    return false;
+  }
+  reinsertions = 0;
+  if (rebuildCost > 0.0f && costLocked() <= rebuildCost * threshold) {
+    return false;
+  }
+  rebuildLocked();
+  return true;
+}
+
+float BVH::costLocked() const {
+  if (root == NONE || nodes[root].leaf()) return 0.0f;
+  float rootArea = nodes[root].box.surfaceArea();
+  if (rootArea <= 0.0f) return 0.0f;
+
+  float area = 0.0f;
+  for (auto &node : nodes) {
+    if (node.height > 0) {
+      area += node.box.surfaceArea();
+    }
+  }
+  return area / rootArea;
+}
+
+void BVH::queryFrustum(const Frustum& frustum, std::vector<uint32_t>& out) const {
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  if (root == NONE) return;
+
+  // each entry carries whether its parent was already fully inside
+  thread_local std::vector<std::pair<uint32_t, bool>> stack;
+  stack.clear();
+  stack.push_back({root, false});
+  while (!stack.empty()) {
+    uint32_t index = stack.back().first;
+    bool inside = stack.back().second;
+    stack.pop_back();
+
+    const Node& node = nodes[index];
+    if (!inside) {
+      Frustum::Result result = frustum.classify(node.box);
+      if (result == Frustum::OUTSIDE) continue;
+      inside = result == Frustum::INSIDE;
+    }
+    if (node.leaf()) {
+      out.push_back(node.data);
+    }
+    else {
+      stack.push_back({node.left, inside});
+      stack.push_back({node.right, inside});
+    }
+  }
+}
+
+void BVH::queryRay(const Ray& ray, float maxDistance, std::vector<uint32_t>& out) const {
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  if (root == NONE) return;
+
+  glm::vec3 inverse(1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z);
+  auto hit = [&](const AABB& box) {
+    float near = 0.0f;
+    float far = maxDistance;
+    for (int i = 0; i < 3; i++) {
+      float t1 = (box.min[i] - ray.origin[i]) * inverse[i];
+      float t2 = (box.max[i] - ray.origin[i]) * inverse[i];
+      near = std::max(near, std::min(t1, t2));
+      far = std::min(far, std::max(t1, t2));
+    }
+    return near <= far;
+  };
+
+  thread_local std::vector<uint32_t> stack;
+  stack.clear();
+  stack.push_back(root);
+  while (!stack.empty()) {
+    const Node& node = nodes[stack.back()];
+    stack.pop_back();
+    if (!hit(node.box)) continue;
+    if (node.leaf()) {
+      out.push_back(node.data);
+    }
+    else {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    }
+  }
+}
+
+void BVH::queryBox(const AABB& box, std::vector<uint32_t>& out) const {
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  if (root == NONE) return;
+
+  thread_local std::vector<uint32_t> stack;
+  stack.clear();
+  stack.push_back(root);
+  while (!stack.empty()) {
+    const Node& node = nodes[stack.back()];
+    stack.pop_back();
+    if (!node.box.overlaps(box)) continue;
+    if (node.leaf()) {
+      out.push_back(node.data);
+    }
+    else {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    }
+  }
+}
+
+AABB BVH::fatBox(uint32_t proxy) const {
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return nodes[proxy].box;
+}
+
+size_t BVH::size() const {
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return leafCount;
+}
+
+int32_t BVH::height() const {
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return root == NONE ? 0 : nodes[root].height;
+}
+
+float BVH::cost() const {
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  return costLocked();
+}
@@ -0,0 +1,105 @@
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+#include "engine/capture.hpp"
+#include "engine/exception.hpp"
+
+#define file "src/engine/capture.cpp"
+
+FrameWriter::FrameWriter(const std::string& _path, Format _format) : format(_format), path(_path) {
+  if (format == RAW) {
+    raw = std::fopen(path.c_str(), "wb");
+    if (raw == nullptr) {
+      throw EngineException("failed to create capture file", file);
+    }
+  }
+  thread = std::thread(&FrameWriter::run, this);
+}
+
+FrameWriter::~FrameWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  workAvailable.notify_one();
+  if (thread.joinable()) {
+    thread.join();
+  }
+  if (raw != nullptr) {
+    std::fclose(raw);
+  }
+}
+
+void FrameWriter::write(CapturedFrame frame) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back(std::move(frame));
+  }
+  workAvailable.notify_one();
+}
+
+void FrameWriter::flush() {
+  std::unique_lock<std::mutex> lock(mutex);
+  workDone.wait(lock, [this] { return queue.empty() && !encoding; });
+  if (raw != nullptr) {
+    std::fflush(raw);
+  }
+}
+
+size_t FrameWriter::pending() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return queue.size() + (encoding ? 1 : 0);
+}
+
+uint64_t FrameWriter::framesWritten() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return written;
+}
+
+uint64_t FrameWriter::framesFailed() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return failed;
+}
+
+bool FrameWriter::encode(const CapturedFrame& frame) {
+  size_t size = size_t(frame.width) * frame.height * 4;
+  if (frame.width == 0 || frame.height == 0 || frame.pixels.size() < size) return false;
+
+  if (format == RAW) {
+    return std::fwrite(frame.pixels.data(), 1, size, raw) == size;
+  }
+
+  // names sort in frame order for over two weeks of capture at 60 fps
+  char number[24];
+  std::snprintf(number, sizeof(number), "%08llu", static_cast<unsigned long long>(frame.frame));
+  std::string name = path + number + ".png";
+  int stride = static_cast<int>(frame.width * 4);
+  return stbi_write_png(name.c_str(), static_cast<int>(frame.width), static_cast<int>(frame.height), 4, frame.pixels.data(), stride) != 0;
+}
+
+void FrameWriter::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    workAvailable.wait(lock, [this] { return stopping || !queue.empty(); });
+    // the destructor still writes what was queued before it
+    if (queue.empty()) break;
+
+    CapturedFrame frame = std::move(queue.front());
+    queue.pop_front();
+    encoding = true;
+    lock.unlock();
+
+    bool ok = encode(frame);
+
+    lock.lock();
+    encoding = false;
+    if (ok) {
+      written++;
+    }
+    else {
+      failed++;
+    }
+    if (queue.empty()) {
+      workDone.notify_all();
+    }
+  }
+}
@@ -0,0 +1,331 @@
+#include "engine/ecs.hpp"
+#include "engine/exception.hpp"
+#include "engine/jobs.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#define file "src/engine/ecs.cpp"
+
+// below this many nodes handing ranges to the job system costs more than it saves
+static const size_t PARALLEL_THRESHOLD = 16384;
+
+// out = a * b for column-major matrices, two result columns per AVX register
+static inline void multiplyMatrices(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+#ifdef __AVX__
+  const float* pa = glm::value_ptr(a);
+  const float* pb = glm::value_ptr(b);
+  float* po = glm::value_ptr(out);
+
+  __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(pa));
+  __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(pa + 4));
+  __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(pa + 8));
+  __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(pa + 12));
+
+  for (int j = 0; j < 16; j += 8) {
+    __m256 columns = _mm256_loadu_ps(pb + j);
+    __m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(columns, 0x00));
+    r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(columns, 0x55)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(columns, 0xAA)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(columns, 0xFF)));
+    _mm256_storeu_ps(po + j, r);
+  }
+#else
+  out = a * b;
+#endif
+}
+
+template <typename T>
+static void permute(std::vector<T>& values, const std::vector<uint32_t>& order) {
+  std::vector<T> reordered(values.size());
+  for (size_t k = 0; k < order.size(); k++) {
+    reordered[k] = values[order[k]];
+  }
+  values.swap(reordered);
+}
+
+void TransformStorage::insert(Entity e, const Transform& transform) {
+  if (index.contains(e)) {
+    set(e, transform);
+    return;
+  }
+  index.insert(e);
+  position.push_back(transform.position);
+  rotation.push_back(transform.rotation);
+  scale.push_back(transform.scale);
+  world.push_back(transform.matrix());
+  parent.push_back(NULL_ENTITY);
+  dirty.push_back(1);
+  orderDirty = true;
+}
+
+void TransformStorage::remove(Entity e) {
+  if (!index.contains(e)) return;
+  uint32_t slot = index.remove(e);
+  position[slot] = position.back();
+  rotation[slot] = rotation.back();
+  scale[slot] = scale.back();
+  world[slot] = world.back();
+  parent[slot] = parent.back();
+  dirty[slot] = dirty.back();
+  position.pop_back();
+  rotation.pop_back();
+  scale.pop_back();
+  world.pop_back();
+  parent.pop_back();
+  dirty.pop_back();
+  orderDirty = true;
+}
+
+Transform TransformStorage::get(Entity e) const {
+  uint32_t slot = index.find(e);
+  Transform transform;
+  transform.position = position[slot];
+  transform.rotation = rotation[slot];
+  transform.scale = scale[slot];
+  return transform;
+}
+
+void TransformStorage::set(Entity e, const Transform& transform) {
+  uint32_t slot = index.find(e);
+  position[slot] = transform.position;
+  rotation[slot] = transform.rotation;
+  scale[slot] = transform.scale;
+  dirty[slot] = 1;
+}
+
+void TransformStorage::setParent(Entity child, Entity parentEntity) {
+  uint32_t slot = index.find(child);
+  if (slot == SparseIndex::NONE) {
+    throw EngineException("entity has no transform", file);
+  }
+
+  for (Entity p = parentEntity; p != NULL_ENTITY;) {
+    if (p == child) {
+      throw EngineException("transform parent would create a cycle", file);
+    }
+    uint32_t parentIndex = index.find(p);
+    if (parentIndex == SparseIndex::NONE) {
+      throw EngineException("transform parent has no transform", file);
+    }
+    p = parent[parentIndex];
+  }
+
+  parent[slot] = parentEntity;
+  dirty[slot] = 1;
+  orderDirty = true;
+}
+
+Entity TransformStorage::getParent(Entity e) const {
+  return parent[index.find(e)];
+}
+
+void TransformStorage::sortByDepth() {
+  size_t count = position.size();
+
+  parentSlot.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    parentSlot[i] = parent[i] == NULL_ENTITY ? SparseIndex::NONE : index.find(parent[i]);
+    if (parentSlot[i] == SparseIndex::NONE && parent[i] != NULL_ENTITY) {
+      parent[i] = NULL_ENTITY;
+      dirty[i] = 1;
+    }
+  }
+
+  // walk up to the nearest node with a known depth, then fill in the chain
+  std::vector<uint32_t> depth(count, UINT32_MAX);
+  std::vector<uint32_t> chain;
+  uint32_t maxDepth = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint32_t node = static_cast<uint32_t>(i);
+    while (node != SparseIndex::NONE && depth[node] == UINT32_MAX) {
+      chain.push_back(node);
+      node = parentSlot[node];
+    }
+    uint32_t d = node == SparseIndex::NONE ? 0 : depth[node] + 1;
+    while (!chain.empty()) {
+      depth[chain.back()] = d++;
+      chain.pop_back();
+    }
+    maxDepth = std::max(maxDepth, depth[i]);
+  }
+
+  // stable counting sort keeps siblings in their previous relative order
+  levelStarts.assign(count > 0 ? maxDepth + 2 : 1, 0);
+  for (size_t i = 0; i < count; i++) {
+    levelStarts[depth[i] + 1]++;
+  }
+  for (size_t level = 1; level < levelStarts.size(); level++) {
+    levelStarts[level] += levelStarts[level - 1];
+  }
+
+  std::vector<uint32_t> order(count);
+  std::vector<size_t> next(levelStarts.begin(), levelStarts.end() - 1);
+  for (size_t i = 0; i < count; i++) {
+    order[next[depth[i]]++] = static_cast<uint32_t>(i);
+  }
+
+  permute(position, order);
+  permute(rotation, order);
+  permute(scale, order);
+  permute(world, order);
+  permute(parent, order);
+  permute(dirty, order);
+  index.reorder(order);
+
+  for (size_t i = 0; i < count; i++) {
+    parentSlot[i] = parent[i] == NULL_ENTITY ? SparseIndex::NONE : index.find(parent[i]);
+  }
+  orderDirty = false;
+}
+
+void TransformStorage::updateRange(size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    uint32_t p = parentSlot[i];
+    if (p != SparseIndex::NONE) {
+      dirty[i] |= dirty[p];
+    }
+    if (!dirty[i]) continue;
+
+    // translate * rotate * scale without the general matrix multiplies
+    glm::mat4 local = glm::mat4_cast(rotation[i]);
+    local[0] *= scale[i].x;
+    local[1] *= scale[i].y;
+    local[2] *= scale[i].z;
+    local[3] = glm::vec4(position[i], 1.0f);
+
+    if (p == SparseIndex::NONE) {
+      world[i] = local;
+    }
+    else {
+      multiplyMatrices(world[p], local, world[i]);
+    }
+  }
+}
+
+void TransformStorage::updateWorld(unsigned threads) {
+  if (orderDirty) {
+    sortByDepth();
+  }
+
+  size_t count = position.size();
+  if (threads <= 1 || count < PARALLEL_THRESHOLD) {
+    updateRange(0, count);
+  }
+  else {
+    // every level depends only on the levels before it, so each level is
+    // split into at most threads ranges and finished before the next starts
+    JobSystem& jobs = JobSystem::shared();
+    for (size_t level = 0; level + 1 < levelStarts.size(); level++) {
+      size_t levelBegin = levelStarts[level];
+      size_t levelSize = levelStarts[level + 1] - levelBegin;
+      size_t grain = std::max<size_t>((levelSize + threads - 1) / threads, PARALLEL_THRESHOLD / 16);
+      jobs.parallelFor(levelSize, grain, [this, levelBegin](size_t begin, size_t end) {
+        updateRange(levelBegin + begin, levelBegin + end);
+      });
+    }
+  }
+
+  changed.swap(dirty);
+  dirty.assign(count, 0);
+}
+
+Entity World::create() {
+  uint32_t index;
+  if (!freeIndices.empty()) {
+    index = freeIndices.back();
+    freeIndices.pop_back();
+  }
+  else {
+    if (generations.size() >= ENTITY_INDEX_MASK) {
+      throw EngineException("too many entities", file);
+    }
+    index = static_cast<uint32_t>(generations.size());
+    generations.push_back(0);
+  }
+  return (generations[index] << ENTITY_INDEX_BITS) | index;
+}
+
+void World::destroy(Entity e) {
+  if (!alive(e)) return;
+  transforms.remove(e);
+  removeRenderable(e);
+  removeBounds(e);
+
+  uint32_t index = entityIndex(e);
+  generations[index] = (generations[index] + 1) & (UINT32_MAX >> ENTITY_INDEX_BITS);
+  freeIndices.push_back(index);
+}
+
+bool World::alive(Entity e) const {
+  uint32_t index = entityIndex(e);
+  return index < generations.size() && generations[index] == entityGeneration(e);
+}
+
+void World::addRenderable(Entity e, const Renderable& renderable) {
+  renderables.insert(e, renderable);
+  renderablesVersion++;
+}
+
+void World::removeRenderable(Entity e) {
+  if (!renderables.has(e)) return;
+  renderables.remove(e);
+  renderablesVersion++;
+}
+
+void World::clear() {
+  generations.clear();
+  freeIndices.clear();
+  transforms = TransformStorage();
+  renderables = SparseSet<Renderable>();
+  renderablesVersion++;
+  bounds = SparseSet<Bounds>();
+  bvh.clear();
+}
+
+void World::setBounds(Entity e, const AABB& local) {
+  uint32_t slot = transforms.find(e);
+  AABB box = slot == SparseIndex::NONE ? local : local.transformed(transforms.world[slot]);
+
+  Bounds* existing = bounds.tryGet(e);
+  if (existing != nullptr) {
+    existing->local = local;
+    bvh.move(existing->proxy, box);
+    return;
+  }
+
+  Bounds b;
+  b.local = local;
+  b.proxy = bvh.insert(box, e);
+  bounds.insert(e, b);
+}
+
+void World::removeBounds(Entity e) {
+  Bounds* b = bounds.tryGet(e);
+  if (b == nullptr) return;
+  bvh.remove(b->proxy);
+  bounds.remove(e);
+}
+
+void World::updateBounds() {
+  movedProxies.clear();
+  movedBoxes.clear();
+
+  const std::vector<Entity>& entities = bounds.entities();
+  for (size_t i = 0; i < entities.size(); i++) {
+    uint32_t slot = transforms.find(entities[i]);
+    if (slot == SparseIndex::NONE || slot >= transforms.changed.size() || !transforms.changed[slot]) continue;
+    movedProxies.push_back(bounds[i].proxy);
+    movedBoxes.push_back(bounds[i].local.transformed(transforms.world[slot]));
+  }
+
+  if (!movedProxies.empty()) {
+    bvh.move(movedProxies, movedBoxes);
+  }
+  bvh.rebuildIfDegraded();
+}
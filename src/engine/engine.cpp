@@ -1,56 +1,122 @@
 #include "engine.hpp"
 
-void createObjects(Renderer* renderer) {
+#include <exception>
+
+std::vector<Transform> createTransforms() {
+  Transform transform;
+  transform.rotation = glm::angleAxis(glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+
+  std::vector<Transform> transforms(3, transform);
+  transforms[1].position = glm::vec3(1.5f, 0.0f, 0.0f);
+  transforms[2].position = glm::vec3(-1.5f, 0.0f, 0.0f);
+  return transforms;
+}
+
+// entities draw with the placeholder texture until the real one has streamed in
+void createObjects(Renderer* renderer, std::vector<Entity>& entities) {
   VulkanRenderer* vulkan = (VulkanRenderer*)renderer;
-  vulkan->createDescriptorPool(3);
+  vulkan->createDescriptorPool(1);
   VulkanPipeline pipeline;
   pipeline.vertShaderPath = "shaders/vert.spv";
   pipeline.fragShaderPath = "shaders/frag.spv";
   vulkan->createGraphicsPipeline(pipeline);
-  VulkanObject cube = vulkan->createObject("../assets/patch.png");
-  VulkanObject cube2 = vulkan->createObject("../assets/patch.png");
-  VulkanObject cube3 = vulkan->createObject("../assets/patch.png");
-  cube.updateUBO(vulkan->swapchainExtent);
-  cube2.updateUBO(vulkan->swapchainExtent);
-  cube3.updateUBO(vulkan->swapchainExtent);
-  cube2.ubo.model = glm::translate(cube2.ubo.model, glm::vec3(1.5f, 0.0f, 0.0f));
-  cube3.ubo.model = glm::translate(cube3.ubo.model, glm::vec3(-1.5f, 0.0f, 0.0f));
-  pipeline.objects.push_back(cube);
-  pipeline.objects.push_back(cube2);
-  pipeline.objects.push_back(cube3);
   vulkan->pipelines.push_back(pipeline);
+
+  uint32_t quad = vulkan->createQuadMesh();
+  uint32_t texture = vulkan->requestTexture("../assets/patch.png");
+  for (auto &transform : createTransforms()) {
+    entities.push_back(vulkan->spawn(0, quad, texture, transform));
+  }
+}
+
+// simulation entries map onto entities in spawn order
+void applyTransforms(VulkanRenderer* vulkan, const std::vector<Entity>& entities, const std::vector<Transform>& transforms) {
+  size_t count = std::min(transforms.size(), entities.size());
+  for (size_t i = 0; i < count; i++) {
+    vulkan->scene.transforms.set(entities[i], transforms[i]);
+  }
 }
 
 void Engine::run() {
-  Renderer* vulkan = new VulkanRenderer();
+  VulkanRenderer* vulkan = new VulkanRenderer();
   try {
-    vulkan->init(createObjects);
-    bool quit = false;
+    // written by mix-cook; without one textures are decoded from their sources
+    AssetManifest::loaded().load(assetManifest);
+    // built by mix-pack; without one every asset is read from disk
+    AssetPack::mounted().open(assetPack);
+
+    std::vector<Entity> entities;
+    vulkan->init([&entities](Renderer* renderer) {
+      createObjects(renderer, entities);
+    });
+    // keeps running silently without an output device
+    if (!audio.open(audioSettings)) {
+      std::cerr << "no audio device: " << SDL_GetError() << std::endl;
+    }
+
+    Simulation simulation(tickRate);
+    simulation.start(createTransforms(), update);
+
+    std::atomic<bool> quit(false);
+    std::exception_ptr renderError;
+
+    // the render thread only consumes snapshots, so blocking in present or
+    // on the GPU never delays input handling or simulation ticks
+    std::thread renderThread([&]() {
+      try {
+        std::vector<Transform> transforms;
+        while (!quit) {
+          if (vulkan->minimized) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+          }
+          const RenderSnapshot* snapshot = simulation.latest();
+          if (snapshot != nullptr) {
+            applyTransforms(vulkan, entities, simulation.interpolate(*snapshot, transforms));
+          }
+          vulkan->drawFrame();
+        }
+      }
+      catch (...) {
+        renderError = std::current_exception();
+        quit = true;
+      }
+    });
+
     SDL_Event e;
     while (!quit) {
-      while (SDL_PollEvent(&e)) {
-        switch (e.type) {
-          case SDL_WINDOWEVENT:
-            switch (e.window.type) {
-              case SDL_WINDOWEVENT_RESIZED:
-                vulkan->framebufferResized = true;
-                break;
-              case SDL_WINDOWEVENT_MINIMIZED:
-                vulkan->minimized = true;
-                break;
-              case SDL_WINDOWEVENT_RESTORED:
-                vulkan->minimized = false;
-                break;
-            }
-            break;
-          case SDL_QUIT:
-            quit = true;
-            break;
-        }
+      if (!SDL_WaitEventTimeout(&e, 10)) continue;
+      switch (e.type) {
+        case SDL_WINDOWEVENT:
+          switch (e.window.event) {
+            case SDL_WINDOWEVENT_RESIZED:
+              vulkan->framebufferResized = true;
+              break;
+            case SDL_WINDOWEVENT_MINIMIZED:
+              vulkan->minimized = true;
+              break;
+            case SDL_WINDOWEVENT_RESTORED:
+              vulkan->minimized = false;
+              break;
+          }
+          break;
+        case SDL_QUIT:
+          quit = true;
+          break;
+        default:
+          simulation.pushEvent(e);
+          break;
       }
-      vulkan->drawFrame();
     }
+
+    renderThread.join();
+    simulation.stop();
+    audio.close();
+    // the device and window are torn down even when the render thread failed
     vulkan->cleanup();
+    if (renderError) {
+      std::rethrow_exception(renderError);
+    }
   }
   catch(EngineException &e) {
     std::cerr << e.what() << std::endl;
@@ -0,0 +1,462 @@
+#include "engine/io.hpp"
+#include "engine/exception.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define MIX_IO_URING 1
+#endif
+
+#define file "src/engine/io.cpp"
+
+struct IoService::Request {
+  Result result;
+  Priority priority;
+  Callback callback;
+  uint64_t offset = 0;
+  // bytes wanted; for whole-file reads filled in once the file is opened
+  size_t size = 0;
+  bool wholeFile = false;
+  int fd = -1;
+  std::atomic<bool> cancelled{false};
+  struct iovec iov;
+};
+
+#ifdef MIX_IO_URING
+// the raw kernel interface, so there is no liburing dependency
+struct IoService::Ring {
+  int fd = -1;
+  unsigned depth = 0;
+  unsigned inFlight = 0;
+
+  void* sqRing = MAP_FAILED;
+  size_t sqRingSize = 0;
+  void* cqRing = MAP_FAILED;
+  size_t cqRingSize = 0;
+  io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+  size_t sqesSize = 0;
+
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqArray;
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  io_uring_cqe* cqes;
+
+  bool setup(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) return false;
+    depth = params.sq_entries;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap) {
+      sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) return false;
+    if (singleMap) {
+      cqRing = sqRing;
+    }
+    else {
+      cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if (cqRing == MAP_FAILED) return false;
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED) return false;
+
+    char* sq = static_cast<char*>(sqRing);
+    char* cq = static_cast<char*>(cqRing);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  ~Ring() {
+    if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+    if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+    if (fd >= 0) close(fd);
+  }
+
+  // only the ring thread submits, so the tail needs no atomics beyond the release store
+  void pushRead(Request* request) {
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+
+    size_t done = request->result.bytes;
+    request->iov.iov_base = request->result.buffer + done;
+    request->iov.iov_len = request->size - done;
+
+    // READV rather than READ keeps this working on 5.1+ kernels
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = request->fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&request->iov);
+    sqe->len = 1;
+    sqe->off = request->offset + done;
+    sqe->user_data = reinterpret_cast<uint64_t>(request);
+
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    inFlight++;
+  }
+
+  int enter(unsigned toSubmit, unsigned minComplete) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, IORING_ENTER_GETEVENTS, nullptr, 0));
+  }
+};
+#else
+struct IoService::Ring {};
+#endif
+
+IoService::IoService(unsigned workerCount, unsigned queueDepth) {
+#ifdef MIX_IO_URING
+  std::unique_ptr<Ring> candidate(new Ring());
+  if (candidate->setup(std::max(queueDepth, 1u))) {
+    ring = std::move(candidate);
+    ringThread = std::thread(&IoService::runRing, this);
+  }
+#else
+  (void)queueDepth;
+#endif
+
+  for (unsigned i = 0; i < std::max(workerCount, 1u); i++) {
+    workers.emplace_back(&IoService::runWorker, this);
+  }
+}
+
+IoService::~IoService() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    for (auto &queue : queues) {
+      while (!queue.empty()) {
+        queue.front()->result.error = ECANCELED;
+        completed.push_back(std::move(queue.front()));
+        queue.pop_front();
+      }
+    }
+  }
+  workAvailable.notify_all();
+
+  // the ring thread finishes what is in flight before the workers are told to stop
+  if (ringThread.joinable()) {
+    ringThread.join();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    workersStopping = true;
+  }
+  workAvailable.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+IoService& IoService::shared() {
+  static IoService service;
+  return service;
+}
+
+IoService::RequestId IoService::read(const std::string& path, void* buffer, size_t size, uint64_t offset, Callback callback, Priority priority) {
+  std::unique_ptr<Request> request(new Request());
+  request->result.path = path;
+  request->result.buffer = static_cast<char*>(buffer);
+  request->size = size;
+  request->offset = offset;
+  request->callback = std::move(callback);
+  request->priority = priority;
+  return submit(std::move(request));
+}
+
+IoService::RequestId IoService::readFile(const std::string& path, Callback callback, Priority priority) {
+  std::unique_ptr<Request> request(new Request());
+  request->result.path = path;
+  request->wholeFile = true;
+  request->callback = std::move(callback);
+  request->priority = priority;
+  return submit(std::move(request));
+}
+
+IoService::RequestId IoService::submit(std::unique_ptr<Request> request) {
+  RequestId id;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping) {
+      throw EngineException("io service is shutting down", file);
+    }
+    id = nextId++;
+    request->result.id = id;
+    active[id] = request.get();
+    queues[request->priority].push_back(std::move(request));
+  }
+  workAvailable.notify_all();
+  return id;
+}
+
+// callers hold the mutex
+std::unique_ptr<IoService::Request> IoService::popQueued() {
+  for (auto &queue : queues) {
+    if (!queue.empty()) {
+      std::unique_ptr<Request> request = std::move(queue.front());
+      queue.pop_front();
+      return request;
+    }
+  }
+  return nullptr;
+}
+
+bool IoService::cancel(RequestId id) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = active.find(id);
+    if (it == active.end()) return false;
+    Request* target = it->second;
+    target->cancelled = true;
+
+    auto &queue = queues[target->priority];
+    for (auto request = queue.begin(); request != queue.end(); ++request) {
+      if (request->get() == target) {
+        target->result.error = ECANCELED;
+        completed.push_back(std::move(*request));
+        queue.erase(request);
+        break;
+      }
+    }
+  }
+  workAvailable.notify_all();
+  return true;
+}
+
+void IoService::wait(RequestId id) {
+  std::unique_lock<std::mutex> lock(mutex);
+  requestDone.wait(lock, [&]() { return active.find(id) == active.end(); });
+}
+
+// opens the file and sizes whole-file reads; sets result.error on failure
+static bool openRequest(int& fd, const std::string& path, bool wholeFile, size_t& size, std::vector<char>& data, char*& buffer, int& error) {
+  fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    error = errno;
+    return false;
+  }
+  if (wholeFile) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      error = errno;
+      return false;
+    }
+    size = static_cast<size_t>(info.st_size);
+    data.resize(size);
+    buffer = data.data();
+  }
+  return true;
+}
+
+void IoService::perform(Request& request) {
+  Result& result = request.result;
+  if (!openRequest(request.fd, result.path, request.wholeFile, request.size, result.data, result.buffer, result.error)) {
+    return;
+  }
+
+  while (result.bytes < request.size) {
+    if (request.cancelled) {
+      result.error = ECANCELED;
+      return;
+    }
+    ssize_t count = pread(request.fd, result.buffer + result.bytes, request.size - result.bytes, static_cast<off_t>(request.offset + result.bytes));
+    if (count < 0) {
+      if (errno == EINTR) continue;
+      result.error = errno;
+      return;
+    }
+    if (count == 0) break;
+    result.bytes += static_cast<size_t>(count);
+  }
+}
+
+void IoService::complete(std::unique_ptr<Request> request) {
+  if (request->fd >= 0) {
+    close(request->fd);
+    request->fd = -1;
+  }
+  if (request->cancelled && request->result.error == 0) {
+    request->result.error = ECANCELED;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    completed.push_back(std::move(request));
+  }
+  workAvailable.notify_one();
+}
+
+void IoService::deliver(std::unique_ptr<Request> request) {
+  if (request->wholeFile) {
+    request->result.data.resize(request->result.bytes);
+    request->result.buffer = request->result.data.data();
+  }
+  if (request->callback) {
+    request->callback(request->result);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    active.erase(request->result.id);
+  }
+  requestDone.notify_all();
+}
+
+void IoService::runWorker() {
+  while (true) {
+    std::unique_ptr<Request> request;
+    bool read = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      workAvailable.wait(lock, [&]() {
+        if (!completed.empty() || workersStopping) return true;
+        if (ring) return false;
+        for (auto &queue : queues) {
+          if (!queue.empty()) return true;
+        }
+        return false;
+      });
+
+      if (!completed.empty()) {
+        request = std::move(completed.front());
+        completed.pop_front();
+      }
+      else if (!ring && (request = popQueued()) != nullptr) {
+        read = true;
+      }
+      else if (workersStopping) {
+        return;
+      }
+    }
+
+    if (read) {
+      perform(*request);
+      if (request->fd >= 0) {
+        close(request->fd);
+        request->fd = -1;
+      }
+      if (request->cancelled && request->result.error == 0) {
+        request->result.error = ECANCELED;
+      }
+    }
+    if (request) {
+      deliver(std::move(request));
+    }
+  }
+}
+
+void IoService::runRing() {
+#ifdef MIX_IO_URING
+  // continuations of short reads go out ahead of new requests
+  std::vector<Request*> resubmit;
+  unsigned unsubmitted = 0;
+
+  while (true) {
+    std::vector<std::unique_ptr<Request>> batch;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (ring->inFlight == 0 && resubmit.empty()) {
+        workAvailable.wait(lock, [&]() {
+          if (stopping) return true;
+          for (auto &queue : queues) {
+            if (!queue.empty()) return true;
+          }
+          return false;
+        });
+        if (stopping) return;
+      }
+      while (ring->inFlight + resubmit.size() + batch.size() < ring->depth) {
+        std::unique_ptr<Request> request = popQueued();
+        if (!request) break;
+        batch.push_back(std::move(request));
+      }
+    }
+
+    unsigned submitted = 0;
+    for (Request* request : resubmit) {
+      ring->pushRead(request);
+      submitted++;
+    }
+    resubmit.clear();
+
+    for (auto &request : batch) {
+      Result& result = request->result;
+      if (request->cancelled) {
+        result.error = ECANCELED;
+        complete(std::move(request));
+        continue;
+      }
+      if (!openRequest(request->fd, result.path, request->wholeFile, request->size, result.data, result.buffer, result.error) || request->size == 0) {
+        complete(std::move(request));
+        continue;
+      }
+      // owned by the ring until its completion is reaped
+      ring->pushRead(request.release());
+      submitted++;
+    }
+
+    // blocks for at least one completion, which bounds how long a new
+    // request can sit in the queue while reads are in flight. Entries the
+    // kernel didn't take (EAGAIN/EBUSY) stay in the ring for the next call
+    unsubmitted += submitted;
+    int consumed = ring->enter(unsubmitted, ring->inFlight > 0 ? 1 : 0);
+    if (consumed > 0) {
+      unsubmitted -= static_cast<unsigned>(consumed);
+    }
+
+    unsigned head = *ring->cqHead;
+    while (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+      io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+      std::unique_ptr<Request> request(reinterpret_cast<Request*>(cqe->user_data));
+      int res = cqe->res;
+      head++;
+      ring->inFlight--;
+
+      if (res == -EINTR || res == -EAGAIN) {
+        resubmit.push_back(request.release());
+        continue;
+      }
+      if (res < 0) {
+        request->result.error = -res;
+      }
+      else {
+        request->result.bytes += static_cast<size_t>(res);
+        if (res > 0 && request->result.bytes < request->size && !request->cancelled) {
+          resubmit.push_back(request.release());
+          continue;
+        }
+      }
+      complete(std::move(request));
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+  }
+#endif
+}
@@ -0,0 +1,282 @@
+#include "engine/jobs.hpp"
+
+#include <algorithm>
+
+struct JobSystem::Job {
+  Function fn;
+  JobCounter* counter;
+};
+
+// Chase-Lev deque after Lê et al., "Correct and Efficient Work-Stealing for
+// Weak Memory Models" (2013), with a fixed ring; a full deque makes the
+// owner fall back to the shared queue instead of growing.
+struct JobSystem::Deque {
+  static const int64_t CAPACITY = 4096;
+
+  std::atomic<int64_t> top{0};
+  std::atomic<int64_t> bottom{0};
+  std::atomic<Job*> buffer[CAPACITY];
+
+  // owner only
+  bool push(Job* job) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY) return false;
+
+    buffer[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // owner only
+  Job* pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if (t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    Job* job = buffer[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+      // last one, race the thieves for it
+      if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        job = nullptr;
+      }
+      bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+  }
+
+  // any thread
+  Job* steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) return nullptr;
+
+    Job* job = buffer[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return job;
+  }
+};
+
+struct JobSystem::Worker {
+  Deque deque;
+  std::thread thread;
+};
+
+// which system and worker the current thread belongs to, if any
+static thread_local const JobSystem* currentSystem = nullptr;
+static thread_local int currentWorker = -1;
+
+bool JobCounter::done() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return pending == 0;
+}
+
+JobSystem::JobSystem(unsigned workerCount) {
+  for (unsigned i = 0; i < workerCount; i++) {
+    workers.push_back(std::unique_ptr<Worker>(new Worker()));
+  }
+  // started separately so no worker steals from a deque still being built
+  for (unsigned i = 0; i < workerCount; i++) {
+    workers[i]->thread = std::thread(&JobSystem::runWorker, this, i);
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+    wakeups++;
+  }
+  wake.notify_all();
+  for (auto &worker : workers) {
+    worker->thread.join();
+  }
+
+  // nobody waits on jobs still queued at shutdown
+  for (auto &worker : workers) {
+    while (Job* job = worker->deque.pop()) {
+      delete job;
+    }
+  }
+  for (Job* job : injected) {
+    delete job;
+  }
+}
+
+JobSystem& JobSystem::shared() {
+  static JobSystem system(std::max(1u, std::thread::hardware_concurrency()) - 1);
+  return system;
+}
+
+void JobSystem::schedule(Job* job) {
+  if (currentSystem != this || !workers[currentWorker]->deque.push(job)) {
+    std::lock_guard<std::mutex> lock(injectedMutex);
+    injected.push_back(job);
+    injectedCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // pairs with the fence in runWorker: either a worker going to sleep sees
+  // this job, or this sees the sleeper and wakes it
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping.load(std::memory_order_relaxed) > 0) {
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      wakeups++;
+    }
+    wake.notify_one();
+  }
+}
+
+JobSystem::Job* JobSystem::findWork(int self) {
+  if (self >= 0) {
+    if (Job* job = workers[self]->deque.pop()) return job;
+  }
+
+  if (injectedCount.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> lock(injectedMutex);
+    if (!injected.empty()) {
+      Job* job = injected.front();
+      injected.pop_front();
+      injectedCount.fetch_sub(1, std::memory_order_relaxed);
+      return job;
+    }
+  }
+
+  // start at a different victim each time so thieves spread out
+  static thread_local uint32_t seed = 0x9e3779b9u;
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  size_t count = workers.size();
+  for (size_t i = 0; i < count; i++) {
+    size_t victim = (seed + i) % count;
+    if (static_cast<int>(victim) == self) continue;
+    if (Job* job = workers[victim]->deque.steal()) return job;
+  }
+  return nullptr;
+}
+
+void JobSystem::execute(Job* job) {
+  job->fn();
+  JobCounter* counter = job->counter;
+  delete job;
+  complete(counter);
+}
+
+void JobSystem::complete(JobCounter* counter) {
+  if (counter == nullptr) return;
+
+  std::vector<std::function<void()>> continuations;
+  {
+    std::lock_guard<std::mutex> lock(counter->mutex);
+    if (--counter->pending > 0) return;
+    continuations.swap(counter->continuations);
+  }
+  // the counter may be gone by now, only the moved out list is used
+  for (auto &continuation : continuations) {
+    continuation();
+  }
+}
+
+void JobSystem::run(Function fn, JobCounter* counter) {
+  if (counter != nullptr) {
+    std::lock_guard<std::mutex> lock(counter->mutex);
+    counter->pending++;
+  }
+  schedule(new Job{std::move(fn), counter});
+}
+
+void JobSystem::runAfter(JobCounter& dependency, Function fn, JobCounter* counter) {
+  if (counter != nullptr) {
+    std::lock_guard<std::mutex> lock(counter->mutex);
+    counter->pending++;
+  }
+  Job* job = new Job{std::move(fn), counter};
+
+  {
+    std::lock_guard<std::mutex> lock(dependency.mutex);
+    if (dependency.pending > 0) {
+      dependency.continuations.push_back([this, job]() { schedule(job); });
+      return;
+    }
+  }
+  schedule(job);
+}
+
+void JobSystem::wait(JobCounter& counter) {
+  int self = currentSystem == this ? currentWorker : -1;
+  while (!counter.done()) {
+    if (Job* job = findWork(self)) {
+      execute(job);
+    }
+    else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void JobSystem::parallelFor(size_t count, size_t grain, const std::function<void(size_t begin, size_t end)>& fn) {
+  grain = std::max<size_t>(grain, 1);
+  // a few ranges per thread leave room for stealing to even out the load
+  size_t ranges = std::min((count + grain - 1) / grain, size_t(workers.size() + 1) * 4);
+  if (ranges <= 1) {
+    if (count > 0) fn(0, count);
+    return;
+  }
+
+  size_t size = (count + ranges - 1) / ranges;
+  JobCounter counter;
+  // the caller takes the first range itself instead of queueing it
+  for (size_t begin = size; begin < count; begin += size) {
+    size_t end = std::min(count, begin + size);
+    run([&fn, begin, end]() { fn(begin, end); }, &counter);
+  }
+  fn(0, std::min(count, size));
+  wait(counter);
+}
+
+void JobSystem::runWorker(unsigned index) {
+  currentSystem = this;
+  currentWorker = static_cast<int>(index);
+
+  unsigned idle = 0;
+  while (!stopping.load(std::memory_order_relaxed)) {
+    if (Job* job = findWork(currentWorker)) {
+      execute(job);
+      idle = 0;
+      continue;
+    }
+    if (++idle < 64) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    uint64_t seen;
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      seen = wakeups;
+    }
+    sleeping.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Job* job = findWork(currentWorker);
+    if (job == nullptr) {
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      wake.wait(lock, [&]() { return wakeups != seen; });
+    }
+    sleeping.fetch_sub(1, std::memory_order_relaxed);
+
+    if (job != nullptr) {
+      execute(job);
+    }
+    idle = 0;
+  }
+}
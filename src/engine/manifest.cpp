@@ -0,0 +1,99 @@
+#include "engine/manifest.hpp"
+#include "engine/exception.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+#define file "src/engine/manifest.cpp"
+
+bool parseCookedTexture(const char* data, size_t size, int& width, int& height, const unsigned char*& texels) {
+  if (size < sizeof(CookedTextureHeader)) return false;
+
+  CookedTextureHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != COOKED_TEXTURE_MAGIC || header.version != COOKED_TEXTURE_VERSION) return false;
+  if (uint64_t(header.width) * header.height * 4 != size - sizeof(header)) return false;
+
+  width = static_cast<int>(header.width);
+  height = static_cast<int>(header.height);
+  texels = reinterpret_cast<const unsigned char*>(data + sizeof(header));
+  return true;
+}
+
+AssetManifest& AssetManifest::loaded() {
+  static AssetManifest manifest;
+  return manifest;
+}
+
+static const char* kindNames[] = {"shader", "texture"};
+
+bool AssetManifest::load(const std::string& path) {
+  std::ifstream in(path);
+  if (!in.is_open()) return false;
+
+  std::string magic;
+  uint32_t version = 0;
+  in >> magic >> version;
+  if (magic != "mix-manifest" || version != MANIFEST_VERSION) {
+    throw EngineException("not a supported asset manifest", file);
+  }
+
+  entries.clear();
+  std::string line;
+  std::getline(in, line);
+  while (std::getline(in, line)) {
+    if (line.empty()) continue;
+
+    std::istringstream fields(line);
+    std::string kind, hash, name;
+    Entry entry;
+    if (!(fields >> kind >> hash >> name >> entry.cooked)) {
+      throw EngineException("malformed asset manifest line", file);
+    }
+    if (kind == kindNames[SHADER]) entry.kind = SHADER;
+    else if (kind == kindNames[TEXTURE]) entry.kind = TEXTURE;
+    else throw EngineException("unknown asset kind in manifest", file);
+    entry.hash = std::stoull(hash, nullptr, 16);
+    entries[name] = entry;
+  }
+  return true;
+}
+
+void AssetManifest::save(const std::string& path) const {
+  // sorted so unchanged assets give an unchanged file
+  std::vector<const std::pair<const std::string, Entry>*> sorted;
+  for (auto &entry : entries) {
+    sorted.push_back(&entry);
+  }
+  std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) { return a->first < b->first; });
+
+  // written beside the old one and renamed, a failed cook never leaves half a manifest
+  std::string temporary = path + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::trunc);
+    if (!out.is_open()) {
+      throw EngineException("failed to create asset manifest", file);
+    }
+    out << "mix-manifest " << MANIFEST_VERSION << "\n";
+    for (auto entry : sorted) {
+      char hash[17];
+      snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(entry->second.hash));
+      out << kindNames[entry->second.kind] << " " << hash << " " << entry->first << " " << entry->second.cooked << "\n";
+    }
+    if (!out.good()) {
+      throw EngineException("failed to write asset manifest", file);
+    }
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    throw EngineException("failed to replace asset manifest", file);
+  }
+}
+
+const AssetManifest::Entry* AssetManifest::find(const std::string& name) const {
+  auto it = entries.find(name);
+  return it == entries.end() ? nullptr : &it->second;
+}
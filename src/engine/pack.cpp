@@ -0,0 +1,321 @@
+#include "engine/pack.hpp"
+#include "engine/exception.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef MIX_HAS_LZ4
+#include <lz4.h>
+#endif
+
+#define file "src/engine/pack.cpp"
+
+uint64_t hashAssetName(const std::string& name) {
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : name) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+AssetPack::~AssetPack() {
+  close();
+}
+
+AssetPack& AssetPack::mounted() {
+  static AssetPack pack;
+  return pack;
+}
+
+bool AssetPack::open(const std::string& path) {
+  close();
+
+  fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT) return false;
+    throw EngineException("failed to open asset pack", file);
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(PackHeader)) {
+    close();
+    throw EngineException("asset pack is truncated", file);
+  }
+  mappedSize = static_cast<size_t>(info.st_size);
+
+  void* mapped = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED) {
+    close();
+    throw EngineException("failed to map asset pack", file);
+  }
+  base = static_cast<const char*>(mapped);
+
+  header = reinterpret_cast<const PackHeader*>(base);
+  try {
+    validate();
+  }
+  catch (...) {
+    close();
+    throw;
+  }
+  entries = reinterpret_cast<const PackEntry*>(base + header->entriesOffset);
+  chunks = reinterpret_cast<const PackChunk*>(base + header->chunksOffset);
+  names = base + header->namesOffset;
+  return true;
+}
+
+// every offset is checked once here so lookups can trust the tables
+void AssetPack::validate() const {
+  if (header->magic != PACK_MAGIC || header->version != PACK_VERSION) {
+    throw EngineException("not a supported asset pack", file);
+  }
+
+  auto inside = [&](uint64_t offset, uint64_t size) {
+    return offset <= mappedSize && size <= mappedSize - offset;
+  };
+  if (!inside(header->entriesOffset, uint64_t(header->entryCount) * sizeof(PackEntry))
+      || !inside(header->chunksOffset, uint64_t(header->chunkCount) * sizeof(PackChunk))
+      || !inside(header->namesOffset, header->namesSize)
+      || header->entriesOffset % alignof(PackEntry) != 0
+      || header->chunksOffset % alignof(PackChunk) != 0) {
+    throw EngineException("asset pack tables are out of bounds", file);
+  }
+
+  const PackEntry* table = reinterpret_cast<const PackEntry*>(base + header->entriesOffset);
+  const PackChunk* chunkTable = reinterpret_cast<const PackChunk*>(base + header->chunksOffset);
+  for (uint32_t i = 0; i < header->entryCount; i++) {
+    const PackEntry& entry = table[i];
+    if (i > 0 && table[i - 1].nameHash > entry.nameHash) {
+      throw EngineException("asset pack table is not sorted", file);
+    }
+    if (!inside(entry.nameOffset, entry.nameLength) || uint64_t(entry.nameOffset) + entry.nameLength > header->namesSize
+        || !inside(entry.offset, entry.storedSize)) {
+      throw EngineException("asset pack entry is out of bounds", file);
+    }
+    if (uint64_t(entry.firstChunk) + entry.chunkCount > header->chunkCount) {
+      throw EngineException("asset pack chunk range is out of bounds", file);
+    }
+    // view and read trust size, so it has to match what is stored
+    if (entry.chunkCount == 0 && entry.size != entry.storedSize) {
+      throw EngineException("asset pack entry size doesn't match its data", file);
+    }
+    uint64_t chunked = 0;
+    for (uint32_t c = 0; c < entry.chunkCount; c++) {
+      const PackChunk& chunk = chunkTable[entry.firstChunk + c];
+      if (!inside(chunk.offset, chunk.storedSize) || chunk.size > PACK_CHUNK_SIZE) {
+        throw EngineException("asset pack chunk is out of bounds", file);
+      }
+      chunked += chunk.size;
+    }
+    if (entry.chunkCount > 0 && chunked != entry.size) {
+      throw EngineException("asset pack entry size doesn't match its chunks", file);
+    }
+  }
+}
+
+void AssetPack::close() {
+  if (base != nullptr) {
+    munmap(const_cast<char*>(base), mappedSize);
+  }
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  fd = -1;
+  base = nullptr;
+  mappedSize = 0;
+  header = nullptr;
+  entries = nullptr;
+  chunks = nullptr;
+  names = nullptr;
+}
+
+const PackEntry* AssetPack::find(const std::string& name) const {
+  if (!isOpen()) return nullptr;
+
+  uint64_t hash = hashAssetName(name);
+  const PackEntry* end = entries + header->entryCount;
+  const PackEntry* it = std::lower_bound(entries, end, hash, [](const PackEntry& entry, uint64_t value) {
+    return entry.nameHash < value;
+  });
+  // colliding hashes sit next to each other, the name settles it
+  for (; it != end && it->nameHash == hash; ++it) {
+    if (it->nameLength == name.size() && memcmp(names + it->nameOffset, name.data(), name.size()) == 0) {
+      return it;
+    }
+  }
+  return nullptr;
+}
+
+PackSpan AssetPack::view(const std::string& name) const {
+  PackSpan span;
+  const PackEntry* entry = find(name);
+  if (entry != nullptr && entry->chunkCount == 0) {
+    span.data = base + entry->offset;
+    span.size = static_cast<size_t>(entry->size);
+  }
+  return span;
+}
+
+bool AssetPack::read(const std::string& name, std::vector<char>& out) const {
+  const PackEntry* entry = find(name);
+  if (entry == nullptr) return false;
+
+  out.resize(static_cast<size_t>(entry->size));
+  if (entry->chunkCount == 0) {
+    memcpy(out.data(), base + entry->offset, out.size());
+    return true;
+  }
+
+  size_t written = 0;
+  for (uint32_t c = 0; c < entry->chunkCount; c++) {
+    const PackChunk& chunk = chunks[entry->firstChunk + c];
+    if (written + chunk.size > out.size()) {
+      throw EngineException("asset pack chunk overruns its entry", file);
+    }
+    if (chunk.storedSize == chunk.size) {
+      memcpy(out.data() + written, base + chunk.offset, chunk.size);
+    }
+    else {
+#ifdef MIX_HAS_LZ4
+      int decoded = LZ4_decompress_safe(base + chunk.offset, out.data() + written, static_cast<int>(chunk.storedSize), static_cast<int>(chunk.size));
+      if (decoded != static_cast<int>(chunk.size)) {
+        throw EngineException("failed to decompress asset pack chunk", file);
+      }
+#else
+      throw EngineException("LZ4 support wasn't built", file);
+#endif
+    }
+    written += chunk.size;
+  }
+  if (written != out.size()) {
+    throw EngineException("asset pack entry is missing chunks", file);
+  }
+  return true;
+}
+
+void AssetPackWriter::add(const std::string& name, std::vector<char> data, bool compress) {
+  Pending entry;
+  entry.name = name;
+  entry.data = std::move(data);
+  entry.compress = compress;
+  pending.push_back(std::move(entry));
+}
+
+void AssetPackWriter::write(const std::string& path) const {
+  std::vector<size_t> order(pending.size());
+  std::vector<uint64_t> hashes(pending.size());
+  for (size_t i = 0; i < pending.size(); i++) {
+    order[i] = i;
+    hashes[i] = hashAssetName(pending[i].name);
+  }
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return hashes[a] != hashes[b] ? hashes[a] < hashes[b] : pending[a].name < pending[b].name;
+  });
+
+  // compress first, the tables need every stored size before data is placed
+  std::vector<std::vector<char>> stored(pending.size());
+  std::vector<std::vector<PackChunk>> entryChunks(pending.size());
+  for (size_t i = 0; i < pending.size(); i++) {
+    const std::vector<char>& data = pending[i].data;
+#ifdef MIX_HAS_LZ4
+    if (pending[i].compress && !data.empty()) {
+      std::vector<char> packed;
+      std::vector<char> scratch(LZ4_compressBound(static_cast<int>(PACK_CHUNK_SIZE)));
+      for (size_t start = 0; start < data.size(); start += PACK_CHUNK_SIZE) {
+        int size = static_cast<int>(std::min<size_t>(PACK_CHUNK_SIZE, data.size() - start));
+        int compressed = LZ4_compress_default(data.data() + start, scratch.data(), size, static_cast<int>(scratch.size()));
+
+        PackChunk chunk;
+        chunk.offset = packed.size();
+        chunk.size = static_cast<uint32_t>(size);
+        if (compressed > 0 && compressed < size) {
+          chunk.storedSize = static_cast<uint32_t>(compressed);
+          packed.insert(packed.end(), scratch.begin(), scratch.begin() + compressed);
+        }
+        else {
+          chunk.storedSize = chunk.size;
+          packed.insert(packed.end(), data.begin() + start, data.begin() + start + size);
+        }
+        entryChunks[i].push_back(chunk);
+      }
+      if (packed.size() < data.size()) {
+        stored[i].swap(packed);
+        continue;
+      }
+      entryChunks[i].clear();
+    }
+#endif
+    stored[i] = data;
+  }
+
+  PackHeader header = {};
+  header.magic = PACK_MAGIC;
+  header.version = PACK_VERSION;
+  header.entryCount = static_cast<uint32_t>(pending.size());
+
+  std::string names;
+  std::vector<PackEntry> entries(pending.size());
+  std::vector<PackChunk> chunks;
+  for (size_t k = 0; k < order.size(); k++) {
+    size_t i = order[k];
+    PackEntry& entry = entries[k];
+    entry.nameHash = hashes[i];
+    entry.nameOffset = static_cast<uint32_t>(names.size());
+    entry.nameLength = static_cast<uint32_t>(pending[i].name.size());
+    names += pending[i].name;
+    entry.size = pending[i].data.size();
+    entry.storedSize = stored[i].size();
+    entry.firstChunk = static_cast<uint32_t>(chunks.size());
+    entry.chunkCount = static_cast<uint32_t>(entryChunks[i].size());
+    chunks.insert(chunks.end(), entryChunks[i].begin(), entryChunks[i].end());
+  }
+  header.chunkCount = static_cast<uint32_t>(chunks.size());
+
+  header.entriesOffset = sizeof(PackHeader);
+  header.chunksOffset = header.entriesOffset + entries.size() * sizeof(PackEntry);
+  header.namesOffset = header.chunksOffset + chunks.size() * sizeof(PackChunk);
+  header.namesSize = names.size();
+
+  // chunk offsets are relative to their entry until the data is placed
+  uint64_t offset = alignUp(header.namesOffset + header.namesSize, PACK_ALIGNMENT);
+  for (auto &entry : entries) {
+    entry.offset = offset;
+    for (uint32_t c = 0; c < entry.chunkCount; c++) {
+      chunks[entry.firstChunk + c].offset += offset;
+    }
+    offset = alignUp(offset + entry.storedSize, PACK_ALIGNMENT);
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    throw EngineException("failed to create asset pack", file);
+  }
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(PackEntry));
+  out.write(reinterpret_cast<const char*>(chunks.data()), chunks.size() * sizeof(PackChunk));
+  out.write(names.data(), names.size());
+
+  uint64_t position = header.namesOffset + header.namesSize;
+  const char padding[PACK_ALIGNMENT] = {};
+  for (size_t k = 0; k < order.size(); k++) {
+    const std::vector<char>& data = stored[order[k]];
+    out.write(padding, entries[k].offset - position);
+    out.write(data.data(), data.size());
+    position = entries[k].offset + data.size();
+  }
+  if (!out.good()) {
+    throw EngineException("failed to write asset pack", file);
+  }
+}
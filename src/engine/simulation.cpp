@@ -0,0 +1,84 @@
+#include "engine/simulation.hpp"
+
+#include <algorithm>
+
+void Simulation::start(std::vector<Transform> initial, UpdateFunc func) {
+  previous = initial;
+  current = initial;
+  update = func;
+  tick = 0;
+  publish();
+
+  running = true;
+  thread = std::thread(&Simulation::loop, this);
+}
+
+void Simulation::stop() {
+  running = false;
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+void Simulation::pushEvent(const SDL_Event& e) {
+  std::lock_guard<std::mutex> lock(inputMutex);
+  pendingEvents.push_back(e);
+}
+
+void Simulation::publish() {
+  RenderSnapshot& snapshot = snapshots.writeBuffer();
+  snapshot.tick = tick;
+  snapshot.time = std::chrono::steady_clock::now();
+  snapshot.previous.assign(previous.begin(), previous.end());
+  snapshot.current.assign(current.begin(), current.end());
+  snapshots.publish();
+}
+
+void Simulation::loop() {
+  auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(tickSeconds));
+  auto next = std::chrono::steady_clock::now() + interval;
+
+  while (running) {
+    {
+      std::lock_guard<std::mutex> lock(inputMutex);
+      events.swap(pendingEvents);
+    }
+
+    previous = current;
+    if (update) {
+      update(current, events, tickSeconds);
+    }
+    events.clear();
+    tick++;
+    publish();
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - next > interval * 5) {
+      // too far behind to catch up, drop the missed ticks instead of spiralling
+      next = now;
+    }
+    std::this_thread::sleep_until(next);
+    next += interval;
+  }
+}
+
+const RenderSnapshot* Simulation::latest() {
+  if (snapshots.update()) {
+    received = true;
+  }
+  return received ? &snapshots.readBuffer() : nullptr;
+}
+
+std::vector<Transform>& Simulation::interpolate(const RenderSnapshot& snapshot, std::vector<Transform>& out) const {
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - snapshot.time).count();
+  float alpha = static_cast<float>(std::clamp(elapsed / tickSeconds, 0.0, 1.0));
+
+  out.resize(snapshot.current.size());
+  for (size_t i = 0; i < snapshot.current.size(); i++) {
+    // entities spawned this tick have nothing to interpolate from
+    out[i] = i < snapshot.previous.size()
+      ? Transform::interpolate(snapshot.previous[i], snapshot.current[i], alpha)
+      : snapshot.current[i];
+  }
+  return out;
+}
@@ -1,20 +1,25 @@
 #include "engine/utils.hpp"
+#include "engine/io.hpp"
+#include "engine/pack.hpp"
 #define File "src/engine/utils/file.cpp"
 
 std::vector<char> readFile (const std::string& filename) {
-  std::ifstream file (filename, std::ios::ate | std::ios::binary);
-
-  if (!file.is_open()) {
-    throw EngineException("failed to open file", File);
+  std::vector<char> buffer;
+  if (AssetPack::mounted().read(filename, buffer)) {
+    return buffer;
   }
 
-  size_t size = static_cast<size_t>(file.tellg());
-  std::vector<char> buffer(size);
+  int error = 0;
 
-  file.seekg(0);
-  file.read(buffer.data(), size);
+  IoService& io = IoService::shared();
+  io.wait(io.readFile(filename, [&](IoService::Result& result) {
+    error = result.error;
+    buffer.swap(result.data);
+  }, IoService::HIGH));
 
-  file.close();
+  if (error != 0) {
+    throw EngineException("failed to open file", File);
+  }
 
   return buffer;
 }
@@ -19,13 +19,21 @@ void VulkanRenderer::createBuffer(
   VkBufferUsageFlags usage,
   VkMemoryPropertyFlags properties,
   VkBuffer& buffer,
-  VkDeviceMemory& bufferMemory) {
+  VkDeviceMemory& bufferMemory,
+  bool shared) {
   VkBufferCreateInfo bufferInfo = {};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
   bufferInfo.usage = usage;
   bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
+  uint32_t queueFamilies[] = {graphicsQueueFamily, computeQueueFamily};
+  if (shared && asyncComputeSupported) {
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = 2;
+    bufferInfo.pQueueFamilyIndices = queueFamilies;
+  }
+
  if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
     throw EngineException("failed to create buffer", file);
   }
@@ -40,23 +48,28 @@ void VulkanRenderer::createBuffer(
   if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
     throw EngineException("failed to allocate buffer memory", file);
   }
+  stats.deviceAllocations++;
 
   vkBindBufferMemory(device, buffer, bufferMemory, 0);
 }
 
 void VulkanRenderer::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+  VkCommandBuffer commandBuffer = beginUploads();
 
   VkBufferCopy copyRegion = {};
   copyRegion.size = size;
   vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
-  endSingleTimeCommands(commandBuffer);
+  submitUploads();
 }
 
-void VulkanRenderer::createVertexBuffer(VulkanObject& obj) {
-  VkDeviceSize bufferSize = sizeof(obj.vertices[0]) * obj.vertices.size();
-
+void VulkanRenderer::createDeviceLocalBuffer(
+  const void* source,
+  VkDeviceSize bufferSize,
+  VkBufferUsageFlags usage,
+  VkBuffer& buffer,
+  VkDeviceMemory& bufferMemory,
+  bool shared) {
   VkBuffer stagingBuffer;
   VkDeviceMemory stagingBufferMemory;
   createBuffer(
@@ -64,183 +77,375 @@ void VulkanRenderer::createVertexBuffer(VulkanObject& obj) {
     VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
     stagingBuffer,
-    stagingBufferMemory);
+    stagingBufferMemory
+  );
 
   void* data;
   vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-      memcpy(data, obj.vertices.data(), (size_t) bufferSize);
+  memcpy(data, source, (size_t) bufferSize);
   vkUnmapMemory(device, stagingBufferMemory);
 
   createBuffer(
     bufferSize,
-    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+    VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage,
     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    obj.vertexBuffer,
-    obj.vertexBufferMemory);
+    buffer,
+    bufferMemory,
+    shared
+  );
 
-  copyBuffer(stagingBuffer, obj.vertexBuffer, bufferSize);
+  beginUploads();
+  copyBuffer(stagingBuffer, buffer, bufferSize);
+  releaseStagingBuffer(stagingBuffer, stagingBufferMemory);
+  // the compute queue doesn't wait on graphics submissions, see drawFrame
+  if (shared && asyncComputeSupported) {
+    uploadsShared = true;
+  }
+  submitUploads();
+  stats.bytesUploaded += bufferSize;
+}
 
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
-  vkFreeMemory(device, stagingBufferMemory, nullptr);
+uint32_t VulkanRenderer::createMesh(const std::vector<Vertex>& vertices, const std::vector<uint16_t>& indices) {
+  return createMesh(vertices, std::vector<std::vector<uint16_t>>{indices}, std::vector<float>{0.0f});
 }
 
-void VulkanRenderer::createIndexBuffer (VulkanObject& obj) {
-  VkDeviceSize bufferSize = sizeof(obj.indices[0]) * obj.indices.size();
+uint32_t VulkanRenderer::createMesh(
+  const std::vector<Vertex>& vertices,
+  const std::vector<std::vector<uint16_t>>& lodIndices,
+  const std::vector<float>& lodErrors) {
+  if (lodIndices.empty() || lodIndices.size() != lodErrors.size()) {
+    throw EngineException("mesh needs one error per level of detail", file);
+  }
 
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-  createBuffer(
-    bufferSize,
-    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-    stagingBuffer,
-    stagingBufferMemory
+  // every level goes into the same index buffer back to back
+  VulkanMesh mesh;
+  std::vector<uint16_t> indices;
+  for (size_t i = 0; i < lodIndices.size(); i++) {
+    MeshLod lod;
+    lod.firstIndex = static_cast<uint32_t>(indices.size());
+    lod.indexCount = static_cast<uint32_t>(lodIndices[i].size());
+    lod.error = lodErrors[i];
+    mesh.lods.push_back(lod);
+    indices.insert(indices.end(), lodIndices[i].begin(), lodIndices[i].end());
+  }
+
+  createDeviceLocalBuffer(
+    vertices.data(),
+    sizeof(vertices[0]) * vertices.size(),
+    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+    mesh.vertexBuffer,
+    mesh.vertexBufferMemory
+  );
+  createDeviceLocalBuffer(
+    indices.data(),
+    sizeof(indices[0]) * indices.size(),
+    VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+    mesh.indexBuffer,
+    mesh.indexBufferMemory
   );
 
-  void* data;
-  vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-  memcpy(data, obj.indices.data(), (size_t) bufferSize);
-  vkUnmapMemory(device, stagingBufferMemory);
+  if (!vertices.empty()) {
+    mesh.bounds.min = mesh.bounds.max = glm::vec3(vertices[0].pos, 0.0f);
+    for (auto &vertex : vertices) {
+      mesh.bounds.min = glm::min(mesh.bounds.min, glm::vec3(vertex.pos, 0.0f));
+      mesh.bounds.max = glm::max(mesh.bounds.max, glm::vec3(vertex.pos, 0.0f));
+    }
+  }
 
-  createBuffer(
-    bufferSize,
-    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    obj.indexBuffer,
-    obj.indexBufferMemory
-  );
+  meshes.push_back(mesh);
+  return static_cast<uint32_t>(meshes.size() - 1);
+}
 
-  copyBuffer(stagingBuffer, obj.indexBuffer, bufferSize);
+uint32_t VulkanRenderer::createQuadMesh() {
+  const std::vector<Vertex> vertices = {
+    {{-0.5f, -0.3f}, {1.0f, 0.0f}},
+    {{0.5f, -0.3f}, {0.0f, 0.0f}},
+    {{0.5f, 0.3f}, {0.0f, 1.0f}},
+    {{-0.5f, 0.3f}, {1.0f, 1.0f}}
+  };
+  const std::vector<uint16_t> indices = {
+    0, 1, 2, 2, 3, 0
+  };
+  return createMesh(vertices, indices);
+}
+
+// a subdivided quad where level k keeps every 2^k-th grid line, so all
+// levels index the same vertices; the error of a level is its cell size
+uint32_t VulkanRenderer::createGridMesh(uint32_t cells, uint32_t lodCount) {
+  if (lodCount == 0 || cells == 0 || cells > 128 || cells % (1u << (lodCount - 1)) != 0) {
+    throw EngineException("grid cells must be at most 128 and divisible by 2^(lodCount - 1)", file);
+  }
 
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
-  vkFreeMemory(device, stagingBufferMemory, nullptr);
+  std::vector<Vertex> vertices;
+  for (uint32_t y = 0; y <= cells; y++) {
+    for (uint32_t x = 0; x <= cells; x++) {
+      float u = x / static_cast<float>(cells);
+      float v = y / static_cast<float>(cells);
+      vertices.push_back({{u - 0.5f, v * 0.6f - 0.3f}, {1.0f - u, v}});
+    }
+  }
+
+  std::vector<std::vector<uint16_t>> lodIndices(lodCount);
+  std::vector<float> lodErrors(lodCount);
+  for (uint32_t lod = 0; lod < lodCount; lod++) {
+    uint32_t step = 1u << lod;
+    for (uint32_t y = 0; y < cells; y += step) {
+      for (uint32_t x = 0; x < cells; x += step) {
+        uint16_t a = static_cast<uint16_t>(y * (cells + 1) + x);
+        uint16_t b = static_cast<uint16_t>(a + step);
+        uint16_t c = static_cast<uint16_t>(b + step * (cells + 1));
+        uint16_t d = static_cast<uint16_t>(a + step * (cells + 1));
+        lodIndices[lod].insert(lodIndices[lod].end(), {a, b, c, c, d, a});
+      }
+    }
+    lodErrors[lod] = lod == 0 ? 0.0f : step / static_cast<float>(cells);
+  }
+
+  return createMesh(vertices, lodIndices, lodErrors);
 }
 
-void VulkanRenderer::createDescriptorSetLayout() {
+void VulkanRenderer::createDescriptorSetLayouts() {
+  // set 0: the per-frame camera block
   VkDescriptorSetLayoutBinding uboLayoutBinding = {};
   uboLayoutBinding.binding = 0;
   uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
   uboLayoutBinding.descriptorCount = 1;
   uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
+  VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 1;
+  layoutInfo.pBindings = &uboLayoutBinding;
+
+  if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cameraSetLayout) != VK_SUCCESS) {
+    throw EngineException("failed to create camera descriptor set layout", file);
+  }
+
+  // set 1: one combined image sampler per texture, pushed when the device can
   VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
-  samplerLayoutBinding.binding = 1;
+  samplerLayoutBinding.binding = 0;
   samplerLayoutBinding.descriptorCount = 1;
   samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
   samplerLayoutBinding.pImmutableSamplers = nullptr;
   samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-  std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};
-
-  VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-  layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-  layoutInfo.pBindings = bindings.data();;
+  layoutInfo.pBindings = &samplerLayoutBinding;
+  if (pushDescriptorsEnabled) {
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+  }
 
-  if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
-      throw std::runtime_error("failed to create descriptor set layout!");
+  if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &textureSetLayout) != VK_SUCCESS) {
+    throw EngineException("failed to create texture descriptor set layout", file);
   }
+  createTextureTemplates();
 }
 
-void VulkanRenderer::createDescriptorPool(int size) {
+void VulkanRenderer::createDescriptorPool(int maxTextures) {
+  // camera sets are reallocated on swapchain recreation, so leave room for
+  // one generation waiting in the deletion queue
+  uint32_t cameraSets = static_cast<uint32_t>(swapchainImages.size() * 2);
+  // pushed textures take nothing from the pool
+  uint32_t textureSets = pushDescriptorsEnabled ? 0 : static_cast<uint32_t>(maxTextures);
+
   std::array<VkDescriptorPoolSize, 2> poolSizes = {};
   poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  poolSizes[0].descriptorCount = static_cast<uint32_t>(swapchainImages.size() * size);
+  poolSizes[0].descriptorCount = cameraSets;
   poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  poolSizes[1].descriptorCount = static_cast<uint32_t>(swapchainImages.size() * size);
+  poolSizes[1].descriptorCount = textureSets;
 
   VkDescriptorPoolCreateInfo poolInfo = {};
   poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.poolSizeCount = textureSets > 0 ? 2 : 1;
   poolInfo.pPoolSizes = poolSizes.data();
-  poolInfo.maxSets = static_cast<uint32_t>(swapchainImages.size() * size);
+  poolInfo.maxSets = cameraSets + textureSets;
+  poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 
   if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
     throw EngineException("failed to create descriptor pool", file);
   }
 }
 
-void VulkanRenderer::createDescriptorSets(VulkanObject& obj) {
-  std::vector<VkDescriptorSetLayout> layouts(swapchainImages.size(), descriptorSetLayout);
+void VulkanRenderer::createTextureDescriptorSet(VulkanTexture& texture, VkDescriptorPool pool) {
+  if (pushDescriptorsEnabled) return;
+
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = pool;
+  allocInfo.descriptorSetCount = 1;
+  allocInfo.pSetLayouts = &textureSetLayout;
+
+  if (vkAllocateDescriptorSets(device, &allocInfo, &texture.descriptorSet) != VK_SUCCESS) {
+    throw EngineException("failed to allocate texture descriptor set", file);
+  }
+
+  VkDescriptorImageInfo imageInfo = {};
+  imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  imageInfo.imageView = texture.view;
+  imageInfo.sampler = textureSampler;
+
+  VkWriteDescriptorSet descriptorWrite = {};
+  descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  descriptorWrite.dstSet = texture.descriptorSet;
+  descriptorWrite.dstBinding = 0;
+  descriptorWrite.dstArrayElement = 0;
+  descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  descriptorWrite.descriptorCount = 1;
+  descriptorWrite.pImageInfo = &imageInfo;
+
+  vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+}
+
+void VulkanRenderer::createCameraBuffers() {
+  size_t images = swapchainImages.size();
+  cameraBuffers.resize(images);
+  cameraBuffersMemory.resize(images);
+  cameraBuffersMapped.resize(images);
+  cameraSets.resize(images);
+
+  std::vector<VkDescriptorSetLayout> layouts(images, cameraSetLayout);
   VkDescriptorSetAllocateInfo allocInfo = {};
   allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
   allocInfo.descriptorPool = descriptorPool;
-  allocInfo.descriptorSetCount = static_cast<uint32_t>(swapchainImages.size());
+  allocInfo.descriptorSetCount = static_cast<uint32_t>(images);
   allocInfo.pSetLayouts = layouts.data();
 
-  obj.descriptorSets.resize(swapchainImages.size());
-  if (vkAllocateDescriptorSets(device, &allocInfo, obj.descriptorSets.data()) != VK_SUCCESS) {
-    throw EngineException("failed to allocate descriptor sets", file);
+  if (vkAllocateDescriptorSets(device, &allocInfo, cameraSets.data()) != VK_SUCCESS) {
+    throw EngineException("failed to allocate camera descriptor sets", file);
   }
 
-  for (size_t i = 0; i < obj.descriptorSets.size(); i++) {
+  for (size_t i = 0; i < images; i++) {
+    createBuffer(
+      sizeof(CameraUniform),
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      cameraBuffers[i],
+      cameraBuffersMemory[i]
+    );
+    vkMapMemory(device, cameraBuffersMemory[i], 0, VK_WHOLE_SIZE, 0, &cameraBuffersMapped[i]);
+
     VkDescriptorBufferInfo bufferInfo = {};
-    bufferInfo.buffer = obj.uniformBuffers[i];
+    bufferInfo.buffer = cameraBuffers[i];
     bufferInfo.offset = 0;
-    bufferInfo.range = sizeof(UniformBufferObject);
+    bufferInfo.range = sizeof(CameraUniform);
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = cameraSets[i];
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+  }
+}
 
-    VkDescriptorImageInfo imageInfo = {};
-    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageInfo.imageView = obj.textureImageView;
-    imageInfo.sampler = textureSampler;
+void VulkanRenderer::ensureInstanceCapacity(size_t count) {
+  if (count <= instanceCapacity && !instanceBuffers.empty()) {
+    return;
+  }
 
-    std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+  size_t capacity = std::max<size_t>(instanceCapacity, 64);
+  while (capacity < count) {
+    capacity *= 2;
+  }
 
-    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = obj.descriptorSets[i];
-    descriptorWrites[0].dstBinding = 0;
-    descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptorWrites[0].descriptorCount = 1;
-    descriptorWrites[0].pBufferInfo = &bufferInfo;
+  releaseInstanceBuffers();
+
+  size_t images = swapchainImages.size();
+  instanceBuffers.resize(images);
+  instanceBuffersMemory.resize(images);
+  instanceBuffersMapped.resize(images);
+
+  for (size_t i = 0; i < images; i++) {
+    createBuffer(
+      sizeof(InstanceData) * capacity,
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      instanceBuffers[i],
+      instanceBuffersMemory[i]
+    );
+    vkMapMemory(device, instanceBuffersMemory[i], 0, VK_WHOLE_SIZE, 0, &instanceBuffersMapped[i]);
+  }
 
-    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[1].dstSet = obj.descriptorSets[i];
-    descriptorWrites[1].dstBinding = 1;
-    descriptorWrites[1].dstArrayElement = 0;
-    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[1].descriptorCount = 1;
-    descriptorWrites[1].pImageInfo = &imageInfo;
+  createCullBuffers(capacity);
 
-    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-  }
+  instanceCapacity = capacity;
+  markCommandBuffersDirty();
 }
 
-void VulkanRenderer::createUniformBuffers(VulkanObject& obj) {
-  VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+void VulkanRenderer::releaseInstanceBuffers() {
+  // command buffers still in flight may reference the old buffers
+  uint64_t value = timeline.lastSubmitted();
+  for (size_t i = 0; i < instanceBuffers.size(); i++) {
+    deletionQueue.destroyBuffer(value, instanceBuffers[i], instanceBuffersMemory[i]);
+  }
+  instanceBuffers.clear();
+  instanceBuffersMemory.clear();
+  instanceBuffersMapped.clear();
 
-  obj.uniformBuffers.resize(swapchainImages.size());
-  obj.uniformBuffersMemory.resize(swapchainImages.size());
+  releaseCullBuffers();
+}
 
-  for (size_t i = 0; i < swapchainImages.size(); i++) {
-      createBuffer(
-        bufferSize,
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        obj.uniformBuffers[i],
-        obj.uniformBuffersMemory[i]);
+void VulkanRenderer::releaseFrameBuffers() {
+  releaseInstanceBuffers();
+  releaseSpriteBuffers();
+  for (auto &system : particleSystems) {
+    releaseParticleFrameResources(system);
   }
+
+  uint64_t value = timeline.lastSubmitted();
+  for (size_t i = 0; i < cameraBuffers.size(); i++) {
+    deletionQueue.freeDescriptorSet(value, descriptorPool, cameraSets[i]);
+    deletionQueue.destroyBuffer(value, cameraBuffers[i], cameraBuffersMemory[i]);
+  }
+  cameraBuffers.clear();
+  cameraBuffersMemory.clear();
+  cameraBuffersMapped.clear();
+  cameraSets.clear();
 }
 
-VkCommandBuffer VulkanRenderer::beginSingleTimeCommands() {
+// Uploads are recorded into one command buffer and submitted without
+// waiting. Later graphics submissions run after it, and its closing barrier
+// makes the writes visible to them; its staging buffers and the command
+// buffer itself are freed once the timeline passes it. Calls nest, so a
+// caller can gather many uploads into one submission.
+VkCommandBuffer VulkanRenderer::beginUploads() {
+  if (uploadDepth++ > 0) return uploadCommandBuffer;
+
   VkCommandBufferAllocateInfo allocInfo = {};
   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
   allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
   allocInfo.commandPool = commandPool;
   allocInfo.commandBufferCount = 1;
 
-  VkCommandBuffer commandBuffer;
-  vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+  vkAllocateCommandBuffers(device, &allocInfo, &uploadCommandBuffer);
 
   VkCommandBufferBeginInfo beginInfo = {};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
   beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-  vkBeginCommandBuffer(commandBuffer, &beginInfo);
+  vkBeginCommandBuffer(uploadCommandBuffer, &beginInfo);
 
-  return commandBuffer;
+  return uploadCommandBuffer;
 }
 
-void VulkanRenderer::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
+void VulkanRenderer::submitUploads() {
+  if (--uploadDepth > 0) return;
+
+  VkCommandBuffer commandBuffer = uploadCommandBuffer;
+  uploadCommandBuffer = VK_NULL_HANDLE;
+
+  VkMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+  vkCmdPipelineBarrier(
+    commandBuffer,
+    VK_PIPELINE_STAGE_TRANSFER_BIT,
+    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+    0, 1, &barrier, 0, nullptr, 0, nullptr);
   vkEndCommandBuffer(commandBuffer);
 
   VkSubmitInfo submitInfo = {};
@@ -248,8 +453,22 @@ void VulkanRenderer::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &commandBuffer;
 
-  vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(graphicsQueue);
+  uint64_t value = timeline.submit(graphicsQueue, submitInfo);
+
+  for (auto &staging : uploadStaging) {
+    deletionQueue.destroyBuffer(value, staging.first, staging.second);
+  }
+  uploadStaging.clear();
+  if (uploadsShared) {
+    computeUploadValue = value;
+    uploadsShared = false;
+  }
+  timeline.retire(value, [this, commandBuffer]() {
+    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+  });
+}
 
-  vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+// only valid between beginUploads and submitUploads
+void VulkanRenderer::releaseStagingBuffer(VkBuffer buffer, VkDeviceMemory memory) {
+  uploadStaging.push_back({buffer, memory});
 }
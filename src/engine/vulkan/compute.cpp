@@ -0,0 +1,85 @@
+#include "engine/vulkan.hpp"
+
+#define file "src/engine/vulkan/compute.cpp"
+
+// Async compute: with a compute-only queue family, each image's compute work
+// is recorded into its own command buffer and submitted to that family's
+// queue before the graphics submission, which waits for it on a semaphore
+// only at the stages that read its results. Nothing it writes is read by the
+// previous frame's draws, so it runs while the graphics queue finishes them.
+
+void VulkanRenderer::createComputeCommandPool() {
+  if (!asyncComputeSupported) return;
+
+  VkCommandPoolCreateInfo poolInfo = {};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.queueFamilyIndex = computeQueueFamily;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+  if (vkCreateCommandPool(device, &poolInfo, nullptr, &computeCommandPool) != VK_SUCCESS) {
+    throw EngineException("failed to create compute command pool", file);
+  }
+}
+
+bool VulkanRenderer::asyncComputeActive() const {
+  return asyncCompute && asyncComputeSupported;
+}
+
+// a frame with nothing to dispatch skips the compute submission entirely
+bool VulkanRenderer::hasComputeWork() const {
+  if (!computePasses.empty()) return true;
+  for (const ParticleSystem& system : particleSystems) {
+    if (system.capacity > 0 && !system.sets.empty()) return true;
+  }
+  return false;
+}
+
+// Particle draws are the only per-image results read by the graphics queue;
+// they are exclusive, so the compute queue releases them and the graphics
+// queue acquires them. They are rewritten every frame, so nothing is
+// transferred back.
+void VulkanRenderer::recordComputeHandoff(VkCommandBuffer commandBuffer, size_t i, bool acquire) {
+  std::vector<VkBufferMemoryBarrier> barriers;
+  for (const ParticleSystem& system : particleSystems) {
+    if (system.capacity == 0 || system.drawBuffers.empty()) continue;
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = acquire ? 0 : VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = acquire ? VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT : 0;
+    barrier.srcQueueFamilyIndex = computeQueueFamily;
+    barrier.dstQueueFamilyIndex = graphicsQueueFamily;
+    barrier.buffer = system.drawBuffers[i];
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    barriers.push_back(barrier);
+  }
+  if (barriers.empty()) return;
+
+  // the acquire waits on the same stages as the semaphore, so the two chain
+  VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+  if (acquire) {
+    srcStages = dstStages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+  }
+  vkCmdPipelineBarrier(
+    commandBuffer,
+    srcStages,
+    dstStages,
+    0, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, nullptr);
+}
+
+// Only the graphics submission goes through the timeline; it can't finish
+// before the compute work it waits on, so its value covers both.
+void VulkanRenderer::submitCompute(uint32_t imageIndex) {
+  VkSubmitInfo submitInfo = {};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &computeCommandBuffers[imageIndex];
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &computeFinishedSemaphores[currentFrame];
+
+  if (vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+    throw EngineException("failed to submit compute work", file);
+  }
+}
@@ -0,0 +1,85 @@
+#include "engine/deletion.hpp"
+
+#include <iterator>
+
+void DeletionQueue::push(uint64_t value, VkObjectType type, uint64_t handle, uint64_t owner) {
+  if (handle == 0) return;
+  auto position = entries.end();
+  while (position != entries.begin() && std::prev(position)->value > value) {
+    position--;
+  }
+  entries.insert(position, {value, type, handle, owner});
+}
+
+void DeletionQueue::destroyBuffer(uint64_t value, VkBuffer buffer, VkDeviceMemory memory) {
+  push(value, VK_OBJECT_TYPE_BUFFER, (uint64_t) buffer);
+  push(value, VK_OBJECT_TYPE_DEVICE_MEMORY, (uint64_t) memory);
+}
+
+void DeletionQueue::destroyImage(uint64_t value, VkImage image, VkImageView view, VkDeviceMemory memory) {
+  push(value, VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t) view);
+  push(value, VK_OBJECT_TYPE_IMAGE, (uint64_t) image);
+  push(value, VK_OBJECT_TYPE_DEVICE_MEMORY, (uint64_t) memory);
+}
+
+void DeletionQueue::destroyPipeline(uint64_t value, VkPipeline pipeline, VkPipelineLayout layout) {
+  push(value, VK_OBJECT_TYPE_PIPELINE, (uint64_t) pipeline);
+  push(value, VK_OBJECT_TYPE_PIPELINE_LAYOUT, (uint64_t) layout);
+}
+
+void DeletionQueue::freeDescriptorSet(uint64_t value, VkDescriptorPool pool, VkDescriptorSet set) {
+  push(value, VK_OBJECT_TYPE_DESCRIPTOR_SET, (uint64_t) set, (uint64_t) pool);
+}
+
+void DeletionQueue::destroyDescriptorPool(uint64_t value, VkDescriptorPool pool) {
+  push(value, VK_OBJECT_TYPE_DESCRIPTOR_POOL, (uint64_t) pool);
+}
+
+void DeletionQueue::freeMemory(uint64_t value, VkDeviceMemory memory) {
+  push(value, VK_OBJECT_TYPE_DEVICE_MEMORY, (uint64_t) memory);
+}
+
+void DeletionQueue::destroyFramebuffer(uint64_t value, VkFramebuffer framebuffer) {
+  push(value, VK_OBJECT_TYPE_FRAMEBUFFER, (uint64_t) framebuffer);
+}
+
+void DeletionQueue::flush(VkDevice device, uint64_t completedValue) {
+  while (!entries.empty() && entries.front().value <= completedValue) {
+    Entry entry = entries.front();
+    entries.pop_front();
+
+    switch (entry.type) {
+      case VK_OBJECT_TYPE_BUFFER:
+        vkDestroyBuffer(device, (VkBuffer) entry.handle, nullptr);
+        break;
+      case VK_OBJECT_TYPE_IMAGE:
+        vkDestroyImage(device, (VkImage) entry.handle, nullptr);
+        break;
+      case VK_OBJECT_TYPE_IMAGE_VIEW:
+        vkDestroyImageView(device, (VkImageView) entry.handle, nullptr);
+        break;
+      case VK_OBJECT_TYPE_DEVICE_MEMORY:
+        vkFreeMemory(device, (VkDeviceMemory) entry.handle, nullptr);
+        break;
+      case VK_OBJECT_TYPE_PIPELINE:
+        vkDestroyPipeline(device, (VkPipeline) entry.handle, nullptr);
+        break;
+      case VK_OBJECT_TYPE_PIPELINE_LAYOUT:
+        vkDestroyPipelineLayout(device, (VkPipelineLayout) entry.handle, nullptr);
+        break;
+      case VK_OBJECT_TYPE_DESCRIPTOR_SET: {
+        VkDescriptorSet set = (VkDescriptorSet) entry.handle;
+        vkFreeDescriptorSets(device, (VkDescriptorPool) entry.owner, 1, &set);
+        break;
+      }
+      case VK_OBJECT_TYPE_DESCRIPTOR_POOL:
+        vkDestroyDescriptorPool(device, (VkDescriptorPool) entry.handle, nullptr);
+        break;
+      case VK_OBJECT_TYPE_FRAMEBUFFER:
+        vkDestroyFramebuffer(device, (VkFramebuffer) entry.handle, nullptr);
+        break;
+      default:
+        break;
+    }
+  }
+}
@@ -0,0 +1,114 @@
+#include "engine/vulkan.hpp"
+
+#define file "src/engine/vulkan/descriptors.cpp"
+
+// Push descriptors: with VK_KHR_push_descriptor, textureSetLayout is a push
+// layout and each draw's texture is written into the command buffer as it is
+// recorded, through an update template. Textures then own no descriptor set,
+// so creating and destroying them never touches a descriptor pool. Without
+// the extension every texture keeps its own set, bound the same way.
+
+bool VulkanRenderer::checkPushDescriptorSupport(VkPhysicalDevice device) {
+  // update templates are core from 1.1
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(device, &properties);
+  if (properties.apiVersion < VK_API_VERSION_1_1) return false;
+
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+  for (const auto& extension : availableExtensions) {
+    if (strcmp(extension.extensionName, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool VulkanRenderer::pushDescriptorsActive() const {
+  return pushDescriptorsEnabled;
+}
+
+// A push template only works with pipeline layouts compatible with the one it
+// was made for, up to its set. Textures are set 1 behind the camera in world
+// layouts, and set 0 in front of the projection push constant in screen
+// sprite layouts, so one template each.
+void VulkanRenderer::createTextureTemplates() {
+  if (!pushDescriptorsEnabled) return;
+
+  cmdPushDescriptorSetWithTemplate = (PFN_vkCmdPushDescriptorSetWithTemplateKHR) vkGetDeviceProcAddr(device, "vkCmdPushDescriptorSetWithTemplateKHR");
+  if (cmdPushDescriptorSetWithTemplate == nullptr) {
+    throw EngineException("failed to load vkCmdPushDescriptorSetWithTemplateKHR", file);
+  }
+
+  VkPushConstantRange pushConstant = {};
+  pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  pushConstant.size = sizeof(glm::mat4);
+  std::array<VkDescriptorSetLayout, 2> worldSetLayouts = {cameraSetLayout, textureSetLayout};
+
+  VkDescriptorUpdateTemplateEntry entry = {};
+  entry.dstBinding = 0;
+  entry.dstArrayElement = 0;
+  entry.descriptorCount = 1;
+  entry.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  entry.offset = 0;
+  entry.stride = sizeof(VkDescriptorImageInfo);
+
+  for (uint32_t set = 0; set < textureTemplates.size(); set++) {
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    if (set == 1) {
+      pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(worldSetLayouts.size());
+      pipelineLayoutInfo.pSetLayouts = worldSetLayouts.data();
+    }
+    else {
+      pipelineLayoutInfo.setLayoutCount = 1;
+      pipelineLayoutInfo.pSetLayouts = &textureSetLayout;
+      pipelineLayoutInfo.pushConstantRangeCount = 1;
+      pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+    }
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &textureTemplateLayouts[set]) != VK_SUCCESS) {
+      throw EngineException("failed to create texture template layout", file);
+    }
+
+    VkDescriptorUpdateTemplateCreateInfo templateInfo = {};
+    templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    templateInfo.descriptorUpdateEntryCount = 1;
+    templateInfo.pDescriptorUpdateEntries = &entry;
+    templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR;
+    templateInfo.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    templateInfo.pipelineLayout = textureTemplateLayouts[set];
+    templateInfo.set = set;
+    if (vkCreateDescriptorUpdateTemplate(device, &templateInfo, nullptr, &textureTemplates[set]) != VK_SUCCESS) {
+      throw EngineException("failed to create texture update template", file);
+    }
+  }
+}
+
+void VulkanRenderer::destroyTextureTemplates() {
+  if (!pushDescriptorsEnabled) return;
+
+  for (uint32_t set = 0; set < textureTemplates.size(); set++) {
+    vkDestroyDescriptorUpdateTemplate(device, textureTemplates[set], nullptr);
+    vkDestroyPipelineLayout(device, textureTemplateLayouts[set], nullptr);
+  }
+}
+
+// requested textures draw as the placeholder until they have streamed in
+void VulkanRenderer::bindTexture(VkCommandBuffer commandBuffer, VkPipelineLayout layout, uint32_t set, uint32_t texture) {
+  const VulkanTexture& bound = textures[borrowsPlaceholderTexture(texture) ? placeholderTexture : texture];
+
+  if (pushDescriptorsEnabled) {
+    VkDescriptorImageInfo imageInfo = {};
+    imageInfo.sampler = textureSampler;
+    imageInfo.imageView = bound.view;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    cmdPushDescriptorSetWithTemplate(commandBuffer, textureTemplates[set], layout, set, &imageInfo);
+  }
+  else {
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, set, 1, &bound.descriptorSet, 0, nullptr);
+  }
+}
@@ -12,19 +12,26 @@ QueueFamilyIndices VulkanRenderer::findQueueFamilies(VkPhysicalDevice device) {
   vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
   int i = 0;
+  // culling and particles dispatch compute work on the graphics queue
+  const VkQueueFlags graphicsCompute = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
   for (const auto& queueFamily : queueFamilies) {
-    if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+    if (!indices.graphicsFamily.has_value() && (queueFamily.queueFlags & graphicsCompute) == graphicsCompute) {
       indices.graphicsFamily = i;
     }
+    // a compute-only family runs alongside graphics instead of sharing its queue
+    if (!indices.computeFamily.has_value() && (queueFamily.queueFlags & graphicsCompute) == VK_QUEUE_COMPUTE_BIT) {
+      indices.computeFamily = i;
+    }
 
     VkBool32 presentSupport = false;
     vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
 
-    if (presentSupport) {
+    // presenting from the graphics family avoids sharing swapchain images
+    if (presentSupport && (!indices.presentFamily.has_value() || indices.graphicsFamily == static_cast<uint32_t>(i))) {
       indices.presentFamily = i;
     }
 
-    if (indices.isComplete()) break;
+    if (indices.isComplete() && indices.computeFamily.has_value()) break;
 
     i++;
   }
@@ -48,6 +55,39 @@ bool VulkanRenderer::checkDeviceExtensionSupport(VkPhysicalDevice device) {
   return requiredExtensions.empty();
 }
 
+bool VulkanRenderer::checkTimelineSemaphoreSupport(VkPhysicalDevice device, bool& core) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(device, &properties);
+  core = properties.apiVersion >= VK_API_VERSION_1_2;
+
+  if (!core) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    bool found = false;
+    for (const auto& extension : availableExtensions) {
+      if (strcmp(extension.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0) {
+        found = true;
+        break;
+      }
+    }
+    if (!found) return false;
+  }
+
+  VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+  timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+
+  VkPhysicalDeviceFeatures2 features = {};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &timelineFeatures;
+  vkGetPhysicalDeviceFeatures2(device, &features);
+
+  return timelineFeatures.timelineSemaphore == VK_TRUE;
+}
+
 bool VulkanRenderer::deviceIsSuitable(VkPhysicalDevice device) {
   QueueFamilyIndices indices = findQueueFamilies(device);
 
@@ -99,6 +139,9 @@ void VulkanRenderer::createLogicalDevice() {
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
   std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+  if (indices.computeFamily.has_value()) {
+    uniqueQueueFamilies.insert(indices.computeFamily.value());
+  }
 
   float queuePriority = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -110,19 +153,48 @@ void VulkanRenderer::createLogicalDevice() {
     queueCreateInfos.push_back(queueCreateInfo);
   }
 
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
+  // culled draws are indirect and select their instance data with firstInstance
+  deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+  occlusionCullingSupported = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+
+  std::vector<const char*> extensions = deviceExtensions;
+
+  // drivers without timeline semaphores fall back to fences in GpuTimeline
+  timelineSemaphoreSupported = checkTimelineSemaphoreSupport(physicalDevice, timelineSemaphoreCore);
+
+  VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+  timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+  timelineFeatures.timelineSemaphore = VK_TRUE;
+
+  // without it every texture owns a descriptor set
+  pushDescriptorsEnabled = pushDescriptors && checkPushDescriptorSupport(physicalDevice);
+  if (pushDescriptorsEnabled) {
+    extensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+  }
+  stats.pushDescriptors = pushDescriptorsEnabled;
 
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
+  if (timelineSemaphoreSupported) {
+    createInfo.pNext = &timelineFeatures;
+    if (!timelineSemaphoreCore) {
+      extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    }
+  }
+
   createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
   createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
   createInfo.pEnabledFeatures = &deviceFeatures;
 
-  createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+  createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+  createInfo.ppEnabledExtensionNames = extensions.data();
 
 #ifdef USE_VALIDATION_LAYERS
       createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -137,4 +209,9 @@ void VulkanRenderer::createLogicalDevice() {
 
   vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
   vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+
+  graphicsQueueFamily = indices.graphicsFamily.value();
+  asyncComputeSupported = indices.computeFamily.has_value();
+  computeQueueFamily = indices.computeFamily.value_or(graphicsQueueFamily);
+  vkGetDeviceQueue(device, computeQueueFamily, 0, &computeQueue);
 }
@@ -5,15 +5,16 @@ void VulkanRenderer::createFramebuffers () {
   swapchainFramebuffers.resize(swapchainImageViews.size());
 
   for (size_t i = 0; i < swapchainImageViews.size(); i++) {
-    VkImageView attachments[] = {
-      swapchainImageViews[i]
+    std::array<VkImageView, 2> attachments = {
+      swapchainImageViews[i],
+      depthImageView
     };
 
     VkFramebufferCreateInfo framebufferInfo = {};
     framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
     framebufferInfo.renderPass = renderPass;
-    framebufferInfo.attachmentCount = 1;
-    framebufferInfo.pAttachments = attachments;
+    framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    framebufferInfo.pAttachments = attachments.data();
     framebufferInfo.width = swapchainExtent.width;
     framebufferInfo.height = swapchainExtent.height;
     framebufferInfo.layers = 1;
@@ -25,8 +26,17 @@ void VulkanRenderer::createFramebuffers () {
 }
 
 void VulkanRenderer::drawFrame () {
-  if (minimized) return;
-  vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+  if (minimized) {
+    // sprites are queued per frame, a skipped frame drops them
+    spriteVertices.clear();
+    spriteKeys.clear();
+    return;
+  }
+  timeline.wait(framesInFlight[currentFrame]);
+  timeline.collect();
+  deletionQueue.flush(device, timeline.lastCompleted());
+  // textures decoded since the last frame; their callbacks may spawn renderables
+  uploadPendingTextures();
 
   uint32_t imageIndex;
   VkResult result =
@@ -39,6 +49,8 @@ void VulkanRenderer::drawFrame () {
       &imageIndex);
 
   if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    spriteVertices.clear();
+    spriteKeys.clear();
     recreateSwapchain();
     return;
   }
@@ -46,35 +58,81 @@ void VulkanRenderer::drawFrame () {
     throw EngineException("failed to acquire swap chain image!", file);
   }
 
-  if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
-    vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+  if (imagesInFlight[imageIndex] != 0) {
+    timeline.wait(imagesInFlight[imageIndex]);
+    readTimestamps(imageIndex);
+    readCullCounters(imageIndex);
+    // may dirty every command buffer when the scale moves a step
+    updateRenderScale();
   }
 
-  imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+  // grows the instance buffers (and dirties every command buffer) when the scene outgrows them
+  ensureInstanceCapacity(scene.renderables.size());
+  // dirties the image's command buffer only when the batches changed
+  prepareSprites(imageIndex);
+  // rebuilds edited chunks that came into view, and dirties on a new visible set
+  prepareTilemaps(imageIndex);
+  // emitter counts for this frame, and the alive count this image read back
+  prepareParticles(imageIndex);
+
+  scene.transforms.updateWorld(transformThreads);
+  scene.updateBounds();
+  // changing a level of detail bumps renderablesVersion, so it is recorded below
+  selectLods();
+
+  // the previous submission of this image is done, so its buffer can be re-recorded
+  if (commandBuffersDirty[imageIndex] || recordedVersions[imageIndex] != scene.renderablesVersion) {
+    recordCommandBuffer(imageIndex);
+  }
 
   updateUniformBuffer(imageIndex);
 
+  // The compute queue may start while the previous frame still draws. The
+  // one before that finished in the wait above, which is as far back as the
+  // particle pools alternate.
+  bool async = computeRecorded[imageIndex];
+  if (async) {
+    // the compute queue can't wait on the graphics queue's uploads, so only
+    // the frame right after one into a shared buffer may block here
+    timeline.wait(computeUploadValue);
+    submitCompute(imageIndex);
+  }
+  stats.asyncCompute = async;
+
   VkSubmitInfo submitInfo = {};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-  VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-  VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submitInfo.waitSemaphoreCount = 1;
+  // compute results are first read by indirect draws and vertex shaders
+  VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame], computeFinishedSemaphores[currentFrame]};
+  VkPipelineStageFlags waitStages[] = {
+    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+    VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+  };
+  submitInfo.waitSemaphoreCount = async ? 2 : 1;
   submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
 
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+  // a requested capture copies the finished image out in the same submission
+  size_t captureSlot = 0;
+  bool capturing = recordCapture(imageIndex, captureSlot);
+  VkCommandBuffer frameCommandBuffers[] = {commandBuffers[imageIndex], VK_NULL_HANDLE};
+  if (capturing) {
+    frameCommandBuffers[1] = readbackBuffers[captureSlot].commandBuffer;
+  }
+  submitInfo.commandBufferCount = capturing ? 2 : 1;
+  submitInfo.pCommandBuffers = frameCommandBuffers;
 
   VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
   submitInfo.signalSemaphoreCount = 1;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
-  vkResetFences(device, 1, &inFlightFences[currentFrame]);
-
-  if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-    throw EngineException("failed to submit draw command buffer", file);
+  uint64_t frameValue = timeline.submit(graphicsQueue, submitInfo);
+  framesInFlight[currentFrame] = frameValue;
+  imagesInFlight[imageIndex] = frameValue;
+  if (capturing) {
+    retireCapture(captureSlot, frameValue);
   }
+  framesDrawn++;
 
   VkPresentInfoKHR presentInfo = {};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -97,17 +155,240 @@ void VulkanRenderer::drawFrame () {
   else if (result != VK_SUCCESS) {
     throw EngineException("failed to present swap chain image", file);
   }
+  recordFirstFrame();
 
   currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
 void VulkanRenderer::updateUniformBuffer(uint32_t currentImage) {
-  for (auto &pipeline : pipelines) {
-    for (auto &obj : pipeline.objects) {
-      void* data;
-      vkMapMemory(device, obj.uniformBuffersMemory[currentImage], 0, sizeof(UniformBufferObject), 0, &data);
-        memcpy(data, &obj.ubo, sizeof(UniformBufferObject));
-      vkUnmapMemory(device, obj.uniformBuffersMemory[currentImage]);
+  CameraUniform cameraUniform;
+  cameraUniform.view = camera.view();
+  cameraUniform.proj = camera.proj(swapchainExtent);
+  cameraUniform.view2D = camera2D.viewProj(swapchainExtent);
+  memcpy(cameraBuffersMapped[currentImage], &cameraUniform, sizeof(CameraUniform));
+
+  InstanceData* instances = static_cast<InstanceData*>(instanceBuffersMapped[currentImage]);
+  // the cull shader writes the draws, so it also gets the selected LOD ranges
+  bool culling = occlusionCullingActive();
+  CullObject* objects = culling ? static_cast<CullObject*>(cullObjectBuffersMapped[currentImage]) : nullptr;
+
+  const std::vector<Entity>& entities = scene.renderables.entities();
+  const std::vector<Renderable>& renderables = scene.renderables.data();
+  glm::mat4 identity(1.0f);
+  for (size_t i = 0; i < entities.size(); i++) {
+    uint32_t slot = scene.transforms.find(entities[i]);
+    const glm::mat4& model = slot == SparseIndex::NONE ? identity : scene.transforms.world[slot];
+    instances[i].model = model;
+
+    if (culling) {
+      const Renderable& r = renderables[i];
+      AABB box = meshes[r.mesh].bounds.transformed(model);
+      objects[i].boundsMin = glm::vec4(box.min, 1.0f);
+      objects[i].boundsMax = glm::vec4(box.max, 1.0f);
+      objects[i].firstIndex = r.firstIndex;
+      objects[i].indexCount = r.indexCount;
+    }
+  }
+}
+
+// keeps the current level inside a band around the error threshold so
+// objects hovering at a boundary distance don't flip every frame
+static uint32_t selectLod(const std::vector<MeshLod>& lods, uint32_t current, float pixelsPerUnit, float threshold, float hysteresis) {
+  uint32_t lod = std::min<uint32_t>(current, static_cast<uint32_t>(lods.size() - 1));
+  if (lods[lod].error * pixelsPerUnit > threshold * (1.0f + hysteresis)) {
+    while (lod > 0 && lods[lod].error * pixelsPerUnit > threshold) {
+      lod--;
+    }
+    return lod;
+  }
+  while (lod + 1 < lods.size() && lods[lod + 1].error * pixelsPerUnit <= threshold * (1.0f - hysteresis)) {
+    lod++;
+  }
+  return lod;
+}
+
+void VulkanRenderer::selectLods() {
+  // pixels covered by one world unit at distance 1
+  float pixelsPerRadian = swapchainExtent.height / (2.0f * std::tan(camera.fovy * 0.5f));
+
+  uint64_t drawn = 0;
+  uint64_t saved = 0;
+  bool changed = false;
+  std::vector<Renderable>& renderables = scene.renderables.data();
+  const std::vector<Entity>& entities = scene.renderables.entities();
+  for (size_t i = 0; i < renderables.size(); i++) {
+    Renderable& r = renderables[i];
+    const VulkanMesh& mesh = meshes[r.mesh];
+    if (mesh.lods.empty()) continue;
+
+    uint32_t slot = scene.transforms.find(entities[i]);
+    if (mesh.lods.size() > 1 && slot != SparseIndex::NONE) {
+      const glm::mat4& world = scene.transforms.world[slot];
+      float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+      glm::vec3 center = glm::vec3(world * glm::vec4(mesh.bounds.center(), 1.0f));
+      float radius = glm::length(mesh.bounds.max - mesh.bounds.center()) * scale;
+      float distance = std::max(glm::length(center - camera.eye) - radius, camera.near);
+
+      uint32_t lod = selectLod(mesh.lods, r.lod, scale * pixelsPerRadian / distance, lodErrorPixels, lodHysteresis);
+      if (lod != r.lod) {
+        r.lod = lod;
+        r.firstIndex = mesh.lods[lod].firstIndex;
+        r.indexCount = mesh.lods[lod].indexCount;
+        changed = true;
+      }
+    }
+
+    drawn += r.indexCount / 3;
+    saved += (mesh.lods[0].indexCount - r.indexCount) / 3;
+  }
+
+  stats.trianglesDrawn = drawn;
+  stats.trianglesSaved = saved;
+  if (changed) {
+    scene.renderablesVersion++;
+  }
+}
+
+void VulkanRenderer::createTimestampQueryPool() {
+  QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  timestampPeriod = properties.limits.timestampPeriod;
+  timestampsSupported = queueFamilies[indices.graphicsFamily.value()].timestampValidBits != 0 && timestampPeriod > 0.0f;
+  if (!timestampsSupported) return;
+
+  VkQueryPoolCreateInfo queryPoolInfo = {};
+  queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  queryPoolInfo.queryCount = static_cast<uint32_t>(swapchainImages.size() * 2);
+
+  if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &timestampPool) != VK_SUCCESS) {
+    throw EngineException("failed to create timestamp query pool", file);
+  }
+}
+
+void VulkanRenderer::readTimestamps(uint32_t imageIndex) {
+  if (!timestampsSupported) return;
+
+  uint64_t timestamps[2];
+  VkResult result = vkGetQueryPoolResults(
+    device,
+    timestampPool,
+    imageIndex * 2,
+    2,
+    sizeof(timestamps),
+    timestamps,
+    sizeof(uint64_t),
+    VK_QUERY_RESULT_64_BIT);
+
+  if (result == VK_SUCCESS) {
+    stats.gpuFrameMs = (timestamps[1] - timestamps[0]) * timestampPeriod / 1000000.0;
+  }
+}
+
+void VulkanRenderer::markCommandBuffersDirty() {
+  commandBuffersDirty.assign(commandBuffers.size(), true);
+}
+
+Entity VulkanRenderer::spawn(uint32_t pipeline, uint32_t mesh, uint32_t texture, const Transform& transform) {
+  Entity e = scene.create();
+  scene.transforms.insert(e, transform);
+
+  Renderable renderable;
+  renderable.pipeline = pipeline;
+  renderable.vertexBuffer = meshes[mesh].vertexBuffer;
+  renderable.indexBuffer = meshes[mesh].indexBuffer;
+  renderable.firstIndex = meshes[mesh].lods[0].firstIndex;
+  renderable.indexCount = meshes[mesh].lods[0].indexCount;
+  renderable.mesh = mesh;
+  renderable.lod = 0;
+  renderable.texture = texture;
+  scene.addRenderable(e, renderable);
+  scene.setBounds(e, meshes[mesh].bounds);
+
+  return e;
+}
+
+void VulkanRenderer::despawn(Entity e) {
+  scene.destroy(e);
+}
+
+// Renderables cache a mesh's buffers and every draw binds its texture by
+// index, so either can only go once nothing draws with it. Recorded command
+// buffers still reference it and are re-recorded before their next submit.
+bool VulkanRenderer::meshInUse(uint32_t mesh) const {
+  for (const Renderable& r : scene.renderables.data()) {
+    if (r.mesh == mesh) return true;
+  }
+  return false;
+}
+
+bool VulkanRenderer::textureInUse(uint32_t texture) const {
+  for (const Renderable& r : scene.renderables.data()) {
+    if (r.texture == texture) return true;
+  }
+  // the low 32 bits of a queued sprite's key are its texture
+  for (const SpriteKey& key : spriteKeys) {
+    if (static_cast<uint32_t>(key.key) == texture) return true;
+  }
+  for (const Tilemap& map : tilemaps) {
+    if (!map.chunks.empty() && map.texture == texture) return true;
+  }
+  for (const ParticleSystem& system : particleSystems) {
+    if (system.capacity > 0 && system.texture == texture) return true;
+  }
+  return false;
+}
+
+void VulkanRenderer::destroyMesh(uint32_t mesh) {
+  if (meshInUse(mesh)) {
+    throw EngineException("mesh is still used by a renderable", file);
+  }
+  bool streaming = borrowsPlaceholderMesh(mesh);
+  if (!streaming) {
+    meshes[mesh].destroy(deletionQueue, timeline.lastSubmitted());
+  }
+  // keep the slot so other mesh ids stay valid
+  meshes[mesh] = VulkanMesh();
+  meshes[mesh].cancelled = streaming;
+  markCommandBuffersDirty();
+}
+
+void VulkanRenderer::destroyTexture(uint32_t texture) {
+  if (textureInUse(texture)) {
+    throw EngineException("texture is still in use", file);
+  }
+  // a requested texture still loading only borrows the placeholder's set
+  if (!borrowsPlaceholderTexture(texture)) {
+    textures[texture].destroy(deletionQueue, timeline.lastSubmitted(), descriptorPool);
+  }
+  textures[texture] = VulkanTexture();
+  markCommandBuffersDirty();
+}
+
+void VulkanRenderer::destroyBuffer(VkBuffer buffer, VkDeviceMemory memory) {
+  deletionQueue.destroyBuffer(timeline.lastSubmitted(), buffer, memory);
+}
+
+// Renderables store pipeline indices, so the slot is kept, left empty and
+// skipped when pipelines are recreated.
+void VulkanRenderer::removePipeline(size_t pipelineIndex) {
+  if (pipelineIndex >= pipelines.size() || pipelines[pipelineIndex].pipeline == VK_NULL_HANDLE) {
+    throw EngineException("no such pipeline", file);
+  }
+  for (const Renderable& r : scene.renderables.data()) {
+    if (r.pipeline == pipelineIndex) {
+      throw EngineException("pipeline is still used by a renderable", file);
     }
   }
+  deletionQueue.destroyPipeline(timeline.lastSubmitted(), pipelines[pipelineIndex].pipeline, pipelines[pipelineIndex].layout);
+  pipelines[pipelineIndex] = VulkanPipeline();
+  markCommandBuffersDirty();
 }
@@ -6,16 +6,18 @@
 #pragma GCC diagnostic pop
 #include "engine/vulkan.hpp"
 
+#include <cerrno>
+
 #define file "src/engine/vulkan/image.cpp"
 
-void VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+void VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory, uint32_t mipLevels) {
   VkImageCreateInfo imageInfo = {};
   imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   imageInfo.imageType = VK_IMAGE_TYPE_2D;
   imageInfo.extent.width = width;
   imageInfo.extent.height = height;
   imageInfo.extent.depth = 1;
-  imageInfo.mipLevels = 1;
+  imageInfo.mipLevels = mipLevels;
   imageInfo.arrayLayers = 1;
   imageInfo.format = format;
   imageInfo.tiling = tiling;
@@ -39,19 +41,14 @@ void VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat forma
   if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
       throw std::runtime_error("failed to allocate image memory!");
   }
+  stats.deviceAllocations++;
 
   vkBindImageMemory(device, image, imageMemory, 0);
 }
 
-void VulkanRenderer::createTextureImage(VulkanObject& obj, std::string fileName) {
-  int textureWidth, textureHeight, textureChannels;
-  stbi_uc* pixels = stbi_load(fileName.c_str(), &textureWidth, &textureHeight, &textureChannels, STBI_rgb_alpha);
+void VulkanRenderer::createTextureImage(VulkanTexture& texture, const unsigned char* pixels, int textureWidth, int textureHeight) {
   VkDeviceSize imageSize = textureWidth * textureHeight * 4;
 
-  if (!pixels) {
-    throw EngineException("failed to load texture image", file);
-  }
-
   VkBuffer stagingBuffer;
   VkDeviceMemory stagingBufferMemory;
 
@@ -67,8 +64,6 @@ void VulkanRenderer::createTextureImage(VulkanObject& obj, std::string fileName)
     memcpy(data, pixels, static_cast<size_t>(imageSize));
   vkUnmapMemory(device, stagingBufferMemory);
 
-  stbi_image_free(pixels);
-
   createImage(
     textureWidth,
     textureHeight,
@@ -76,20 +71,35 @@ void VulkanRenderer::createTextureImage(VulkanObject& obj, std::string fileName)
     VK_IMAGE_TILING_OPTIMAL,
     VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-    obj.textureImage,
-    obj.textureImageMemory
+    texture.image,
+    texture.memory
   );
 
-  transitionImageLayout(obj.textureImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-  copyBufferToImage(stagingBuffer, obj.textureImage, static_cast<uint32_t>(textureWidth), static_cast<uint32_t>(textureHeight));
+  // one submission for the transitions and the copy
+  beginUploads();
+  transitionImageLayout(texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+  copyBufferToImage(stagingBuffer, texture.image, static_cast<uint32_t>(textureWidth), static_cast<uint32_t>(textureHeight));
 
-  transitionImageLayout(obj.textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
-  vkFreeMemory(device, stagingBufferMemory, nullptr);
+  transitionImageLayout(texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  releaseStagingBuffer(stagingBuffer, stagingBufferMemory);
+  submitUploads();
+  stats.bytesUploaded += imageSize;
 }
 
-void VulkanRenderer::transitionImageLayout(VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout) {
+// the stages and accesses on either side come from the layouts themselves
+void VulkanRenderer::transitionImageLayout(
+  VkImage image,
+  VkImageLayout oldLayout,
+  VkImageLayout newLayout,
+  VkImageAspectFlags aspectFlags,
+  uint32_t mipLevels
+) {
+  RenderGraph::Access source = RenderGraph::layoutAccess(oldLayout);
+  RenderGraph::Access destination = RenderGraph::layoutAccess(newLayout);
+  if (newLayout == VK_IMAGE_LAYOUT_UNDEFINED) {
+    throw EngineException("unsupported layout transition", file);
+  }
+
   VkImageMemoryBarrier barrier = {};
   barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
   barrier.oldLayout = oldLayout;
@@ -97,52 +107,33 @@ void VulkanRenderer::transitionImageLayout(VkImage image, VkImageLayout oldLayou
   barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
   barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
   barrier.image = image;
-  barrier.srcAccessMask = 0;
-  barrier.dstAccessMask = 0;
+  // only writes need to be made available
+  barrier.srcAccessMask = source.access & (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT
+    | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+  barrier.dstAccessMask = destination.access;
 
-  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.aspectMask = aspectFlags;
   barrier.subresourceRange.baseMipLevel = 0;
-  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.levelCount = mipLevels;
   barrier.subresourceRange.baseArrayLayer = 0;
   barrier.subresourceRange.layerCount = 1;
 
-  VkPipelineStageFlags sourceStage;
-  VkPipelineStageFlags destinationStage;
-
-  if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-    sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-  }
-  else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  }
-  else {
-    throw std::invalid_argument("unsupported layout transition!");
-  }
-
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+  VkCommandBuffer commandBuffer = beginUploads();
 
   vkCmdPipelineBarrier(
     commandBuffer,
-    sourceStage, destinationStage,
+    source.stages, destination.stages,
     0,
     0, nullptr,
     0, nullptr,
     1, &barrier
   );
 
-  endSingleTimeCommands(commandBuffer);
+  submitUploads();
 }
 
 void VulkanRenderer::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-  VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+  VkCommandBuffer commandBuffer = beginUploads();
 
   VkBufferImageCopy region = {};
   region.bufferOffset = 0;
@@ -170,18 +161,18 @@ void VulkanRenderer::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t
     &region
   );
 
-  endSingleTimeCommands(commandBuffer);
+  submitUploads();
 }
 
-VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format) {
+VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t baseMipLevel, uint32_t levelCount) {
   VkImageViewCreateInfo viewInfo = {};
   viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
   viewInfo.image = image;
   viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
   viewInfo.format = format;
-  viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  viewInfo.subresourceRange.baseMipLevel = 0;
-  viewInfo.subresourceRange.levelCount = 1;
+  viewInfo.subresourceRange.aspectMask = aspectFlags;
+  viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
+  viewInfo.subresourceRange.levelCount = levelCount;
   viewInfo.subresourceRange.baseArrayLayer = 0;
   viewInfo.subresourceRange.layerCount = 1;
 
@@ -193,8 +184,215 @@ VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format) {
   return imageView;
 }
 
-void VulkanRenderer::createTextureImageView(VulkanObject& obj) {
-  obj.textureImageView = createImageView(obj.textureImage, VK_FORMAT_R8G8B8A8_SRGB);
+uint32_t VulkanRenderer::addTexture(const unsigned char* pixels, int width, int height) {
+  VulkanTexture texture;
+  createTextureImage(texture, pixels, width, height);
+  texture.view = createImageView(texture.image, VK_FORMAT_R8G8B8A8_SRGB);
+  createTextureDescriptorSet(texture, descriptorPool);
+
+  textures.push_back(texture);
+  return static_cast<uint32_t>(textures.size() - 1);
+}
+
+// cooked textures are already RGBA8, anything else goes through stb;
+// pending has no pixels afterwards when the data didn't parse
+static void decodeTexture(const char* data, size_t size, bool cooked, PendingTexture& pending) {
+  if (cooked) {
+    const unsigned char* texels;
+    if (parseCookedTexture(data, size, pending.width, pending.height, texels)) {
+      pending.cooked.assign(texels, texels + size_t(pending.width) * pending.height * 4);
+    }
+    return;
+  }
+
+  int channels;
+  pending.pixels = stbi_load_from_memory(
+    reinterpret_cast<const stbi_uc*>(data),
+    static_cast<int>(size),
+    &pending.width,
+    &pending.height,
+    &channels,
+    STBI_rgb_alpha);
+}
+
+static const unsigned char* pendingPixels(const PendingTexture& pending) {
+  if (pending.pixels) return pending.pixels;
+  return pending.cooked.empty() ? nullptr : pending.cooked.data();
+}
+
+// the cooked file when mix-cook has processed texturePath, otherwise the source
+static std::string resolveTexture(const std::string& texturePath, bool& cooked) {
+  const AssetManifest::Entry* entry = AssetManifest::loaded().find(texturePath);
+  cooked = entry != nullptr && entry->kind == AssetManifest::TEXTURE;
+  return cooked ? entry->cooked : texturePath;
+}
+
+uint32_t VulkanRenderer::createTexture(std::string texturePath) {
+  auto start = std::chrono::high_resolution_clock::now();
+
+  bool cooked;
+  std::string source = resolveTexture(texturePath, cooked);
+
+  // uncompressed pack entries are used straight out of the mapping
+  std::vector<char> encoded;
+  PackSpan span = AssetPack::mounted().view(source);
+  if (span.data == nullptr) {
+    encoded = readFile(source);
+    span.data = encoded.data();
+    span.size = encoded.size();
+  }
+
+  int width, height;
+  const unsigned char* texels = nullptr;
+  stbi_uc* decoded = nullptr;
+  if (cooked) {
+    if (!parseCookedTexture(span.data, span.size, width, height, texels)) {
+      throw EngineException("failed to load cooked texture", file);
+    }
+  }
+  else {
+    int channels;
+    decoded = stbi_load_from_memory(
+      reinterpret_cast<const stbi_uc*>(span.data),
+      static_cast<int>(span.size),
+      &width,
+      &height,
+      &channels,
+      STBI_rgb_alpha);
+    if (!decoded) {
+      throw EngineException("failed to load texture image", file);
+    }
+    texels = decoded;
+  }
+
+  uint32_t texture = addTexture(texels, width, height);
+  stbi_image_free(decoded);
+
+  stats.uploadSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+  return texture;
+}
+
+void VulkanRenderer::loadTextureAsync(
+  std::string texturePath,
+  std::function<void(uint32_t texture)> onLoaded,
+  IoService::Priority priority,
+  std::function<void()> onFailed) {
+  PendingTexture pending;
+  pending.path = texturePath;
+  pending.pixels = nullptr;
+  pending.width = 0;
+  pending.height = 0;
+  pending.onLoaded = onLoaded;
+  pending.onFailed = onFailed;
+
+  bool cooked;
+  std::string source = resolveTexture(texturePath, cooked);
+
+  // a pack hit has no I/O left to wait for, only the decode, so it skips the
+  // service and is ready for the next frame's upload
+  const AssetPack& pack = AssetPack::mounted();
+  if (pack.contains(source)) {
+    PackSpan span = pack.view(source);
+    if (span.data != nullptr) {
+      decodeTexture(span.data, span.size, cooked, pending);
+    }
+    else {
+      std::vector<char> encoded;
+      pack.read(source, encoded);
+      decodeTexture(encoded.data(), encoded.size(), cooked, pending);
+    }
+    std::lock_guard<std::mutex> lock(pendingTexturesMutex);
+    pendingTextures.push_back(pending);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(pendingTexturesMutex);
+  IoService::RequestId id = IoService::shared().readFile(source, [this, pending, cooked](IoService::Result& result) mutable {
+    if (result.error == 0) {
+      decodeTexture(result.data.data(), result.data.size(), cooked, pending);
+    }
+
+    std::lock_guard<std::mutex> lock(pendingTexturesMutex);
+    textureRequests.erase(std::remove(textureRequests.begin(), textureRequests.end(), result.id), textureRequests.end());
+    // cancelled by cleanup, nobody is left to upload it
+    if (result.error == ECANCELED) {
+      stbi_image_free(pending.pixels);
+      return;
+    }
+    pendingTextures.push_back(pending);
+  }, priority);
+  textureRequests.push_back(id);
+}
+
+// Every texture decoded since the last frame goes into one upload
+// submission, which this frame's draws follow on the queue. It is submitted
+// before any onLoaded runs, so a callback destroying a texture can't free
+// one the upload still writes.
+void VulkanRenderer::uploadPendingTextures() {
+  std::vector<PendingTexture> ready;
+  {
+    std::lock_guard<std::mutex> lock(pendingTexturesMutex);
+    if (pendingTextures.empty()) return;
+    ready.swap(pendingTextures);
+  }
+
+  // a missing or corrupt file only loses that texture, not the frame
+  std::vector<PendingTexture> failed;
+  for (size_t i = 0; i < ready.size();) {
+    if (pendingPixels(ready[i])) {
+      i++;
+      continue;
+    }
+    std::cerr << "failed to load texture " << ready[i].path << std::endl;
+    failed.push_back(std::move(ready[i]));
+    ready.erase(ready.begin() + i);
+  }
+
+  if (!ready.empty()) {
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<uint32_t> loaded(ready.size());
+    beginUploads();
+    for (size_t i = 0; i < ready.size(); i++) {
+      loaded[i] = addTexture(pendingPixels(ready[i]), ready[i].width, ready[i].height);
+      stbi_image_free(ready[i].pixels);
+    }
+    submitUploads();
+    stats.uploadSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    // newest first, so a callback moving its texture into a requested slot
+    // always leaves the last index free to pop
+    for (size_t i = ready.size(); i-- > 0;) {
+      if (ready[i].onLoaded) {
+        ready[i].onLoaded(loaded[i]);
+      }
+    }
+  }
+
+  for (auto &pending : failed) {
+    if (pending.onFailed) {
+      pending.onFailed();
+    }
+  }
+}
+
+void VulkanRenderer::discardPendingTextures() {
+  std::vector<IoService::RequestId> requests;
+  {
+    std::lock_guard<std::mutex> lock(pendingTexturesMutex);
+    requests = textureRequests;
+  }
+  // callbacks of cancelled loads still run, but drop their result
+  IoService& io = IoService::shared();
+  for (auto id : requests) {
+    io.cancel(id);
+    io.wait(id);
+  }
+
+  std::lock_guard<std::mutex> lock(pendingTexturesMutex);
+  for (auto &pending : pendingTextures) {
+    stbi_image_free(pending.pixels);
+  }
+  pendingTextures.clear();
 }
 
 void VulkanRenderer::createTextureSampler() {
@@ -4,6 +4,7 @@
 
 void VulkanRenderer::init(std::function<void(Renderer* renderer)> func) {
   createFunc = func;
+  initStart = std::chrono::high_resolution_clock::now();
   SDLinit();
   createInstance();
 #ifdef USE_VALIDATION_LAYERS
@@ -12,16 +13,34 @@ void VulkanRenderer::init(std::function<void(Renderer* renderer)> func) {
   createSurface();
   pickPhysicalDevice();
   createLogicalDevice();
+  timeline.init(device, timelineSemaphoreSupported, timelineSemaphoreCore);
 
   createSwapchain();
   createImageViews();
+  depthFormat = findDepthFormat();
   createRenderPass();
-  createDescriptorSetLayout();
-  createFramebuffers();
+  createDescriptorSetLayouts();
+  createOcclusionPipelines();
   createCommandPool();
+  createComputeCommandPool();
+  createDepthResources();
+  createHiZResources();
+  createFramebuffers();
+  createTimestampQueryPool();
 
   createTextureSampler();
-
+  createPlaceholders();
+
+  VulkanPipeline spritePipeline;
+  spritePipeline.vertShaderPath = "shaders/sprite-vert.spv";
+  spritePipeline.fragShaderPath = "shaders/sprite-frag.spv";
+  addSpritePipeline(spritePipeline);
+  tilemapPipeline.vertShaderPath = "shaders/tilemap-vert.spv";
+  tilemapPipeline.fragShaderPath = "shaders/tilemap-frag.spv";
+  createSpritePipeline(tilemapPipeline, true);
+  createParticlePipelines();
+
+  // anything createFunc requests streams in after the first frames
   createFunc((Renderer*)this);
 
   createCommandBuffers();
@@ -41,21 +60,69 @@ void DestroyDebugUtilsMessengerEXT(
 #endif
 
 void VulkanRenderer::cleanup() {
+  discardPendingTextures();
   vkDeviceWaitIdle(device);
+  finishCaptures();
+  releaseReadbackBuffers();
+  releaseFrameBuffers();
+  for (auto &map : tilemaps) {
+    releaseTilemap(map);
+  }
+  tilemaps.clear();
+  for (auto &system : particleSystems) {
+    if (system.capacity > 0) {
+      releaseParticleSystem(system);
+    }
+  }
+  particleSystems.clear();
+  deletionQueue.flush(device, UINT64_MAX);
 
   cleanupSwapchain();
+  pipelines.clear();
+  spritePipelines.clear();
 
+  for (uint32_t mesh = 0; mesh < meshes.size(); mesh++) {
+    if (!borrowsPlaceholderMesh(mesh)) {
+      meshes[mesh].destroy(device);
+    }
+  }
+  meshes.clear();
+  for (auto &texture : textures) {
+    texture.destroy(device);
+  }
+  textures.clear();
+  scene.clear();
+
+  vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+  vkDestroyDescriptorPool(device, placeholderPool, nullptr);
   vkDestroySampler(device, textureSampler, nullptr);
 
-  vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+  destroyParticlePipelines();
+  destroyTextureTemplates();
+  vkDestroyDescriptorSetLayout(device, cameraSetLayout, nullptr);
+  vkDestroyDescriptorSetLayout(device, textureSetLayout, nullptr);
+
+  if (occlusionCullingSupported) {
+    vkDestroyPipeline(device, cullPipeline, nullptr);
+    vkDestroyPipelineLayout(device, cullLayout, nullptr);
+    vkDestroyPipeline(device, hizPipeline, nullptr);
+    vkDestroyPipelineLayout(device, hizLayout, nullptr);
+    vkDestroySampler(device, hizSampler, nullptr);
+    vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, hizSetLayout, nullptr);
+  }
 
   for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
     vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
     vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-    vkDestroyFence(device, inFlightFences[i], nullptr);
+    vkDestroySemaphore(device, computeFinishedSemaphores[i], nullptr);
   }
+  timeline.destroy();
 
   vkDestroyCommandPool(device, commandPool, nullptr);
+  if (asyncComputeSupported) {
+    vkDestroyCommandPool(device, computeCommandPool, nullptr);
+  }
   vkDestroyDevice(device, nullptr);
 #ifdef USE_VALIDATION_LAYERS
   DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
@@ -111,7 +178,7 @@ void VulkanRenderer::createInstance() {
   appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   appInfo.pEngineName = "No Engine";
   appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  appInfo.apiVersion = VK_API_VERSION_1_1;
+  appInfo.apiVersion = VK_API_VERSION_1_2;
 
   VkInstanceCreateInfo instanceInfo = {};
   instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -143,20 +210,17 @@ void VulkanRenderer::createInstance() {
 void VulkanRenderer::createSyncObjects() {
   imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
   renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-  inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-  imagesInFlight.resize(swapchainImages.size(), VK_NULL_HANDLE);
+  computeFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+  framesInFlight.assign(MAX_FRAMES_IN_FLIGHT, 0);
+  imagesInFlight.assign(swapchainImages.size(), 0);
 
   VkSemaphoreCreateInfo semaphoreInfo = {};
   semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-  VkFenceCreateInfo fenceInfo = {};
-  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
   for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
     if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
         vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-        vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+        vkCreateSemaphore(device, &semaphoreInfo, nullptr, &computeFinishedSemaphores[i]) != VK_SUCCESS) {
 
       throw EngineException("failed to create a sync object for a frame", file);
     }
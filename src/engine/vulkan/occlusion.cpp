@@ -0,0 +1,502 @@
+#include "engine/vulkan.hpp"
+
+#include <cmath>
+
+#define file "src/engine/vulkan/occlusion.cpp"
+
+struct CullParams {
+  uint32_t objectCount;
+  uint32_t levels;
+  uint32_t width;
+  uint32_t height;
+};
+
+struct HiZSizes {
+  int32_t sourceWidth;
+  int32_t sourceHeight;
+  int32_t destinationWidth;
+  int32_t destinationHeight;
+};
+
+// depth-only formats, so one view serves as both attachment and sampled image
+VkFormat VulkanRenderer::findDepthFormat() {
+  const VkFormat candidates[] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM};
+  VkFormatFeatureFlags attachment = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  VkFormatFeatureFlags sampled = attachment | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+  for (VkFormat format : candidates) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+    if ((properties.optimalTilingFeatures & sampled) == sampled) {
+      return format;
+    }
+  }
+
+  // still usable for depth testing, just not for building the pyramid
+  occlusionCullingSupported = false;
+  for (VkFormat format : candidates) {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+    if ((properties.optimalTilingFeatures & attachment) == attachment) {
+      return format;
+    }
+  }
+  throw EngineException("failed to find a supported depth format", file);
+}
+
+void VulkanRenderer::createDepthResources() {
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  if (occlusionCullingSupported) {
+    usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+  }
+
+  createImage(
+    swapchainExtent.width,
+    swapchainExtent.height,
+    depthFormat,
+    VK_IMAGE_TILING_OPTIMAL,
+    usage,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    depthImage,
+    depthImageMemory
+  );
+  depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+}
+
+void VulkanRenderer::createComputePipeline(const std::string& shaderPath, VkDescriptorSetLayout setLayout, uint32_t pushConstantSize, VkPipelineLayout& layout, VkPipeline& pipeline) {
+  createComputePipeline(shaderPath, std::vector<VkDescriptorSetLayout>{setLayout}, pushConstantSize, layout, pipeline);
+}
+
+void VulkanRenderer::createComputePipeline(const std::string& shaderPath, const std::vector<VkDescriptorSetLayout>& setLayouts, uint32_t pushConstantSize, VkPipelineLayout& layout, VkPipeline& pipeline) {
+  auto code = readFile(shaderPath);
+  VkShaderModule shaderModule = createShaderModule(code);
+
+  VkPushConstantRange pushConstantRange = {};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = pushConstantSize;
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+  pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+  pipelineLayoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+  if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS) {
+    throw EngineException("failed to create compute pipeline layout", file);
+  }
+
+  VkComputePipelineCreateInfo pipelineInfo = {};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = shaderModule;
+  pipelineInfo.stage.pName = "main";
+  pipelineInfo.layout = layout;
+
+  if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+    throw EngineException("failed to create compute pipeline", file);
+  }
+
+  vkDestroyShaderModule(device, shaderModule, nullptr);
+}
+
+void VulkanRenderer::recordComputeBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) {
+  VkMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = dstAccess;
+  vkCmdPipelineBarrier(
+    commandBuffer,
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    dstStages,
+    0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanRenderer::createOcclusionPipelines() {
+  if (!occlusionCullingSupported) return;
+
+  // cull set: camera, objects, draws, counters, pyramid
+  std::array<VkDescriptorSetLayoutBinding, 5> cullBindings = {};
+  const VkDescriptorType cullTypes[] = {
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+  };
+  for (uint32_t i = 0; i < cullBindings.size(); i++) {
+    cullBindings[i].binding = i;
+    cullBindings[i].descriptorType = cullTypes[i];
+    cullBindings[i].descriptorCount = 1;
+    cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+  layoutInfo.pBindings = cullBindings.data();
+
+  if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cullSetLayout) != VK_SUCCESS) {
+    throw EngineException("failed to create cull descriptor set layout", file);
+  }
+
+  // pyramid set: source level, destination level
+  std::array<VkDescriptorSetLayoutBinding, 2> hizBindings = {};
+  hizBindings[0].binding = 0;
+  hizBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  hizBindings[0].descriptorCount = 1;
+  hizBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  hizBindings[1].binding = 1;
+  hizBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  hizBindings[1].descriptorCount = 1;
+  hizBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  layoutInfo.bindingCount = static_cast<uint32_t>(hizBindings.size());
+  layoutInfo.pBindings = hizBindings.data();
+
+  if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &hizSetLayout) != VK_SUCCESS) {
+    throw EngineException("failed to create Hi-Z descriptor set layout", file);
+  }
+
+  createComputePipeline("shaders/cull.spv", cullSetLayout, sizeof(CullParams), cullLayout, cullPipeline);
+  createComputePipeline("shaders/hiz.spv", hizSetLayout, sizeof(HiZSizes), hizLayout, hizPipeline);
+
+  // texelFetch only, so no filtering; clamping keeps edge boxes in range
+  VkSamplerCreateInfo samplerInfo = {};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_NEAREST;
+  samplerInfo.minFilter = VK_FILTER_NEAREST;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.minLod = 0.0f;
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+  if (vkCreateSampler(device, &samplerInfo, nullptr, &hizSampler) != VK_SUCCESS) {
+    throw EngineException("failed to create Hi-Z sampler", file);
+  }
+}
+
+void VulkanRenderer::createHiZResources() {
+  if (!occlusionCullingSupported) return;
+
+  uint32_t largest = std::max(swapchainExtent.width, swapchainExtent.height);
+  hizLevels = static_cast<uint32_t>(std::floor(std::log2(static_cast<float>(largest)))) + 1;
+
+  createImage(
+    swapchainExtent.width,
+    swapchainExtent.height,
+    VK_FORMAT_R32_SFLOAT,
+    VK_IMAGE_TILING_OPTIMAL,
+    VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    hizImage,
+    hizImageMemory,
+    hizLevels
+  );
+  hizView = createImageView(hizImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, hizLevels);
+  hizLevelViews.resize(hizLevels);
+  for (uint32_t level = 0; level < hizLevels; level++) {
+    hizLevelViews[level] = createImageView(hizImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1);
+  }
+
+  // the pyramid stays in GENERAL for its whole life; clearing it to the far
+  // plane means nothing is culled before the first depth has been rendered
+  VkCommandBuffer commandBuffer = beginUploads();
+
+  VkImageSubresourceRange range = {};
+  range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  range.baseMipLevel = 0;
+  range.levelCount = hizLevels;
+  range.baseArrayLayer = 0;
+  range.layerCount = 1;
+
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = hizImage;
+  barrier.subresourceRange = range;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+  VkClearColorValue far = {};
+  far.float32[0] = 1.0f;
+  vkCmdClearColorImage(commandBuffer, hizImage, VK_IMAGE_LAYOUT_GENERAL, &far, 1, &range);
+
+  barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+  submitUploads();
+
+  // room for the pyramid sets plus two generations of per-image cull sets,
+  // since cull sets are replaced when the instance buffers grow
+  uint32_t images = static_cast<uint32_t>(swapchainImages.size());
+  uint32_t cullSetCount = images * 2;
+
+  std::array<VkDescriptorPoolSize, 4> poolSizes = {};
+  poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  poolSizes[0].descriptorCount = hizLevels + cullSetCount;
+  poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  poolSizes[1].descriptorCount = hizLevels;
+  poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  poolSizes[2].descriptorCount = cullSetCount;
+  poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSizes[3].descriptorCount = cullSetCount * 3;
+
+  VkDescriptorPoolCreateInfo poolInfo = {};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+  poolInfo.pPoolSizes = poolSizes.data();
+  poolInfo.maxSets = hizLevels + cullSetCount;
+  poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+
+  if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &occlusionPool) != VK_SUCCESS) {
+    throw EngineException("failed to create occlusion descriptor pool", file);
+  }
+
+  hizSets.resize(hizLevels);
+  std::vector<VkDescriptorSetLayout> layouts(hizLevels, hizSetLayout);
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = occlusionPool;
+  allocInfo.descriptorSetCount = hizLevels;
+  allocInfo.pSetLayouts = layouts.data();
+
+  if (vkAllocateDescriptorSets(device, &allocInfo, hizSets.data()) != VK_SUCCESS) {
+    throw EngineException("failed to allocate Hi-Z descriptor sets", file);
+  }
+
+  for (uint32_t level = 0; level < hizLevels; level++) {
+    VkDescriptorImageInfo sourceInfo = {};
+    sourceInfo.sampler = hizSampler;
+    sourceInfo.imageView = level == 0 ? depthImageView : hizLevelViews[level - 1];
+    sourceInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+    VkDescriptorImageInfo destinationInfo = {};
+    destinationInfo.imageView = hizLevelViews[level];
+    destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = hizSets[level];
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pImageInfo = &sourceInfo;
+
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = hizSets[level];
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pImageInfo = &destinationInfo;
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+  }
+}
+
+void VulkanRenderer::cleanupHiZResources() {
+  if (!occlusionCullingSupported) return;
+
+  // frees the pyramid sets and any cull sets with it
+  vkDestroyDescriptorPool(device, occlusionPool, nullptr);
+  hizSets.clear();
+
+  for (auto view : hizLevelViews) {
+    vkDestroyImageView(device, view, nullptr);
+  }
+  hizLevelViews.clear();
+  vkDestroyImageView(device, hizView, nullptr);
+  vkDestroyImage(device, hizImage, nullptr);
+  vkFreeMemory(device, hizImageMemory, nullptr);
+}
+
+void VulkanRenderer::createCullBuffers(size_t capacity) {
+  if (!occlusionCullingSupported) return;
+
+  size_t images = swapchainImages.size();
+  cullObjectBuffers.resize(images);
+  cullObjectBuffersMemory.resize(images);
+  cullObjectBuffersMapped.resize(images);
+  drawCommandBuffers.resize(images);
+  drawCommandBuffersMemory.resize(images);
+  cullCounterBuffers.resize(images);
+  cullCounterBuffersMemory.resize(images);
+  cullCounterBuffersMapped.resize(images);
+  cullSets.resize(images);
+
+  std::vector<VkDescriptorSetLayout> layouts(images, cullSetLayout);
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = occlusionPool;
+  allocInfo.descriptorSetCount = static_cast<uint32_t>(images);
+  allocInfo.pSetLayouts = layouts.data();
+
+  if (vkAllocateDescriptorSets(device, &allocInfo, cullSets.data()) != VK_SUCCESS) {
+    throw EngineException("failed to allocate cull descriptor sets", file);
+  }
+
+  for (size_t i = 0; i < images; i++) {
+    createBuffer(
+      sizeof(CullObject) * capacity,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      cullObjectBuffers[i],
+      cullObjectBuffersMemory[i]
+    );
+    vkMapMemory(device, cullObjectBuffersMemory[i], 0, VK_WHOLE_SIZE, 0, &cullObjectBuffersMapped[i]);
+
+    // only ever written by the cull shader
+    createBuffer(
+      sizeof(VkDrawIndexedIndirectCommand) * capacity,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      drawCommandBuffers[i],
+      drawCommandBuffersMemory[i]
+    );
+
+    createBuffer(
+      sizeof(CullCounters),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      cullCounterBuffers[i],
+      cullCounterBuffersMemory[i]
+    );
+    vkMapMemory(device, cullCounterBuffersMemory[i], 0, VK_WHOLE_SIZE, 0, &cullCounterBuffersMapped[i]);
+    memset(cullCounterBuffersMapped[i], 0, sizeof(CullCounters));
+
+    VkDescriptorBufferInfo cameraInfo = {cameraBuffers[i], 0, sizeof(CameraUniform)};
+    VkDescriptorBufferInfo objectInfo = {cullObjectBuffers[i], 0, VK_WHOLE_SIZE};
+    VkDescriptorBufferInfo drawInfo = {drawCommandBuffers[i], 0, VK_WHOLE_SIZE};
+    VkDescriptorBufferInfo counterInfo = {cullCounterBuffers[i], 0, sizeof(CullCounters)};
+
+    VkDescriptorImageInfo pyramidInfo = {};
+    pyramidInfo.sampler = hizSampler;
+    pyramidInfo.imageView = hizView;
+    pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    std::array<VkWriteDescriptorSet, 5> descriptorWrites = {};
+    const VkDescriptorBufferInfo* bufferInfos[] = {&cameraInfo, &objectInfo, &drawInfo, &counterInfo};
+    for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++) {
+      descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptorWrites[binding].dstSet = cullSets[i];
+      descriptorWrites[binding].dstBinding = binding;
+      descriptorWrites[binding].descriptorCount = 1;
+      if (binding < 4) {
+        descriptorWrites[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[binding].pBufferInfo = bufferInfos[binding];
+      }
+      else {
+        descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[binding].pImageInfo = &pyramidInfo;
+      }
+    }
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+  }
+}
+
+void VulkanRenderer::releaseCullBuffers() {
+  uint64_t value = timeline.lastSubmitted();
+  for (size_t i = 0; i < cullSets.size(); i++) {
+    deletionQueue.freeDescriptorSet(value, occlusionPool, cullSets[i]);
+    deletionQueue.destroyBuffer(value, cullObjectBuffers[i], cullObjectBuffersMemory[i]);
+    deletionQueue.destroyBuffer(value, drawCommandBuffers[i], drawCommandBuffersMemory[i]);
+    deletionQueue.destroyBuffer(value, cullCounterBuffers[i], cullCounterBuffersMemory[i]);
+  }
+  cullObjectBuffers.clear();
+  cullObjectBuffersMemory.clear();
+  cullObjectBuffersMapped.clear();
+  drawCommandBuffers.clear();
+  drawCommandBuffersMemory.clear();
+  cullCounterBuffers.clear();
+  cullCounterBuffersMemory.clear();
+  cullCounterBuffersMapped.clear();
+  cullSets.clear();
+}
+
+bool VulkanRenderer::occlusionCullingActive() const {
+  return occlusionCulling && occlusionCullingSupported;
+}
+
+// the frame graph resets the counters in a pass of its own and places the
+// barriers on either side
+void VulkanRenderer::recordCullPass(VkCommandBuffer commandBuffer, size_t i) {
+  CullParams params;
+  params.objectCount = static_cast<uint32_t>(scene.renderables.size());
+  params.levels = hizLevels;
+  params.width = swapchainExtent.width;
+  params.height = swapchainExtent.height;
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullLayout, 0, 1, &cullSets[i], 0, nullptr);
+  vkCmdPushConstants(commandBuffer, cullLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullParams), &params);
+  if (params.objectCount > 0) {
+    vkCmdDispatch(commandBuffer, (params.objectCount + 63) / 64, 1, 1);
+  }
+}
+
+// The frame graph orders this after the scene's depth writes and this
+// frame's cull, and makes the last level visible to the next frame's cull;
+// only the levels reading each other are synchronized here.
+void VulkanRenderer::recordDepthPyramid(VkCommandBuffer commandBuffer) {
+  VkMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hizPipeline);
+
+  // level 0 resamples the rendered part of the depth buffer to the pyramid's
+  // size, every later level halves the one before
+  VkExtent2D depthExtent = renderExtent();
+  HiZSizes sizes;
+  sizes.destinationWidth = static_cast<int32_t>(swapchainExtent.width);
+  sizes.destinationHeight = static_cast<int32_t>(swapchainExtent.height);
+  for (uint32_t level = 0; level < hizLevels; level++) {
+    sizes.sourceWidth = level == 0 ? static_cast<int32_t>(depthExtent.width) : sizes.destinationWidth;
+    sizes.sourceHeight = level == 0 ? static_cast<int32_t>(depthExtent.height) : sizes.destinationHeight;
+    if (level > 0) {
+      sizes.destinationWidth = std::max(sizes.sourceWidth / 2, 1);
+      sizes.destinationHeight = std::max(sizes.sourceHeight / 2, 1);
+    }
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, hizLayout, 0, 1, &hizSets[level], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, hizLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HiZSizes), &sizes);
+    vkCmdDispatch(
+      commandBuffer,
+      static_cast<uint32_t>(sizes.destinationWidth + 7) / 8,
+      static_cast<uint32_t>(sizes.destinationHeight + 7) / 8,
+      1);
+
+    if (level + 1 == hizLevels) break;
+    vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+}
+
+void VulkanRenderer::readCullCounters(uint32_t imageIndex) {
+  if (!occlusionCullingActive() || imageIndex >= cullCounterBuffersMapped.size()) {
+    stats.objectsDrawn = static_cast<uint32_t>(scene.renderables.size());
+    stats.objectsFrustumCulled = 0;
+    stats.objectsOcclusionCulled = 0;
+    return;
+  }
+
+  const CullCounters* counters = static_cast<const CullCounters*>(cullCounterBuffersMapped[imageIndex]);
+  stats.objectsDrawn = counters->drawn;
+  stats.objectsFrustumCulled = counters->frustumCulled;
+  stats.objectsOcclusionCulled = counters->occlusionCulled;
+}
@@ -0,0 +1,528 @@
+#include "engine/vulkan.hpp"
+
+#include <cstddef>
+
+#define file "src/engine/vulkan/particles.cpp"
+
+// std430 mirrors of the buffers in particles.comp
+struct GpuParticle {
+  // w is the seconds left
+  glm::vec4 position;
+  // w is the lifetime it started with
+  glm::vec4 velocity;
+  uint32_t color;
+  float size;
+  float padding[2];
+};
+
+struct GpuEmitter {
+  // w is the spread
+  glm::vec4 position;
+  // w is the lifetime
+  glm::vec4 velocity;
+  uint32_t color;
+  float size;
+  // this emitter's threads in the emit dispatch
+  uint32_t first;
+  uint32_t count;
+};
+
+struct ParticleParams {
+  // w is the frame's seconds
+  glm::vec4 gravity;
+  uint32_t emitterCount;
+  uint32_t emitTotal;
+  uint32_t seed;
+  uint32_t capacity;
+  // indirect dispatch of the emit stage
+  uint32_t emitDispatch[3];
+  // written back by the finish stage
+  uint32_t alive;
+  GpuEmitter emitters[PARTICLE_MAX_EMITTERS];
+};
+
+struct ParticleState {
+  uint32_t aliveCount[2];
+  int32_t deadCount;
+  // which alive list holds the live particles
+  uint32_t parity;
+  // indirect dispatch of the simulate stage, written by the prepare stage
+  uint32_t dispatch[3];
+  uint32_t padding;
+};
+
+// per image, written by the finish stage and read by the draw
+struct ParticleDraw {
+  VkDrawIndirectCommand draw;
+  // start of the pool and alive list the draw reads, in slots
+  uint32_t first;
+};
+
+// the compute shader's stages, in recording order
+enum ParticleStage : uint32_t {
+  PARTICLE_EMIT,
+  PARTICLE_PREPARE,
+  PARTICLE_SIMULATE,
+  PARTICLE_FINISH
+};
+
+void VulkanRenderer::createParticlePipelines() {
+  // params, particles, alive lists, free list, counters, draw
+  std::array<VkDescriptorSetLayoutBinding, 6> bindings = {};
+  for (uint32_t i = 0; i < bindings.size(); i++) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_VERTEX_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+  layoutInfo.pBindings = bindings.data();
+
+  if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &particleSetLayout) != VK_SUCCESS) {
+    throw EngineException("failed to create particle set layout", file);
+  }
+
+  createComputePipeline("shaders/particles.spv", particleSetLayout, sizeof(uint32_t), particleComputeLayout, particleComputePipeline);
+
+  particlePipeline.vertShaderPath = "shaders/particle-vert.spv";
+  particlePipeline.fragShaderPath = "shaders/particle-frag.spv";
+  createParticlePipeline();
+}
+
+void VulkanRenderer::destroyParticlePipelines() {
+  vkDestroyPipeline(device, particleComputePipeline, nullptr);
+  vkDestroyPipelineLayout(device, particleComputeLayout, nullptr);
+  vkDestroyDescriptorSetLayout(device, particleSetLayout, nullptr);
+}
+
+// billboards are expanded from the particle buffer in the vertex shader, so
+// there is no vertex input
+void VulkanRenderer::createParticlePipeline() {
+  auto vertCode = readFile(particlePipeline.vertShaderPath);
+  auto fragCode = readFile(particlePipeline.fragShaderPath);
+
+  VkShaderModule vertShaderModule = createShaderModule(vertCode);
+  VkShaderModule fragShaderModule = createShaderModule(fragCode);
+
+  VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+  shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  shaderStages[0].module = vertShaderModule;
+  shaderStages[0].pName = "main";
+  shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  shaderStages[1].module = fragShaderModule;
+  shaderStages[1].pName = "main";
+
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+  vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+  inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+  VkViewport viewport = {};
+  viewport.width = (float) swapchainExtent.width;
+  viewport.height = (float) swapchainExtent.height;
+  viewport.maxDepth = 1.0f;
+
+  VkRect2D scissor = {};
+  scissor.extent = swapchainExtent;
+
+  VkPipelineViewportStateCreateInfo viewportState = {};
+  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportState.viewportCount = 1;
+  viewportState.pViewports = &viewport;
+  viewportState.scissorCount = 1;
+  viewportState.pScissors = &scissor;
+
+  // set by recordScene, like the scene pipelines
+  std::array<VkDynamicState, 2> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamicState = {};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+  dynamicState.pDynamicStates = dynamicStates.data();
+
+  VkPipelineRasterizationStateCreateInfo rasterizer = {};
+  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+  rasterizer.lineWidth = 1.0f;
+  rasterizer.cullMode = VK_CULL_MODE_NONE;
+  rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+  VkPipelineMultisampleStateCreateInfo multisampling = {};
+  multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  // hidden by the scene but not by each other, so they needn't be sorted
+  VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+  depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depthStencil.depthTestEnable = VK_TRUE;
+  depthStencil.depthWriteEnable = VK_FALSE;
+  depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+  VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+  colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  colorBlendAttachment.blendEnable = VK_TRUE;
+  colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+  colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+  colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+  colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+  colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+  VkPipelineColorBlendStateCreateInfo colorBlending = {};
+  colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  colorBlending.attachmentCount = 1;
+  colorBlending.pAttachments = &colorBlendAttachment;
+
+  std::array<VkDescriptorSetLayout, 3> setLayouts = {cameraSetLayout, textureSetLayout, particleSetLayout};
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+  pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+  if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &particlePipeline.layout) != VK_SUCCESS) {
+    throw EngineException("failed to create particle layout", file);
+  }
+
+  VkGraphicsPipelineCreateInfo pipelineInfo = {};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.stageCount = 2;
+  pipelineInfo.pStages = shaderStages;
+  pipelineInfo.pVertexInputState = &vertexInputInfo;
+  pipelineInfo.pInputAssemblyState = &inputAssembly;
+  pipelineInfo.pViewportState = &viewportState;
+  pipelineInfo.pDynamicState = &dynamicState;
+  pipelineInfo.pRasterizationState = &rasterizer;
+  pipelineInfo.pMultisampleState = &multisampling;
+  pipelineInfo.pDepthStencilState = &depthStencil;
+  pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.layout = particlePipeline.layout;
+  pipelineInfo.renderPass = renderPass;
+  pipelineInfo.subpass = 0;
+
+  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &particlePipeline.pipeline) != VK_SUCCESS) {
+    throw EngineException("failed to create particle pipeline", file);
+  }
+
+  vkDestroyShaderModule(device, fragShaderModule, nullptr);
+  vkDestroyShaderModule(device, vertShaderModule, nullptr);
+}
+
+uint32_t VulkanRenderer::createParticleSystem(uint32_t capacity, uint32_t texture) {
+  if (capacity == 0) {
+    throw EngineException("particle capacity must be positive", file);
+  }
+
+  ParticleSystem system;
+  system.capacity = capacity;
+  system.texture = texture;
+
+  // particles are only ever written by the shader, so the pools start
+  // undefined; with async compute the previous frame's draw reads one pool
+  // while the compute queue writes the other
+  createBuffer(
+    sizeof(GpuParticle) * 2 * capacity,
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    system.particleBuffer,
+    system.particleBufferMemory,
+    true
+  );
+  createBuffer(
+    sizeof(uint32_t) * 2 * capacity,
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    system.aliveBuffer,
+    system.aliveBufferMemory,
+    true
+  );
+
+  // every slot starts free
+  std::vector<uint32_t> dead(capacity);
+  for (uint32_t i = 0; i < capacity; i++) {
+    dead[i] = i;
+  }
+  // filled on the graphics queue and used on the compute queue
+  createDeviceLocalBuffer(
+    dead.data(),
+    sizeof(dead[0]) * dead.size(),
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    system.deadBuffer,
+    system.deadBufferMemory,
+    true
+  );
+
+  ParticleState state = {};
+  state.deadCount = static_cast<int32_t>(capacity);
+  state.dispatch[1] = 1;
+  state.dispatch[2] = 1;
+  createDeviceLocalBuffer(
+    &state,
+    sizeof(state),
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+    system.stateBuffer,
+    system.stateBufferMemory,
+    true
+  );
+
+  particleSystems.push_back(system);
+  // systems made in init get their frame resources with the command buffers
+  if (!cameraBuffers.empty()) {
+    createParticleFrameResources(particleSystems.back());
+    markCommandBuffersDirty();
+  }
+  return static_cast<uint32_t>(particleSystems.size() - 1);
+}
+
+void VulkanRenderer::destroyParticleSystem(uint32_t system) {
+  if (system >= particleSystems.size() || particleSystems[system].capacity == 0) {
+    throw EngineException("no such particle system", file);
+  }
+  releaseParticleSystem(particleSystems[system]);
+  // keep the slot so other system ids stay valid
+  particleSystems[system] = ParticleSystem();
+  markCommandBuffersDirty();
+}
+
+void VulkanRenderer::releaseParticleSystem(ParticleSystem& system) {
+  releaseParticleFrameResources(system);
+
+  uint64_t value = timeline.lastSubmitted();
+  deletionQueue.destroyBuffer(value, system.particleBuffer, system.particleBufferMemory);
+  deletionQueue.destroyBuffer(value, system.aliveBuffer, system.aliveBufferMemory);
+  deletionQueue.destroyBuffer(value, system.deadBuffer, system.deadBufferMemory);
+  deletionQueue.destroyBuffer(value, system.stateBuffer, system.stateBufferMemory);
+}
+
+// per swapchain image, so rebuilt with the other frame buffers when the
+// image count may change
+void VulkanRenderer::createParticleFrameResources(ParticleSystem& system) {
+  uint32_t images = static_cast<uint32_t>(swapchainImages.size());
+
+  VkDescriptorPoolSize poolSize = {};
+  poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSize.descriptorCount = images * 6;
+
+  VkDescriptorPoolCreateInfo poolInfo = {};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  poolInfo.maxSets = images;
+
+  if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &system.pool) != VK_SUCCESS) {
+    throw EngineException("failed to create particle pool", file);
+  }
+
+  system.paramBuffers.resize(images);
+  system.paramBuffersMemory.resize(images);
+  system.paramBuffersMapped.resize(images);
+  system.drawBuffers.resize(images);
+  system.drawBuffersMemory.resize(images);
+  system.sets.resize(images);
+
+  std::vector<VkDescriptorSetLayout> layouts(images, particleSetLayout);
+  VkDescriptorSetAllocateInfo allocInfo = {};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = system.pool;
+  allocInfo.descriptorSetCount = images;
+  allocInfo.pSetLayouts = layouts.data();
+
+  if (vkAllocateDescriptorSets(device, &allocInfo, system.sets.data()) != VK_SUCCESS) {
+    throw EngineException("failed to allocate particle sets", file);
+  }
+
+  for (uint32_t i = 0; i < images; i++) {
+    // the emit stage's indirect dispatch lives in here too
+    createBuffer(
+      sizeof(ParticleParams),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      system.paramBuffers[i],
+      system.paramBuffersMemory[i]
+    );
+    vkMapMemory(device, system.paramBuffersMemory[i], 0, VK_WHOLE_SIZE, 0, &system.paramBuffersMapped[i]);
+    memset(system.paramBuffersMapped[i], 0, sizeof(ParticleParams));
+
+    // written in full before every draw, so it never needs initializing
+    createBuffer(
+      sizeof(ParticleDraw),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      system.drawBuffers[i],
+      system.drawBuffersMemory[i]
+    );
+
+    VkDescriptorBufferInfo bufferInfos[6] = {
+      {system.paramBuffers[i], 0, sizeof(ParticleParams)},
+      {system.particleBuffer, 0, VK_WHOLE_SIZE},
+      {system.aliveBuffer, 0, VK_WHOLE_SIZE},
+      {system.deadBuffer, 0, VK_WHOLE_SIZE},
+      {system.stateBuffer, 0, sizeof(ParticleState)},
+      {system.drawBuffers[i], 0, sizeof(ParticleDraw)}
+    };
+    std::array<VkWriteDescriptorSet, 6> descriptorWrites = {};
+    for (uint32_t binding = 0; binding < descriptorWrites.size(); binding++) {
+      descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptorWrites[binding].dstSet = system.sets[i];
+      descriptorWrites[binding].dstBinding = binding;
+      descriptorWrites[binding].descriptorCount = 1;
+      descriptorWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+    }
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+  }
+}
+
+void VulkanRenderer::releaseParticleFrameResources(ParticleSystem& system) {
+  uint64_t value = timeline.lastSubmitted();
+  if (system.pool != VK_NULL_HANDLE) {
+    deletionQueue.destroyDescriptorPool(value, system.pool);
+    system.pool = VK_NULL_HANDLE;
+  }
+  for (size_t i = 0; i < system.paramBuffers.size(); i++) {
+    deletionQueue.destroyBuffer(value, system.paramBuffers[i], system.paramBuffersMemory[i]);
+    deletionQueue.destroyBuffer(value, system.drawBuffers[i], system.drawBuffersMemory[i]);
+  }
+  system.paramBuffers.clear();
+  system.paramBuffersMemory.clear();
+  system.paramBuffersMapped.clear();
+  system.drawBuffers.clear();
+  system.drawBuffersMemory.clear();
+  system.sets.clear();
+}
+
+// Reads back what this image's last submission left alive and writes the
+// emitters for this one. Emitters can change every frame without
+// re-recording anything; only their per-frame particle counts reach the GPU.
+void VulkanRenderer::prepareParticles(uint32_t imageIndex) {
+  auto now = std::chrono::high_resolution_clock::now();
+  float seconds = 0.0f;
+  if (lastParticleUpdate.time_since_epoch().count() != 0) {
+    // a stall shouldn't release a burst of particles all at once
+    seconds = std::min(std::chrono::duration<float>(now - lastParticleUpdate).count(), 0.1f);
+  }
+  lastParticleUpdate = now;
+
+  uint32_t alive = 0;
+  uint32_t emitted = 0;
+  for (ParticleSystem& system : particleSystems) {
+    if (system.capacity == 0 || system.paramBuffersMapped.empty()) continue;
+
+    ParticleParams* params = static_cast<ParticleParams*>(system.paramBuffersMapped[imageIndex]);
+    alive += params->alive;
+
+    uint32_t emitters = std::min<uint32_t>(static_cast<uint32_t>(system.emitters.size()), PARTICLE_MAX_EMITTERS);
+    system.emitCarry.resize(system.emitters.size(), 0.0f);
+    uint32_t total = 0;
+    for (uint32_t e = 0; e < emitters; e++) {
+      const ParticleEmitter& emitter = system.emitters[e];
+      float& carry = system.emitCarry[e];
+      carry += std::max(emitter.rate, 0.0f) * seconds;
+      uint32_t count = static_cast<uint32_t>(carry);
+      carry -= count;
+      // more than the pool holds would only fail to find free slots
+      count = std::min(count, system.capacity - total);
+
+      GpuEmitter& gpu = params->emitters[e];
+      gpu.position = glm::vec4(emitter.position, emitter.spread);
+      gpu.velocity = glm::vec4(emitter.velocity, emitter.lifetime);
+      gpu.color = packColor(emitter.color);
+      gpu.size = emitter.size;
+      gpu.first = total;
+      gpu.count = count;
+      total += count;
+    }
+
+    params->gravity = glm::vec4(system.gravity, seconds);
+    params->emitterCount = emitters;
+    params->emitTotal = total;
+    params->seed = particleSeed++;
+    params->capacity = system.capacity;
+    params->emitDispatch[0] = (total + 63) / 64;
+    params->emitDispatch[1] = 1;
+    params->emitDispatch[2] = 1;
+    emitted += total;
+  }
+  stats.particlesAlive = alive;
+  stats.particlesEmitted = emitted;
+}
+
+// Every system runs each stage before any runs the next, so the whole update
+// is four dispatches per system and five barriers in total. On the compute
+// queue the draws are handed over by recordComputeHandoff instead.
+void VulkanRenderer::recordParticleSimulation(VkCommandBuffer commandBuffer, size_t i, bool async) {
+  bool any = false;
+  for (const ParticleSystem& system : particleSystems) {
+    any = any || (system.capacity > 0 && !system.sets.empty());
+  }
+  if (!any) return;
+
+  // earlier submissions' draws and readbacks are done with the lists
+  VkPipelineStageFlags drawStages = async ? 0 : VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+  VkMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(
+    commandBuffer,
+    drawStages | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleComputePipeline);
+  for (uint32_t stage = PARTICLE_EMIT; stage <= PARTICLE_FINISH; stage++) {
+    vkCmdPushConstants(commandBuffer, particleComputeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(stage), &stage);
+    for (const ParticleSystem& system : particleSystems) {
+      if (system.capacity == 0 || system.sets.empty()) continue;
+
+      vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleComputeLayout, 0, 1, &system.sets[i], 0, nullptr);
+      if (stage == PARTICLE_EMIT) {
+        vkCmdDispatchIndirect(commandBuffer, system.paramBuffers[i], offsetof(ParticleParams, emitDispatch));
+      }
+      else if (stage == PARTICLE_SIMULATE) {
+        vkCmdDispatchIndirect(commandBuffer, system.stateBuffer, offsetof(ParticleState, dispatch));
+      }
+      else {
+        vkCmdDispatch(commandBuffer, 1, 1, 1);
+      }
+    }
+
+    if (stage == PARTICLE_PREPARE) {
+      // simulate's dispatch size comes from prepare
+      recordComputeBarrier(
+        commandBuffer,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+    else if (stage == PARTICLE_FINISH) {
+      // the draw, the billboards, and the alive count read back on the host
+      VkAccessFlags drawAccess = async ? 0 : VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+      recordComputeBarrier(commandBuffer, drawStages | VK_PIPELINE_STAGE_HOST_BIT, drawAccess | VK_ACCESS_HOST_READ_BIT);
+    }
+    else {
+      recordComputeBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+  }
+}
+
+void VulkanRenderer::recordParticles(VkCommandBuffer commandBuffer, size_t i, uint32_t& drawCalls) {
+  bool bound = false;
+  for (const ParticleSystem& system : particleSystems) {
+    if (system.capacity == 0 || system.sets.empty()) continue;
+
+    if (!bound) {
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, particlePipeline.pipeline);
+      vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, particlePipeline.layout, 0, 1, &cameraSets[i], 0, nullptr);
+      bound = true;
+    }
+    bindTexture(commandBuffer, particlePipeline.layout, 1, system.texture);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, particlePipeline.layout, 2, 1, &system.sets[i], 0, nullptr);
+    // six vertices per live particle, counted by the finish stage
+    vkCmdDrawIndirect(commandBuffer, system.drawBuffers[i], offsetof(ParticleDraw, draw), 1, sizeof(VkDrawIndirectCommand));
+    drawCalls++;
+  }
+}
@@ -22,6 +22,7 @@ void VulkanRenderer::createCommandPool() {
   VkCommandPoolCreateInfo poolInfo = {};
   poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
   poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
   if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
     throw EngineException("failed to create command pool", file);
@@ -30,6 +31,11 @@ void VulkanRenderer::createCommandPool() {
 
 void VulkanRenderer::createCommandBuffers() {
   commandBuffers.resize(swapchainFramebuffers.size());
+  commandBuffersDirty.assign(commandBuffers.size(), false);
+  recordedVersions.assign(commandBuffers.size(), 0);
+  recordedSpriteBatches.assign(commandBuffers.size(), std::vector<SpriteBatch>());
+  recordedTilemapDraws.assign(commandBuffers.size(), std::vector<TilemapDraw>());
+  computeRecorded.assign(commandBuffers.size(), false);
 
   VkCommandBufferAllocateInfo allocInfo = {};
   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -41,49 +47,271 @@ void VulkanRenderer::createCommandBuffers() {
     throw EngineException("failed to create command buffers", file);
   }
 
+  if (asyncComputeSupported) {
+    computeCommandBuffers.resize(commandBuffers.size());
+    allocInfo.commandPool = computeCommandPool;
+    if (vkAllocateCommandBuffers(device, &allocInfo, computeCommandBuffers.data()) != VK_SUCCESS) {
+      throw EngineException("failed to create command buffers", file);
+    }
+  }
+
+  createCameraBuffers();
+  for (auto &system : particleSystems) {
+    if (system.capacity > 0) {
+      createParticleFrameResources(system);
+    }
+  }
+  ensureInstanceCapacity(scene.renderables.size());
+  createFrameGraph();
   for (size_t i = 0; i < commandBuffers.size(); i++) {
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    recordCommandBuffer(i);
+  }
+}
+
+void VulkanRenderer::recordCommandBuffer(size_t i) {
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-    if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-      throw EngineException("failed to begin recording command buffer!", file);
+  if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
+    throw EngineException("failed to begin recording command buffer!", file);
+  }
+
+  if (timestampsSupported) {
+    vkCmdResetQueryPool(commandBuffers[i], timestampPool, static_cast<uint32_t>(i * 2), 2);
+    vkCmdWriteTimestamp(commandBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool, static_cast<uint32_t>(i * 2));
+  }
+
+  // the rest of the compute work goes to the compute queue when there is one,
+  // which hands the draws their results before the frame graph runs
+  bool async = asyncComputeActive() && hasComputeWork();
+  VkCommandBuffer computeBuffer = async ? computeCommandBuffers[i] : commandBuffers[i];
+  if (async && vkBeginCommandBuffer(computeBuffer, &beginInfo) != VK_SUCCESS) {
+    throw EngineException("failed to begin recording command buffer!", file);
+  }
+  recordParticleSimulation(computeBuffer, i, async);
+  for (auto &pass : computePasses) {
+    pass(computeBuffer, i);
+  }
+  if (async) {
+    recordComputeHandoff(computeBuffer, i, false);
+    if (vkEndCommandBuffer(computeBuffer) != VK_SUCCESS) {
+      throw EngineException("failed to record command buffer", file);
     }
+    recordComputeHandoff(commandBuffers[i], i, true);
+  }
+  computeRecorded[i] = async;
 
-    VkRenderPassBeginInfo renderPassInfo = {};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = renderPass;
-    renderPassInfo.framebuffer = swapchainFramebuffers[i];
+  frameGraph.execute(commandBuffers[i], i);
 
-    renderPassInfo.renderArea.offset = {0, 0};
-    renderPassInfo.renderArea.extent = swapchainExtent;
+  if (timestampsSupported) {
+    vkCmdWriteTimestamp(commandBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, static_cast<uint32_t>(i * 2 + 1));
+  }
 
-    VkClearValue clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
-    renderPassInfo.clearValueCount = 1;
-    renderPassInfo.pClearValues = &clearColor;
+  if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
+    throw EngineException("failed to record command buffer", file);
+  }
+  commandBuffersDirty[i] = false;
+  recordedVersions[i] = scene.renderablesVersion;
+}
 
-    vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+// Cull writes the draws and counters, the scene pass reads the draws, and the
+// Hi-Z pass reads the scene's depth for the next frame's cull. With dynamic
+// resolution the scene goes to a transient target that is blitted to the
+// swapchain image. The graph places every barrier between them; the render
+// pass still orders its own attachments against the previous frame.
+void VulkanRenderer::createFrameGraph() {
+  frameGraph.init(device, physicalDevice);
+
+  // anything before the render pass waits on the acquire semaphore at color output
+  RenderGraph::Access acquired = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED};
+  RenderGraph::Access none;
+  RenderGraph::Resource swapchainResource = frameGraph.importImage("swapchain", swapchainImages, VK_IMAGE_ASPECT_COLOR_BIT, 1, acquired);
+  RenderGraph::Resource depth = frameGraph.importImage("depth", {depthImage}, VK_IMAGE_ASPECT_DEPTH_BIT, 1, none);
+
+  RenderGraph::Access colorOutput = {
+    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+  };
+  RenderGraph::Access depthOutput = RenderGraph::layoutAccess(VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+  VkImageLayout depthFinalLayout = occlusionCullingSupported
+    ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+    : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  renderingOffscreen = dynamicResolutionActive();
+  RenderGraph::Resource color = swapchainResource;
+  VkImageLayout colorFinalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  if (renderingOffscreen) {
+    RenderGraph::ImageDesc desc;
+    desc.format = swapchainImageFormat;
+    desc.extent = swapchainExtent;
+    desc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    sceneColor = color = frameGraph.createImage("sceneColor", desc);
+    colorFinalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  }
 
-    for (auto &pipeline : pipelines) {
-    vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
-      for (auto &obj : pipeline.objects) {
-        VkBuffer vertexBuffers[] = {obj.vertexBuffer};
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
+  RenderGraph::Resource hiz = 0;
+  RenderGraph::Resource drawCommands = 0;
+  RenderGraph::Resource counters = 0;
+  // the pyramid is left readable by compute at the end of every frame
+  RenderGraph::Access pyramidRead = {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL};
+  if (occlusionCullingSupported) {
+    hiz = frameGraph.importImage("hiz", {hizImage}, VK_IMAGE_ASPECT_COLOR_BIT, hizLevels, pyramidRead);
+    drawCommands = frameGraph.importBuffer("drawCommands");
+    // host reads of the previous frame's counters are ordered by its fence
+    counters = frameGraph.importBuffer("cullCounters");
+
+    RenderGraph::Pass reset = frameGraph.addPass("cullReset", [this](VkCommandBuffer commandBuffer, size_t i) {
+      if (occlusionCullingActive()) {
+        vkCmdFillBuffer(commandBuffer, cullCounterBuffers[i], 0, sizeof(CullCounters), 0);
+      }
+    });
+    frameGraph.write(reset, counters, {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT});
 
-        vkCmdBindIndexBuffer(commandBuffers[i], obj.indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+    RenderGraph::Pass cull = frameGraph.addPass("cull", [this](VkCommandBuffer commandBuffer, size_t i) {
+      if (occlusionCullingActive()) {
+        recordCullPass(commandBuffer, i);
+      }
+    });
+    frameGraph.read(cull, hiz, pyramidRead);
+    frameGraph.write(cull, counters, {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT});
+    frameGraph.write(cull, drawCommands, {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT});
+  }
 
-        vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout, 0, 1, &obj.descriptorSets[i], 0, nullptr);
+  RenderGraph::Pass scenePass = frameGraph.addPass("scene", [this](VkCommandBuffer commandBuffer, size_t i) {
+    recordScene(commandBuffer, i);
+  });
+  if (occlusionCullingSupported) {
+    frameGraph.read(scenePass, drawCommands, {VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT});
+  }
+  frameGraph.attachment(scenePass, color, colorOutput, colorFinalLayout);
+  frameGraph.attachment(scenePass, depth, depthOutput, depthFinalLayout);
+
+  if (renderingOffscreen) {
+    RenderGraph::Pass upscale = frameGraph.addPass("upscale", [this](VkCommandBuffer commandBuffer, size_t i) {
+      recordUpscale(commandBuffer, i);
+    });
+    frameGraph.read(upscale, color, RenderGraph::layoutAccess(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL));
+    frameGraph.write(upscale, swapchainResource, RenderGraph::layoutAccess(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL));
+  }
 
-        vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(obj.indices.size()), 1, 0, 0, 0);
+  if (occlusionCullingSupported) {
+    RenderGraph::Pass pyramid = frameGraph.addPass("hiz", [this](VkCommandBuffer commandBuffer, size_t) {
+      if (occlusionCullingActive()) {
+        recordDepthPyramid(commandBuffer);
       }
-    }
+    });
+    frameGraph.read(pyramid, depth, {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, depthFinalLayout});
+    frameGraph.write(pyramid, hiz, {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL});
 
-    vkCmdEndRenderPass(commandBuffers[i]);
+    frameGraph.markOutput(hiz, pyramidRead);
+    frameGraph.markOutput(counters, {VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT});
+  }
+  frameGraph.markOutput(swapchainResource, {0, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR});
 
-    if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-      throw EngineException("failed to record command buffer", file);
+  for (auto &addPasses : graphPasses) {
+    addPasses(frameGraph);
+  }
+  frameGraph.compile();
+  if (renderingOffscreen) {
+    createOffscreenFramebuffer();
+  }
+
+  const RenderGraph::Stats& graphStats = frameGraph.stats();
+  stats.graphBarriers = graphStats.barriers;
+  stats.graphPassesCulled = graphStats.culled;
+  stats.transientMemory = graphStats.transientMemory;
+}
+
+void VulkanRenderer::rebuildFrameGraph() {
+  deletionQueue.destroyFramebuffer(timeline.lastSubmitted(), offscreenFramebuffer);
+  offscreenFramebuffer = VK_NULL_HANDLE;
+  frameGraph.release(deletionQueue, timeline.lastSubmitted());
+  createFrameGraph();
+  markCommandBuffersDirty();
+}
+
+void VulkanRenderer::recordScene(VkCommandBuffer commandBuffer, size_t i) {
+  VkExtent2D extent = renderExtent();
+
+  VkRenderPassBeginInfo renderPassInfo = {};
+  renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  renderPassInfo.renderPass = renderingOffscreen ? offscreenRenderPass : renderPass;
+  renderPassInfo.framebuffer = renderingOffscreen ? offscreenFramebuffer : swapchainFramebuffers[i];
+
+  renderPassInfo.renderArea.offset = {0, 0};
+  renderPassInfo.renderArea.extent = extent;
+
+  std::array<VkClearValue, 2> clearValues = {};
+  clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+  clearValues[1].depthStencil = {1.0f, 0};
+  renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+  renderPassInfo.pClearValues = clearValues.data();
+
+  // culling writes one indirect draw per renderable, in the same dense order
+  bool culling = occlusionCullingActive();
+
+  vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+  VkViewport viewport = {};
+  viewport.width = (float) extent.width;
+  viewport.height = (float) extent.height;
+  viewport.maxDepth = 1.0f;
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  vkCmdSetScissor(commandBuffer, 0, 1, &renderPassInfo.renderArea);
+
+  // renderables are drawn in dense order, only rebinding state when it changes;
+  // instance j of the instance buffer holds the model matrix of renderable j
+  VkDeviceSize instanceOffset = 0;
+  vkCmdBindVertexBuffers(commandBuffer, 1, 1, &instanceBuffers[i], &instanceOffset);
+
+  uint32_t drawCalls = 0;
+  uint32_t boundPipeline = UINT32_MAX;
+  VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+  VkBuffer boundIndexBuffer = VK_NULL_HANDLE;
+  uint32_t boundTexture = UINT32_MAX;
+  const std::vector<Renderable>& renderables = scene.renderables.data();
+  for (size_t j = 0; j < renderables.size(); j++) {
+    const Renderable& r = renderables[j];
+    if (r.pipeline >= pipelines.size() || pipelines[r.pipeline].pipeline == VK_NULL_HANDLE) continue;
+    VkPipelineLayout layout = pipelines[r.pipeline].layout;
+    if (r.pipeline != boundPipeline) {
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[r.pipeline].pipeline);
+      vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &cameraSets[i], 0, nullptr);
+      boundPipeline = r.pipeline;
+      boundTexture = UINT32_MAX;
     }
+    if (r.vertexBuffer != boundVertexBuffer) {
+      VkBuffer vertexBuffers[] = {r.vertexBuffer};
+      VkDeviceSize offsets[] = {0};
+      vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+      boundVertexBuffer = r.vertexBuffer;
+    }
+    if (r.indexBuffer != boundIndexBuffer) {
+      vkCmdBindIndexBuffer(commandBuffer, r.indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+      boundIndexBuffer = r.indexBuffer;
+    }
+    if (r.texture != boundTexture) {
+      bindTexture(commandBuffer, layout, 1, r.texture);
+      boundTexture = r.texture;
+    }
+
+    if (culling) {
+      VkDeviceSize offset = sizeof(VkDrawIndexedIndirectCommand) * j;
+      vkCmdDrawIndexedIndirect(commandBuffer, drawCommandBuffers[i], offset, 1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+    else {
+      vkCmdDrawIndexed(commandBuffer, r.indexCount, 1, r.firstIndex, 0, static_cast<uint32_t>(j));
+    }
+    drawCalls++;
   }
+  // particles test against the scene's depth; tilemaps, then sprites, go over it without
+  recordParticles(commandBuffer, i, drawCalls);
+  recordTilemaps(commandBuffer, i, drawCalls);
+  recordSprites(commandBuffer, i, drawCalls);
+  stats.drawCalls = drawCalls;
+
+  vkCmdEndRenderPass(commandBuffer);
 }
 
 void VulkanRenderer::createRenderPass() {
@@ -100,37 +328,73 @@ void VulkanRenderer::createRenderPass() {
   colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
   colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
+  // ends read-only so the Hi-Z pass can sample it after the render pass
+  VkAttachmentDescription depthAttachment = {};
+  depthAttachment.format = depthFormat;
+  depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+
+  depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  depthAttachment.storeOp = occlusionCullingSupported ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+  depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+  depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depthAttachment.finalLayout = occlusionCullingSupported
+    ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+    : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
   VkAttachmentReference colorAttachmentRef = {};
   colorAttachmentRef.attachment = 0;
   colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+  VkAttachmentReference depthAttachmentRef = {};
+  depthAttachmentRef.attachment = 1;
+  depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
   VkSubpassDescription subpass = {};
   subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
   subpass.colorAttachmentCount = 1;
   subpass.pColorAttachments = &colorAttachmentRef;
+  subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
-  VkSubpassDependency dependency = {};
-  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.dstSubpass = 0;
+  // the depth image is shared between frames, so clearing it waits for the
+  // previous frame's depth writes and Hi-Z reads; the frame graph makes the
+  // finished depth visible to this frame's Hi-Z pass
+  std::array<VkSubpassDependency, 1> dependencies = {};
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass = 0;
 
-  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.srcAccessMask = 0;
+  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
-  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+    | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
 
   VkRenderPassCreateInfo renderPassInfo = {};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-  renderPassInfo.attachmentCount = 1;
-  renderPassInfo.pAttachments = &colorAttachment;
+  renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+  renderPassInfo.pAttachments = attachments.data();
   renderPassInfo.subpassCount = 1;
   renderPassInfo.pSubpasses = &subpass;
-  renderPassInfo.dependencyCount = 1;
-  renderPassInfo.pDependencies = &dependency;
+  renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+  renderPassInfo.pDependencies = dependencies.data();
 
   if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
     throw EngineException("failed to create render pass", file);
   }
+
+  // compatible with renderPass, so the same pipelines draw into either; the
+  // frame graph moves the target on to the upscale blit
+  if (dynamicResolutionSupported) {
+    attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &offscreenRenderPass) != VK_SUCCESS) {
+      throw EngineException("failed to create render pass", file);
+    }
+  }
 }
 
 void VulkanRenderer::createGraphicsPipeline (VulkanPipeline &pipeline) {
@@ -156,12 +420,18 @@ void VulkanRenderer::createGraphicsPipeline (VulkanPipeline &pipeline) {
 
   VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
   vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  auto bindingDescription = Vertex::getBindingDescription();
-  auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-  vertexInputInfo.vertexBindingDescriptionCount = 1;
+  std::array<VkVertexInputBindingDescription, 2> bindingDescriptions = {
+    Vertex::getBindingDescription(),
+    InstanceData::getBindingDescription()
+  };
+  auto vertexAttributes = Vertex::getAttributeDescriptions();
+  auto instanceAttributes = InstanceData::getAttributeDescriptions();
+  std::vector<VkVertexInputAttributeDescription> attributeDescriptions(vertexAttributes.begin(), vertexAttributes.end());
+  attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end());
+
+  vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
   vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-  vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+  vertexInputInfo.pVertexBindingDescriptions = bindingDescriptions.data();
   vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
   VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
@@ -188,6 +458,13 @@ void VulkanRenderer::createGraphicsPipeline (VulkanPipeline &pipeline) {
   viewportState.scissorCount = 1;
   viewportState.pScissors = &scissor;
 
+  // the scene may be drawn below swapchain resolution, so recordScene sets these
+  std::array<VkDynamicState, 2> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamicState = {};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+  dynamicState.pDynamicStates = dynamicStates.data();
+
   VkPipelineRasterizationStateCreateInfo rasterizer = {};
   rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
   rasterizer.depthClampEnable = VK_FALSE;
@@ -207,6 +484,14 @@ void VulkanRenderer::createGraphicsPipeline (VulkanPipeline &pipeline) {
   multisampling.sampleShadingEnable = VK_FALSE;
   multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
+  VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+  depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depthStencil.depthTestEnable = VK_TRUE;
+  depthStencil.depthWriteEnable = VK_TRUE;
+  depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+  depthStencil.depthBoundsTestEnable = VK_FALSE;
+  depthStencil.stencilTestEnable = VK_FALSE;
+
   VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
   colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
   colorBlendAttachment.blendEnable = VK_FALSE;
@@ -219,8 +504,9 @@ void VulkanRenderer::createGraphicsPipeline (VulkanPipeline &pipeline) {
 
   VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
   pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.setLayoutCount = 1;
-  pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+  std::array<VkDescriptorSetLayout, 2> setLayouts = {cameraSetLayout, textureSetLayout};
+  pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+  pipelineLayoutInfo.pSetLayouts = setLayouts.data();
   pipelineLayoutInfo.pushConstantRangeCount = 0;
   if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipeline.layout) != VK_SUCCESS) {
     throw EngineException("failed to create pipeline layout!", file);
@@ -233,8 +519,10 @@ void VulkanRenderer::createGraphicsPipeline (VulkanPipeline &pipeline) {
   pipelineInfo.pVertexInputState = &vertexInputInfo;
   pipelineInfo.pInputAssemblyState = &inputAssembly;
   pipelineInfo.pViewportState = &viewportState;
+  pipelineInfo.pDynamicState = &dynamicState;
   pipelineInfo.pRasterizationState = &rasterizer;
   pipelineInfo.pMultisampleState = &multisampling;
+  pipelineInfo.pDepthStencilState = &depthStencil;
   pipelineInfo.pColorBlendState = &colorBlending;
   pipelineInfo.layout = pipeline.layout;
   pipelineInfo.renderPass = renderPass;
@@ -0,0 +1,259 @@
+#include "engine/vulkan.hpp"
+
+#define file "src/engine/vulkan/readback.cpp"
+
+// Frame capture: the copy is its own command buffer, submitted after the
+// frame's in the same vkQueueSubmit, so prerecorded command buffers don't
+// change when a capture is requested. The present waits on the semaphore
+// signalled after both, and the timeline tells the render thread when the
+// pixels can be read, a frame or two later.
+
+// one more than MAX_FRAMES_IN_FLIGHT, so every frame can be captured
+static const size_t READBACK_BUFFERS = 3;
+
+bool VulkanRenderer::checkCaptureSupport(const VkSurfaceCapabilitiesKHR& capabilities, VkFormat format) {
+  if ((capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) == 0) return false;
+
+  switch (format) {
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_R8G8B8A8_UNORM:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool VulkanRenderer::captureSupported() const {
+  return captureFormatSupported;
+}
+
+void VulkanRenderer::captureFrame(std::function<void(CapturedFrame& frame)> callback) {
+  if (!captureFormatSupported) {
+    throw EngineException("frame capture is not supported", file);
+  }
+  pendingCaptures.push_back(std::move(callback));
+}
+
+// The CPU reads every byte, so cached memory is preferred; it may not be
+// coherent, which readCapture makes up for.
+void VulkanRenderer::allocateReadbackBuffer(ReadbackBuffer& readback, VkDeviceSize size) {
+  VkBufferCreateInfo bufferInfo = {};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  if (vkCreateBuffer(device, &bufferInfo, nullptr, &readback.buffer) != VK_SUCCESS) {
+    throw EngineException("failed to create readback buffer", file);
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetBufferMemoryRequirements(device, readback.buffer, &memRequirements);
+
+  VkPhysicalDeviceMemoryProperties memProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+  uint32_t memoryType = UINT32_MAX;
+  VkMemoryPropertyFlags cached = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount && memoryType == UINT32_MAX; i++) {
+    if ((memRequirements.memoryTypeBits & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & cached) == cached) {
+      memoryType = i;
+    }
+  }
+  if (memoryType == UINT32_MAX) {
+    memoryType = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  }
+  readback.coherent = (memProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+  VkMemoryAllocateInfo allocInfo = {};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize = memRequirements.size;
+  allocInfo.memoryTypeIndex = memoryType;
+  if (vkAllocateMemory(device, &allocInfo, nullptr, &readback.memory) != VK_SUCCESS) {
+    throw EngineException("failed to allocate readback memory", file);
+  }
+  stats.deviceAllocations++;
+
+  vkBindBufferMemory(device, readback.buffer, readback.memory, 0);
+  vkMapMemory(device, readback.memory, 0, VK_WHOLE_SIZE, 0, &readback.mapped);
+  readback.size = size;
+}
+
+void VulkanRenderer::freeReadbackBuffer(ReadbackBuffer& readback) {
+  if (readback.buffer == VK_NULL_HANDLE) return;
+  vkUnmapMemory(device, readback.memory);
+  vkDestroyBuffer(device, readback.buffer, nullptr);
+  vkFreeMemory(device, readback.memory, nullptr);
+  readback.buffer = VK_NULL_HANDLE;
+  readback.memory = VK_NULL_HANDLE;
+  readback.mapped = nullptr;
+  readback.size = 0;
+}
+
+// Records the copy of this frame's image into a free readback buffer, if a
+// capture is waiting and one is free. Buffers only grow, and only while
+// they aren't in flight, so nothing the GPU uses is ever freed here.
+bool VulkanRenderer::recordCapture(uint32_t imageIndex, size_t& slot) {
+  if (pendingCaptures.empty() || !captureFormatSupported) return false;
+
+  slot = readbackBuffers.size();
+  for (size_t i = 0; i < readbackBuffers.size(); i++) {
+    if (!readbackBuffers[i].inFlight) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot == readbackBuffers.size()) {
+    if (readbackBuffers.size() == READBACK_BUFFERS) return false;
+    readbackBuffers.emplace_back();
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    if (vkAllocateCommandBuffers(device, &allocInfo, &readbackBuffers[slot].commandBuffer) != VK_SUCCESS) {
+      throw EngineException("failed to allocate readback command buffer", file);
+    }
+  }
+
+  ReadbackBuffer& readback = readbackBuffers[slot];
+  VkDeviceSize size = VkDeviceSize(swapchainExtent.width) * swapchainExtent.height * 4;
+  if (readback.size < size) {
+    freeReadbackBuffer(readback);
+    allocateReadbackBuffer(readback, size);
+  }
+
+  readback.frame.frame = framesDrawn;
+  readback.frame.width = swapchainExtent.width;
+  readback.frame.height = swapchainExtent.height;
+  readback.bgra = swapchainImageFormat == VK_FORMAT_B8G8R8A8_SRGB || swapchainImageFormat == VK_FORMAT_B8G8R8A8_UNORM;
+  readback.callback = std::move(pendingCaptures.front());
+  pendingCaptures.pop_front();
+
+  VkCommandBuffer commandBuffer = readback.commandBuffer;
+  VkCommandBufferBeginInfo beginInfo = {};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+    throw EngineException("failed to begin recording readback command buffer", file);
+  }
+
+  // The frame graph leaves the image ready to present after whichever pass
+  // wrote it last, the render pass or the upscale blit; waiting on all
+  // commands covers both and the transition to present
+  VkImageMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = swapchainImages[imageIndex];
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.layerCount = 1;
+  barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  vkCmdPipelineBarrier(
+    commandBuffer,
+    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+    VK_PIPELINE_STAGE_TRANSFER_BIT,
+    0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+  VkBufferImageCopy region = {};
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.layerCount = 1;
+  region.imageExtent = {swapchainExtent.width, swapchainExtent.height, 1};
+  vkCmdCopyImageToBuffer(commandBuffer, swapchainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, 1, &region);
+
+  // back to present for the presentation engine, and the copy made visible to the host
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = 0;
+
+  VkBufferMemoryBarrier bufferBarrier = {};
+  bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  bufferBarrier.buffer = readback.buffer;
+  bufferBarrier.offset = 0;
+  bufferBarrier.size = VK_WHOLE_SIZE;
+  vkCmdPipelineBarrier(
+    commandBuffer,
+    VK_PIPELINE_STAGE_TRANSFER_BIT,
+    VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+    0, 0, nullptr, 1, &bufferBarrier, 1, &barrier);
+
+  if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+    throw EngineException("failed to record readback command buffer", file);
+  }
+
+  readback.inFlight = true;
+  return true;
+}
+
+void VulkanRenderer::retireCapture(size_t slot, uint64_t frameValue) {
+  timeline.retire(frameValue, [this, slot]() {
+    readCapture(readbackBuffers[slot]);
+  });
+}
+
+// Runs on the render thread from GpuTimeline::collect. The buffer is free
+// again before the callback, which may capture another frame.
+void VulkanRenderer::readCapture(ReadbackBuffer& readback) {
+  if (!readback.coherent) {
+    VkMappedMemoryRange range = {};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = readback.memory;
+    range.offset = 0;
+    range.size = VK_WHOLE_SIZE;
+    vkInvalidateMappedMemoryRanges(device, 1, &range);
+  }
+
+  CapturedFrame frame = readback.frame;
+  size_t size = size_t(frame.width) * frame.height * 4;
+  frame.pixels.resize(size);
+  const unsigned char* source = static_cast<const unsigned char*>(readback.mapped);
+  if (readback.bgra) {
+    for (size_t i = 0; i < size; i += 4) {
+      frame.pixels[i] = source[i + 2];
+      frame.pixels[i + 1] = source[i + 1];
+      frame.pixels[i + 2] = source[i];
+      frame.pixels[i + 3] = source[i + 3];
+    }
+  }
+  else {
+    memcpy(frame.pixels.data(), source, size);
+  }
+
+  auto callback = std::move(readback.callback);
+  readback.callback = nullptr;
+  readback.inFlight = false;
+  callback(frame);
+}
+
+void VulkanRenderer::finishCaptures() {
+  bool inFlight = false;
+  for (const ReadbackBuffer& readback : readbackBuffers) {
+    inFlight = inFlight || readback.inFlight;
+  }
+  if (!inFlight) return;
+
+  timeline.wait(timeline.lastSubmitted());
+  timeline.collect();
+}
+
+// captures that never got a buffer are dropped without their callback
+void VulkanRenderer::releaseReadbackBuffers() {
+  pendingCaptures.clear();
+  for (ReadbackBuffer& readback : readbackBuffers) {
+    freeReadbackBuffer(readback);
+    vkFreeCommandBuffers(device, commandPool, 1, &readback.commandBuffer);
+  }
+  readbackBuffers.clear();
+}
@@ -0,0 +1,590 @@
+#include "engine/rendergraph.hpp"
+#include "engine/exception.hpp"
+
+#include <algorithm>
+
+#define file "src/engine/vulkan/rendergraph.cpp"
+
+static const VkAccessFlags WRITE_ACCESS =
+  VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+  | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+RenderGraph::Access RenderGraph::layoutAccess(VkImageLayout layout) {
+  Access access;
+  access.layout = layout;
+  switch (layout) {
+    case VK_IMAGE_LAYOUT_UNDEFINED:
+      access.stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+      break;
+    case VK_IMAGE_LAYOUT_GENERAL:
+      access.stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+      access.access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+      break;
+    case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+      access.stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+      access.access = VK_ACCESS_TRANSFER_WRITE_BIT;
+      break;
+    case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+      access.stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+      access.access = VK_ACCESS_TRANSFER_READ_BIT;
+      break;
+    case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+      access.stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+      access.access = VK_ACCESS_SHADER_READ_BIT;
+      break;
+    case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+      access.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+      access.access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+      break;
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+      access.stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+      access.access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+      break;
+    case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+      access.stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+        | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+      access.access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+      break;
+    case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+      access.stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+      break;
+    default:
+      throw EngineException("unsupported image layout", file);
+  }
+  return access;
+}
+
+void RenderGraph::init(VkDevice _device, VkPhysicalDevice _physicalDevice) {
+  device = _device;
+  physicalDevice = _physicalDevice;
+}
+
+RenderGraph::Resource RenderGraph::importImage(
+  const std::string& name,
+  const std::vector<VkImage>& images,
+  VkImageAspectFlags aspect,
+  uint32_t mipLevels,
+  const Access& initial
+) {
+  if (images.empty()) {
+    throw EngineException("imported image has no images", file);
+  }
+  ResourceInfo info;
+  info.name = name;
+  info.image = true;
+  info.images = images;
+  info.aspect = aspect;
+  info.mipLevels = mipLevels;
+  info.initial = initial;
+  resources.push_back(info);
+  compiled = false;
+  return static_cast<Resource>(resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::importBuffer(const std::string& name, const Access& initial) {
+  ResourceInfo info;
+  info.name = name;
+  info.initial = initial;
+  info.initial.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  resources.push_back(info);
+  compiled = false;
+  return static_cast<Resource>(resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::importBuffer(const std::string& name) {
+  return importBuffer(name, Access());
+}
+
+RenderGraph::Resource RenderGraph::createImage(const std::string& name, const ImageDesc& desc) {
+  ResourceInfo info;
+  info.name = name;
+  info.image = true;
+  info.transient = true;
+  info.aspect = desc.aspect;
+  info.mipLevels = desc.mipLevels;
+  info.desc = desc;
+  resources.push_back(info);
+  compiled = false;
+  return static_cast<Resource>(resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::find(const std::string& name) const {
+  for (size_t r = 0; r < resources.size(); r++) {
+    if (resources[r].name == name) return static_cast<Resource>(r);
+  }
+  throw EngineException("unknown render graph resource", file);
+}
+
+bool RenderGraph::has(const std::string& name) const {
+  for (const ResourceInfo& info : resources) {
+    if (info.name == name) return true;
+  }
+  return false;
+}
+
+VkImage RenderGraph::image(Resource resource, size_t image) const {
+  const std::vector<VkImage>& images = resources.at(resource).images;
+  if (images.empty()) return VK_NULL_HANDLE;
+  return images[image % images.size()];
+}
+
+VkImageView RenderGraph::view(Resource resource) const {
+  return resources.at(resource).view;
+}
+
+RenderGraph::Pass RenderGraph::addPass(const std::string& name, RecordFunc record) {
+  PassInfo info;
+  info.name = name;
+  info.record = record;
+  passes.push_back(info);
+  compiled = false;
+  return static_cast<Pass>(passes.size() - 1);
+}
+
+// a pass uses each resource once; declaring it again merges the accesses
+RenderGraph::Use& RenderGraph::use(Pass pass, Resource resource, const Access& access) {
+  if (pass >= passes.size() || resource >= resources.size()) {
+    throw EngineException("unknown render graph pass or resource", file);
+  }
+  compiled = false;
+  for (Use& existing : passes[pass].uses) {
+    if (existing.resource != resource) continue;
+    if (resources[resource].image && existing.access.layout != access.layout) {
+      throw EngineException("pass uses an image in two layouts", file);
+    }
+    existing.access.stages |= access.stages;
+    existing.access.access |= access.access;
+    return existing;
+  }
+  Use added = {resource, access, false, false, VK_IMAGE_LAYOUT_UNDEFINED};
+  passes[pass].uses.push_back(added);
+  return passes[pass].uses.back();
+}
+
+void RenderGraph::read(Pass pass, Resource resource, const Access& access) {
+  use(pass, resource, access);
+}
+
+void RenderGraph::write(Pass pass, Resource resource, const Access& access) {
+  use(pass, resource, access).write = true;
+}
+
+void RenderGraph::attachment(Pass pass, Resource resource, const Access& access, VkImageLayout finalLayout) {
+  Use& added = use(pass, resource, access);
+  added.write = true;
+  added.attachment = true;
+  added.finalLayout = finalLayout;
+}
+
+void RenderGraph::markOutput(Resource resource, const Access& final) {
+  if (resource >= resources.size()) {
+    throw EngineException("unknown render graph resource", file);
+  }
+  resources[resource].output = true;
+  resources[resource].final = final;
+  compiled = false;
+}
+
+void RenderGraph::markOutput(Resource resource) {
+  markOutput(resource, Access());
+}
+
+bool RenderGraph::culled(Pass pass) const {
+  return !passes.at(pass).live;
+}
+
+// Adds what one use needs to the batch before its pass and moves the state
+// past it. Reads only wait when the last write isn't visible to them yet;
+// writes and layout changes also wait for the reads before them.
+void RenderGraph::transition(Batch& batch, State& state, Resource resource, const Access& access, bool write) {
+  VkPipelineStageFlags dstStages = access.stages;
+  if (dstStages == 0) dstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+  bool relayout = resources[resource].image && access.layout != state.layout;
+
+  if (relayout) {
+    VkPipelineStageFlags waitStages = state.writeStages | state.readStages;
+    if (waitStages == 0) waitStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    batch.srcStages |= waitStages;
+    batch.dstStages |= dstStages;
+    ImageBarrier barrier = {resource, state.layout, access.layout, state.writeAccess, access.access};
+    batch.images.push_back(barrier);
+  }
+  else if (write) {
+    VkPipelineStageFlags waitStages = state.writeStages | state.readStages;
+    if (waitStages) {
+      batch.srcStages |= waitStages;
+      batch.dstStages |= dstStages;
+      batch.srcAccess |= state.writeAccess;
+      if (state.writeAccess) batch.dstAccess |= access.access;
+    }
+  }
+  else {
+    bool visible = (access.stages & ~state.visibleStages) == 0 && (access.access & ~state.visibleAccess) == 0;
+    if (state.writeStages && !visible) {
+      batch.srcStages |= state.writeStages;
+      batch.dstStages |= dstStages;
+      batch.srcAccess |= state.writeAccess;
+      batch.dstAccess |= access.access;
+    }
+  }
+
+  state.layout = access.layout;
+  if (write) {
+    state.writeStages = dstStages;
+    state.writeAccess = access.access & WRITE_ACCESS;
+    state.readStages = 0;
+    state.visibleStages = 0;
+    state.visibleAccess = 0;
+  }
+  else {
+    // a layout change is itself a write, already visible to this read
+    if (relayout) {
+      state.writeStages = dstStages;
+      state.writeAccess = 0;
+    }
+    state.readStages |= dstStages;
+    state.visibleStages |= access.stages;
+    state.visibleAccess |= access.access;
+  }
+}
+
+static uint32_t findTransientMemoryType(VkPhysicalDevice physicalDevice, uint32_t typeFilter) {
+  VkPhysicalDeviceMemoryProperties memProperties;
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+  for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+    if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+      return i;
+    }
+  }
+
+  throw EngineException("failed to find memory type for transient image", file);
+}
+
+// Largest first, each image goes into the first allocation none of whose
+// images are alive during its passes; all of them are bound at offset 0.
+void RenderGraph::allocateTransients(
+  const std::vector<uint32_t>& firstUse,
+  const std::vector<uint32_t>& lastUse,
+  std::vector<std::vector<Resource>>& buckets
+) {
+  struct Bucket {
+    uint32_t memoryTypeBits;
+    VkDeviceSize size;
+  };
+  std::vector<Bucket> bucketInfo;
+  std::vector<std::pair<VkDeviceSize, Resource>> order;
+  std::vector<VkMemoryRequirements> requirements(resources.size());
+
+  for (size_t r = 0; r < resources.size(); r++) {
+    ResourceInfo& info = resources[r];
+    if (!info.transient || firstUse[r] == UINT32_MAX) continue;
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = info.desc.extent.width;
+    imageInfo.extent.height = info.desc.extent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = info.desc.mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = info.desc.format;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = info.desc.usage;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkImage image;
+    if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+      throw EngineException("failed to create transient image", file);
+    }
+    info.images.assign(1, image);
+    vkGetImageMemoryRequirements(device, image, &requirements[r]);
+    order.push_back({requirements[r].size, static_cast<Resource>(r)});
+  }
+  std::stable_sort(order.begin(), order.end(), [](const std::pair<VkDeviceSize, Resource>& a, const std::pair<VkDeviceSize, Resource>& b) {
+    return a.first > b.first;
+  });
+
+  for (auto &entry : order) {
+    Resource r = entry.second;
+    size_t chosen = buckets.size();
+    for (size_t b = 0; b < buckets.size() && chosen == buckets.size(); b++) {
+      if ((bucketInfo[b].memoryTypeBits & requirements[r].memoryTypeBits) == 0) continue;
+      bool overlaps = false;
+      for (Resource other : buckets[b]) {
+        if (firstUse[r] <= lastUse[other] && firstUse[other] <= lastUse[r]) overlaps = true;
+      }
+      if (!overlaps) chosen = b;
+    }
+    if (chosen == buckets.size()) {
+      buckets.push_back(std::vector<Resource>());
+      bucketInfo.push_back({requirements[r].memoryTypeBits, 0});
+    }
+    buckets[chosen].push_back(r);
+    bucketInfo[chosen].memoryTypeBits &= requirements[r].memoryTypeBits;
+    bucketInfo[chosen].size = std::max(bucketInfo[chosen].size, requirements[r].size);
+    graphStats.aliasedMemory += requirements[r].size;
+  }
+
+  for (size_t b = 0; b < buckets.size(); b++) {
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = bucketInfo[b].size;
+    allocInfo.memoryTypeIndex = findTransientMemoryType(physicalDevice, bucketInfo[b].memoryTypeBits);
+
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+      throw EngineException("failed to allocate transient memory", file);
+    }
+    transientMemory.push_back(memory);
+    graphStats.transientMemory += bucketInfo[b].size;
+
+    // in pass order, so each image's predecessor is the one before it
+    std::sort(buckets[b].begin(), buckets[b].end(), [&firstUse](Resource a, Resource c) {
+      return firstUse[a] < firstUse[c];
+    });
+    for (Resource r : buckets[b]) {
+      ResourceInfo& info = resources[r];
+      vkBindImageMemory(device, info.images[0], memory, 0);
+
+      VkImageViewCreateInfo viewInfo = {};
+      viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      viewInfo.image = info.images[0];
+      viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      viewInfo.format = info.desc.format;
+      viewInfo.subresourceRange.aspectMask = info.aspect;
+      viewInfo.subresourceRange.baseMipLevel = 0;
+      viewInfo.subresourceRange.levelCount = info.mipLevels;
+      viewInfo.subresourceRange.baseArrayLayer = 0;
+      viewInfo.subresourceRange.layerCount = 1;
+
+      if (vkCreateImageView(device, &viewInfo, nullptr, &info.view) != VK_SUCCESS) {
+        throw EngineException("failed to create transient image view", file);
+      }
+    }
+  }
+  graphStats.aliasedMemory -= graphStats.transientMemory;
+}
+
+void RenderGraph::compile() {
+  if (compiled) return;
+  for (ResourceInfo& info : resources) {
+    if (info.transient && !info.images.empty()) {
+      throw EngineException("render graph compiled twice without release", file);
+    }
+  }
+  graphStats = Stats();
+
+  // walking back from the outputs, a pass lives if it writes something a
+  // later live pass or the frame still needs; plain writes end that need
+  std::vector<bool> needed(resources.size());
+  for (size_t r = 0; r < resources.size(); r++) {
+    needed[r] = resources[r].output;
+  }
+  for (size_t p = passes.size(); p-- > 0;) {
+    PassInfo& pass = passes[p];
+    pass.live = false;
+    for (const Use& u : pass.uses) {
+      if (u.write && needed[u.resource]) pass.live = true;
+    }
+    if (!pass.live) {
+      graphStats.culled++;
+      continue;
+    }
+    graphStats.passes++;
+    for (const Use& u : pass.uses) {
+      if (u.write && (u.access.access & ~WRITE_ACCESS) == 0) needed[u.resource] = false;
+    }
+    for (const Use& u : pass.uses) {
+      if (!u.write || (u.access.access & ~WRITE_ACCESS) != 0) needed[u.resource] = true;
+    }
+  }
+
+  std::vector<uint32_t> firstUse(resources.size(), UINT32_MAX);
+  std::vector<uint32_t> lastUse(resources.size(), 0);
+  for (size_t p = 0; p < passes.size(); p++) {
+    if (!passes[p].live) continue;
+    for (const Use& u : passes[p].uses) {
+      if (!resources[u.resource].transient) continue;
+      if (firstUse[u.resource] == UINT32_MAX) {
+        if (!u.write) {
+          throw EngineException("transient image read before it is written", file);
+        }
+        if (u.access.layout == VK_IMAGE_LAYOUT_UNDEFINED) {
+          throw EngineException("transient image used without a layout", file);
+        }
+        firstUse[u.resource] = static_cast<uint32_t>(p);
+      }
+      lastUse[u.resource] = static_cast<uint32_t>(p);
+    }
+  }
+  std::vector<std::vector<Resource>> buckets;
+  allocateTransients(firstUse, lastUse, buckets);
+
+  std::vector<State> states(resources.size());
+  for (size_t r = 0; r < resources.size(); r++) {
+    const Access& initial = resources[r].initial;
+    State& state = states[r];
+    state.writeStages = initial.stages;
+    state.writeAccess = initial.access & WRITE_ACCESS;
+    if (state.writeAccess == 0) {
+      state.visibleStages = initial.stages;
+      state.visibleAccess = initial.access;
+    }
+    state.layout = resources[r].transient ? VK_IMAGE_LAYOUT_UNDEFINED : initial.layout;
+  }
+
+  // where each transient's first use landed, to chain it after its predecessor
+  std::vector<size_t> firstBarrier(resources.size(), SIZE_MAX);
+  batches.assign(passes.size() + 1, Batch());
+  for (size_t p = 0; p < passes.size(); p++) {
+    if (!passes[p].live) continue;
+    for (const Use& u : passes[p].uses) {
+      State& state = states[u.resource];
+      if (resources[u.resource].transient && p == firstUse[u.resource] && !u.attachment) {
+        firstBarrier[u.resource] = batches[p].images.size();
+      }
+      if (u.attachment) {
+        state.writeStages = u.access.stages;
+        state.writeAccess = u.access.access & WRITE_ACCESS;
+        state.readStages = 0;
+        state.visibleStages = 0;
+        state.visibleAccess = 0;
+        state.layout = u.finalLayout;
+        continue;
+      }
+      transition(batches[p], state, u.resource, u.access, u.write);
+    }
+  }
+  for (size_t r = 0; r < resources.size(); r++) {
+    const ResourceInfo& info = resources[r];
+    if (!info.output || (info.final.stages == 0 && info.final.layout == VK_IMAGE_LAYOUT_UNDEFINED)) continue;
+    Access final = info.final;
+    if (final.layout == VK_IMAGE_LAYOUT_UNDEFINED) final.layout = states[r].layout;
+    transition(batches.back(), states[r], static_cast<Resource>(r), final, false);
+  }
+
+  // the memory still holds the last image that used it, possibly from the
+  // previous frame, so the first use waits for that image's last one
+  for (auto &bucket : buckets) {
+    for (size_t k = 0; k < bucket.size(); k++) {
+      Resource r = bucket[k];
+      const State& previous = states[bucket[(k + bucket.size() - 1) % bucket.size()]];
+      VkPipelineStageFlags waitStages = previous.writeStages | previous.readStages;
+      Batch& batch = batches[firstUse[r]];
+      if (waitStages == 0) continue;
+      batch.srcStages |= waitStages;
+      if (firstBarrier[r] != SIZE_MAX) {
+        batch.images[firstBarrier[r]].srcAccess |= previous.writeAccess;
+      }
+      else {
+        // an attachment's render pass does the layout change itself
+        batch.srcAccess |= previous.writeAccess;
+        for (const Use& u : passes[firstUse[r]].uses) {
+          if (u.resource != r) continue;
+          batch.dstStages |= u.access.stages;
+          batch.dstAccess |= u.access.access;
+        }
+      }
+    }
+  }
+
+  for (const Batch& batch : batches) {
+    if (batch.dstStages == 0) continue;
+    graphStats.barriers++;
+    graphStats.imageBarriers += static_cast<uint32_t>(batch.images.size());
+  }
+  compiled = true;
+}
+
+void RenderGraph::emit(VkCommandBuffer commandBuffer, const Batch& batch, size_t image) const {
+  if (batch.dstStages == 0) return;
+
+  std::vector<VkImageMemoryBarrier> imageBarriers(batch.images.size());
+  for (size_t b = 0; b < batch.images.size(); b++) {
+    const ImageBarrier& source = batch.images[b];
+    const ResourceInfo& info = resources[source.resource];
+
+    VkImageMemoryBarrier& barrier = imageBarriers[b];
+    barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = source.oldLayout;
+    barrier.newLayout = source.newLayout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = info.images[image % info.images.size()];
+    barrier.srcAccessMask = source.srcAccess;
+    barrier.dstAccessMask = source.dstAccess;
+    barrier.subresourceRange.aspectMask = info.aspect;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = info.mipLevels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+  }
+
+  VkMemoryBarrier memoryBarrier = {};
+  memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  memoryBarrier.srcAccessMask = batch.srcAccess;
+  memoryBarrier.dstAccessMask = batch.dstAccess;
+  uint32_t memoryBarrierCount = (batch.srcAccess || batch.dstAccess) ? 1 : 0;
+
+  vkCmdPipelineBarrier(
+    commandBuffer,
+    batch.srcStages,
+    batch.dstStages,
+    0,
+    memoryBarrierCount, &memoryBarrier,
+    0, nullptr,
+    static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, size_t image) const {
+  if (!compiled) {
+    throw EngineException("render graph executed before compile", file);
+  }
+  for (size_t p = 0; p < passes.size(); p++) {
+    if (!passes[p].live) continue;
+    emit(commandBuffer, batches[p], image);
+    passes[p].record(commandBuffer, image);
+  }
+  emit(commandBuffer, batches.back(), image);
+}
+
+void RenderGraph::destroy() {
+  for (ResourceInfo& info : resources) {
+    if (!info.transient) continue;
+    vkDestroyImageView(device, info.view, nullptr);
+    for (VkImage image : info.images) {
+      vkDestroyImage(device, image, nullptr);
+    }
+  }
+  for (VkDeviceMemory memory : transientMemory) {
+    vkFreeMemory(device, memory, nullptr);
+  }
+  resources.clear();
+  passes.clear();
+  batches.clear();
+  transientMemory.clear();
+  compiled = false;
+  graphStats = Stats();
+}
+
+void RenderGraph::release(DeletionQueue& queue, uint64_t value) {
+  for (ResourceInfo& info : resources) {
+    if (!info.transient) continue;
+    for (VkImage image : info.images) {
+      queue.destroyImage(value, image, info.view, VK_NULL_HANDLE);
+    }
+  }
+  for (VkDeviceMemory memory : transientMemory) {
+    queue.freeMemory(value, memory);
+  }
+  resources.clear();
+  passes.clear();
+  batches.clear();
+  transientMemory.clear();
+  compiled = false;
+  graphStats = Stats();
+}
@@ -0,0 +1,114 @@
+#include "engine/vulkan.hpp"
+
+#include <cmath>
+
+#define file "src/engine/vulkan/resolution.cpp"
+
+// Dynamic resolution: the controller looks at the smoothed GPU frame time
+// and, assuming cost follows the pixel count, picks the scale that would hit
+// the target. Scales move in steps and wait for timings from the new scale,
+// since every change re-records the command buffers.
+
+// scales are multiples of this, and only change when the wanted scale is
+// more than one step away
+static const float RENDER_SCALE_STEP = 1.0f / 16.0f;
+
+// the target has the swapchain's format, so both ends of the blit must support it
+bool VulkanRenderer::checkBlitSupport(const VkSurfaceCapabilitiesKHR& capabilities, VkFormat format) {
+  if ((capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) == 0) return false;
+
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+  VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT
+    | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  return (properties.optimalTilingFeatures & needed) == needed;
+}
+
+bool VulkanRenderer::dynamicResolutionActive() const {
+  return dynamicResolution && dynamicResolutionSupported && timestampsSupported;
+}
+
+VkExtent2D VulkanRenderer::renderExtent() const {
+  if (!renderingOffscreen) return swapchainExtent;
+
+  VkExtent2D extent;
+  extent.width = std::max(static_cast<uint32_t>(std::lround(swapchainExtent.width * renderScale)), 1u);
+  extent.height = std::max(static_cast<uint32_t>(std::lround(swapchainExtent.height * renderScale)), 1u);
+  return extent;
+}
+
+// one target for every image, like depth; frames are serialized on the graphics queue
+void VulkanRenderer::createOffscreenFramebuffer() {
+  std::array<VkImageView, 2> attachments = {frameGraph.view(sceneColor), depthImageView};
+
+  VkFramebufferCreateInfo framebufferInfo = {};
+  framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  framebufferInfo.renderPass = offscreenRenderPass;
+  framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+  framebufferInfo.pAttachments = attachments.data();
+  framebufferInfo.width = swapchainExtent.width;
+  framebufferInfo.height = swapchainExtent.height;
+  framebufferInfo.layers = 1;
+
+  if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &offscreenFramebuffer) != VK_SUCCESS) {
+    throw EngineException("failed to create offscreen framebuffer", file);
+  }
+}
+
+void VulkanRenderer::updateRenderScale() {
+  if (!renderingOffscreen) {
+    renderScale = 1.0f;
+    stats.renderScale = 1.0f;
+    return;
+  }
+  stats.renderScale = renderScale;
+  if (stats.gpuFrameMs <= 0.0) return;
+
+  if (smoothedGpuFrameMs <= 0.0) {
+    smoothedGpuFrameMs = stats.gpuFrameMs;
+  }
+  else {
+    smoothedGpuFrameMs += (stats.gpuFrameMs - smoothedGpuFrameMs) * 0.1;
+  }
+
+  float low = std::clamp(minRenderScale, RENDER_SCALE_STEP, 1.0f);
+  float high = std::clamp(maxRenderScale, low, 1.0f);
+
+  // frames recorded before the last change are still in flight
+  framesSinceScaleChange++;
+  bool outside = renderScale < low || renderScale > high;
+  if (!outside && framesSinceScaleChange < swapchainImages.size() * 2) return;
+
+  float wanted = renderScale * static_cast<float>(std::sqrt(targetFrameMs / smoothedGpuFrameMs));
+  wanted = std::clamp(wanted, low, high);
+  if (!outside && std::fabs(wanted - renderScale) <= RENDER_SCALE_STEP) return;
+
+  float scale = std::round(wanted / RENDER_SCALE_STEP) * RENDER_SCALE_STEP;
+  scale = std::clamp(scale, low, high);
+  if (scale == renderScale) return;
+
+  // predicts the new frame time so the average doesn't lag behind the change
+  smoothedGpuFrameMs *= (scale * scale) / (renderScale * renderScale);
+  renderScale = scale;
+  framesSinceScaleChange = 0;
+  markCommandBuffersDirty();
+}
+
+void VulkanRenderer::recordUpscale(VkCommandBuffer commandBuffer, size_t i) {
+  VkExtent2D extent = renderExtent();
+
+  VkImageBlit region = {};
+  region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.srcSubresource.layerCount = 1;
+  region.srcOffsets[1] = {static_cast<int32_t>(extent.width), static_cast<int32_t>(extent.height), 1};
+  region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.dstSubresource.layerCount = 1;
+  region.dstOffsets[1] = {static_cast<int32_t>(swapchainExtent.width), static_cast<int32_t>(swapchainExtent.height), 1};
+
+  vkCmdBlitImage(
+    commandBuffer,
+    frameGraph.image(sceneColor), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    swapchainImages[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    1, &region,
+    VK_FILTER_LINEAR);
+}
@@ -0,0 +1,357 @@
+#include "engine/vulkan.hpp"
+
+#define file "src/engine/vulkan/sprites.cpp"
+
+// quad corners in rect order, two triangles each
+static const uint32_t SPRITE_INDICES[6] = {0, 1, 2, 2, 3, 0};
+
+uint32_t packColor(const glm::vec4& color) {
+  uint32_t packed = 0;
+  for (int c = 0; c < 4; c++) {
+    float channel = std::min(std::max(color[c], 0.0f), 1.0f);
+    packed |= static_cast<uint32_t>(channel * 255.0f + 0.5f) << (c * 8);
+  }
+  return packed;
+}
+
+void VulkanRenderer::drawSprite(
+  uint32_t texture,
+  const SpriteRect& rect,
+  const SpriteRect& uv,
+  const glm::vec4& color,
+  const glm::mat3& transform,
+  int16_t layer,
+  uint32_t pipeline) {
+  const glm::vec2 corners[4] = {
+    rect.min,
+    glm::vec2(rect.max.x, rect.min.y),
+    rect.max,
+    glm::vec2(rect.min.x, rect.max.y)
+  };
+  const glm::vec2 texCoords[4] = {
+    uv.min,
+    glm::vec2(uv.max.x, uv.min.y),
+    uv.max,
+    glm::vec2(uv.min.x, uv.max.y)
+  };
+
+  uint32_t packed = packColor(color);
+  for (int i = 0; i < 4; i++) {
+    SpriteVertex vertex;
+    vertex.pos = glm::vec2(transform * glm::vec3(corners[i], 1.0f));
+    vertex.texCoord = texCoords[i];
+    vertex.color = packed;
+    spriteVertices.push_back(vertex);
+  }
+
+  // layer biased to sort unsigned, then 8 bits of pipeline and 32 of texture
+  uint64_t key = (static_cast<uint64_t>(layer + 32768) << 40)
+    | (static_cast<uint64_t>(pipeline & 0xff) << 32)
+    | texture;
+  spriteKeys.push_back({key, static_cast<uint32_t>(spriteKeys.size())});
+}
+
+uint32_t VulkanRenderer::addSpritePipeline(VulkanPipeline pipeline) {
+  createSpritePipeline(pipeline);
+  spritePipelines.push_back(pipeline);
+  return static_cast<uint32_t>(spritePipelines.size() - 1);
+}
+
+void VulkanRenderer::createSpritePipeline(VulkanPipeline& pipeline, bool world) {
+  auto vertCode = readFile(pipeline.vertShaderPath);
+  auto fragCode = readFile(pipeline.fragShaderPath);
+
+  VkShaderModule vertShaderModule = createShaderModule(vertCode);
+  VkShaderModule fragShaderModule = createShaderModule(fragCode);
+
+  VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+  shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  shaderStages[0].module = vertShaderModule;
+  shaderStages[0].pName = "main";
+  shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  shaderStages[1].module = fragShaderModule;
+  shaderStages[1].pName = "main";
+
+  auto bindingDescription = SpriteVertex::getBindingDescription();
+  auto attributeDescriptions = SpriteVertex::getAttributeDescriptions();
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+  vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInputInfo.vertexBindingDescriptionCount = 1;
+  vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+  vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+  vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+  inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+  VkViewport viewport = {};
+  viewport.width = (float) swapchainExtent.width;
+  viewport.height = (float) swapchainExtent.height;
+  viewport.maxDepth = 1.0f;
+
+  VkRect2D scissor = {};
+  scissor.extent = swapchainExtent;
+
+  VkPipelineViewportStateCreateInfo viewportState = {};
+  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportState.viewportCount = 1;
+  viewportState.pViewports = &viewport;
+  viewportState.scissorCount = 1;
+  viewportState.pScissors = &scissor;
+
+  // set by recordScene, like the scene pipelines
+  std::array<VkDynamicState, 2> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamicState = {};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+  dynamicState.pDynamicStates = dynamicStates.data();
+
+  // transforms may mirror sprites, so both windings are drawn
+  VkPipelineRasterizationStateCreateInfo rasterizer = {};
+  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+  rasterizer.lineWidth = 1.0f;
+  rasterizer.cullMode = VK_CULL_MODE_NONE;
+  rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+  VkPipelineMultisampleStateCreateInfo multisampling = {};
+  multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  // drawn over the scene in submission order, the depth buffer isn't used
+  VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+  depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depthStencil.depthTestEnable = VK_FALSE;
+  depthStencil.depthWriteEnable = VK_FALSE;
+
+  VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+  colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  colorBlendAttachment.blendEnable = VK_TRUE;
+  colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+  colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+  colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+  VkPipelineColorBlendStateCreateInfo colorBlending = {};
+  colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  colorBlending.attachmentCount = 1;
+  colorBlending.pAttachments = &colorBlendAttachment;
+
+  // set 0 is the sprite's texture, the pixel to clip space matrix is pushed;
+  // world pipelines get the camera at set 0 like the scene's pipelines instead
+  VkPushConstantRange pushConstant = {};
+  pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  pushConstant.size = sizeof(glm::mat4);
+  std::array<VkDescriptorSetLayout, 2> worldSetLayouts = {cameraSetLayout, textureSetLayout};
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  if (world) {
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(worldSetLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = worldSetLayouts.data();
+  }
+  else {
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &textureSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+  }
+  if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipeline.layout) != VK_SUCCESS) {
+    throw EngineException("failed to create sprite layout", file);
+  }
+
+  VkGraphicsPipelineCreateInfo pipelineInfo = {};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.stageCount = 2;
+  pipelineInfo.pStages = shaderStages;
+  pipelineInfo.pVertexInputState = &vertexInputInfo;
+  pipelineInfo.pInputAssemblyState = &inputAssembly;
+  pipelineInfo.pViewportState = &viewportState;
+  pipelineInfo.pDynamicState = &dynamicState;
+  pipelineInfo.pRasterizationState = &rasterizer;
+  pipelineInfo.pMultisampleState = &multisampling;
+  pipelineInfo.pDepthStencilState = &depthStencil;
+  pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.layout = pipeline.layout;
+  pipelineInfo.renderPass = renderPass;
+  pipelineInfo.subpass = 0;
+
+  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline.pipeline) != VK_SUCCESS) {
+    throw EngineException("failed to create sprite pipeline", file);
+  }
+
+  vkDestroyShaderModule(device, fragShaderModule, nullptr);
+  vkDestroyShaderModule(device, vertShaderModule, nullptr);
+}
+
+// grows like the instance buffers, doubling and dirtying every command buffer
+void VulkanRenderer::ensureSpriteCapacity(size_t count) {
+  if (count <= spriteCapacity && !spriteBuffers.empty()) {
+    return;
+  }
+
+  size_t capacity = std::max<size_t>(spriteCapacity, 1024);
+  while (capacity < count) {
+    capacity *= 2;
+  }
+
+  releaseSpriteBuffers();
+
+  size_t images = swapchainImages.size();
+  spriteBuffers.resize(images);
+  spriteBuffersMemory.resize(images);
+  spriteBuffersMapped.resize(images);
+
+  for (size_t i = 0; i < images; i++) {
+    createBuffer(
+      sizeof(SpriteVertex) * 4 * capacity,
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      spriteBuffers[i],
+      spriteBuffersMemory[i]
+    );
+    vkMapMemory(device, spriteBuffersMemory[i], 0, VK_WHOLE_SIZE, 0, &spriteBuffersMapped[i]);
+  }
+
+  // every quad uses the same six indices, offset by its four vertices
+  std::vector<uint32_t> indices(capacity * 6);
+  for (size_t sprite = 0; sprite < capacity; sprite++) {
+    for (size_t j = 0; j < 6; j++) {
+      indices[sprite * 6 + j] = static_cast<uint32_t>(sprite * 4 + SPRITE_INDICES[j]);
+    }
+  }
+  createDeviceLocalBuffer(
+    indices.data(),
+    sizeof(indices[0]) * indices.size(),
+    VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+    spriteIndexBuffer,
+    spriteIndexBufferMemory
+  );
+
+  spriteCapacity = capacity;
+  markCommandBuffersDirty();
+}
+
+void VulkanRenderer::releaseSpriteBuffers() {
+  uint64_t value = timeline.lastSubmitted();
+  for (size_t i = 0; i < spriteBuffers.size(); i++) {
+    deletionQueue.destroyBuffer(value, spriteBuffers[i], spriteBuffersMemory[i]);
+  }
+  spriteBuffers.clear();
+  spriteBuffersMemory.clear();
+  spriteBuffersMapped.clear();
+
+  if (spriteIndexBuffer != VK_NULL_HANDLE) {
+    deletionQueue.destroyBuffer(value, spriteIndexBuffer, spriteIndexBufferMemory);
+    spriteIndexBuffer = VK_NULL_HANDLE;
+    spriteIndexBufferMemory = VK_NULL_HANDLE;
+  }
+  spriteCapacity = 0;
+}
+
+// Stable LSD radix sort of the keys a byte at a time. Bytes every key shares,
+// usually the layer and pipeline, are skipped, so a frame with a handful of
+// textures costs about one pass.
+void VulkanRenderer::sortSprites() {
+  const int BYTES = 7;
+  size_t count = spriteKeys.size();
+  uint32_t histograms[BYTES][256] = {};
+  for (const SpriteKey& key : spriteKeys) {
+    for (int b = 0; b < BYTES; b++) {
+      histograms[b][(key.key >> (b * 8)) & 0xff]++;
+    }
+  }
+
+  spriteKeysScratch.resize(count);
+  for (int b = 0; b < BYTES; b++) {
+    uint32_t* histogram = histograms[b];
+    if (histogram[(spriteKeys[0].key >> (b * 8)) & 0xff] == count) continue;
+
+    uint32_t offset = 0;
+    for (int digit = 0; digit < 256; digit++) {
+      uint32_t n = histogram[digit];
+      histogram[digit] = offset;
+      offset += n;
+    }
+    for (const SpriteKey& key : spriteKeys) {
+      spriteKeysScratch[histogram[(key.key >> (b * 8)) & 0xff]++] = key;
+    }
+    spriteKeys.swap(spriteKeysScratch);
+  }
+}
+
+// Writes this frame's sprites into the image's vertex buffer in sorted order
+// and merges equal keys into batches. Runs after the image's previous
+// submission has finished, so its buffer is free to overwrite.
+void VulkanRenderer::prepareSprites(uint32_t imageIndex) {
+  size_t count = spriteKeys.size();
+  spriteBatches.clear();
+
+  if (count > 0) {
+    ensureSpriteCapacity(count);
+    sortSprites();
+
+    SpriteVertex* vertices = static_cast<SpriteVertex*>(spriteBuffersMapped[imageIndex]);
+    uint64_t batchKey = ~0ull;
+    for (size_t i = 0; i < count; i++) {
+      const SpriteKey& key = spriteKeys[i];
+      memcpy(vertices + i * 4, spriteVertices.data() + size_t(key.sprite) * 4, sizeof(SpriteVertex) * 4);
+
+      if (key.key != batchKey) {
+        SpriteBatch batch;
+        batch.pipeline = static_cast<uint32_t>((key.key >> 32) & 0xff);
+        batch.texture = static_cast<uint32_t>(key.key);
+        batch.firstSprite = static_cast<uint32_t>(i);
+        batch.spriteCount = 0;
+        spriteBatches.push_back(batch);
+        batchKey = key.key;
+      }
+      spriteBatches.back().spriteCount++;
+    }
+  }
+
+  if (spriteBatches != recordedSpriteBatches[imageIndex]) {
+    commandBuffersDirty[imageIndex] = true;
+  }
+  stats.spritesDrawn = static_cast<uint32_t>(count);
+  stats.spriteBatches = static_cast<uint32_t>(spriteBatches.size());
+
+  // the queue is per frame; capacity is kept so the next one doesn't allocate
+  spriteVertices.clear();
+  spriteKeys.clear();
+}
+
+void VulkanRenderer::recordSprites(VkCommandBuffer commandBuffer, size_t i, uint32_t& drawCalls) {
+  recordedSpriteBatches[i].clear();
+  if (spriteBatches.empty() || spriteBuffers.empty()) return;
+
+  // pixels from the top left to clip space
+  glm::mat4 projection(1.0f);
+  projection[0][0] = 2.0f / swapchainExtent.width;
+  projection[1][1] = 2.0f / swapchainExtent.height;
+  projection[3][0] = -1.0f;
+  projection[3][1] = -1.0f;
+
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &spriteBuffers[i], &offset);
+  vkCmdBindIndexBuffer(commandBuffer, spriteIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+  uint32_t boundPipeline = UINT32_MAX;
+  for (const SpriteBatch& batch : spriteBatches) {
+    const VulkanPipeline& pipeline = spritePipelines[batch.pipeline];
+    if (batch.pipeline != boundPipeline) {
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.pipeline);
+      vkCmdPushConstants(commandBuffer, pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(projection), &projection);
+      boundPipeline = batch.pipeline;
+    }
+    bindTexture(commandBuffer, pipeline.layout, 0, batch.texture);
+    vkCmdDrawIndexed(commandBuffer, batch.spriteCount * 6, 1, batch.firstSprite * 6, 0, 0);
+    drawCalls++;
+  }
+  recordedSpriteBatches[i] = spriteBatches;
+}
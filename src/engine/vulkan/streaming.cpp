@@ -0,0 +1,150 @@
+#include "engine/vulkan.hpp"
+
+#define file "src/engine/vulkan/streaming.cpp"
+
+static double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// a grey checkerboard and a unit quad, small enough to create before the
+// first frame; slots still waiting on their real resource borrow them
+void VulkanRenderer::createPlaceholders() {
+  if (!pushDescriptorsEnabled) {
+    VkDescriptorPoolSize poolSize = {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSize.descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = 1;
+
+    if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &placeholderPool) != VK_SUCCESS) {
+      throw EngineException("failed to create placeholder descriptor pool", file);
+    }
+  }
+
+  const int size = 8;
+  unsigned char pixels[size * size * 4];
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      unsigned char shade = ((x / 2 + y / 2) % 2) ? 160 : 96;
+      unsigned char* texel = pixels + (y * size + x) * 4;
+      texel[0] = texel[1] = texel[2] = shade;
+      texel[3] = 255;
+    }
+  }
+
+  VulkanTexture texture;
+  createTextureImage(texture, pixels, size, size);
+  texture.view = createImageView(texture.image, VK_FORMAT_R8G8B8A8_SRGB);
+  createTextureDescriptorSet(texture, placeholderPool);
+  textures.push_back(texture);
+  placeholderTexture = static_cast<uint32_t>(textures.size() - 1);
+
+  placeholderMesh = createQuadMesh();
+}
+
+bool VulkanRenderer::borrowsPlaceholderTexture(uint32_t texture) const {
+  return texture != placeholderTexture && textures[texture].borrowsPlaceholder;
+}
+
+bool VulkanRenderer::borrowsPlaceholderMesh(uint32_t mesh) const {
+  return mesh != placeholderMesh && meshes[mesh].vertexBuffer == meshes[placeholderMesh].vertexBuffer;
+}
+
+uint32_t VulkanRenderer::requestTexture(std::string texturePath, IoService::Priority priority) {
+  VulkanTexture texture;
+  texture.borrowsPlaceholder = true;
+  textures.push_back(texture);
+  uint32_t slot = static_cast<uint32_t>(textures.size() - 1);
+
+  streamingResources++;
+  loadTextureAsync(texturePath, [this, slot](uint32_t loaded) {
+    swapInTexture(slot, loaded);
+  }, priority, [this]() {
+    // the slot keeps borrowing the placeholder
+    finishStreaming();
+  });
+  return slot;
+}
+
+// runs from uploadPendingTextures, before this frame's command buffer is
+// recorded, so every draw of the slot switches over in the same frame
+void VulkanRenderer::swapInTexture(uint32_t slot, uint32_t loaded) {
+  finishStreaming();
+
+  // destroyed while it was loading
+  if (!borrowsPlaceholderTexture(slot)) {
+    destroyTexture(loaded);
+  }
+  else {
+    textures[slot] = textures[loaded];
+    textures[loaded] = VulkanTexture();
+    // draws bind textures by slot, so re-recording picks up the new one
+    markCommandBuffersDirty();
+  }
+
+  if (loaded == textures.size() - 1) {
+    textures.pop_back();
+  }
+}
+
+uint32_t VulkanRenderer::reserveMesh() {
+  VulkanMesh mesh = meshes[placeholderMesh];
+  meshes.push_back(mesh);
+  streamingResources++;
+  return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+void VulkanRenderer::replaceMesh(
+  uint32_t mesh,
+  const std::vector<Vertex>& vertices,
+  const std::vector<std::vector<uint16_t>>& lodIndices,
+  const std::vector<float>& lodErrors) {
+  // destroyed while it was loading; nothing is uploaded
+  if (meshes[mesh].cancelled) {
+    finishStreaming();
+    return;
+  }
+
+  uint32_t created = createMesh(vertices, lodIndices, lodErrors);
+
+  if (borrowsPlaceholderMesh(mesh)) {
+    finishStreaming();
+  }
+  else {
+    meshes[mesh].destroy(deletionQueue, timeline.lastSubmitted());
+  }
+  meshes[mesh] = meshes[created];
+  meshes.pop_back();
+
+  const VulkanMesh& replacement = meshes[mesh];
+  const std::vector<Entity>& entities = scene.renderables.entities();
+  std::vector<Renderable>& renderables = scene.renderables.data();
+  for (size_t i = 0; i < renderables.size(); i++) {
+    Renderable& r = renderables[i];
+    if (r.mesh != mesh) continue;
+
+    r.vertexBuffer = replacement.vertexBuffer;
+    r.indexBuffer = replacement.indexBuffer;
+    r.lod = 0;
+    r.firstIndex = replacement.lods[0].firstIndex;
+    r.indexCount = replacement.lods[0].indexCount;
+    scene.setBounds(entities[i], replacement.bounds);
+  }
+  markCommandBuffersDirty();
+}
+
+void VulkanRenderer::finishStreaming() {
+  if (streamingResources > 0 && --streamingResources == 0) {
+    stats.timeToLoadedMs = millisecondsSince(initStart);
+  }
+}
+
+void VulkanRenderer::recordFirstFrame() {
+  if (stats.timeToFirstFrameMs == 0.0) {
+    stats.timeToFirstFrameMs = millisecondsSince(initStart);
+  }
+}
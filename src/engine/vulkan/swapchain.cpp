@@ -67,15 +67,38 @@ VkExtent2D VulkanRenderer::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capa
 
 void VulkanRenderer::recreateSwapchain() {
   vkDeviceWaitIdle(device);
+  // the image count may change, so the per-image camera and instance buffers are rebuilt
+  releaseFrameBuffers();
+  deletionQueue.flush(device, UINT64_MAX);
 
   cleanupSwapchain();
 
   createSwapchain();
   createImageViews();
   createRenderPass();
+  createDepthResources();
+  createHiZResources();
   createFramebuffers();
-  createFunc((Renderer*)this);
+  createTimestampQueryPool();
+  // meshes, textures and the scene survive; only pipelines depend on the render pass and extent
+  for (auto &pipeline : pipelines) {
+    // removed pipelines keep an empty slot
+    if (pipeline.vertShaderPath.empty()) continue;
+    createGraphicsPipeline(pipeline);
+  }
+  for (auto &pipeline : spritePipelines) {
+    createSpritePipeline(pipeline);
+  }
+  createSpritePipeline(tilemapPipeline, true);
+  createParticlePipeline();
   createCommandBuffers();
+
+  imagesInFlight.assign(swapchainImages.size(), 0);
+}
+
+void VulkanRenderer::resize(int width, int height) {
+  SDL_SetWindowSize(win, width, height);
+  recreateSwapchain();
 }
 
 void VulkanRenderer::cleanupSwapchain() {
@@ -83,29 +106,47 @@ void VulkanRenderer::cleanupSwapchain() {
     vkDestroyFramebuffer(device, framebuffer, nullptr);
   }
 
+  if (offscreenFramebuffer != VK_NULL_HANDLE) {
+    vkDestroyFramebuffer(device, offscreenFramebuffer, nullptr);
+    offscreenFramebuffer = VK_NULL_HANDLE;
+  }
+  frameGraph.destroy();
+  cleanupHiZResources();
+  vkDestroyImageView(device, depthImageView, nullptr);
+  vkDestroyImage(device, depthImage, nullptr);
+  vkFreeMemory(device, depthImageMemory, nullptr);
+
   vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+  if (asyncComputeSupported) {
+    vkFreeCommandBuffers(device, computeCommandPool, static_cast<uint32_t>(computeCommandBuffers.size()), computeCommandBuffers.data());
+  }
+
+  if (timestampsSupported) {
+    vkDestroyQueryPool(device, timestampPool, nullptr);
+  }
 
   for (auto &pipeline : pipelines) {
     vkDestroyPipeline(device, pipeline.pipeline, nullptr);
     vkDestroyPipelineLayout(device, pipeline.layout, nullptr);
   }
+  for (auto &pipeline : spritePipelines) {
+    vkDestroyPipeline(device, pipeline.pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipeline.layout, nullptr);
+  }
+  vkDestroyPipeline(device, tilemapPipeline.pipeline, nullptr);
+  vkDestroyPipelineLayout(device, tilemapPipeline.layout, nullptr);
+  vkDestroyPipeline(device, particlePipeline.pipeline, nullptr);
+  vkDestroyPipelineLayout(device, particlePipeline.layout, nullptr);
   vkDestroyRenderPass(device, renderPass, nullptr);
+  if (offscreenRenderPass != VK_NULL_HANDLE) {
+    vkDestroyRenderPass(device, offscreenRenderPass, nullptr);
+    offscreenRenderPass = VK_NULL_HANDLE;
+  }
 
   for (auto imageView : swapchainImageViews) {
     vkDestroyImageView(device, imageView, nullptr);
   }
   vkDestroySwapchainKHR(device, swapchain, nullptr);
-
-  for (auto &pipeline : pipelines) {
-    for (auto &obj : pipeline.objects) {
-      obj.destroy(device);
-    }
-    pipeline.objects.clear();
-  }
-
-  pipelines.clear();
-
-  vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 }
 
 void VulkanRenderer::createSwapchain() {
@@ -131,6 +172,16 @@ void VulkanRenderer::createSwapchain() {
   swapchainInfo.imageExtent = extent;
   swapchainInfo.imageArrayLayers = 1;
   swapchainInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  // dynamic resolution blits the scene into the swapchain image
+  dynamicResolutionSupported = checkBlitSupport(swapchainSupport.capabilities, surfaceFormat.format);
+  if (dynamicResolutionSupported) {
+    swapchainInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  }
+  // frame capture copies the presented image out
+  captureFormatSupported = checkCaptureSupport(swapchainSupport.capabilities, surfaceFormat.format);
+  if (captureFormatSupported) {
+    swapchainInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
 
   QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
   uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
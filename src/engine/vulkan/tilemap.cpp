@@ -0,0 +1,310 @@
+#include "engine/vulkan.hpp"
+
+#define file "src/engine/vulkan/tilemap.cpp"
+
+uint32_t VulkanRenderer::createTilemap(
+  uint32_t texture,
+  uint32_t width,
+  uint32_t height,
+  uint32_t layers,
+  glm::vec2 tileSize,
+  uint32_t atlasColumns,
+  uint32_t atlasRows,
+  glm::vec2 origin) {
+  if (width == 0 || height == 0 || layers == 0 || atlasColumns == 0 || atlasRows == 0) {
+    throw EngineException("empty tilemap or atlas", file);
+  }
+  if (tileSize.x <= 0.0f || tileSize.y <= 0.0f) {
+    throw EngineException("tile size must be positive", file);
+  }
+
+  Tilemap map;
+  map.texture = texture;
+  map.width = width;
+  map.height = height;
+  map.layers = layers;
+  map.origin = origin;
+  map.tileSize = tileSize;
+  map.atlasColumns = atlasColumns;
+  map.atlasRows = atlasRows;
+  map.tiles.assign(size_t(width) * height * layers, 0);
+  map.chunksX = (width + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+  map.chunksY = (height + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+  map.chunks.resize(size_t(map.chunksX) * map.chunksY);
+  for (TilemapChunk& chunk : map.chunks) {
+    // nothing to draw until a tile is set
+    chunk.layerStart.assign(layers + 1, 0);
+    chunk.dirty = false;
+  }
+
+  tilemaps.push_back(std::move(map));
+  return static_cast<uint32_t>(tilemaps.size() - 1);
+}
+
+Tilemap& VulkanRenderer::liveTilemap(uint32_t map) {
+  if (map >= tilemaps.size() || tilemaps[map].chunks.empty()) {
+    throw EngineException("no such tilemap", file);
+  }
+  return tilemaps[map];
+}
+
+void VulkanRenderer::setTile(uint32_t map, uint32_t layer, uint32_t x, uint32_t y, uint16_t tile) {
+  Tilemap& tilemap = liveTilemap(map);
+  if (layer >= tilemap.layers || x >= tilemap.width || y >= tilemap.height) {
+    throw EngineException("tile outside the tilemap", file);
+  }
+
+  uint16_t& current = tilemap.tiles[(size_t(layer) * tilemap.height + y) * tilemap.width + x];
+  if (current == tile) return;
+  current = tile;
+  tilemap.chunks[(y / TILEMAP_CHUNK_SIZE) * tilemap.chunksX + x / TILEMAP_CHUNK_SIZE].dirty = true;
+}
+
+uint16_t VulkanRenderer::getTile(uint32_t map, uint32_t layer, uint32_t x, uint32_t y) {
+  Tilemap& tilemap = liveTilemap(map);
+  if (layer >= tilemap.layers || x >= tilemap.width || y >= tilemap.height) {
+    throw EngineException("tile outside the tilemap", file);
+  }
+  return tilemap.tiles[(size_t(layer) * tilemap.height + y) * tilemap.width + x];
+}
+
+void VulkanRenderer::setTiles(uint32_t map, uint32_t layer, const std::vector<uint16_t>& tiles) {
+  Tilemap& tilemap = liveTilemap(map);
+  size_t layerSize = size_t(tilemap.width) * tilemap.height;
+  if (layer >= tilemap.layers || tiles.size() != layerSize) {
+    throw EngineException("tiles don't match the layer", file);
+  }
+
+  std::copy(tiles.begin(), tiles.end(), tilemap.tiles.begin() + layer * layerSize);
+  for (TilemapChunk& chunk : tilemap.chunks) {
+    chunk.dirty = true;
+  }
+}
+
+void VulkanRenderer::destroyTilemap(uint32_t map) {
+  releaseTilemap(liveTilemap(map));
+  // keep the slot so other tilemap ids stay valid
+  tilemaps[map] = Tilemap();
+}
+
+void VulkanRenderer::releaseTilemap(Tilemap& map) {
+  uint64_t value = timeline.lastSubmitted();
+  for (TilemapChunk& chunk : map.chunks) {
+    if (chunk.vertexBuffer != VK_NULL_HANDLE) {
+      deletionQueue.destroyBuffer(value, chunk.vertexBuffer, chunk.vertexBufferMemory);
+      chunk.vertexBuffer = VK_NULL_HANDLE;
+      chunk.vertexBufferMemory = VK_NULL_HANDLE;
+    }
+  }
+}
+
+// appends a quad per non-empty tile, layer by layer, in the same corner
+// order drawSprite uses so the shared quad index buffer applies
+void VulkanRenderer::buildTilemapChunk(const Tilemap& map, uint32_t chunk, std::vector<SpriteVertex>& vertices, std::vector<uint32_t>& layerStart) {
+  uint32_t x0 = (chunk % map.chunksX) * TILEMAP_CHUNK_SIZE;
+  uint32_t y0 = (chunk / map.chunksX) * TILEMAP_CHUNK_SIZE;
+  uint32_t x1 = std::min(x0 + TILEMAP_CHUNK_SIZE, map.width);
+  uint32_t y1 = std::min(y0 + TILEMAP_CHUNK_SIZE, map.height);
+  glm::vec2 cellSize(1.0f / map.atlasColumns, 1.0f / map.atlasRows);
+  uint32_t cells = map.atlasColumns * map.atlasRows;
+  size_t first = vertices.size();
+
+  layerStart.resize(map.layers + 1);
+  for (uint32_t layer = 0; layer < map.layers; layer++) {
+    layerStart[layer] = static_cast<uint32_t>((vertices.size() - first) / 4);
+    for (uint32_t y = y0; y < y1; y++) {
+      const uint16_t* row = map.tiles.data() + (size_t(layer) * map.height + y) * map.width;
+      for (uint32_t x = x0; x < x1; x++) {
+        // tiles past the end of the atlas are drawn as empty
+        uint32_t tile = row[x];
+        if (tile == 0 || tile > cells) continue;
+
+        uint32_t cell = tile - 1;
+        glm::vec2 min = map.origin + glm::vec2(float(x) * map.tileSize.x, float(y) * map.tileSize.y);
+        glm::vec2 max = min + map.tileSize;
+        glm::vec2 uvMin(float(cell % map.atlasColumns) * cellSize.x, float(cell / map.atlasColumns) * cellSize.y);
+        glm::vec2 uvMax = uvMin + cellSize;
+
+        SpriteVertex quad[4];
+        quad[0].pos = min;
+        quad[0].texCoord = uvMin;
+        quad[1].pos = glm::vec2(max.x, min.y);
+        quad[1].texCoord = glm::vec2(uvMax.x, uvMin.y);
+        quad[2].pos = max;
+        quad[2].texCoord = uvMax;
+        quad[3].pos = glm::vec2(min.x, max.y);
+        quad[3].texCoord = glm::vec2(uvMin.x, uvMax.y);
+        for (SpriteVertex& vertex : quad) {
+          vertex.color = 0xffffffff;
+          vertices.push_back(vertex);
+        }
+      }
+    }
+  }
+  layerStart[map.layers] = static_cast<uint32_t>((vertices.size() - first) / 4);
+}
+
+// Bakes every chunk in tilemapRebuilds through one staging buffer and one
+// upload submission, which the frame's draws are submitted after.
+void VulkanRenderer::rebuildTilemapChunks() {
+  tilemapVertices.clear();
+  std::vector<size_t> offsets;
+  offsets.reserve(tilemapRebuilds.size());
+  for (const auto& rebuild : tilemapRebuilds) {
+    Tilemap& map = tilemaps[rebuild.first];
+    offsets.push_back(tilemapVertices.size());
+    buildTilemapChunk(map, rebuild.second, tilemapVertices, map.chunks[rebuild.second].layerStart);
+  }
+  VkDeviceSize totalSize = sizeof(SpriteVertex) * tilemapVertices.size();
+
+  VkBuffer stagingBuffer = VK_NULL_HANDLE;
+  VkDeviceMemory stagingBufferMemory = VK_NULL_HANDLE;
+  if (totalSize > 0) {
+    createBuffer(
+      totalSize,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      stagingBuffer,
+      stagingBufferMemory
+    );
+    void* data;
+    vkMapMemory(device, stagingBufferMemory, 0, totalSize, 0, &data);
+    memcpy(data, tilemapVertices.data(), (size_t) totalSize);
+    vkUnmapMemory(device, stagingBufferMemory);
+  }
+
+  VkCommandBuffer commandBuffer = totalSize > 0 ? beginUploads() : VK_NULL_HANDLE;
+  uint64_t value = timeline.lastSubmitted();
+  for (size_t i = 0; i < tilemapRebuilds.size(); i++) {
+    TilemapChunk& chunk = tilemaps[tilemapRebuilds[i].first].chunks[tilemapRebuilds[i].second];
+    chunk.dirty = false;
+    // frames in flight may still draw the old geometry
+    if (chunk.vertexBuffer != VK_NULL_HANDLE) {
+      deletionQueue.destroyBuffer(value, chunk.vertexBuffer, chunk.vertexBufferMemory);
+      chunk.vertexBuffer = VK_NULL_HANDLE;
+      chunk.vertexBufferMemory = VK_NULL_HANDLE;
+    }
+
+    size_t end = i + 1 < offsets.size() ? offsets[i + 1] : tilemapVertices.size();
+    VkDeviceSize size = sizeof(SpriteVertex) * (end - offsets[i]);
+    if (size == 0) continue;
+
+    createBuffer(
+      size,
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      chunk.vertexBuffer,
+      chunk.vertexBufferMemory
+    );
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = sizeof(SpriteVertex) * offsets[i];
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, chunk.vertexBuffer, 1, &copyRegion);
+  }
+
+  if (totalSize > 0) {
+    releaseStagingBuffer(stagingBuffer, stagingBufferMemory);
+    submitUploads();
+    stats.bytesUploaded += totalSize;
+  }
+}
+
+// Finds the chunks under the view, rebuilds the dirty ones and lists their
+// layers as draws. Like sprites, the image's command buffer is only
+// re-recorded when that list changes: panning inside the same chunks just
+// moves view2D in the camera uniform.
+void VulkanRenderer::prepareTilemaps(uint32_t imageIndex) {
+  tilemapDraws.clear();
+  tilemapRebuilds.clear();
+
+  glm::vec2 halfView = glm::vec2(swapchainExtent.width, swapchainExtent.height) / (2.0f * camera2D.zoom);
+  glm::vec2 viewMin = camera2D.position - halfView;
+  glm::vec2 viewMax = camera2D.position + halfView;
+
+  // chunk ranges per map, flattened as map, x0, y0, x1, y1
+  visibleTilemapChunks.clear();
+  for (uint32_t m = 0; m < tilemaps.size(); m++) {
+    const Tilemap& map = tilemaps[m];
+    if (map.chunks.empty()) continue;
+
+    glm::vec2 chunkSize = map.tileSize * float(TILEMAP_CHUNK_SIZE);
+    glm::vec2 first = glm::floor((viewMin - map.origin) / chunkSize);
+    glm::vec2 last = glm::floor((viewMax - map.origin) / chunkSize);
+    if (last.x < 0.0f || last.y < 0.0f || first.x >= map.chunksX || first.y >= map.chunksY) continue;
+
+    uint32_t x0 = static_cast<uint32_t>(std::max(first.x, 0.0f));
+    uint32_t y0 = static_cast<uint32_t>(std::max(first.y, 0.0f));
+    uint32_t x1 = static_cast<uint32_t>(std::min(last.x, float(map.chunksX - 1)));
+    uint32_t y1 = static_cast<uint32_t>(std::min(last.y, float(map.chunksY - 1)));
+    visibleTilemapChunks.insert(visibleTilemapChunks.end(), {m, x0, y0, x1, y1});
+
+    for (uint32_t y = y0; y <= y1; y++) {
+      for (uint32_t x = x0; x <= x1; x++) {
+        if (map.chunks[y * map.chunksX + x].dirty) {
+          tilemapRebuilds.push_back({m, y * map.chunksX + x});
+        }
+      }
+    }
+  }
+  if (!tilemapRebuilds.empty()) {
+    rebuildTilemapChunks();
+  }
+
+  uint32_t chunksDrawn = 0;
+  for (size_t v = 0; v < visibleTilemapChunks.size(); v += 5) {
+    const Tilemap& map = tilemaps[visibleTilemapChunks[v]];
+    uint32_t x0 = visibleTilemapChunks[v + 1];
+    uint32_t y0 = visibleTilemapChunks[v + 2];
+    uint32_t x1 = visibleTilemapChunks[v + 3];
+    uint32_t y1 = visibleTilemapChunks[v + 4];
+    chunksDrawn += (x1 - x0 + 1) * (y1 - y0 + 1);
+
+    // a whole layer before the next, so upper layers cover lower ones across chunk edges
+    for (uint32_t layer = 0; layer < map.layers; layer++) {
+      for (uint32_t y = y0; y <= y1; y++) {
+        for (uint32_t x = x0; x <= x1; x++) {
+          const TilemapChunk& chunk = map.chunks[y * map.chunksX + x];
+          uint32_t count = chunk.layerStart[layer + 1] - chunk.layerStart[layer];
+          if (count == 0) continue;
+          tilemapDraws.push_back({chunk.vertexBuffer, map.texture, chunk.layerStart[layer], count});
+        }
+      }
+    }
+  }
+
+  // chunks draw through the sprite quad indices, one chunk layer at most per call
+  if (!tilemapDraws.empty()) {
+    ensureSpriteCapacity(TILEMAP_CHUNK_SIZE * TILEMAP_CHUNK_SIZE);
+  }
+  if (tilemapDraws != recordedTilemapDraws[imageIndex]) {
+    commandBuffersDirty[imageIndex] = true;
+  }
+  stats.tilemapChunksDrawn = chunksDrawn;
+  stats.tilemapChunksRebuilt = static_cast<uint32_t>(tilemapRebuilds.size());
+}
+
+void VulkanRenderer::recordTilemaps(VkCommandBuffer commandBuffer, size_t i, uint32_t& drawCalls) {
+  recordedTilemapDraws[i].clear();
+  if (tilemapDraws.empty() || spriteIndexBuffer == VK_NULL_HANDLE) return;
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tilemapPipeline.pipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tilemapPipeline.layout, 0, 1, &cameraSets[i], 0, nullptr);
+  vkCmdBindIndexBuffer(commandBuffer, spriteIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+  VkBuffer boundVertexBuffer = VK_NULL_HANDLE;
+  uint32_t boundTexture = UINT32_MAX;
+  for (const TilemapDraw& draw : tilemapDraws) {
+    if (draw.vertexBuffer != boundVertexBuffer) {
+      VkDeviceSize offset = 0;
+      vkCmdBindVertexBuffers(commandBuffer, 0, 1, &draw.vertexBuffer, &offset);
+      boundVertexBuffer = draw.vertexBuffer;
+    }
+    if (draw.texture != boundTexture) {
+      bindTexture(commandBuffer, tilemapPipeline.layout, 1, draw.texture);
+      boundTexture = draw.texture;
+    }
+    vkCmdDrawIndexed(commandBuffer, draw.quadCount * 6, 1, 0, static_cast<int32_t>(draw.firstQuad * 4), 0);
+    drawCalls++;
+  }
+  recordedTilemapDraws[i] = tilemapDraws;
+}
@@ -0,0 +1,192 @@
+#include "engine/timeline.hpp"
+#include "engine/exception.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+#define file "src/engine/vulkan/timeline.cpp"
+
+void GpuTimeline::init(VkDevice _device, bool useTimelineSemaphore, bool coreTimelineSemaphore) {
+  device = _device;
+  timelineSemaphore = useTimelineSemaphore;
+  submittedValue = completedValue = 0;
+
+  if (!timelineSemaphore) return;
+
+  if (coreTimelineSemaphore) {
+    waitSemaphores = (PFN_vkWaitSemaphores) vkGetDeviceProcAddr(device, "vkWaitSemaphores");
+    getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValue) vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValue");
+  }
+  else {
+    waitSemaphores = (PFN_vkWaitSemaphores) vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+    getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValue) vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+  }
+
+  if (waitSemaphores == nullptr || getSemaphoreCounterValue == nullptr) {
+    throw EngineException("failed to load timeline semaphore functions", file);
+  }
+
+  VkSemaphoreTypeCreateInfo typeInfo = {};
+  typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  typeInfo.initialValue = 0;
+
+  VkSemaphoreCreateInfo semaphoreInfo = {};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &typeInfo;
+
+  if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+    throw EngineException("failed to create timeline semaphore", file);
+  }
+}
+
+void GpuTimeline::destroy() {
+  // callers drain the device first, so everything submitted has completed
+  completedValue = submittedValue;
+  collect();
+
+  if (timelineSemaphore) {
+    vkDestroySemaphore(device, semaphore, nullptr);
+  }
+
+  for (auto &pending : pendingFences) {
+    vkDestroyFence(device, pending.fence, nullptr);
+  }
+  for (auto fence : freeFences) {
+    vkDestroyFence(device, fence, nullptr);
+  }
+  pendingFences.clear();
+  freeFences.clear();
+}
+
+VkFence GpuTimeline::acquireFence() {
+  if (!freeFences.empty()) {
+    VkFence fence = freeFences.back();
+    freeFences.pop_back();
+    return fence;
+  }
+
+  VkFenceCreateInfo fenceInfo = {};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+  VkFence fence;
+  if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS) {
+    throw EngineException("failed to create timeline fence", file);
+  }
+  return fence;
+}
+
+uint64_t GpuTimeline::submit(VkQueue queue, VkSubmitInfo submitInfo) {
+  uint64_t value = submittedValue + 1;
+
+  if (timelineSemaphore) {
+    std::vector<VkSemaphore> signalSemaphores(submitInfo.pSignalSemaphores, submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+    signalSemaphores.push_back(semaphore);
+
+    // binary semaphores ignore their value, only the last entry is ours
+    std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+    signalValues.back() = value;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.pNext = submitInfo.pNext;
+    timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+    timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+    submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+    if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+      throw EngineException("failed to submit to queue", file);
+    }
+  }
+  else {
+    VkFence fence = acquireFence();
+    if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS) {
+      freeFences.push_back(fence);
+      throw EngineException("failed to submit to queue", file);
+    }
+    pendingFences.push_back({value, fence});
+  }
+
+  submittedValue = value;
+  return value;
+}
+
+uint64_t GpuTimeline::poll() {
+  if (timelineSemaphore) {
+    uint64_t value;
+    if (getSemaphoreCounterValue(device, semaphore, &value) == VK_SUCCESS) {
+      completedValue = value;
+    }
+  }
+  else {
+    while (!pendingFences.empty() && vkGetFenceStatus(device, pendingFences.front().fence) == VK_SUCCESS) {
+      completedValue = pendingFences.front().value;
+      vkResetFences(device, 1, &pendingFences.front().fence);
+      freeFences.push_back(pendingFences.front().fence);
+      pendingFences.pop_front();
+    }
+    if (pendingFences.empty()) {
+      completedValue = submittedValue;
+    }
+  }
+  return completedValue;
+}
+
+bool GpuTimeline::reached(uint64_t value) {
+  return value <= completedValue || value <= poll();
+}
+
+void GpuTimeline::wait(uint64_t value) {
+  value = std::min(value, submittedValue);
+  if (value <= completedValue) return;
+
+  if (timelineSemaphore) {
+    VkSemaphoreWaitInfo waitInfo = {};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &semaphore;
+    waitInfo.pValues = &value;
+
+    if (waitSemaphores(device, &waitInfo, UINT64_MAX) != VK_SUCCESS) {
+      throw EngineException("failed to wait for timeline semaphore", file);
+    }
+    completedValue = value;
+  }
+  else {
+    // fences of a single timeline signal in submission order
+    while (!pendingFences.empty() && pendingFences.front().value <= value) {
+      PendingFence pending = pendingFences.front();
+      vkWaitForFences(device, 1, &pending.fence, VK_TRUE, UINT64_MAX);
+      vkResetFences(device, 1, &pending.fence);
+      freeFences.push_back(pending.fence);
+      pendingFences.pop_front();
+      completedValue = pending.value;
+    }
+  }
+}
+
+void GpuTimeline::retire(uint64_t value, std::function<void()> callback) {
+  if (value <= completedValue) {
+    callback();
+    return;
+  }
+  // keep the queue sorted so collect can stop at the first pending value
+  auto position = retirements.end();
+  while (position != retirements.begin() && std::prev(position)->value > value) {
+    position--;
+  }
+  retirements.insert(position, {value, std::move(callback)});
+}
+
+void GpuTimeline::collect() {
+  if (retirements.empty()) return;
+  poll();
+  while (!retirements.empty() && retirements.front().value <= completedValue) {
+    auto callback = std::move(retirements.front().callback);
+    retirements.pop_front();
+    callback();
+  }
+}
@@ -0,0 +1,250 @@
+#include "engine/manifest.hpp"
+#include "engine/pack.hpp"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Cooks shaders to SPIR-V and textures to raw RGBA8, skipping every asset
+// whose source and options hash the same as in the previous manifest. The
+// build runs it from the binary directory:
+//
+//   mix-cook --out . --glslc glslc --shader ../shaders/shader.vert shaders/vert.spv
+//            --texture ../assets/patch.png ../assets/patch.png
+//
+// Shaders are cooked to their name, textures under cooked/.
+
+// bump to recook everything when a cooked format changes
+static const char* cookVersion = "mix-cook 1";
+
+struct CookJob {
+  AssetManifest::Kind kind;
+  std::string source;
+  std::string name;
+  std::string output;
+  uint64_t hash = 0;
+  bool stale = true;
+  std::string error;
+};
+
+struct CookOptions {
+  std::string out = ".";
+  std::string glslc = "glslc";
+  std::string shaderFlags;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+};
+
+static int usage() {
+  std::cerr << "usage: mix-cook [--out <dir>] [--glslc <path>] [--shader-flags <flags>] [-j <threads>]" << std::endl
+            << "                [--shader <source> <name>]... [--texture <source> <name>]..." << std::endl;
+  return 1;
+}
+
+static uint64_t hashBytes(uint64_t hash, const char* data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+static uint64_t hashString(uint64_t hash, const std::string& value) {
+  // the terminator keeps "ab" + "c" apart from "a" + "bc"
+  return hashBytes(hash, value.c_str(), value.size() + 1);
+}
+
+static std::string quote(const std::string& value) {
+  std::string quoted = "'";
+  for (char c : value) {
+    if (c == '\'') quoted += "'\\''";
+    else quoted += c;
+  }
+  return quoted + "'";
+}
+
+// outputs are written beside their destination and renamed into place
+static void replaceOutput(const std::string& temporary, const std::string& output) {
+  std::error_code error;
+  std::filesystem::rename(temporary, output, error);
+  if (error) {
+    throw std::runtime_error("failed to replace " + output);
+  }
+}
+
+static void cookShader(const CookJob& job, const CookOptions& options) {
+  std::string temporary = job.output + ".tmp";
+  std::string command = quote(options.glslc) + " " + options.shaderFlags + " " + quote(job.source) + " -o " + quote(temporary);
+  if (std::system(command.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    throw std::runtime_error("glslc failed");
+  }
+  replaceOutput(temporary, job.output);
+}
+
+static void cookTexture(const CookJob& job) {
+  int width, height, channels;
+  stbi_uc* texels = stbi_load(job.source.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+  if (!texels) {
+    throw std::runtime_error(std::string("failed to decode: ") + stbi_failure_reason());
+  }
+
+  CookedTextureHeader header;
+  header.magic = COOKED_TEXTURE_MAGIC;
+  header.version = COOKED_TEXTURE_VERSION;
+  header.width = static_cast<uint32_t>(width);
+  header.height = static_cast<uint32_t>(height);
+
+  std::string temporary = job.output + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(texels), static_cast<std::streamsize>(width) * height * 4);
+    stbi_image_free(texels);
+    if (!out.good()) {
+      throw std::runtime_error("failed to write " + temporary);
+    }
+  }
+  replaceOutput(temporary, job.output);
+}
+
+static std::string textureOutput(const std::string& name) {
+  char suffix[10];
+  snprintf(suffix, sizeof(suffix), "-%08x", static_cast<uint32_t>(hashAssetName(name)));
+  // the name hash tells apart textures with the same file name
+  return "cooked/" + std::filesystem::path(name).stem().string() + suffix + ".tex";
+}
+
+int main(int argc, char** argv) {
+  CookOptions options;
+  std::vector<CookJob> jobs;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if ((arg == "--shader" || arg == "--texture") && i + 2 < argc) {
+      CookJob job;
+      job.kind = arg == "--shader" ? AssetManifest::SHADER : AssetManifest::TEXTURE;
+      job.source = argv[++i];
+      job.name = argv[++i];
+      job.output = job.kind == AssetManifest::SHADER ? job.name : textureOutput(job.name);
+      // the manifest is whitespace separated
+      if (job.name.find_first_of(" \t\n") != std::string::npos) {
+        std::cerr << "mix-cook: asset names can't contain whitespace: " << job.name << std::endl;
+        return 1;
+      }
+      jobs.push_back(job);
+    }
+    else if (arg == "--out" && i + 1 < argc) options.out = argv[++i];
+    else if (arg == "--glslc" && i + 1 < argc) options.glslc = argv[++i];
+    else if (arg == "--shader-flags" && i + 1 < argc) options.shaderFlags = argv[++i];
+    else if (arg == "-j" && i + 1 < argc) options.threads = std::max(1, atoi(argv[++i]));
+    else return usage();
+  }
+  if (jobs.empty()) {
+    return usage();
+  }
+
+  std::filesystem::path out(options.out);
+  std::string manifestPath = (out / "assets.manifest").string();
+  AssetManifest previous;
+  try {
+    previous.load(manifestPath);
+  }
+  catch (std::exception&) {
+    // unreadable, so everything is cooked again
+    previous.clear();
+  }
+
+  // hashing reads every source, so it runs on the pool as well
+  std::atomic<size_t> next(0);
+  auto runJobs = [&](auto work) {
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < std::min<size_t>(options.threads, jobs.size()); t++) {
+      threads.emplace_back([&]() {
+        for (size_t i = next++; i < jobs.size(); i = next++) {
+          try {
+            work(jobs[i]);
+          }
+          catch (std::exception& e) {
+            jobs[i].error = e.what();
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    next = 0;
+  };
+
+  runJobs([&](CookJob& job) {
+    std::ifstream in(job.source, std::ios::binary);
+    if (!in.is_open()) {
+      throw std::runtime_error("failed to open " + job.source);
+    }
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    uint64_t hash = hashString(14695981039346656037ull, cookVersion);
+    hash = hashString(hash, job.kind == AssetManifest::SHADER ? options.glslc + " " + options.shaderFlags : "rgba8");
+    job.hash = hashBytes(hash, bytes.data(), bytes.size());
+
+    const AssetManifest::Entry* entry = previous.find(job.name);
+    job.stale = entry == nullptr || entry->hash != job.hash || entry->cooked != job.output
+      || !std::filesystem::exists(out / job.output);
+  });
+
+  for (auto &job : jobs) {
+    if (job.error.empty() && job.stale) {
+      std::filesystem::create_directories((out / job.output).parent_path());
+    }
+  }
+
+  runJobs([&](CookJob& job) {
+    if (!job.error.empty() || !job.stale) return;
+
+    CookJob resolved = job;
+    resolved.output = (out / job.output).string();
+    if (job.kind == AssetManifest::SHADER) cookShader(resolved, options);
+    else cookTexture(resolved);
+  });
+
+  // failed assets are left out, so the next build retries them
+  AssetManifest manifest;
+  size_t cooked = 0, failed = 0;
+  for (auto &job : jobs) {
+    if (!job.error.empty()) {
+      std::cerr << "mix-cook: " << job.source << ": " << job.error << std::endl;
+      failed++;
+      continue;
+    }
+    if (job.stale) cooked++;
+
+    AssetManifest::Entry entry;
+    entry.kind = job.kind;
+    entry.hash = job.hash;
+    entry.cooked = job.output;
+    manifest.set(job.name, entry);
+  }
+
+  try {
+    manifest.save(manifestPath);
+  }
+  catch (std::exception&) {
+    std::cerr << "mix-cook: failed to write " << manifestPath << std::endl;
+    return 1;
+  }
+
+  std::cout << "cooked " << cooked << ", " << jobs.size() - cooked - failed << " up to date";
+  if (failed > 0) std::cout << ", " << failed << " failed";
+  std::cout << std::endl;
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,59 @@
+#include "engine/pack.hpp"
+#include "engine/utils.hpp"
+
+#include <cstring>
+#include <iostream>
+
+// Builds an asset pack from loose files. Each entry is named exactly as its
+// path is given, so run it from the directory the engine runs in:
+//
+//   mix-pack -o assets.pack --lz4 shaders/vert.spv shaders/frag.spv ../assets/patch.png
+static int usage() {
+  std::cerr << "usage: mix-pack -o <pack> [--lz4] <files...>" << std::endl;
+  return 1;
+}
+
+int main(int argc, char** argv) {
+  std::string output;
+  bool compress = false;
+  std::vector<std::string> inputs;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    }
+    else if (strcmp(argv[i], "--lz4") == 0) {
+      compress = true;
+    }
+    else if (argv[i][0] == '-') {
+      return usage();
+    }
+    else {
+      inputs.push_back(argv[i]);
+    }
+  }
+  if (output.empty() || inputs.empty()) {
+    return usage();
+  }
+
+#ifndef MIX_HAS_LZ4
+  if (compress) {
+    std::cerr << "mix-pack: built without LZ4, storing entries uncompressed" << std::endl;
+  }
+#endif
+
+  try {
+    AssetPackWriter writer;
+    for (auto &input : inputs) {
+      writer.add(input, readFile(input), compress);
+    }
+    writer.write(output);
+  }
+  catch (std::exception& e) {
+    std::cerr << "mix-pack: " << e.what() << std::endl;
+    return 1;
+  }
+
+  std::cout << "packed " << inputs.size() << " files into " << output << std::endl;
+  return 0;
+}